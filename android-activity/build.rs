@@ -1,6 +1,9 @@
 #![allow(dead_code)]
 
 fn build_glue_for_game_activity() {
+    for f in ["gamesdk_common.h", "jni_stats.h"] {
+        println!("cargo:rerun-if-changed=game-activity-csrc/common/{f}");
+    }
     for f in [
         "GameActivity.h",
         "GameActivity.cpp",
@@ -19,13 +22,20 @@ fn build_glue_for_game_activity() {
         .cpp_link_stdlib("c++_static")
         .compile("libgame_activity.a");
 
-    for f in ["gamecommon.h", "gametextinput.h", "gametextinput.cpp"] {
+    for f in [
+        "gamecommon.h",
+        "gametextinput.h",
+        "gametextinput.cpp",
+        "textcodec.h",
+        "textcodec.cpp",
+    ] {
         println!("cargo:rerun-if-changed=game-activity-csrc/game-text-input/{f}");
     }
     cc::Build::new()
         .cpp(true)
         .include("game-activity-csrc")
         .file("game-activity-csrc/game-text-input/gametextinput.cpp")
+        .file("game-activity-csrc/game-text-input/textcodec.cpp")
         .cpp_link_stdlib("c++_static")
         .compile("libgame_text_input.a");
 
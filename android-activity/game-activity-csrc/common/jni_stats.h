@@ -0,0 +1,319 @@
+/*
+ * Accounting for the JNI work done by the GameActivity and GameTextInput
+ * native code.
+ *
+ * Each native method that's called from Java opens a JniEntryScope for its
+ * duration, which counts the call and how long it took. JNI calls that are
+ * made through an InstrumentedJNIEnv on the same thread, while the scope is
+ * open, are charged to the same counters along with the local references that
+ * they return.
+ */
+
+#pragma once
+
+#include <jni.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+
+namespace gamesdk {
+
+/*
+ * Counters for a single native entry point. These are only updated with
+ * relaxed atomics, so they may be read from any thread but aren't guaranteed
+ * to be consistent with each other.
+ */
+struct JniEntryCounters {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> jniCalls{0};
+    std::atomic<uint64_t> localRefs{0};
+    std::atomic<int64_t> totalNanos{0};
+    std::atomic<int64_t> maxNanos{0};
+};
+
+/*
+ * The counters of the innermost JniEntryScope that's open on the calling
+ * thread, or null.
+ *
+ * This is a function-local static, rather than a global, so that there's a
+ * single instance shared by each library that includes this header.
+ */
+inline JniEntryCounters *&currentJniEntry() {
+    static thread_local JniEntryCounters *current = nullptr;
+    return current;
+}
+
+/*
+ * Charges the calling thread's JNI calls to `counters` for the lifetime of
+ * the scope, and then records the call and how long it took.
+ *
+ * Scopes may nest, if Java calls back into native code while a JNI call is in
+ * progress, in which case the outer scope's time includes the inner scope.
+ */
+class JniEntryScope {
+   public:
+    explicit JniEntryScope(JniEntryCounters &counters)
+        : counters_(counters),
+          outer_(currentJniEntry()),
+          startNanos_(nowNanos()) {
+        currentJniEntry() = &counters_;
+    }
+
+    ~JniEntryScope() {
+        int64_t elapsed = nowNanos() - startNanos_;
+        currentJniEntry() = outer_;
+
+        counters_.calls.fetch_add(1, std::memory_order_relaxed);
+        counters_.totalNanos.fetch_add(elapsed, std::memory_order_relaxed);
+        int64_t max = counters_.maxNanos.load(std::memory_order_relaxed);
+        while (elapsed > max && !counters_.maxNanos.compare_exchange_weak(
+                                    max, elapsed, std::memory_order_relaxed)) {
+        }
+    }
+
+    JniEntryScope(const JniEntryScope &) = delete;
+    JniEntryScope &operator=(const JniEntryScope &) = delete;
+
+   private:
+    static int64_t nowNanos() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    JniEntryCounters &counters_;
+    JniEntryCounters *outer_;
+    int64_t startNanos_;
+};
+
+namespace detail {
+
+inline void countJniCall() {
+    JniEntryCounters *entry = currentJniEntry();
+    if (entry != nullptr) {
+        entry->jniCalls.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+inline T countJniLocalRef(T ref) {
+    JniEntryCounters *entry = currentJniEntry();
+    if (entry != nullptr) {
+        entry->jniCalls.fetch_add(1, std::memory_order_relaxed);
+        if (ref != nullptr) {
+            entry->localRefs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return ref;
+}
+
+}  // namespace detail
+
+/*
+ * A handle to a JNIEnv whose calls are charged to the current JniEntryScope.
+ *
+ * This wraps the JNIEnv pointer that's passed to a native method, or that's
+ * looked up for the calling thread, and is used with `->` in the same way. It
+ * only forwards the JNIEnv methods that are used by GameActivity and
+ * GameTextInput; get() returns the JNIEnv itself for anything else, which
+ * isn't counted. It's as cheap to copy as the pointer.
+ */
+class InstrumentedJNIEnv {
+   public:
+    explicit InstrumentedJNIEnv(JNIEnv *env) : env_(env) {}
+
+    JNIEnv *get() const { return env_; }
+    explicit operator bool() const { return env_ != nullptr; }
+    InstrumentedJNIEnv *operator->() { return this; }
+
+    jclass FindClass(const char *name) {
+        return detail::countJniLocalRef(env_->FindClass(name));
+    }
+    jmethodID GetMethodID(jclass clazz, const char *name, const char *sig) {
+        detail::countJniCall();
+        return env_->GetMethodID(clazz, name, sig);
+    }
+    jmethodID GetStaticMethodID(jclass clazz, const char *name,
+                                const char *sig) {
+        detail::countJniCall();
+        return env_->GetStaticMethodID(clazz, name, sig);
+    }
+    jfieldID GetFieldID(jclass clazz, const char *name, const char *sig) {
+        detail::countJniCall();
+        return env_->GetFieldID(clazz, name, sig);
+    }
+
+    jint CallIntMethod(jobject obj, jmethodID methodID, ...) {
+        detail::countJniCall();
+        va_list args;
+        va_start(args, methodID);
+        jint result = env_->CallIntMethodV(obj, methodID, args);
+        va_end(args);
+        return result;
+    }
+    jlong CallLongMethod(jobject obj, jmethodID methodID, ...) {
+        detail::countJniCall();
+        va_list args;
+        va_start(args, methodID);
+        jlong result = env_->CallLongMethodV(obj, methodID, args);
+        va_end(args);
+        return result;
+    }
+    jfloat CallFloatMethod(jobject obj, jmethodID methodID, ...) {
+        detail::countJniCall();
+        va_list args;
+        va_start(args, methodID);
+        jfloat result = env_->CallFloatMethodV(obj, methodID, args);
+        va_end(args);
+        return result;
+    }
+    void CallVoidMethod(jobject obj, jmethodID methodID, ...) {
+        detail::countJniCall();
+        va_list args;
+        va_start(args, methodID);
+        env_->CallVoidMethodV(obj, methodID, args);
+        va_end(args);
+    }
+    jobject CallObjectMethod(jobject obj, jmethodID methodID, ...) {
+        va_list args;
+        va_start(args, methodID);
+        jobject result = env_->CallObjectMethodV(obj, methodID, args);
+        va_end(args);
+        return detail::countJniLocalRef(result);
+    }
+    jint CallStaticIntMethod(jclass clazz, jmethodID methodID, ...) {
+        detail::countJniCall();
+        va_list args;
+        va_start(args, methodID);
+        jint result = env_->CallStaticIntMethodV(clazz, methodID, args);
+        va_end(args);
+        return result;
+    }
+    jobject NewObject(jclass clazz, jmethodID methodID, ...) {
+        va_list args;
+        va_start(args, methodID);
+        jobject result = env_->NewObjectV(clazz, methodID, args);
+        va_end(args);
+        return detail::countJniLocalRef(result);
+    }
+
+    jstring NewStringUTF(const char *bytes) {
+        return detail::countJniLocalRef(env_->NewStringUTF(bytes));
+    }
+    const char *GetStringUTFChars(jstring string, jboolean *isCopy) {
+        detail::countJniCall();
+        return env_->GetStringUTFChars(string, isCopy);
+    }
+    jsize GetStringUTFLength(jstring string) {
+        detail::countJniCall();
+        return env_->GetStringUTFLength(string);
+    }
+    void ReleaseStringUTFChars(jstring string, const char *utf) {
+        detail::countJniCall();
+        env_->ReleaseStringUTFChars(string, utf);
+    }
+    jstring NewString(const jchar *unicodeChars, jsize len) {
+        return detail::countJniLocalRef(env_->NewString(unicodeChars, len));
+    }
+    jsize GetStringLength(jstring string) {
+        detail::countJniCall();
+        return env_->GetStringLength(string);
+    }
+    void GetStringRegion(jstring str, jsize start, jsize len, jchar *buf) {
+        detail::countJniCall();
+        env_->GetStringRegion(str, start, len, buf);
+    }
+
+    jbyteArray NewByteArray(jsize length) {
+        return detail::countJniLocalRef(env_->NewByteArray(length));
+    }
+    jsize GetArrayLength(jarray array) {
+        detail::countJniCall();
+        return env_->GetArrayLength(array);
+    }
+    jbyte *GetByteArrayElements(jbyteArray array, jboolean *isCopy) {
+        detail::countJniCall();
+        return env_->GetByteArrayElements(array, isCopy);
+    }
+    void ReleaseByteArrayElements(jbyteArray array, jbyte *elems, jint mode) {
+        detail::countJniCall();
+        env_->ReleaseByteArrayElements(array, elems, mode);
+    }
+    void SetByteArrayRegion(jbyteArray array, jsize start, jsize len,
+                            const jbyte *buf) {
+        detail::countJniCall();
+        env_->SetByteArrayRegion(array, start, len, buf);
+    }
+
+    jobject GetObjectField(jobject obj, jfieldID fieldID) {
+        return detail::countJniLocalRef(env_->GetObjectField(obj, fieldID));
+    }
+    jint GetIntField(jobject obj, jfieldID fieldID) {
+        detail::countJniCall();
+        return env_->GetIntField(obj, fieldID);
+    }
+    jfloat GetFloatField(jobject obj, jfieldID fieldID) {
+        detail::countJniCall();
+        return env_->GetFloatField(obj, fieldID);
+    }
+
+    jobject NewGlobalRef(jobject obj) {
+        detail::countJniCall();
+        return env_->NewGlobalRef(obj);
+    }
+    void DeleteGlobalRef(jobject globalRef) {
+        detail::countJniCall();
+        env_->DeleteGlobalRef(globalRef);
+    }
+    void DeleteLocalRef(jobject localRef) {
+        detail::countJniCall();
+        env_->DeleteLocalRef(localRef);
+    }
+
+    jboolean ExceptionCheck() {
+        detail::countJniCall();
+        return env_->ExceptionCheck();
+    }
+    jthrowable ExceptionOccurred() {
+        return detail::countJniLocalRef(env_->ExceptionOccurred());
+    }
+    void ExceptionDescribe() {
+        detail::countJniCall();
+        env_->ExceptionDescribe();
+    }
+    void ExceptionClear() {
+        detail::countJniCall();
+        env_->ExceptionClear();
+    }
+
+    jint GetJavaVM(JavaVM **vm) {
+        detail::countJniCall();
+        return env_->GetJavaVM(vm);
+    }
+    jint RegisterNatives(jclass clazz, const JNINativeMethod *methods,
+                         jint nMethods) {
+        detail::countJniCall();
+        return env_->RegisterNatives(clazz, methods, nMethods);
+    }
+
+   private:
+    JNIEnv *env_;
+};
+
+/*
+ * Get the JNIEnv for the calling thread, which must already be attached to
+ * `vm`. The result is null if it isn't attached.
+ */
+inline InstrumentedJNIEnv currentThreadEnv(JavaVM *vm) {
+    JNIEnv *env = nullptr;
+    if (vm == nullptr ||
+        vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) !=
+            JNI_OK) {
+        return InstrumentedJNIEnv(nullptr);
+    }
+    return InstrumentedJNIEnv(env);
+}
+
+}  // namespace gamesdk
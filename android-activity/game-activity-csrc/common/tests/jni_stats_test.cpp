@@ -0,0 +1,248 @@
+/*
+ * Tests for the JNI accounting of jni_stats.h.
+ *
+ * JNI calls are made through an InstrumentedJNIEnv that wraps a mock JNIEnv,
+ * with and without a JniEntryScope open, and the counters of each scope are
+ * checked: the calls, JNI calls and local references charged to it, how
+ * nested scopes split the work between them, which happens when Java calls
+ * back into native code while a JNI call is in progress, and that each
+ * thread's calls are only charged to its own scope.
+ *
+ * Build and run it on a device or emulator with the NDK, e.g.:
+ *
+ *   $CXX -std=c++17 -O2 -pthread -I../.. jni_stats_test.cpp \
+ *       -o jni_stats_test
+ *   adb push jni_stats_test /data/local/tmp
+ *   adb shell /data/local/tmp/jni_stats_test
+ *
+ * where $CXX is the NDK's clang++ for the target, e.g.
+ * aarch64-linux-android30-clang++.
+ */
+
+#include "common/jni_stats.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fprintf(stderr, "\n");                          \
+            exit(1);                                        \
+        }                                                   \
+    } while (0)
+
+#define CHECK_COUNTERS(counters, expectedCalls, expectedJniCalls,             \
+                       expectedLocalRefs)                                     \
+    do {                                                                      \
+        uint64_t calls = (counters).calls.load();                             \
+        uint64_t jniCalls = (counters).jniCalls.load();                       \
+        uint64_t localRefs = (counters).localRefs.load();                     \
+        CHECK(calls == (expectedCalls) && jniCalls == (expectedJniCalls) &&   \
+                  localRefs == (expectedLocalRefs),                           \
+              #counters ": %llu calls, %llu JNI calls, %llu local refs, "     \
+                        "expected %llu, %llu, %llu",                          \
+              (unsigned long long)calls, (unsigned long long)jniCalls,        \
+              (unsigned long long)localRefs,                                  \
+              (unsigned long long)(expectedCalls),                            \
+              (unsigned long long)(expectedJniCalls),                         \
+              (unsigned long long)(expectedLocalRefs));                       \
+    } while (0)
+
+static _jclass gClass;
+static _jstring gString;
+
+// Found for any name but "Missing"
+static jclass mockFindClass(JNIEnv *, const char *name) {
+    return strcmp(name, "Missing") == 0 ? nullptr : &gClass;
+}
+
+static jmethodID mockGetMethodID(JNIEnv *, jclass, const char *,
+                                 const char *) {
+    return nullptr;
+}
+
+static jint mockCallIntMethodV(JNIEnv *, jobject, jmethodID, va_list) {
+    return 7;
+}
+
+static jstring mockNewStringUTF(JNIEnv *, const char *) { return &gString; }
+
+static jboolean mockExceptionCheck(JNIEnv *) { return JNI_FALSE; }
+
+static void mockDeleteLocalRef(JNIEnv *, jobject) {}
+
+// A native method that Java calls back into while CallVoidMethod is in
+// progress, which makes 2 JNI calls and gets 1 local reference
+static gamesdk::JniEntryCounters gCallback;
+static JNIEnv *gEnv;
+
+static void mockCallVoidMethodV(JNIEnv *, jobject, jmethodID, va_list) {
+    gamesdk::JniEntryScope scope(gCallback);
+    gamesdk::InstrumentedJNIEnv env(gEnv);
+    jstring string = env->NewStringUTF("callback");
+    env->DeleteLocalRef(string);
+}
+
+static jint mockGetEnv(JavaVM *, void **env, jint) {
+    *env = gEnv;
+    return JNI_OK;
+}
+
+static void setUpMocks() {
+    static JNINativeInterface functions;
+    static JNIEnv env;
+    functions.FindClass = mockFindClass;
+    functions.GetMethodID = mockGetMethodID;
+    functions.CallIntMethodV = mockCallIntMethodV;
+    functions.CallVoidMethodV = mockCallVoidMethodV;
+    functions.NewStringUTF = mockNewStringUTF;
+    functions.ExceptionCheck = mockExceptionCheck;
+    functions.DeleteLocalRef = mockDeleteLocalRef;
+    env.functions = &functions;
+    gEnv = &env;
+}
+
+static void testCalls() {
+    gamesdk::InstrumentedJNIEnv env(gEnv);
+    gamesdk::JniEntryCounters counters;
+
+    // Nothing is charged without a scope
+    CHECK(gamesdk::currentJniEntry() == nullptr, "scope open");
+    CHECK(env->CallIntMethod(nullptr, nullptr) == 7, "result");
+
+    {
+        gamesdk::JniEntryScope scope(counters);
+        CHECK(gamesdk::currentJniEntry() == &counters, "scope not current");
+        jclass clazz = env->FindClass("Found");
+        env->GetMethodID(clazz, "method", "()I");
+        CHECK(env->CallIntMethod(nullptr, nullptr, 1, 2) == 7, "result");
+        // A null result isn't a local reference
+        CHECK(env->FindClass("Missing") == nullptr, "found missing class");
+        env->NewStringUTF("string");
+        env->ExceptionCheck();
+    }
+    CHECK(gamesdk::currentJniEntry() == nullptr, "scope still open");
+    CHECK_COUNTERS(counters, 1, 6, 2);
+
+    // Each scope adds to the counters
+    {
+        gamesdk::JniEntryScope scope(counters);
+        env->ExceptionCheck();
+    }
+    CHECK_COUNTERS(counters, 2, 7, 2);
+}
+
+static void testNesting() {
+    gamesdk::InstrumentedJNIEnv env(gEnv);
+    gamesdk::JniEntryCounters outer;
+
+    {
+        gamesdk::JniEntryScope scope(outer);
+        env->FindClass("Found");
+        // Java calls back into native code, in its own scope
+        env->CallVoidMethod(nullptr, nullptr);
+        CHECK(gamesdk::currentJniEntry() == &outer, "outer scope not restored");
+        env->ExceptionCheck();
+    }
+    CHECK(gamesdk::currentJniEntry() == nullptr, "scope still open");
+
+    // The callback's work is only charged to the callback, and the call that
+    // led to it to the outer scope
+    CHECK_COUNTERS(outer, 1, 3, 1);
+    CHECK_COUNTERS(gCallback, 1, 2, 1);
+    // The outer scope's time includes the callback
+    CHECK(outer.totalNanos.load() >= gCallback.totalNanos.load(),
+          "outer %lld ns, callback %lld ns", (long long)outer.totalNanos.load(),
+          (long long)gCallback.totalNanos.load());
+}
+
+static void testTime() {
+    gamesdk::JniEntryCounters counters;
+    const int64_t sleepNanos = 5000000;
+    {
+        gamesdk::JniEntryScope scope(counters);
+        struct timespec sleep = {0, sleepNanos};
+        nanosleep(&sleep, nullptr);
+    }
+    int64_t max = counters.maxNanos.load();
+    CHECK(max >= sleepNanos, "max %lld ns", (long long)max);
+    CHECK(counters.totalNanos.load() == max, "total %lld ns, max %lld ns",
+          (long long)counters.totalNanos.load(), (long long)max);
+
+    // A shorter call doesn't lower the max
+    { gamesdk::JniEntryScope scope(counters); }
+    CHECK(counters.maxNanos.load() == max, "max %lld ns, was %lld ns",
+          (long long)counters.maxNanos.load(), (long long)max);
+    CHECK(counters.totalNanos.load() >= max, "total %lld ns",
+          (long long)counters.totalNanos.load());
+}
+
+#define THREADS 4
+#define CALLS 100000
+
+static gamesdk::JniEntryCounters gShared;
+static gamesdk::JniEntryCounters gOwn[THREADS];
+
+// Each call is charged to both the shared counters and the thread's own
+// counters, through a nested scope, while other threads do the same
+static void *callFromThread(void *arg) {
+    int thread = (int)(intptr_t)arg;
+    gamesdk::InstrumentedJNIEnv env(gEnv);
+    for (int i = 0; i < CALLS; i++) {
+        gamesdk::JniEntryScope scope(gShared);
+        env->ExceptionCheck();
+        {
+            gamesdk::JniEntryScope own(gOwn[thread]);
+            env->NewStringUTF("string");
+        }
+    }
+    return nullptr;
+}
+
+static void testThreads() {
+    gamesdk::JniEntryCounters mainThread;
+    gamesdk::JniEntryScope scope(mainThread);
+
+    pthread_t threads[THREADS];
+    for (intptr_t t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], nullptr, callFromThread, (void *)t);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], nullptr);
+    }
+
+    // The scope that's open on this thread isn't charged for other threads
+    CHECK_COUNTERS(mainThread, 0, 0, 0);
+    CHECK_COUNTERS(gShared, (uint64_t)THREADS * CALLS,
+                   (uint64_t)THREADS * CALLS, 0);
+    for (int t = 0; t < THREADS; t++) {
+        CHECK_COUNTERS(gOwn[t], CALLS, CALLS, CALLS);
+    }
+}
+
+static void testCurrentThreadEnv() {
+    CHECK(!gamesdk::currentThreadEnv(nullptr), "env without a VM");
+
+    JNIInvokeInterface functions = {};
+    functions.GetEnv = mockGetEnv;
+    JavaVM vm;
+    vm.functions = &functions;
+    gamesdk::InstrumentedJNIEnv env = gamesdk::currentThreadEnv(&vm);
+    CHECK(env && env.get() == gEnv, "wrong env");
+}
+
+int main(void) {
+    setUpMocks();
+    testCalls();
+    testNesting();
+    testTime();
+    testThreads();
+    testCurrentThreadEnv();
+    printf("ok\n");
+    return 0;
+}
@@ -30,15 +30,23 @@
 #include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
 #include <sys/system_properties.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 #include "GameActivityLog.h"
+#include "common/jni_stats.h"
 
 namespace {
 
@@ -59,6 +67,19 @@ struct OwnedGameTextInputState {
 #define NELEM(x) ((int)(sizeof(x) / sizeof((x)[0])))
 #endif
 
+/*
+ * JNI usage statistics for each native entry point, see
+ * GameActivity_getJniStats().
+ */
+static gamesdk::JniEntryCounters gJniEntryStats[GAMEACTIVITY_JNI_ENTRY_COUNT];
+
+/*
+ * Charge the rest of the enclosing function to the given
+ * GameActivityJniEntryPoint.
+ */
+#define GAMEACTIVITY_JNI_ENTRY(entry) \
+    gamesdk::JniEntryScope jniEntryScope(gJniEntryStats[entry])
+
 /*
  * JNI methods of the GameActivity Java class.
  */
@@ -105,12 +126,11 @@ static struct ConfigurationClassInfo {
 } gConfigurationClassInfo;
 
 /*
- * JNI methods of the WindowInsetsCompat.Type Java class.
+ * The WindowInsetsCompat.Type of each GameCommonInsetsType, except for the
+ * waterfall insets which are handled differently. These are constants, so
+ * they're only queried once, when GameActivity is registered.
  */
-static struct {
-    jmethodID methods[GAMECOMMON_INSETS_TYPE_COUNT];
-    jclass clazz;
-} gWindowInsetsCompatTypeClassInfo;
+static jint gWindowInsetsCompatTypes[GAMECOMMON_INSETS_TYPE_WATERFALL];
 
 /*
  * Contains a command to be executed by the GameActivity
@@ -121,6 +141,86 @@ struct ActivityWork {
     int64_t arg1;
     int64_t arg2;
     int64_t arg3;
+    // CLOCK_MONOTONIC time at which the work was queued
+    int64_t queueTimeNanos;
+};
+
+// NB: must be a power of two
+#define ACTIVITY_WORK_QUEUE_SIZE 256
+
+/*
+ * A bounded multi-producer, single-consumer ring of work for the application
+ * main thread.
+ *
+ * Work may be queued from any thread, and each slot has a sequence number
+ * that's used to publish its work to the consumer and to hand the slot back to
+ * producers once the work has been read.
+ */
+struct ActivityWorkQueue {
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        ActivityWork work;
+    };
+
+    ActivityWorkQueue() : head(0), tail(0) {
+        for (uint64_t i = 0; i < ACTIVITY_WORK_QUEUE_SIZE; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /*
+     * Returns false if the queue is full.
+     */
+    bool push(const ActivityWork &work) {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = slots[pos & (ACTIVITY_WORK_QUEUE_SIZE - 1)];
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)(sequence - pos);
+            if (diff == 0) {
+                // The slot is free, try to claim it
+                if (tail.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+                    slot.work = work;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // The slot still holds work from the previous lap
+                return false;
+            } else {
+                // Another producer claimed the slot first
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /*
+     * Must only be called by the main thread. Returns false if there's no
+     * (published) work.
+     */
+    bool pop(ActivityWork *outWork) {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        Slot &slot = slots[pos & (ACTIVITY_WORK_QUEUE_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+        *outWork = slot.work;
+        slot.sequence.store(pos + ACTIVITY_WORK_QUEUE_SIZE,
+                            std::memory_order_release);
+        head.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    uint64_t depth() const {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+
+    Slot slots[ACTIVITY_WORK_QUEUE_SIZE];
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
 };
 
 /*
@@ -134,78 +234,68 @@ enum {
     CMD_SHOW_SOFT_INPUT,
     CMD_HIDE_SOFT_INPUT,
     CMD_SET_SOFT_INPUT_STATE,
-    CMD_SET_IME_EDITOR_INFO
+    CMD_SET_IME_EDITOR_INFO,
+    CMD_RETIRE_INPUT_FILTER
 };
 
 /*
- * Last known Configuration values. They may be accessed from the different
- * thread, this is why they are made atomic.
+ * A value that's only written by one thread at a time, but may be read from
+ * any thread, published with a sequence lock: `sequence_` is odd while the
+ * value is being updated, and a reader retries if it was odd, or changed,
+ * while it copied the value.
+ *
+ * The value is stored as atomic words so that a reader that races with an
+ * update never makes a non-atomic access; it just discards what it copied.
  */
-static struct Configuration {
-    std::atomic_int colorMode;
-    std::atomic_int densityDpi;
-    std::atomic<float> fontScale;
-    std::atomic_int fontWeightAdjustment;
-    std::atomic_int hardKeyboardHidden;
-    std::atomic_int keyboard;
-    std::atomic_int keyboardHidden;
-    std::atomic_int mcc;
-    std::atomic_int mnc;
-    std::atomic_int navigation;
-    std::atomic_int navigationHidden;
-    std::atomic_int orientation;
-    std::atomic_int screenHeightDp;
-    std::atomic_int screenLayout;
-    std::atomic_int screenWidthDp;
-    std::atomic_int smallestScreenWidthDp;
-    std::atomic_int touchscreen;
-    std::atomic_int uiMode;
-} gConfiguration;
+template <typename T>
+class SeqLockValue {
+   public:
+    void store(const T &value) {
+        uint32_t words[kWords];
+        memcpy(words, &value, sizeof(words));
+
+        uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+        sequence_.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kWords; i++) {
+            words_[i].store(words[i], std::memory_order_relaxed);
+        }
+        sequence_.store(sequence + 2, std::memory_order_release);
+    }
 
-/*
- * Write a command to be executed by the GameActivity on the application main
- * thread.
- */
-static void write_work(int fd, int32_t cmd, int64_t arg1 = 0, int64_t arg2 = 0,
-                       int64_t arg3 = 0) {
-    ActivityWork work;
-    work.cmd = cmd;
-    work.arg1 = arg1;
-    work.arg2 = arg2;
-    work.arg3 = arg3;
+    T load() const {
+        uint32_t words[kWords];
+        uint32_t sequence;
+        do {
+            sequence = sequence_.load(std::memory_order_acquire);
+            for (size_t i = 0; i < kWords; i++) {
+                words[i] = words_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((sequence & 1) != 0 ||
+                 sequence_.load(std::memory_order_relaxed) != sequence);
 
-    LOG_TRACE("write_work: cmd=%d", cmd);
-restart:
-    int res = write(fd, &work, sizeof(work));
-    if (res < 0 && errno == EINTR) {
-        goto restart;
+        T value;
+        memcpy(&value, words, sizeof(value));
+        return value;
     }
 
-    if (res == sizeof(work)) return;
+   private:
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SeqLockValue must hold a trivially copyable type");
+    static_assert(sizeof(T) % sizeof(uint32_t) == 0,
+                  "SeqLockValue must hold a whole number of 32-bit words");
+    static constexpr size_t kWords = sizeof(T) / sizeof(uint32_t);
 
-    if (res < 0) {
-        ALOGW("Failed writing to work fd: %s", strerror(errno));
-    } else {
-        ALOGW("Truncated writing to work fd: %d", res);
-    }
-}
+    std::atomic_uint32_t sequence_{0};
+    std::atomic_uint32_t words_[kWords] = {};
+};
 
 /*
- * Read commands to be executed by the GameActivity on the application main
- * thread.
+ * Last known Configuration values. They're only written by the Java main
+ * thread but may be read from any thread.
  */
-static bool read_work(int fd, ActivityWork *outWork) {
-    int res = read(fd, outWork, sizeof(ActivityWork));
-    // no need to worry about EINTR, poll loop will just come back again.
-    if (res == sizeof(ActivityWork)) return true;
-
-    if (res < 0) {
-        ALOGW("Failed reading work fd: %s", strerror(errno));
-    } else {
-        ALOGW("Truncated reading work fd: %d", res);
-    }
-    return false;
-}
+static SeqLockValue<GameActivityConfiguration> gConfiguration;
 
 /*
  * Native state for interacting with the GameActivity class.
@@ -214,9 +304,8 @@ struct NativeCode : public GameActivity {
     NativeCode() {
         memset((GameActivity *)this, 0, sizeof(GameActivity));
         memset(&callbacks, 0, sizeof(callbacks));
-        memset(&insetsState, 0, sizeof(insetsState));
         nativeWindow = NULL;
-        mainWorkRead = mainWorkWrite = -1;
+        mainWorkEventFd = -1;
         gameTextInput = NULL;
     }
 
@@ -224,27 +313,36 @@ struct NativeCode : public GameActivity {
         if (callbacks.onDestroy != NULL) {
             callbacks.onDestroy(this);
         }
-        if (env != NULL) {
+        gamesdk::InstrumentedJNIEnv jniEnv = gamesdk::currentThreadEnv(vm);
+        if (jniEnv) {
             if (javaGameActivity != NULL) {
-                env->DeleteGlobalRef(javaGameActivity);
+                jniEnv->DeleteGlobalRef(javaGameActivity);
             }
             if (javaAssetManager != NULL) {
-                env->DeleteGlobalRef(javaAssetManager);
+                jniEnv->DeleteGlobalRef(javaAssetManager);
             }
         }
         GameTextInput_destroy(gameTextInput);
-        if (looper != NULL && mainWorkRead >= 0) {
-            ALooper_removeFd(looper, mainWorkRead);
+        if (looper != NULL && mainWorkEventFd >= 0) {
+            ALooper_removeFd(looper, mainWorkEventFd);
         }
+
+        // Free any input filters that were still waiting to be retired
+        ActivityWork work;
+        while (mainWorkQueue.pop(&work)) {
+            if (work.cmd == CMD_RETIRE_INPUT_FILTER) {
+                delete (GameActivityInputFilter *)(intptr_t)work.arg1;
+            }
+        }
+        delete inputFilter.load(std::memory_order_relaxed);
         ALooper_release(looper);
         looper = NULL;
 
-        setSurface(NULL);
-        if (mainWorkRead >= 0) close(mainWorkRead);
-        if (mainWorkWrite >= 0) close(mainWorkWrite);
+        setSurface(jniEnv.get(), NULL);
+        if (mainWorkEventFd >= 0) close(mainWorkEventFd);
     }
 
-    void setSurface(jobject _surface) {
+    void setSurface(JNIEnv *env, jobject _surface) {
         if (nativeWindow != NULL) {
             ANativeWindow_release(nativeWindow);
         }
@@ -265,11 +363,29 @@ struct NativeCode : public GameActivity {
     int32_t lastWindowWidth;
     int32_t lastWindowHeight;
 
-    // These are used to wake up the main thread to process work.
-    int mainWorkRead;
-    int mainWorkWrite;
+    // Work for the main thread is queued in mainWorkQueue, and the eventfd is
+    // used to wake up the main thread to process it. The eventfd is only
+    // signalled if mainWorkWakePending wasn't already set, and the main thread
+    // drains all the queued work each time it wakes up.
+    ActivityWorkQueue mainWorkQueue;
+    int mainWorkEventFd;
+    std::atomic_bool mainWorkWakePending{false};
+    // Reused by the main thread to drain the queue
+    std::vector<ActivityWork> mainWorkBatch;
     ALooper *looper;
 
+    // See GameActivity_getWorkQueueStats()
+    struct {
+        std::atomic<uint64_t> queued{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> collapsed{0};
+        std::atomic<uint64_t> handled{0};
+        std::atomic<uint64_t> wakeUps{0};
+        std::atomic<uint32_t> maxDepth{0};
+        std::atomic<int64_t> totalLatencyNanos{0};
+        std::atomic<int64_t> maxLatencyNanos{0};
+    } mainWorkStats;
+
     // Need to hold on to a reference here in case the upper layers destroy our
     // AssetManager.
     jobject javaAssetManager;
@@ -280,34 +396,118 @@ struct NativeCode : public GameActivity {
     OwnedGameTextInputState gameTextInputState;
     std::mutex gameTextInputStateMutex;
 
-    ARect insetsState[GAMECOMMON_INSETS_TYPE_COUNT];
+    // Written on the Java main thread, by onWindowInsetsChanged_native, but
+    // may be read from any thread.
+    SeqLockValue<GameActivityWindowInsets> insets;
+
+    // See GameActivity_setDeferredMotionEventDecoding()
+    std::atomic_bool deferMotionEventDecoding{false};
+
+    // See GameActivity_setInputFilter(). The filter is only read on the main
+    // thread, so a replaced filter is freed by queuing CMD_RETIRE_INPUT_FILTER
+    // work, which runs once the main thread can no longer be reading it.
+    std::atomic<GameActivityInputFilter *> inputFilter{nullptr};
 };
 
-static void readConfigurationValues(NativeCode *code, jobject javaConfig);
+static void readConfigurationValues(gamesdk::InstrumentedJNIEnv env,
+                                    jobject javaConfig);
+
+static int64_t monotonicNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Queue a command to be executed by the GameActivity on the application main
+ * thread.
+ *
+ * Returns false if the queue is full and the command was dropped.
+ */
+static bool write_work(NativeCode *code, int32_t cmd, int64_t arg1 = 0,
+                       int64_t arg2 = 0, int64_t arg3 = 0) {
+    ActivityWork work;
+    work.cmd = cmd;
+    work.arg1 = arg1;
+    work.arg2 = arg2;
+    work.arg3 = arg3;
+    work.queueTimeNanos = monotonicNanos();
+
+    LOG_TRACE("write_work: cmd=%d", cmd);
+    if (!code->mainWorkQueue.push(work)) {
+        code->mainWorkStats.dropped.fetch_add(1, std::memory_order_relaxed);
+        ALOGW("Work queue full, dropping cmd=%d", cmd);
+        return false;
+    }
+    code->mainWorkStats.queued.fetch_add(1, std::memory_order_relaxed);
+
+    // NB: this is sequentially consistent with mainWorkCallback clearing the
+    // flag before it drains the queue, so that the work is either drained by
+    // a pending wake up or we signal a new one.
+    if (code->mainWorkWakePending.exchange(true)) {
+        return true;
+    }
+
+    uint64_t one = 1;
+restart:
+    int res = write(code->mainWorkEventFd, &one, sizeof(one));
+    if (res < 0 && errno == EINTR) {
+        goto restart;
+    }
+    if (res < 0) {
+        // The work is still queued, so it'll be drained with the work that's
+        // queued next, which tries to signal the callback again.
+        ALOGW("Failed writing to work fd: %s", strerror(errno));
+        code->mainWorkWakePending.store(false);
+    }
+    return true;
+}
 
 extern "C" void GameActivity_finish(GameActivity *activity) {
     NativeCode *code = static_cast<NativeCode *>(activity);
-    write_work(code->mainWorkWrite, CMD_FINISH, 0);
+    write_work(code, CMD_FINISH, 0);
 }
 
 extern "C" void GameActivity_setWindowFlags(GameActivity *activity,
                                             uint32_t values, uint32_t mask) {
     NativeCode *code = static_cast<NativeCode *>(activity);
-    write_work(code->mainWorkWrite, CMD_SET_WINDOW_FLAGS, values, mask);
+    write_work(code, CMD_SET_WINDOW_FLAGS, values, mask);
 }
 
 extern "C" void GameActivity_showSoftInput(GameActivity *activity,
                                            uint32_t flags) {
     NativeCode *code = static_cast<NativeCode *>(activity);
-    write_work(code->mainWorkWrite, CMD_SHOW_SOFT_INPUT, flags);
+    write_work(code, CMD_SHOW_SOFT_INPUT, flags);
 }
 
 extern "C" void GameActivity_setTextInputState(
     GameActivity *activity, const GameTextInputState *state) {
     NativeCode *code = static_cast<NativeCode *>(activity);
-    std::lock_guard<std::mutex> lock(code->gameTextInputStateMutex);
-    code->gameTextInputState = *state;
-    write_work(code->mainWorkWrite, CMD_SET_SOFT_INPUT_STATE);
+    {
+        std::lock_guard<std::mutex> lock(code->gameTextInputStateMutex);
+        code->gameTextInputState = *state;
+    }
+    write_work(code, CMD_SET_SOFT_INPUT_STATE);
+}
+
+extern "C" void GameActivity_setInputFilter(
+    GameActivity *activity, const GameActivityInputFilter *filter) {
+    NativeCode *code = static_cast<NativeCode *>(activity);
+    GameActivityInputFilter *copy =
+        filter != nullptr ? new GameActivityInputFilter(*filter) : nullptr;
+    GameActivityInputFilter *old =
+        code->inputFilter.exchange(copy, std::memory_order_acq_rel);
+    if (old != nullptr &&
+        !write_work(code, CMD_RETIRE_INPUT_FILTER, (intptr_t)old)) {
+        // The main thread may still be reading it, so it has to be leaked
+        ALOGW("Failed to retire input filter");
+    }
+}
+
+extern "C" void GameActivity_setDeferredMotionEventDecoding(
+    GameActivity *activity, bool enabled) {
+    NativeCode *code = static_cast<NativeCode *>(activity);
+    code->deferMotionEventDecoding.store(enabled, std::memory_order_relaxed);
 }
 
 extern "C" void GameActivity_getTextInputState(
@@ -317,10 +517,23 @@ extern "C" void GameActivity_getTextInputState(
     return GameTextInput_getState(code->gameTextInput, callback, context);
 }
 
+extern "C" void GameActivity_takeTextInputEdit(
+    GameActivity *activity, bool wholeText, GameTextInputEditCallback callback,
+    void *context) {
+    NativeCode *code = static_cast<NativeCode *>(activity);
+    GameTextInput_takeEdit(code->gameTextInput, wholeText, callback, context);
+}
+
+extern "C" uint64_t GameActivity_getTextInputGeneration(
+    GameActivity *activity) {
+    NativeCode *code = static_cast<NativeCode *>(activity);
+    return GameTextInput_getGeneration(code->gameTextInput);
+}
+
 extern "C" void GameActivity_hideSoftInput(GameActivity *activity,
                                            uint32_t flags) {
     NativeCode *code = static_cast<NativeCode *>(activity);
-    write_work(code->mainWorkWrite, CMD_HIDE_SOFT_INPUT, flags);
+    write_work(code, CMD_HIDE_SOFT_INPUT, flags);
 }
 
 extern "C" void GameActivity_getWindowInsets(GameActivity *activity,
@@ -328,7 +541,13 @@ extern "C" void GameActivity_getWindowInsets(GameActivity *activity,
                                              ARect *insets) {
     if (type < 0 || type >= GAMECOMMON_INSETS_TYPE_COUNT) return;
     NativeCode *code = static_cast<NativeCode *>(activity);
-    *insets = code->insetsState[type];
+    *insets = code->insets.load().insets[type];
+}
+
+extern "C" void GameActivity_getWindowInsetsSnapshot(
+    GameActivity *activity, GameActivityWindowInsets *outInsets) {
+    NativeCode *code = static_cast<NativeCode *>(activity);
+    *outInsets = code->insets.load();
 }
 
 extern "C" GameTextInput *GameActivity_getTextInput(
@@ -340,7 +559,8 @@ extern "C" GameTextInput *GameActivity_getTextInput(
 /*
  * Log the JNI exception, if any.
  */
-static void checkAndClearException(JNIEnv *env, const char *methodName) {
+static void checkAndClearException(gamesdk::InstrumentedJNIEnv env,
+                                   const char *methodName) {
     if (env->ExceptionCheck()) {
         ALOGE("Exception while running %s", methodName);
         env->ExceptionDescribe();
@@ -349,31 +569,22 @@ static void checkAndClearException(JNIEnv *env, const char *methodName) {
 }
 
 /*
- * Callback for handling native events on the application's main thread.
+ * Execute a command on the application's main thread.
  */
-static int mainWorkCallback(int fd, int events, void *data) {
-    ALOGD("************** mainWorkCallback *********");
-    NativeCode *code = (NativeCode *)data;
-    if ((events & POLLIN) == 0) {
-        return 1;
-    }
-
-    ActivityWork work;
-    if (!read_work(code->mainWorkRead, &work)) {
-        return 1;
-    }
-    LOG_TRACE("mainWorkCallback: cmd=%d", work.cmd);
+static void execute_work(NativeCode *code, const ActivityWork &work) {
+    LOG_TRACE("execute_work: cmd=%d", work.cmd);
+    gamesdk::InstrumentedJNIEnv env = gamesdk::currentThreadEnv(code->vm);
     switch (work.cmd) {
         case CMD_FINISH: {
-            code->env->CallVoidMethod(code->javaGameActivity,
-                                      gGameActivityClassInfo.finish);
-            checkAndClearException(code->env, "finish");
+            env->CallVoidMethod(code->javaGameActivity,
+                                gGameActivityClassInfo.finish);
+            checkAndClearException(env, "finish");
         } break;
         case CMD_SET_WINDOW_FLAGS: {
-            code->env->CallVoidMethod(code->javaGameActivity,
-                                      gGameActivityClassInfo.setWindowFlags,
-                                      work.arg1, work.arg2);
-            checkAndClearException(code->env, "setWindowFlags");
+            env->CallVoidMethod(code->javaGameActivity,
+                                gGameActivityClassInfo.setWindowFlags,
+                                work.arg1, work.arg2);
+            checkAndClearException(env, "setWindowFlags");
         } break;
         case CMD_SHOW_SOFT_INPUT: {
             GameTextInput_showIme(code->gameTextInput, work.arg1);
@@ -382,33 +593,157 @@ static int mainWorkCallback(int fd, int events, void *data) {
             std::lock_guard<std::mutex> lock(code->gameTextInputStateMutex);
             GameTextInput_setState(code->gameTextInput,
                                    &code->gameTextInputState.inner);
-            checkAndClearException(code->env, "setTextInputState");
+            checkAndClearException(env, "setTextInputState");
         } break;
         case CMD_HIDE_SOFT_INPUT: {
             GameTextInput_hideIme(code->gameTextInput, work.arg1);
         } break;
         case CMD_SET_IME_EDITOR_INFO: {
-            code->env->CallVoidMethod(
-                code->javaGameActivity,
-                gGameActivityClassInfo.setImeEditorInfoFields, work.arg1,
-                work.arg2, work.arg3);
-            checkAndClearException(code->env, "setImeEditorInfo");
+            env->CallVoidMethod(code->javaGameActivity,
+                                gGameActivityClassInfo.setImeEditorInfoFields,
+                                work.arg1, work.arg2, work.arg3);
+            checkAndClearException(env, "setImeEditorInfo");
+        } break;
+        case CMD_RETIRE_INPUT_FILTER: {
+            delete (GameActivityInputFilter *)(intptr_t)work.arg1;
         } break;
         default:
             ALOGW("Unknown work command: %d", work.cmd);
             break;
     }
+}
+
+/*
+ * Callback for handling native events on the application's main thread.
+ */
+static int mainWorkCallback(int fd, int events, void *data) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_MAIN_WORK);
+    NativeCode *code = (NativeCode *)data;
+    if ((events & POLLIN) == 0) {
+        return 1;
+    }
+
+    // Clear the wake up before draining the queue, so that work that's queued
+    // concurrently is either drained now or signals another wake up.
+    code->mainWorkWakePending.exchange(false);
+    uint64_t count;
+    if (read(code->mainWorkEventFd, &count, sizeof(count)) < 0 &&
+        errno != EAGAIN) {
+        ALOGW("Failed reading work fd: %s", strerror(errno));
+    }
+
+    std::vector<ActivityWork> &batch = code->mainWorkBatch;
+    batch.clear();
+    ActivityWork work;
+    while (code->mainWorkQueue.pop(&work)) {
+        batch.push_back(work);
+    }
+    if (batch.empty()) {
+        return 1;
+    }
+
+    auto &stats = code->mainWorkStats;
+    stats.wakeUps.fetch_add(1, std::memory_order_relaxed);
+    if (batch.size() > stats.maxDepth.load(std::memory_order_relaxed)) {
+        stats.maxDepth.store(batch.size(), std::memory_order_relaxed);
+    }
+
+    // Every CMD_SET_SOFT_INPUT_STATE applies the latest state, so only the
+    // last one in the batch needs to be executed.
+    size_t lastSetSoftInputState = batch.size();
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (batch[i].cmd == CMD_SET_SOFT_INPUT_STATE) {
+            lastSetSoftInputState = i;
+        }
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        const ActivityWork &work = batch[i];
+        if (work.cmd == CMD_SET_SOFT_INPUT_STATE &&
+            i != lastSetSoftInputState) {
+            stats.collapsed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        int64_t latency = monotonicNanos() - work.queueTimeNanos;
+        stats.handled.fetch_add(1, std::memory_order_relaxed);
+        stats.totalLatencyNanos.fetch_add(latency, std::memory_order_relaxed);
+        if (latency > stats.maxLatencyNanos.load(std::memory_order_relaxed)) {
+            stats.maxLatencyNanos.store(latency, std::memory_order_relaxed);
+        }
+
+        execute_work(code, work);
+    }
 
     return 1;
 }
 
+extern "C" void GameActivity_getWorkQueueStats(
+    GameActivity *activity, GameActivityWorkQueueStats *outStats) {
+    NativeCode *code = static_cast<NativeCode *>(activity);
+    auto &stats = code->mainWorkStats;
+    outStats->queued = stats.queued.load(std::memory_order_relaxed);
+    outStats->dropped = stats.dropped.load(std::memory_order_relaxed);
+    outStats->collapsed = stats.collapsed.load(std::memory_order_relaxed);
+    outStats->handled = stats.handled.load(std::memory_order_relaxed);
+    outStats->wakeUps = stats.wakeUps.load(std::memory_order_relaxed);
+    outStats->depth = code->mainWorkQueue.depth();
+    outStats->maxDepth = stats.maxDepth.load(std::memory_order_relaxed);
+    outStats->totalLatencyNanos =
+        stats.totalLatencyNanos.load(std::memory_order_relaxed);
+    outStats->maxLatencyNanos =
+        stats.maxLatencyNanos.load(std::memory_order_relaxed);
+}
+
+// These names must match, in order, the GameActivityJniEntryPoint enum fields
+static const char *const kJniEntryPointNames[GAMEACTIVITY_JNI_ENTRY_COUNT] = {
+    "initializeNativeCode_native",
+    "terminateNativeCode_native",
+    "onStart_native",
+    "onResume_native",
+    "onSaveInstanceState_native",
+    "onPause_native",
+    "onStop_native",
+    "onConfigurationChanged_native",
+    "onTrimMemory_native",
+    "onWindowFocusChanged_native",
+    "onSurfaceCreated_native",
+    "onSurfaceChanged_native",
+    "onSurfaceRedrawNeeded_native",
+    "onSurfaceDestroyed_native",
+    "onTouchEvent_native",
+    "onKeyUp_native",
+    "onKeyDown_native",
+    "onTextInput_native",
+    "onWindowInsetsChanged_native",
+    "setInputConnection_native",
+    "onContentRectChangedNative_native",
+    "mainWorkCallback"};
+
+extern "C" bool GameActivity_getJniStats(GameActivityJniEntryPoint entryPoint,
+                                         GameActivityJniStats *outStats) {
+    if (entryPoint < 0 || entryPoint >= GAMEACTIVITY_JNI_ENTRY_COUNT) {
+        return false;
+    }
+    const gamesdk::JniEntryCounters &stats = gJniEntryStats[entryPoint];
+    outStats->name = kJniEntryPointNames[entryPoint];
+    outStats->calls = stats.calls.load(std::memory_order_relaxed);
+    outStats->jniCalls = stats.jniCalls.load(std::memory_order_relaxed);
+    outStats->localRefs = stats.localRefs.load(std::memory_order_relaxed);
+    outStats->totalNanos = stats.totalNanos.load(std::memory_order_relaxed);
+    outStats->maxNanos = stats.maxNanos.load(std::memory_order_relaxed);
+    return true;
+}
+
 // ------------------------------------------------------------------------
 static thread_local std::string g_error_msg;
 
 static jlong initializeNativeCode_native(
-    JNIEnv *env, jobject javaGameActivity, jstring internalDataDir,
+    JNIEnv *jniEnv, jobject javaGameActivity, jstring internalDataDir,
     jstring obbDir, jstring externalDataDir, jobject jAssetMgr,
     jbyteArray savedState, jobject javaConfig) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_INITIALIZE_NATIVE_CODE);
+    gamesdk::InstrumentedJNIEnv env(jniEnv);
     LOG_TRACE("initializeNativeCode_native");
     NativeCode *code = NULL;
 
@@ -423,28 +758,17 @@ static jlong initializeNativeCode_native(
     }
     ALooper_acquire(code->looper);
 
-    int msgpipe[2];
-    if (pipe(msgpipe)) {
-        g_error_msg = "could not create pipe: ";
+    code->mainWorkEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (code->mainWorkEventFd < 0) {
+        g_error_msg = "could not create eventfd: ";
         g_error_msg += strerror(errno);
 
         ALOGW("%s", g_error_msg.c_str());
         delete code;
         return 0;
     }
-    code->mainWorkRead = msgpipe[0];
-    code->mainWorkWrite = msgpipe[1];
-    int result = fcntl(code->mainWorkRead, F_SETFL, O_NONBLOCK);
-    SLOGW_IF(result != 0,
-             "Could not make main work read pipe "
-             "non-blocking: %s",
-             strerror(errno));
-    result = fcntl(code->mainWorkWrite, F_SETFL, O_NONBLOCK);
-    SLOGW_IF(result != 0,
-             "Could not make main work write pipe "
-             "non-blocking: %s",
-             strerror(errno));
-    ALooper_addFd(code->looper, code->mainWorkRead, 0, ALOOPER_EVENT_INPUT,
+    code->mainWorkBatch.reserve(ACTIVITY_WORK_QUEUE_SIZE);
+    ALooper_addFd(code->looper, code->mainWorkEventFd, 0, ALOOPER_EVENT_INPUT,
                   mainWorkCallback, code);
 
     code->GameActivity::callbacks = &code->callbacks;
@@ -453,7 +777,7 @@ static jlong initializeNativeCode_native(
         delete code;
         return 0;
     }
-    code->env = env;
+    code->env = jniEnv;
     code->javaGameActivity = env->NewGlobalRef(javaGameActivity);
 
     const char *dirStr =
@@ -469,7 +793,7 @@ static jlong initializeNativeCode_native(
     if (externalDataDir) env->ReleaseStringUTFChars(externalDataDir, dirStr);
 
     code->javaAssetManager = env->NewGlobalRef(jAssetMgr);
-    code->assetManager = AAssetManager_fromJava(env, jAssetMgr);
+    code->assetManager = AAssetManager_fromJava(jniEnv, jAssetMgr);
 
     dirStr = obbDir ? env->GetStringUTFChars(obbDir, NULL) : "";
     code->obbPathObj = dirStr;
@@ -483,11 +807,11 @@ static jlong initializeNativeCode_native(
         rawSavedSize = env->GetArrayLength(savedState);
     }
 
-    readConfigurationValues(code, javaConfig);
+    readConfigurationValues(env, javaConfig);
 
     GameActivity_onCreate_C(code, rawSavedState, rawSavedSize);
 
-    code->gameTextInput = GameTextInput_init(env, 0);
+    code->gameTextInput = GameTextInput_init(jniEnv, 0);
     GameTextInput_setEventCallback(code->gameTextInput,
                                    reinterpret_cast<GameTextInputEventCallback>(
                                        code->callbacks.onTextInputEvent),
@@ -507,7 +831,8 @@ static jstring getDlError_native(JNIEnv *env, jobject javaGameActivity) {
 }
 
 static void terminateNativeCode_native(JNIEnv *env, jobject javaGameActivity,
-                                    jlong handle) {
+                                       jlong handle) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_TERMINATE_NATIVE_CODE);
     LOG_TRACE("terminateNativeCode_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -517,6 +842,7 @@ static void terminateNativeCode_native(JNIEnv *env, jobject javaGameActivity,
 
 static void onStart_native(JNIEnv *env, jobject javaGameActivity,
                            jlong handle) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_START);
     ALOGV("onStart_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -528,6 +854,7 @@ static void onStart_native(JNIEnv *env, jobject javaGameActivity,
 
 static void onResume_native(JNIEnv *env, jobject javaGameActivity,
                             jlong handle) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_RESUME);
     LOG_TRACE("onResume_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -538,13 +865,15 @@ static void onResume_native(JNIEnv *env, jobject javaGameActivity,
 }
 
 struct SaveInstanceLocals {
-    JNIEnv *env;
+    gamesdk::InstrumentedJNIEnv env;
     jbyteArray array;
 };
 
-static jbyteArray onSaveInstanceState_native(JNIEnv *env,
+static jbyteArray onSaveInstanceState_native(JNIEnv *jniEnv,
                                              jobject javaGameActivity,
                                              jlong handle) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_SAVE_INSTANCE_STATE);
+    gamesdk::InstrumentedJNIEnv env(jniEnv);
     LOG_TRACE("onSaveInstanceState_native");
 
     SaveInstanceLocals locals{
@@ -573,6 +902,7 @@ static jbyteArray onSaveInstanceState_native(JNIEnv *env,
 
 static void onPause_native(JNIEnv *env, jobject javaGameActivity,
                            jlong handle) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_PAUSE);
     LOG_TRACE("onPause_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -583,6 +913,7 @@ static void onPause_native(JNIEnv *env, jobject javaGameActivity,
 }
 
 static void onStop_native(JNIEnv *env, jobject javaGameActivity, jlong handle) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_STOP);
     LOG_TRACE("onStop_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -592,56 +923,108 @@ static void onStop_native(JNIEnv *env, jobject javaGameActivity, jlong handle) {
     }
 }
 
-static void readConfigurationValues(NativeCode *code, jobject javaConfig) {
+static void readConfigurationValues(gamesdk::InstrumentedJNIEnv env,
+                                    jobject javaConfig) {
+    const GameActivityConfiguration previous = gConfiguration.load();
+    // Members that aren't available on this API level keep their last value.
+    GameActivityConfiguration config = previous;
+
     if (gConfigurationClassInfo.colorMode != NULL) {
-        gConfiguration.colorMode = code->env->GetIntField(
+        config.colorMode = env->GetIntField(
             javaConfig, gConfigurationClassInfo.colorMode);
     }
 
-    gConfiguration.densityDpi =
-        code->env->GetIntField(javaConfig, gConfigurationClassInfo.densityDpi);
-    gConfiguration.fontScale =
-        code->env->GetFloatField(javaConfig, gConfigurationClassInfo.fontScale);
+    config.densityDpi =
+        env->GetIntField(javaConfig, gConfigurationClassInfo.densityDpi);
+    config.fontScale =
+        env->GetFloatField(javaConfig, gConfigurationClassInfo.fontScale);
 
     if (gConfigurationClassInfo.fontWeightAdjustment != NULL) {
-        gConfiguration.fontWeightAdjustment = code->env->GetIntField(
+        config.fontWeightAdjustment = env->GetIntField(
             javaConfig, gConfigurationClassInfo.fontWeightAdjustment);
     }
 
-    gConfiguration.hardKeyboardHidden = code->env->GetIntField(
+    config.hardKeyboardHidden = env->GetIntField(
         javaConfig, gConfigurationClassInfo.hardKeyboardHidden);
-    gConfiguration.mcc =
-        code->env->GetIntField(javaConfig, gConfigurationClassInfo.mcc);
-    gConfiguration.mnc =
-        code->env->GetIntField(javaConfig, gConfigurationClassInfo.mnc);
-    gConfiguration.navigation =
-        code->env->GetIntField(javaConfig, gConfigurationClassInfo.navigation);
-    gConfiguration.navigationHidden = code->env->GetIntField(
+    config.keyboard =
+        env->GetIntField(javaConfig, gConfigurationClassInfo.keyboard);
+    config.keyboardHidden = env->GetIntField(
+        javaConfig, gConfigurationClassInfo.keyboardHidden);
+    config.mcc = env->GetIntField(javaConfig, gConfigurationClassInfo.mcc);
+    config.mnc = env->GetIntField(javaConfig, gConfigurationClassInfo.mnc);
+    config.navigation =
+        env->GetIntField(javaConfig, gConfigurationClassInfo.navigation);
+    config.navigationHidden = env->GetIntField(
         javaConfig, gConfigurationClassInfo.navigationHidden);
-    gConfiguration.orientation =
-        code->env->GetIntField(javaConfig, gConfigurationClassInfo.orientation);
-    gConfiguration.screenHeightDp = code->env->GetIntField(
+    config.orientation =
+        env->GetIntField(javaConfig, gConfigurationClassInfo.orientation);
+    config.screenHeightDp = env->GetIntField(
         javaConfig, gConfigurationClassInfo.screenHeightDp);
-    gConfiguration.screenLayout = code->env->GetIntField(
+    config.screenLayout = env->GetIntField(
         javaConfig, gConfigurationClassInfo.screenLayout);
-    gConfiguration.screenWidthDp = code->env->GetIntField(
+    config.screenWidthDp = env->GetIntField(
         javaConfig, gConfigurationClassInfo.screenWidthDp);
-    gConfiguration.smallestScreenWidthDp = code->env->GetIntField(
+    config.smallestScreenWidthDp = env->GetIntField(
         javaConfig, gConfigurationClassInfo.smallestScreenWidthDp);
-    gConfiguration.touchscreen =
-        code->env->GetIntField(javaConfig, gConfigurationClassInfo.touchscreen);
-    gConfiguration.uiMode =
-        code->env->GetIntField(javaConfig, gConfigurationClassInfo.uiMode);
-
-    checkAndClearException(code->env, "Configuration.get");
+    config.touchscreen =
+        env->GetIntField(javaConfig, gConfigurationClassInfo.touchscreen);
+    config.uiMode =
+        env->GetIntField(javaConfig, gConfigurationClassInfo.uiMode);
+
+    checkAndClearException(env, "Configuration.get");
+
+#define CONFIGURATION_CHANGED(member, bit) \
+    (config.member != previous.member ? (bit) : 0u)
+    config.changedMask =
+        CONFIGURATION_CHANGED(colorMode,
+                              GAMEACTIVITY_CONFIGURATION_COLOR_MODE) |
+        CONFIGURATION_CHANGED(densityDpi,
+                              GAMEACTIVITY_CONFIGURATION_DENSITY_DPI) |
+        CONFIGURATION_CHANGED(fontScale,
+                              GAMEACTIVITY_CONFIGURATION_FONT_SCALE) |
+        CONFIGURATION_CHANGED(
+            fontWeightAdjustment,
+            GAMEACTIVITY_CONFIGURATION_FONT_WEIGHT_ADJUSTMENT) |
+        CONFIGURATION_CHANGED(hardKeyboardHidden,
+                              GAMEACTIVITY_CONFIGURATION_HARD_KEYBOARD_HIDDEN) |
+        CONFIGURATION_CHANGED(keyboard, GAMEACTIVITY_CONFIGURATION_KEYBOARD) |
+        CONFIGURATION_CHANGED(keyboardHidden,
+                              GAMEACTIVITY_CONFIGURATION_KEYBOARD_HIDDEN) |
+        CONFIGURATION_CHANGED(mcc, GAMEACTIVITY_CONFIGURATION_MCC) |
+        CONFIGURATION_CHANGED(mnc, GAMEACTIVITY_CONFIGURATION_MNC) |
+        CONFIGURATION_CHANGED(navigation,
+                              GAMEACTIVITY_CONFIGURATION_NAVIGATION) |
+        CONFIGURATION_CHANGED(navigationHidden,
+                              GAMEACTIVITY_CONFIGURATION_NAVIGATION_HIDDEN) |
+        CONFIGURATION_CHANGED(orientation,
+                              GAMEACTIVITY_CONFIGURATION_ORIENTATION) |
+        CONFIGURATION_CHANGED(screenHeightDp,
+                              GAMEACTIVITY_CONFIGURATION_SCREEN_HEIGHT_DP) |
+        CONFIGURATION_CHANGED(screenLayout,
+                              GAMEACTIVITY_CONFIGURATION_SCREEN_LAYOUT) |
+        CONFIGURATION_CHANGED(screenWidthDp,
+                              GAMEACTIVITY_CONFIGURATION_SCREEN_WIDTH_DP) |
+        CONFIGURATION_CHANGED(
+            smallestScreenWidthDp,
+            GAMEACTIVITY_CONFIGURATION_SMALLEST_SCREEN_WIDTH_DP) |
+        CONFIGURATION_CHANGED(touchscreen,
+                              GAMEACTIVITY_CONFIGURATION_TOUCHSCREEN) |
+        CONFIGURATION_CHANGED(uiMode, GAMEACTIVITY_CONFIGURATION_UI_MODE);
+#undef CONFIGURATION_CHANGED
+    config.version = previous.version + 1;
+
+    gConfiguration.store(config);
 }
 
-static void onConfigurationChanged_native(JNIEnv *env, jobject javaGameActivity,
+static void onConfigurationChanged_native(JNIEnv *jniEnv,
+                                          jobject javaGameActivity,
                                           jlong handle, jobject javaNewConfig) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_CONFIGURATION_CHANGED);
+    gamesdk::InstrumentedJNIEnv env(jniEnv);
     LOG_TRACE("onConfigurationChanged_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
-        readConfigurationValues(code, javaNewConfig);
+        readConfigurationValues(env, javaNewConfig);
 
         if (code->callbacks.onConfigurationChanged != NULL) {
             code->callbacks.onConfigurationChanged(code);
@@ -651,6 +1034,7 @@ static void onConfigurationChanged_native(JNIEnv *env, jobject javaGameActivity,
 
 static void onTrimMemory_native(JNIEnv *env, jobject javaGameActivity,
                                 jlong handle, jint level) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_TRIM_MEMORY);
     LOG_TRACE("onTrimMemory_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -662,6 +1046,7 @@ static void onTrimMemory_native(JNIEnv *env, jobject javaGameActivity,
 
 static void onWindowFocusChanged_native(JNIEnv *env, jobject javaGameActivity,
                                         jlong handle, jboolean focused) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_WINDOW_FOCUS_CHANGED);
     LOG_TRACE("onWindowFocusChanged_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -673,11 +1058,12 @@ static void onWindowFocusChanged_native(JNIEnv *env, jobject javaGameActivity,
 
 static void onSurfaceCreated_native(JNIEnv *env, jobject javaGameActivity,
                                     jlong handle, jobject surface) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_CREATED);
     ALOGV("onSurfaceCreated_native");
     LOG_TRACE("onSurfaceCreated_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
-        code->setSurface(surface);
+        code->setSurface(env, surface);
 
         if (code->nativeWindow != NULL &&
             code->callbacks.onNativeWindowCreated != NULL) {
@@ -689,6 +1075,7 @@ static void onSurfaceCreated_native(JNIEnv *env, jobject javaGameActivity,
 static void onSurfaceChanged_native(JNIEnv *env, jobject javaGameActivity,
                                     jlong handle, jobject surface, jint format,
                                     jint width, jint height) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_CHANGED);
     LOG_TRACE("onSurfaceChanged_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -698,7 +1085,7 @@ static void onSurfaceChanged_native(JNIEnv *env, jobject javaGameActivity,
         if (oldNativeWindow != NULL) {
             ANativeWindow_acquire(oldNativeWindow);
         }
-        code->setSurface(surface);
+        code->setSurface(env, surface);
         if (oldNativeWindow != code->nativeWindow) {
             if (oldNativeWindow != NULL &&
                 code->callbacks.onNativeWindowDestroyed != NULL) {
@@ -740,6 +1127,7 @@ static void onSurfaceChanged_native(JNIEnv *env, jobject javaGameActivity,
 
 static void onSurfaceRedrawNeeded_native(JNIEnv *env, jobject javaGameActivity,
                                          jlong handle) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_REDRAW_NEEDED);
     LOG_TRACE("onSurfaceRedrawNeeded_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -753,6 +1141,7 @@ static void onSurfaceRedrawNeeded_native(JNIEnv *env, jobject javaGameActivity,
 
 static void onSurfaceDestroyed_native(JNIEnv *env, jobject javaGameActivity,
                                       jlong handle) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_DESTROYED);
     LOG_TRACE("onSurfaceDestroyed_native");
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
@@ -760,7 +1149,7 @@ static void onSurfaceDestroyed_native(JNIEnv *env, jobject javaGameActivity,
             code->callbacks.onNativeWindowDestroyed != NULL) {
             code->callbacks.onNativeWindowDestroyed(code, code->nativeWindow);
         }
-        code->setSurface(NULL);
+        code->setSurface(env, NULL);
     }
 }
 
@@ -768,100 +1157,129 @@ extern "C" void GameActivity_setImeEditorInfo(GameActivity *activity,
                                               int inputType, int actionId,
                                               int imeOptions) {
     NativeCode *code = static_cast<NativeCode *>(activity);
-    write_work(code->mainWorkWrite, CMD_SET_IME_EDITOR_INFO, inputType,
-               actionId, imeOptions);
+    write_work(code, CMD_SET_IME_EDITOR_INFO, inputType, actionId,
+               imeOptions);
+}
+
+extern "C" void GameActivity_getConfiguration(
+    GameActivity *, GameActivityConfiguration *outConfig) {
+    *outConfig = gConfiguration.load();
 }
 
 extern "C" int GameActivity_getColorMode(GameActivity *) {
-    return gConfiguration.colorMode;
+    return gConfiguration.load().colorMode;
 }
 
 extern "C" int GameActivity_getDensityDpi(GameActivity *) {
-    return gConfiguration.densityDpi;
+    return gConfiguration.load().densityDpi;
 }
 
 extern "C" float GameActivity_getFontScale(GameActivity *) {
-    return gConfiguration.fontScale;
+    return gConfiguration.load().fontScale;
 }
 
 extern "C" int GameActivity_getFontWeightAdjustment(GameActivity *) {
-    return gConfiguration.fontWeightAdjustment;
+    return gConfiguration.load().fontWeightAdjustment;
 }
 
 extern "C" int GameActivity_getHardKeyboardHidden(GameActivity *) {
-    return gConfiguration.hardKeyboardHidden;
+    return gConfiguration.load().hardKeyboardHidden;
 }
 
 extern "C" int GameActivity_getKeyboard(GameActivity *) {
-    return gConfiguration.keyboard;
+    return gConfiguration.load().keyboard;
 }
 
 extern "C" int GameActivity_getKeyboardHidden(GameActivity *) {
-    return gConfiguration.keyboardHidden;
+    return gConfiguration.load().keyboardHidden;
 }
 
 extern "C" int GameActivity_getMcc(GameActivity *) {
-    return gConfiguration.mcc;
+    return gConfiguration.load().mcc;
 }
 
 extern "C" int GameActivity_getMnc(GameActivity *) {
-    return gConfiguration.mnc;
+    return gConfiguration.load().mnc;
 }
 
 extern "C" int GameActivity_getNavigation(GameActivity *) {
-    return gConfiguration.navigation;
+    return gConfiguration.load().navigation;
 }
 
 extern "C" int GameActivity_getNavigationHidden(GameActivity *) {
-    return gConfiguration.navigationHidden;
+    return gConfiguration.load().navigationHidden;
 }
 
 extern "C" int GameActivity_getOrientation(GameActivity *) {
-    return gConfiguration.orientation;
+    return gConfiguration.load().orientation;
 }
 
 extern "C" int GameActivity_getScreenHeightDp(GameActivity *) {
-    return gConfiguration.screenHeightDp;
+    return gConfiguration.load().screenHeightDp;
 }
 
 extern "C" int GameActivity_getScreenLayout(GameActivity *) {
-    return gConfiguration.screenLayout;
+    return gConfiguration.load().screenLayout;
 }
 
 extern "C" int GameActivity_getScreenWidthDp(GameActivity *) {
-    return gConfiguration.screenWidthDp;
+    return gConfiguration.load().screenWidthDp;
 }
 
 extern "C" int GameActivity_getSmallestScreenWidthDp(GameActivity *) {
-    return gConfiguration.smallestScreenWidthDp;
+    return gConfiguration.load().smallestScreenWidthDp;
 }
 
 extern "C" int GameActivity_getTouchscreen(GameActivity *) {
-    return gConfiguration.touchscreen;
+    return gConfiguration.load().touchscreen;
 }
 
 extern "C" int GameActivity_getUIMode(GameActivity *) {
-    return gConfiguration.uiMode;
+    return gConfiguration.load().uiMode;
 }
 
 static bool onTouchEvent_native(JNIEnv *env, jobject javaGameActivity,
                                 jlong handle, jobject motionEvent) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_TOUCH_EVENT);
     if (handle == 0) return false;
     NativeCode *code = (NativeCode *)handle;
     if (code->callbacks.onTouchEvent == nullptr) return false;
 
+    const GameActivityInputFilter *filter =
+        code->inputFilter.load(std::memory_order_acquire);
+    if (filter != nullptr &&
+        !GameActivityInputFilter_acceptsMotionEvent(filter, env, motionEvent)) {
+        return false;
+    }
+
+    // NB: the event (including its history) is only valid for the duration
+    // of the callback, so we can reuse the same storage for every event.
     static GameActivityMotionEvent c_event;
-    GameActivityMotionEvent_fromJava(env, motionEvent, &c_event);
+    static std::vector<int64_t> c_event_history;
+    // NB: the callback takes ownership of any deferred event
+    if (!code->deferMotionEventDecoding.load(std::memory_order_relaxed) ||
+        !GameActivityMotionEvent_fromJavaDeferred(env, motionEvent,
+                                                  &c_event)) {
+        GameActivityMotionEvent_fromJava(env, motionEvent, &c_event,
+                                         &c_event_history);
+    }
     return code->callbacks.onTouchEvent(code, &c_event);
-
 }
 
-static bool onKeyUp_native(JNIEnv *env, jobject javaGameActivity, jlong handle,
-                           jobject keyEvent) {
+static bool onKeyUp_native(JNIEnv *env, jobject javaGameActivity,
+                           jlong handle, jobject keyEvent) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_KEY_UP);
     if (handle == 0) return false;
     NativeCode *code = (NativeCode *)handle;
     if (code->callbacks.onKeyUp == nullptr) return false;
 
+    const GameActivityInputFilter *filter =
+        code->inputFilter.load(std::memory_order_acquire);
+    if (filter != nullptr &&
+        !GameActivityInputFilter_acceptsKeyEvent(filter, env, keyEvent)) {
+        return false;
+    }
+
     static GameActivityKeyEvent c_event;
     GameActivityKeyEvent_fromJava(env, keyEvent, &c_event);
     return code->callbacks.onKeyUp(code, &c_event);
@@ -869,10 +1287,18 @@ static bool onKeyUp_native(JNIEnv *env, jobject javaGameActivity, jlong handle,
 
 static bool onKeyDown_native(JNIEnv *env, jobject javaGameActivity,
                              jlong handle, jobject keyEvent) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_KEY_DOWN);
     if (handle == 0) return false;
     NativeCode *code = (NativeCode *)handle;
     if (code->callbacks.onKeyDown == nullptr) return false;
 
+    const GameActivityInputFilter *filter =
+        code->inputFilter.load(std::memory_order_acquire);
+    if (filter != nullptr &&
+        !GameActivityInputFilter_acceptsKeyEvent(filter, env, keyEvent)) {
+        return false;
+    }
+
     static GameActivityKeyEvent c_event;
     GameActivityKeyEvent_fromJava(env, keyEvent, &c_event);
     return code->callbacks.onKeyDown(code, &c_event);
@@ -880,16 +1306,22 @@ static bool onKeyDown_native(JNIEnv *env, jobject javaGameActivity,
 
 static void onTextInput_native(JNIEnv *env, jobject activity, jlong handle,
                                jobject textInputEvent) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_TEXT_INPUT);
     if (handle == 0) return;
     NativeCode *code = (NativeCode *)handle;
     GameTextInput_processEvent(code->gameTextInput, textInputEvent);
 }
 
-static void onWindowInsetsChanged_native(JNIEnv *env, jobject activity,
+static void onWindowInsetsChanged_native(JNIEnv *jniEnv, jobject activity,
                                          jlong handle) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_WINDOW_INSETS_CHANGED);
+    gamesdk::InstrumentedJNIEnv env(jniEnv);
     if (handle == 0) return;
     NativeCode *code = (NativeCode *)handle;
     if (code->callbacks.onWindowInsetsChanged == nullptr) return;
+
+    const GameActivityWindowInsets previous = code->insets.load();
+    GameActivityWindowInsets current = {};
     for (int type = 0; type < GAMECOMMON_INSETS_TYPE_COUNT; ++type) {
         jobject jinsets;
         // Note that waterfall insets are handled differently on the Java side.
@@ -898,33 +1330,46 @@ static void onWindowInsetsChanged_native(JNIEnv *env, jobject activity,
                 code->javaGameActivity,
                 gGameActivityClassInfo.getWaterfallInsets);
         } else {
-            jint jtype = env->CallStaticIntMethod(
-                gWindowInsetsCompatTypeClassInfo.clazz,
-                gWindowInsetsCompatTypeClassInfo.methods[type]);
             jinsets = env->CallObjectMethod(
                 code->javaGameActivity, gGameActivityClassInfo.getWindowInsets,
-                jtype);
+                gWindowInsetsCompatTypes[type]);
         }
-        ARect &insets = code->insetsState[type];
-        if (jinsets == nullptr) {
-            insets.left = 0;
-            insets.right = 0;
-            insets.top = 0;
-            insets.bottom = 0;
-        } else {
+        ARect &insets = current.insets[type];
+        if (jinsets != nullptr) {
             insets.left = env->GetIntField(jinsets, gInsetsClassInfo.left);
             insets.right = env->GetIntField(jinsets, gInsetsClassInfo.right);
             insets.top = env->GetIntField(jinsets, gInsetsClassInfo.top);
             insets.bottom = env->GetIntField(jinsets, gInsetsClassInfo.bottom);
+            env->DeleteLocalRef(jinsets);
         }
+
+        // Version 0 means that the insets aren't known yet, so all of the
+        // first insets are reported as changed, even if they're all zero.
+        const ARect &old = previous.insets[type];
+        if (previous.version == 0 || insets.left != old.left ||
+            insets.right != old.right || insets.top != old.top ||
+            insets.bottom != old.bottom) {
+            current.changedMask |= 1u << type;
+        }
+    }
+
+    // The Java side reports every WindowInsets dispatch, which repeats the
+    // same insets for most types (e.g. the status bars while the IME slides
+    // in), so only the insets that have changed are passed on.
+    if (current.changedMask == 0) return;
+    current.version = previous.version + 1;
+    code->insets.store(current);
+
+    if (current.changedMask & (1u << GAMECOMMON_INSETS_TYPE_IME)) {
+        GameTextInput_processImeInsets(
+            code->gameTextInput, &current.insets[GAMECOMMON_INSETS_TYPE_IME]);
     }
-    GameTextInput_processImeInsets(
-        code->gameTextInput, &code->insetsState[GAMECOMMON_INSETS_TYPE_IME]);
     code->callbacks.onWindowInsetsChanged(code);
 }
 
 static void setInputConnection_native(JNIEnv *env, jobject activity,
                                       jlong handle, jobject inputConnection) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_SET_INPUT_CONNECTION);
     NativeCode *code = (NativeCode *)handle;
     GameTextInput_setInputConnection(code->gameTextInput, inputConnection);
 }
@@ -932,6 +1377,7 @@ static void setInputConnection_native(JNIEnv *env, jobject activity,
 static void onContentRectChangedNative_native(JNIEnv *env, jobject activity,
                                               jlong handle, jint x, jint y,
                                               jint w, jint h) {
+    GAMEACTIVITY_JNI_ENTRY(GAMEACTIVITY_JNI_ENTRY_ON_CONTENT_RECT_CHANGED);
     if (handle != 0) {
         NativeCode *code = (NativeCode *)handle;
 
@@ -1106,8 +1552,6 @@ extern "C" int GameActivity_register(JNIEnv *env) {
 
     jclass windowInsetsCompatType_class;
     FIND_CLASS(windowInsetsCompatType_class, kWindowInsetsCompatTypePathName);
-    gWindowInsetsCompatTypeClassInfo.clazz =
-        (jclass)env->NewGlobalRef(windowInsetsCompatType_class);
     // These names must match, in order, the GameCommonInsetsType enum fields
     // Note that waterfall is handled differently by the insets API, so we
     // exclude it here.
@@ -1122,9 +1566,11 @@ extern "C" int GameActivity_register(JNIEnv *env) {
         "systemGestures",
         "tappableElement"};
     for (int i = 0; i < GAMECOMMON_INSETS_TYPE_WATERFALL; ++i) {
-        GET_STATIC_METHOD_ID(gWindowInsetsCompatTypeClassInfo.methods[i],
-                             windowInsetsCompatType_class, methodNames[i],
-                             "()I");
+        jmethodID method;
+        GET_STATIC_METHOD_ID(method, windowInsetsCompatType_class,
+                             methodNames[i], "()I");
+        gWindowInsetsCompatTypes[i] =
+            env->CallStaticIntMethod(windowInsetsCompatType_class, method);
     }
     return jniRegisterNativeMethods(env, kGameActivityPathName, g_methods,
                                     NELEM(g_methods));
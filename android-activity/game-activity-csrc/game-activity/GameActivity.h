@@ -239,6 +239,12 @@ typedef struct GameActivityCallbacks {
      * Callback called for every MotionEvent done on the GameActivity
      * SurfaceView. Ownership of `event` is maintained by the library and it is
      * only valid during the callback.
+     *
+     * The exception is the `deferredEvent` of events that are captured while
+     * deferred decoding is enabled (see
+     * GameActivity_setDeferredMotionEventDecoding): the callback takes
+     * ownership of it, whether or not it handles the event, and must release it
+     * with GameActivityMotionEvent_releaseDeferred.
      */
     bool (*onTouchEvent)(GameActivity* activity,
                          const GameActivityMotionEvent* event);
@@ -268,7 +274,9 @@ typedef struct GameActivityCallbacks {
 
     /**
      * Callback called when WindowInsets of the main app window have changed.
-     * Call GameActivity_getWindowInsets to retrieve the insets themselves.
+     * Call GameActivity_getWindowInsets to retrieve the insets themselves, or
+     * GameActivity_getWindowInsetsSnapshot to also find out which of them
+     * changed. This is only called if at least one of the insets changed.
      */
     void (*onWindowInsetsChanged)(GameActivity* activity);
 
@@ -551,6 +559,25 @@ void GameActivity_getTextInputState(GameActivity* activity,
                                     GameTextInputGetStateCallback callback,
                                     void* context);
 
+/**
+ * Get the change to the text entry state since the last call of this
+ * function, as a single edit (see documentation of GameTextInput_takeEdit in
+ * the Game Text Input library reference).
+ *
+ * Edits are only tracked once, so this should only be used by a single
+ * consumer.
+ */
+void GameActivity_takeTextInputEdit(GameActivity* activity, bool wholeText,
+                                    GameTextInputEditCallback callback,
+                                    void* context);
+
+/**
+ * Get a counter that's incremented each time the text entry state changes (see
+ * documentation of GameTextInput_getGeneration in the Game Text Input library
+ * reference).
+ */
+uint64_t GameActivity_getTextInputGeneration(GameActivity* activity);
+
 /**
  * Get a pointer to the GameTextInput library instance.
  */
@@ -590,6 +617,36 @@ void GameActivity_hideSoftInput(GameActivity* activity, uint32_t flags);
 void GameActivity_getWindowInsets(GameActivity* activity,
                                   GameCommonInsetsType type, ARect* insets);
 
+/**
+ * A consistent snapshot of all of the window insets, see
+ * GameActivity_getWindowInsetsSnapshot().
+ */
+typedef struct GameActivityWindowInsets {
+    /**
+     * Incremented each time that any of the insets change. This is 0 until
+     * the insets are first known.
+     */
+    uint32_t version;
+    /**
+     * A mask of `1 << GameCommonInsetsType` bits for the insets that differ
+     * from the previous version. Every bit is set in version 1.
+     */
+    uint32_t changedMask;
+    /** The insets of each GameCommonInsetsType. */
+    ARect insets[GAMECOMMON_INSETS_TYPE_COUNT];
+} GameActivityWindowInsets;
+
+/**
+ * Get the current window insets of every component. This may be called from
+ * any thread, and never blocks; all of the insets come from the same version,
+ * even if they change while they're being read.
+ *
+ * When called from GameActivityCallbacks::onWindowInsetsChanged, `changedMask`
+ * says which insets that callback is for.
+ */
+void GameActivity_getWindowInsetsSnapshot(GameActivity* activity,
+                                          GameActivityWindowInsets* outInsets);
+
 /**
  * Set options on how the IME behaves when it is requested for text input.
  * See
@@ -603,9 +660,214 @@ void GameActivity_getWindowInsets(GameActivity* activity,
 void GameActivity_setImeEditorInfo(GameActivity* activity, int inputType,
                                    int actionId, int imeOptions);
 
+/**
+ * Statistics about the work that's queued for the application's main thread,
+ * by functions such as GameActivity_setTextInputState() and
+ * GameActivity_showSoftInput().
+ */
+typedef struct GameActivityWorkQueueStats {
+    /** The number of work items that have been queued. */
+    uint64_t queued;
+    /** The number of work items that were dropped because the queue was full. */
+    uint64_t dropped;
+    /**
+     * The number of queued work items that were skipped because a later item
+     * superseded them, such as redundant text input state updates.
+     */
+    uint64_t collapsed;
+    /** The number of queued work items that have been executed. */
+    uint64_t handled;
+    /** The number of main thread wake ups that handled work. */
+    uint64_t wakeUps;
+    /** The number of work items that are currently queued. */
+    uint32_t depth;
+    /** The largest number of work items handled by a single wake up. */
+    uint32_t maxDepth;
+    /**
+     * The total time between work items being queued and executed, in
+     * nanoseconds. Divide by `handled` for the mean latency.
+     */
+    int64_t totalLatencyNanos;
+    /**
+     * The longest time between a work item being queued and executed, in
+     * nanoseconds.
+     */
+    int64_t maxLatencyNanos;
+} GameActivityWorkQueueStats;
+
+/**
+ * Get statistics about the work that's queued for the application's main
+ * thread. This may be called from any thread.
+ */
+void GameActivity_getWorkQueueStats(GameActivity* activity,
+                                    GameActivityWorkQueueStats* outStats);
+
+/**
+ * Enable or disable deferred decoding of motion events.
+ *
+ * When enabled, motion events are captured with
+ * GameActivityMotionEvent_fromJavaDeferred, so that the Java main thread only
+ * decodes their scalar state before calling `onTouchEvent`, and their axis
+ * values and history are only decoded if and when they're read. Events that
+ * can't be captured this way (before API 31) are still decoded in full.
+ *
+ * This may be called from any thread, and applies to subsequent events.
+ */
+void GameActivity_setDeferredMotionEventDecoding(GameActivity* activity,
+                                                 bool enabled);
+
+/**
+ * Set a declarative filter for the motion and key events of the activity, or
+ * clear it if `filter` is NULL.
+ *
+ * The filter is checked on the Java main thread before an event is converted,
+ * and events that it rejects are reported as unhandled without calling
+ * `onTouchEvent`, `onKeyDown` or `onKeyUp`.
+ *
+ * The filter is copied, and may be replaced from any thread without blocking
+ * input delivery. It applies to subsequent events.
+ */
+void GameActivity_setInputFilter(GameActivity* activity,
+                                 const GameActivityInputFilter* filter);
+
+/**
+ * The native methods of GameActivity (plus the main thread's handler for
+ * queued work) that keep JNI usage statistics, see GameActivity_getJniStats().
+ */
+typedef enum GameActivityJniEntryPoint {
+    GAMEACTIVITY_JNI_ENTRY_INITIALIZE_NATIVE_CODE = 0,
+    GAMEACTIVITY_JNI_ENTRY_TERMINATE_NATIVE_CODE,
+    GAMEACTIVITY_JNI_ENTRY_ON_START,
+    GAMEACTIVITY_JNI_ENTRY_ON_RESUME,
+    GAMEACTIVITY_JNI_ENTRY_ON_SAVE_INSTANCE_STATE,
+    GAMEACTIVITY_JNI_ENTRY_ON_PAUSE,
+    GAMEACTIVITY_JNI_ENTRY_ON_STOP,
+    GAMEACTIVITY_JNI_ENTRY_ON_CONFIGURATION_CHANGED,
+    GAMEACTIVITY_JNI_ENTRY_ON_TRIM_MEMORY,
+    GAMEACTIVITY_JNI_ENTRY_ON_WINDOW_FOCUS_CHANGED,
+    GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_CREATED,
+    GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_CHANGED,
+    GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_REDRAW_NEEDED,
+    GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_DESTROYED,
+    GAMEACTIVITY_JNI_ENTRY_ON_TOUCH_EVENT,
+    GAMEACTIVITY_JNI_ENTRY_ON_KEY_UP,
+    GAMEACTIVITY_JNI_ENTRY_ON_KEY_DOWN,
+    GAMEACTIVITY_JNI_ENTRY_ON_TEXT_INPUT,
+    GAMEACTIVITY_JNI_ENTRY_ON_WINDOW_INSETS_CHANGED,
+    GAMEACTIVITY_JNI_ENTRY_SET_INPUT_CONNECTION,
+    GAMEACTIVITY_JNI_ENTRY_ON_CONTENT_RECT_CHANGED,
+    GAMEACTIVITY_JNI_ENTRY_MAIN_WORK,
+    GAMEACTIVITY_JNI_ENTRY_COUNT
+} GameActivityJniEntryPoint;
+
+/**
+ * JNI usage statistics for one of the GameActivityJniEntryPoint methods.
+ *
+ * The time spent in a method includes the time spent in any application
+ * callbacks that it calls, such as GameActivityCallbacks::onTouchEvent.
+ */
+typedef struct GameActivityJniStats {
+    /** The name of the native method. */
+    const char* name;
+    /** The number of times the method has been called. */
+    uint64_t calls;
+    /** The number of JNI functions that the method has called. */
+    uint64_t jniCalls;
+    /** The number of JNI local references that the method has created. */
+    uint64_t localRefs;
+    /** The total time spent in the method, in nanoseconds. */
+    int64_t totalNanos;
+    /**
+     * The longest time spent in a single call of the method, in nanoseconds.
+     */
+    int64_t maxNanos;
+} GameActivityJniStats;
+
+/**
+ * Get the JNI usage statistics for the given native method, which are
+ * accumulated for the lifetime of the process. This may be called from any
+ * thread.
+ *
+ * Returns false if `entryPoint` isn't a valid GameActivityJniEntryPoint.
+ */
+bool GameActivity_getJniStats(GameActivityJniEntryPoint entryPoint,
+                              GameActivityJniStats* outStats);
+
+/**
+ * Bits of GameActivityConfiguration::changedMask, one per Configuration field.
+ */
+#define GAMEACTIVITY_CONFIGURATION_COLOR_MODE (1u << 0)
+#define GAMEACTIVITY_CONFIGURATION_DENSITY_DPI (1u << 1)
+#define GAMEACTIVITY_CONFIGURATION_FONT_SCALE (1u << 2)
+#define GAMEACTIVITY_CONFIGURATION_FONT_WEIGHT_ADJUSTMENT (1u << 3)
+#define GAMEACTIVITY_CONFIGURATION_HARD_KEYBOARD_HIDDEN (1u << 4)
+#define GAMEACTIVITY_CONFIGURATION_KEYBOARD (1u << 5)
+#define GAMEACTIVITY_CONFIGURATION_KEYBOARD_HIDDEN (1u << 6)
+#define GAMEACTIVITY_CONFIGURATION_MCC (1u << 7)
+#define GAMEACTIVITY_CONFIGURATION_MNC (1u << 8)
+#define GAMEACTIVITY_CONFIGURATION_NAVIGATION (1u << 9)
+#define GAMEACTIVITY_CONFIGURATION_NAVIGATION_HIDDEN (1u << 10)
+#define GAMEACTIVITY_CONFIGURATION_ORIENTATION (1u << 11)
+#define GAMEACTIVITY_CONFIGURATION_SCREEN_HEIGHT_DP (1u << 12)
+#define GAMEACTIVITY_CONFIGURATION_SCREEN_LAYOUT (1u << 13)
+#define GAMEACTIVITY_CONFIGURATION_SCREEN_WIDTH_DP (1u << 14)
+#define GAMEACTIVITY_CONFIGURATION_SMALLEST_SCREEN_WIDTH_DP (1u << 15)
+#define GAMEACTIVITY_CONFIGURATION_TOUCHSCREEN (1u << 16)
+#define GAMEACTIVITY_CONFIGURATION_UI_MODE (1u << 17)
+
+/**
+ * A consistent snapshot of the Configuration class members that GameActivity
+ * tracks, see GameActivity_getConfiguration().
+ */
+typedef struct GameActivityConfiguration {
+    /**
+     * Incremented each time that GameActivity reads a new Configuration,
+     * starting from 1.
+     */
+    uint32_t version;
+    /**
+     * The GAMEACTIVITY_CONFIGURATION_* bits of the members that differ from
+     * the previous version.
+     */
+    uint32_t changedMask;
+    int32_t colorMode;
+    int32_t densityDpi;
+    float fontScale;
+    int32_t fontWeightAdjustment;
+    int32_t hardKeyboardHidden;
+    int32_t keyboard;
+    int32_t keyboardHidden;
+    int32_t mcc;
+    int32_t mnc;
+    int32_t navigation;
+    int32_t navigationHidden;
+    int32_t orientation;
+    int32_t screenHeightDp;
+    int32_t screenLayout;
+    int32_t screenWidthDp;
+    int32_t smallestScreenWidthDp;
+    int32_t touchscreen;
+    int32_t uiMode;
+} GameActivityConfiguration;
+
+/**
+ * Get the last known Configuration. This may be called from any thread, and
+ * never blocks or allocates; all of the members come from the same version,
+ * even if the Configuration changes while they're being read.
+ *
+ * An application that's notified of a change by
+ * GameActivityCallbacks::onConfigurationChanged can use `changedMask` to find
+ * out what changed, but if it polls for changes from another thread then it
+ * should compare `version` with the last version that it saw, since it may
+ * have missed some.
+ */
+void GameActivity_getConfiguration(GameActivity* activity,
+                                   GameActivityConfiguration* outConfig);
+
 /**
  * These are getters for Configuration class members. They may be called from
- * any thread.
+ * any thread. Use GameActivity_getConfiguration() to read several members
+ * that are consistent with each other.
  */
 int GameActivity_getOrientation(GameActivity* activity);
 int GameActivity_getColorMode(GameActivity* activity);
@@ -16,11 +16,15 @@
 
 #include "GameActivityEvents.h"
 
+#include <dlfcn.h>
+#include <string.h>
 #include <sys/system_properties.h>
 
 #include <string>
+#include <vector>
 
 #include "GameActivityLog.h"
+#include "common/jni_stats.h"
 
 // TODO(b/187147166): these functions were extracted from the Game SDK
 // (gamesdk/src/common/system_utils.h). system_utils.h/cpp should be used
@@ -96,24 +100,82 @@ float GameActivityMotionEvent_getHistoricalAxisValue(
         ALOGE("Invalid axis %d", axis);
         return -1;
     }
-    if (pointerIndex < 0 || pointerIndex >= event->pointerCount) {
+    if (pointerIndex < 0 ||
+        static_cast<uint32_t>(pointerIndex) >= event->pointerCount) {
         ALOGE("Invalid pointer index %d", pointerIndex);
         return -1;
     }
-    if (historyPos < 0 || historyPos >= event->historySize) {
+    if (historyPos < 0 ||
+        historyPos >= GameActivityMotionEvent_getHistorySize(event)) {
         ALOGE("Invalid history index %d", historyPos);
         return -1;
     }
-    if (!enabledAxes[axis]) {
+    uint64_t axisBit = UINT64_C(1) << axis;
+    if (!(event->historicalAxisMask & axisBit)) {
         ALOGW("Axis %d must be enabled before it can be accessed.", axis);
         return 0;
     }
 
-    int pointerOffset = pointerIndex * GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT;
-    int historyValuesOffset = historyPos * event->pointerCount *
-                              GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT;
-    return event
-        ->historicalAxisValues[historyValuesOffset + pointerOffset + axis];
+    if (event->deferredEvent != nullptr) {
+        return AMotionEvent_getHistoricalAxisValue(event->deferredEvent, axis,
+                                                   pointerIndex, historyPos);
+    }
+
+    // Only enabled axes are stored, so remap the axis to its index among the
+    // enabled axes
+    int axisCount = GameActivityMotionEvent_getHistoricalAxisCount(event);
+    int axisIndex = __builtin_popcountll(event->historicalAxisMask &
+                                         (axisBit - 1));
+    int valuesOffset =
+        (historyPos * event->pointerCount + pointerIndex) * axisCount;
+    return event->historicalAxisValues[valuesOffset + axisIndex];
+}
+
+float GameActivityMotionEvent_getPointerAxisValue(
+    const GameActivityMotionEvent *event, int axis, int pointerIndex) {
+    if (axis < 0 || axis >= GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT) {
+        ALOGE("Invalid axis %d", axis);
+        return -1;
+    }
+    if (pointerIndex < 0 ||
+        static_cast<uint32_t>(pointerIndex) >= event->pointerCount) {
+        ALOGE("Invalid pointer index %d", pointerIndex);
+        return -1;
+    }
+    uint64_t axisBit = UINT64_C(1) << axis;
+    if (!(event->historicalAxisMask & axisBit)) {
+        ALOGW("Axis %d must be enabled before it can be accessed.", axis);
+        return 0;
+    }
+
+    if (event->deferredEvent != nullptr) {
+        return AMotionEvent_getAxisValue(event->deferredEvent, axis,
+                                         pointerIndex);
+    }
+    if (event->pointerArrays.ids == nullptr) {
+        return event->pointers[pointerIndex].axisValues[axis];
+    }
+    int axisIndex = __builtin_popcountll(event->historicalAxisMask &
+                                         (axisBit - 1));
+    return event->pointerArrays
+        .axisValues[axisIndex * event->pointerCount + pointerIndex];
+}
+
+// Collects the currently enabled axes, in ascending order.
+//
+// Returns the number of axes written to `axes` and sets `mask` to the
+// equivalent `1 << axis` bitmask.
+static int getEnabledAxes(int32_t axes[GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT],
+                          uint64_t *mask) {
+    int count = 0;
+    *mask = 0;
+    for (int axis = 0; axis < GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT; ++axis) {
+        if (enabledAxes[axis]) {
+            axes[count++] = axis;
+            *mask |= UINT64_C(1) << axis;
+        }
+    }
+    return count;
 }
 
 static struct {
@@ -151,16 +213,191 @@ static struct {
 
 extern "C" void GameActivityMotionEvent_destroy(
     GameActivityMotionEvent *c_event) {
-    delete c_event->historicalAxisValues;
-    delete c_event->historicalEventTimesMillis;
-    delete c_event->historicalEventTimesNanos;
+    delete[] c_event->historicalAxisValues;
+    delete[] c_event->historicalEventTimesMillis;
+    delete[] c_event->historicalEventTimesNanos;
 }
 
-extern "C" void GameActivityMotionEvent_fromJava(
-    JNIEnv *env, jobject motionEvent, GameActivityMotionEvent *out_event) {
+// From API 31, AMotionEvent_fromJava() gives us a native view of a Java
+// MotionEvent, so the whole event can be decoded with plain NDK calls in one
+// pass instead of making a JNI round trip per pointer, per axis and per
+// history entry. These symbols are resolved at runtime so that we can still
+// fall back to the per-method JNI path on older devices.
+typedef const AInputEvent *(*AMotionEvent_fromJava_func)(JNIEnv *env,
+                                                         jobject motionEvent);
+typedef void (*AInputEvent_release_func)(const AInputEvent *event);
+typedef int32_t (*AMotionEvent_getInt_func)(const AInputEvent *event);
+
+static struct {
+    AMotionEvent_fromJava_func fromJava;
+    AInputEvent_release_func release;
+
+    // API 33
+    AMotionEvent_getInt_func getActionButton;
+    AMotionEvent_getInt_func getClassification;
+} gMotionEventNativeInfo;
+
+static void loadMotionEventNativeInfo(int sdkVersion) {
+    gMotionEventNativeInfo = {};
+    if (sdkVersion < 31) {
+        return;
+    }
+    // NB: libandroid.so is already loaded, and we never dlclose() it.
+    void *libandroid = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+    if (libandroid == nullptr) {
+        ALOGW("Failed to open libandroid.so: %s", dlerror());
+        return;
+    }
+    auto fromJava = reinterpret_cast<AMotionEvent_fromJava_func>(
+        dlsym(libandroid, "AMotionEvent_fromJava"));
+    auto release = reinterpret_cast<AInputEvent_release_func>(
+        dlsym(libandroid, "AInputEvent_release"));
+    if (fromJava == nullptr || release == nullptr) {
+        return;
+    }
+    gMotionEventNativeInfo.fromJava = fromJava;
+    gMotionEventNativeInfo.release = release;
+    gMotionEventNativeInfo.getActionButton =
+        reinterpret_cast<AMotionEvent_getInt_func>(
+            dlsym(libandroid, "AMotionEvent_getActionButton"));
+    gMotionEventNativeInfo.getClassification =
+        reinterpret_cast<AMotionEvent_getInt_func>(
+            dlsym(libandroid, "AMotionEvent_getClassification"));
+}
+
+// If `history` is null then the historical arrays are allocated individually
+// and need to be freed with GameActivityMotionEvent_destroy, otherwise they
+// are carved out of `history`, which is only ever grown.
+static void allocateMotionEventHistory(GameActivityMotionEvent *out_event,
+                                       int historySize, int pointerCount,
+                                       int axisCount,
+                                       std::vector<int64_t> *history) {
+    size_t nAxisValues = historySize * pointerCount * axisCount;
+    out_event->historySize = historySize;
+    if (history == nullptr) {
+        out_event->historicalAxisValues = new float[nAxisValues];
+        out_event->historicalEventTimesMillis = new int64_t[historySize];
+        out_event->historicalEventTimesNanos = new int64_t[historySize];
+        return;
+    }
+
+    size_t nAxisWords =
+        (nAxisValues * sizeof(float) + sizeof(int64_t) - 1) / sizeof(int64_t);
+    size_t needed = 2 * historySize + nAxisWords;
+    if (history->size() < needed) {
+        history->resize(needed);
+    }
+    int64_t *data = history->data();
+    out_event->historicalEventTimesMillis = data;
+    out_event->historicalEventTimesNanos = data + historySize;
+    out_event->historicalAxisValues =
+        reinterpret_cast<float *>(data + 2 * historySize);
+}
+
+// Decodes `event` in a single pass over the NDK AMotionEvent accessors.
+//
+// The only JNI calls made are for the (API 33) actionButton and classification
+// fields when the corresponding NDK accessors aren't available.
+//
+// If `decodeAxes` is false then only the scalar state of the event and the ids
+// and tool types of its pointers are decoded, leaving the axis values, raw
+// coordinates and history to be read from `event` later.
+static void motionEventFromNative(gamesdk::InstrumentedJNIEnv env,
+                                  jobject motionEvent,
+                                  const AInputEvent *event,
+                                  GameActivityMotionEvent *out_event,
+                                  std::vector<int64_t> *history,
+                                  bool decodeAxes) {
+    int32_t axes[GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT];
+    int axisCount = getEnabledAxes(axes, &out_event->historicalAxisMask);
+    out_event->pointerArrays = {};
+    out_event->deferredEvent = nullptr;
+
+    int pointerCount = std::min(
+        static_cast<int>(AMotionEvent_getPointerCount(event)),
+        GAMEACTIVITY_MAX_NUM_POINTERS_IN_MOTION_EVENT);
+    out_event->pointerCount = pointerCount;
+    for (int i = 0; i < pointerCount; ++i) {
+        GameActivityPointerAxes *pointer = &out_event->pointers[i];
+        pointer->id = AMotionEvent_getPointerId(event, i);
+        pointer->toolType = AMotionEvent_getToolType(event, i);
+        if (!decodeAxes) {
+            continue;
+        }
+
+        memset(pointer->axisValues, 0, sizeof(pointer->axisValues));
+        pointer->rawX = AMotionEvent_getRawX(event, i);
+        pointer->rawY = AMotionEvent_getRawY(event, i);
+        for (int a = 0; a < axisCount; ++a) {
+            pointer->axisValues[axes[a]] =
+                AMotionEvent_getAxisValue(event, axes[a], i);
+        }
+    }
+
+    int historySize = decodeAxes ? AMotionEvent_getHistorySize(event) : 0;
+    if (decodeAxes) {
+        allocateMotionEventHistory(out_event, historySize, pointerCount,
+                                   axisCount, history);
+    } else {
+        out_event->historySize = 0;
+        out_event->historicalEventTimesMillis = nullptr;
+        out_event->historicalEventTimesNanos = nullptr;
+        out_event->historicalAxisValues = nullptr;
+    }
+
+    float *axisValues = out_event->historicalAxisValues;
+    for (int historyIndex = 0; historyIndex < historySize; historyIndex++) {
+        // NB: unlike MotionEvent.getHistoricalEventTime() this isn't
+        // truncated to milliseconds
+        out_event->historicalEventTimesNanos[historyIndex] =
+            AMotionEvent_getHistoricalEventTime(event, historyIndex);
+        out_event->historicalEventTimesMillis[historyIndex] =
+            out_event->historicalEventTimesNanos[historyIndex] / 1000000;
+        for (int i = 0; i < pointerCount; ++i) {
+            for (int a = 0; a < axisCount; ++a) {
+                *axisValues++ = AMotionEvent_getHistoricalAxisValue(
+                    event, axes[a], i, historyIndex);
+            }
+        }
+    }
+
+    out_event->deviceId = AInputEvent_getDeviceId(event);
+    out_event->source = AInputEvent_getSource(event);
+    out_event->action = AMotionEvent_getAction(event);
+    out_event->eventTime = AMotionEvent_getEventTime(event);
+    out_event->downTime = AMotionEvent_getDownTime(event);
+    out_event->flags = AMotionEvent_getFlags(event);
+    out_event->metaState = AMotionEvent_getMetaState(event);
+    if (gMotionEventNativeInfo.getActionButton) {
+        out_event->actionButton = gMotionEventNativeInfo.getActionButton(event);
+    } else {
+        out_event->actionButton =
+            gMotionEventClassInfo.getActionButton
+                ? env->CallIntMethod(motionEvent,
+                                     gMotionEventClassInfo.getActionButton)
+                : 0;
+    }
+    out_event->buttonState = AMotionEvent_getButtonState(event);
+    if (gMotionEventNativeInfo.getClassification) {
+        out_event->classification =
+            gMotionEventNativeInfo.getClassification(event);
+    } else {
+        out_event->classification =
+            gMotionEventClassInfo.getClassification
+                ? env->CallIntMethod(motionEvent,
+                                     gMotionEventClassInfo.getClassification)
+                : 0;
+    }
+    out_event->edgeFlags = AMotionEvent_getEdgeFlags(event);
+    out_event->precisionX = AMotionEvent_getXPrecision(event);
+    out_event->precisionY = AMotionEvent_getYPrecision(event);
+}
+
+static void loadMotionEventClassInfo(gamesdk::InstrumentedJNIEnv env) {
     static bool gMotionEventClassInfoInitialized = false;
     if (!gMotionEventClassInfoInitialized) {
         int sdkVersion = GetSystemPropAsInt("ro.build.version.sdk");
+        loadMotionEventNativeInfo(sdkVersion);
         gMotionEventClassInfo = {0};
         jclass motionEventClass = env->FindClass("android/view/MotionEvent");
         gMotionEventClassInfo.getDeviceId =
@@ -220,6 +457,31 @@ extern "C" void GameActivityMotionEvent_fromJava(
             motionEventClass, "getHistoricalAxisValue", "(III)F");
         gMotionEventClassInfoInitialized = true;
     }
+}
+
+static void motionEventFromJava(gamesdk::InstrumentedJNIEnv env,
+                                jobject motionEvent,
+                                GameActivityMotionEvent *out_event,
+                                std::vector<int64_t> *history) {
+    loadMotionEventClassInfo(env);
+
+    if (gMotionEventNativeInfo.fromJava) {
+        const AInputEvent *event =
+            gMotionEventNativeInfo.fromJava(env.get(), motionEvent);
+        if (event != nullptr) {
+            motionEventFromNative(env, motionEvent, event, out_event, history,
+                                  /*decodeAxes=*/true);
+            gMotionEventNativeInfo.release(event);
+            return;
+        }
+    }
+
+    // Fallback: query each field via its MotionEvent Java method
+
+    int32_t axes[GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT];
+    int axisCount = getEnabledAxes(axes, &out_event->historicalAxisMask);
+    out_event->pointerArrays = {};
+    out_event->deferredEvent = nullptr;
 
     int pointerCount =
         env->CallIntMethod(motionEvent, gMotionEventClassInfo.getPointerCount);
@@ -244,26 +506,18 @@ extern "C" void GameActivityMotionEvent_fromJava(
                 : 0,
         };
 
-        for (int axisIndex = 0;
-             axisIndex < GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT; ++axisIndex) {
-            if (enabledAxes[axisIndex]) {
-                out_event->pointers[i].axisValues[axisIndex] =
-                    env->CallFloatMethod(motionEvent,
-                                         gMotionEventClassInfo.getAxisValue,
-                                         axisIndex, i);
-            }
+        for (int a = 0; a < axisCount; ++a) {
+            out_event->pointers[i].axisValues[axes[a]] = env->CallFloatMethod(
+                motionEvent, gMotionEventClassInfo.getAxisValue, axes[a], i);
         }
     }
 
     int historySize =
         env->CallIntMethod(motionEvent, gMotionEventClassInfo.getHistorySize);
-    out_event->historySize = historySize;
-    out_event->historicalAxisValues =
-        new float[historySize * pointerCount *
-                  GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT];
-    out_event->historicalEventTimesMillis = new int64_t[historySize];
-    out_event->historicalEventTimesNanos = new int64_t[historySize];
+    allocateMotionEventHistory(out_event, historySize, pointerCount, axisCount,
+                               history);
 
+    float *axisValues = out_event->historicalAxisValues;
     for (int historyIndex = 0; historyIndex < historySize; historyIndex++) {
         out_event->historicalEventTimesMillis[historyIndex] =
             env->CallLongMethod(motionEvent,
@@ -272,21 +526,10 @@ extern "C" void GameActivityMotionEvent_fromJava(
         out_event->historicalEventTimesNanos[historyIndex] =
             out_event->historicalEventTimesMillis[historyIndex] * 1000000;
         for (int i = 0; i < pointerCount; ++i) {
-            int pointerOffset = i * GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT;
-            int historyAxisOffset = historyIndex * pointerCount *
-                                    GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT;
-            float *axisValues =
-                &out_event
-                     ->historicalAxisValues[historyAxisOffset + pointerOffset];
-            for (int axisIndex = 0;
-                 axisIndex < GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT;
-                 ++axisIndex) {
-                if (enabledAxes[axisIndex]) {
-                    axisValues[axisIndex] = env->CallFloatMethod(
-                        motionEvent,
-                        gMotionEventClassInfo.getHistoricalAxisValue, axisIndex,
-                        i, historyIndex);
-                }
+            for (int a = 0; a < axisCount; ++a) {
+                *axisValues++ = env->CallFloatMethod(
+                    motionEvent, gMotionEventClassInfo.getHistoricalAxisValue,
+                    axes[a], i, historyIndex);
             }
         }
     }
@@ -330,6 +573,47 @@ extern "C" void GameActivityMotionEvent_fromJava(
         env->CallFloatMethod(motionEvent, gMotionEventClassInfo.getYPrecision);
 }
 
+extern "C" void GameActivityMotionEvent_fromJava(
+    JNIEnv *env, jobject motionEvent, GameActivityMotionEvent *out_event) {
+    motionEventFromJava(gamesdk::InstrumentedJNIEnv(env), motionEvent,
+                        out_event, nullptr);
+}
+
+void GameActivityMotionEvent_fromJava(JNIEnv *env, jobject motionEvent,
+                                      GameActivityMotionEvent *out_event,
+                                      std::vector<int64_t> *history) {
+    motionEventFromJava(gamesdk::InstrumentedJNIEnv(env), motionEvent,
+                        out_event, history);
+}
+
+extern "C" bool GameActivityMotionEvent_fromJavaDeferred(
+    JNIEnv *jniEnv, jobject motionEvent, GameActivityMotionEvent *out_event) {
+    gamesdk::InstrumentedJNIEnv env(jniEnv);
+    loadMotionEventClassInfo(env);
+    if (!gMotionEventNativeInfo.fromJava) {
+        return false;
+    }
+
+    const AInputEvent *event =
+        gMotionEventNativeInfo.fromJava(env.get(), motionEvent);
+    if (event == nullptr) {
+        return false;
+    }
+    motionEventFromNative(env, motionEvent, event, out_event, nullptr,
+                          /*decodeAxes=*/false);
+    out_event->deferredEvent = event;
+    return true;
+}
+
+extern "C" void GameActivityMotionEvent_releaseDeferred(
+    const GameActivityMotionEvent *event) {
+    // NB: gMotionEventNativeInfo was loaded before the event was captured, and
+    // the event was published to this thread after that.
+    if (event->deferredEvent != nullptr) {
+        gMotionEventNativeInfo.release(event->deferredEvent);
+    }
+}
+
 static struct {
     jmethodID getDeviceId;
     jmethodID getSource;
@@ -348,8 +632,7 @@ static struct {
     //jmethodID getUnicodeChar;
 } gKeyEventClassInfo;
 
-extern "C" void GameActivityKeyEvent_fromJava(JNIEnv *env, jobject keyEvent,
-                                              GameActivityKeyEvent *out_event) {
+static void loadKeyEventClassInfo(gamesdk::InstrumentedJNIEnv env) {
     static bool gKeyEventClassInfoInitialized = false;
     if (!gKeyEventClassInfoInitialized) {
         int sdkVersion = GetSystemPropAsInt("ro.build.version.sdk");
@@ -384,6 +667,12 @@ extern "C" void GameActivityKeyEvent_fromJava(JNIEnv *env, jobject keyEvent,
 
         gKeyEventClassInfoInitialized = true;
     }
+}
+
+extern "C" void GameActivityKeyEvent_fromJava(JNIEnv *jniEnv, jobject keyEvent,
+                                              GameActivityKeyEvent *out_event) {
+    gamesdk::InstrumentedJNIEnv env(jniEnv);
+    loadKeyEventClassInfo(env);
 
     *out_event = {
         /*deviceId=*/env->CallIntMethod(keyEvent,
@@ -412,3 +701,83 @@ extern "C" void GameActivityKeyEvent_fromJava(JNIEnv *env, jobject keyEvent,
         //env->CallIntMethod(keyEvent, gKeyEventClassInfo.getUnicodeChar)
     };
 }
+
+static bool inputFilterAcceptsDevice(const GameActivityInputFilter *filter,
+                                     int32_t deviceId) {
+    uint32_t count = std::min<uint32_t>(filter->deviceIdCount,
+                                        GAMEACTIVITY_INPUT_FILTER_MAX_DEVICES);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (filter->deviceIds[i] == deviceId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+extern "C" bool GameActivityInputFilter_acceptsMotionEvent(
+    const GameActivityInputFilter *filter, JNIEnv *jniEnv,
+    jobject motionEvent) {
+    gamesdk::InstrumentedJNIEnv env(jniEnv);
+    loadMotionEventClassInfo(env);
+
+    if (filter->motionSourceMask != UINT32_MAX) {
+        uint32_t source =
+            env->CallIntMethod(motionEvent, gMotionEventClassInfo.getSource);
+        if (source & ~filter->motionSourceMask) {
+            return false;
+        }
+    }
+    if (filter->motionActionMask != UINT32_MAX) {
+        int32_t action =
+            env->CallIntMethod(motionEvent, gMotionEventClassInfo.getAction) &
+            AMOTION_EVENT_ACTION_MASK;
+        if (action >= 32 || !(filter->motionActionMask & (1u << action))) {
+            return false;
+        }
+    }
+    if (filter->deviceIdCount > 0) {
+        int32_t deviceId =
+            env->CallIntMethod(motionEvent, gMotionEventClassInfo.getDeviceId);
+        if (!inputFilterAcceptsDevice(filter, deviceId)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+extern "C" bool GameActivityInputFilter_acceptsKeyEvent(
+    const GameActivityInputFilter *filter, JNIEnv *jniEnv, jobject keyEvent) {
+    gamesdk::InstrumentedJNIEnv env(jniEnv);
+    loadKeyEventClassInfo(env);
+
+    if (filter->keySourceMask != UINT32_MAX) {
+        uint32_t source =
+            env->CallIntMethod(keyEvent, gKeyEventClassInfo.getSource);
+        if (source & ~filter->keySourceMask) {
+            return false;
+        }
+    }
+
+    bool allKeyCodes = true;
+    for (uint64_t word : filter->keyCodes) {
+        allKeyCodes = allKeyCodes && word == UINT64_MAX;
+    }
+    if (!allKeyCodes) {
+        int32_t keyCode =
+            env->CallIntMethod(keyEvent, gKeyEventClassInfo.getKeyCode);
+        if (keyCode >= 0 && keyCode < GAMEACTIVITY_INPUT_FILTER_KEYCODE_COUNT) {
+            uint64_t bit = UINT64_C(1) << (keyCode % 64);
+            if (!(filter->keyCodes[keyCode / 64] & bit)) {
+                return false;
+            }
+        }
+    }
+    if (filter->deviceIdCount > 0) {
+        int32_t deviceId =
+            env->CallIntMethod(keyEvent, gKeyEventClassInfo.getDeviceId);
+        if (!inputFilterAcceptsDevice(filter, deviceId)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -176,6 +176,25 @@ inline float GameActivityPointerAxes_getOrientation(
 #define GAMEACTIVITY_MAX_NUM_POINTERS_IN_MOTION_EVENT 8
 #endif
 
+/**
+ * \brief Structure-of-arrays storage for the pointers of a
+ * GameActivityMotionEvent.
+ *
+ * Each array holds `pointerCount` elements, except `axisValues` which holds
+ * `pointerCount` values for each axis in `historicalAxisMask`, in ascending
+ * axis order. This way the values of an axis (such as X) are contiguous for
+ * all the pointers of the event.
+ *
+ * \see GameActivityMotionEvent
+ */
+typedef struct GameActivityPointerArrays {
+    int32_t* ids;
+    int32_t* toolTypes;
+    float* rawX;
+    float* rawY;
+    float* axisValues;
+} GameActivityPointerArrays;
+
 /**
  * \brief Describe a motion event that happened on the GameActivity SurfaceView.
  *
@@ -209,14 +228,75 @@ typedef struct GameActivityMotionEvent {
 
     float precisionX;
     float precisionY;
+
+    /**
+     * Bitmask (`1 << axis`) of the axes that were enabled when the event was
+     * received.
+     *
+     * To avoid storing values for axes that aren't enabled,
+     * `historicalAxisValues` only holds values for these axes, in ascending
+     * axis order, for each pointer of each historical sample. Use
+     * GameActivityMotionEvent_getHistoricalAxisValue to look up a value.
+     */
+    uint64_t historicalAxisMask;
+
+    /**
+     * If `pointerArrays.ids` is not NULL then the pointers are stored in
+     * `pointerArrays`, instead of `pointers`, which is left uninitialized.
+     *
+     * This compact layout is only used for events that have been copied by
+     * code that has opted in to it, such as the native app glue.
+     * GameActivityMotionEvent_getPointerAxisValue supports both layouts.
+     */
+    GameActivityPointerArrays pointerArrays;
+
+    /**
+     * If not NULL then the event was captured without decoding its axis
+     * values, raw coordinates or history, which can instead be read on demand
+     * from this native copy of the Java `MotionEvent`, with the NDK
+     * `AMotionEvent_*` accessors. In this case `historySize` is 0 and the
+     * `rawX`, `rawY` and `axisValues` of the pointers are left unset.
+     *
+     * GameActivityMotionEvent_getPointerAxisValue,
+     * GameActivityMotionEvent_getHistorySize and
+     * GameActivityMotionEvent_getHistoricalAxisValue support both forms.
+     *
+     * The event must be released with GameActivityMotionEvent_releaseDeferred
+     * by its owner.
+     *
+     * \see GameActivityMotionEvent_fromJavaDeferred
+     */
+    const AInputEvent* deferredEvent;
 } GameActivityMotionEvent;
 
+/**
+ * \brief Get the value of the requested axis for the given pointer, whether
+ * the event stores its pointers in `pointers` or `pointerArrays`.
+ *
+ * @return The value of the axis, or 0 if the axis is invalid or was not
+ * enabled.
+ */
+float GameActivityMotionEvent_getPointerAxisValue(
+    const GameActivityMotionEvent* event, int axis, int pointerIndex);
+
 float GameActivityMotionEvent_getHistoricalAxisValue(
     const GameActivityMotionEvent* event, int axis, int pointerIndex,
     int historyPos);
 
+/**
+ * \brief Get the number of axis values stored in `historicalAxisValues` for
+ * each pointer of each historical sample.
+ */
+inline int GameActivityMotionEvent_getHistoricalAxisCount(
+    const GameActivityMotionEvent* event) {
+    return __builtin_popcountll(event->historicalAxisMask);
+}
+
 inline int GameActivityMotionEvent_getHistorySize(
     const GameActivityMotionEvent* event) {
+    if (event->deferredEvent != NULL) {
+        return (int)AMotionEvent_getHistorySize(event->deferredEvent);
+    }
     return event->historySize;
 }
 
@@ -289,6 +369,35 @@ void GameActivityMotionEvent_destroy(GameActivityMotionEvent* c_event);
 void GameActivityMotionEvent_fromJava(JNIEnv* env, jobject motionEvent,
                                       GameActivityMotionEvent* out_event);
 
+/**
+ * \brief Capture a Java `MotionEvent` as a `GameActivityMotionEvent` without
+ * decoding its axis values, raw coordinates or history.
+ *
+ * Only the event's scalar state and its pointer ids and tool types are
+ * decoded. The rest of the event is kept in a native copy of the
+ * `MotionEvent`, in `out_event->deferredEvent`, so that it can be decoded
+ * later, on any thread, only if it's needed.
+ *
+ * This relies on `AMotionEvent_fromJava`, which is only available from
+ * API 31. Returns false, without touching `out_event`, if the event can't be
+ * captured this way, in which case GameActivityMotionEvent_fromJava can be
+ * used instead.
+ *
+ * `out_event->deferredEvent` must be released with
+ * GameActivityMotionEvent_releaseDeferred.
+ */
+bool GameActivityMotionEvent_fromJavaDeferred(
+    JNIEnv* env, jobject motionEvent, GameActivityMotionEvent* out_event);
+
+/**
+ * \brief Release the native `MotionEvent` copy of an event that was captured
+ * with GameActivityMotionEvent_fromJavaDeferred, if any.
+ *
+ * The event's `deferredEvent` must not be used afterwards.
+ */
+void GameActivityMotionEvent_releaseDeferred(
+    const GameActivityMotionEvent* event);
+
 /**
  * \brief Describe a key event that happened on the GameActivity SurfaceView.
  *
@@ -327,8 +436,113 @@ typedef struct GameActivityKeyEvent {
 void GameActivityKeyEvent_fromJava(JNIEnv* env, jobject motionEvent,
                                    GameActivityKeyEvent* out_event);
 
+/**
+ * The number of keycodes covered by `GameActivityInputFilter::keyCodes`.
+ */
+#define GAMEACTIVITY_INPUT_FILTER_KEYCODE_COUNT 512
+
+/**
+ * The maximum number of devices in `GameActivityInputFilter::deviceIds`.
+ */
+#define GAMEACTIVITY_INPUT_FILTER_MAX_DEVICES 8
+
+/**
+ * \brief A declarative filter for the input events of a GameActivity.
+ *
+ * Unlike a filter callback, this can be checked with a few JNI calls on the
+ * Java event, before it's converted to a GameActivityMotionEvent or
+ * GameActivityKeyEvent, so rejected events are never converted.
+ *
+ * Use GameActivityInputFilter_init to start from a filter that accepts all
+ * events.
+ *
+ * \see GameActivity_setInputFilter
+ */
+typedef struct GameActivityInputFilter {
+    /**
+     * The `AINPUT_SOURCE_*` bits that motion events may have. A motion event
+     * is rejected if its source has any bits that aren't in this mask.
+     */
+    uint32_t motionSourceMask;
+
+    /**
+     * Bitmask (`1 << (action & AMOTION_EVENT_ACTION_MASK)`) of the motion
+     * actions that are accepted.
+     */
+    uint32_t motionActionMask;
+
+    /**
+     * The `AINPUT_SOURCE_*` bits that key events may have. A key event is
+     * rejected if its source has any bits that aren't in this mask.
+     */
+    uint32_t keySourceMask;
+
+    /**
+     * Bitset (bit `keyCode % 64` of word `keyCode / 64`) of the key codes that
+     * are accepted. Key codes beyond GAMEACTIVITY_INPUT_FILTER_KEYCODE_COUNT
+     * are always accepted.
+     */
+    uint64_t keyCodes[GAMEACTIVITY_INPUT_FILTER_KEYCODE_COUNT / 64];
+
+    /**
+     * If not 0, only events from the first `deviceIdCount` devices in
+     * `deviceIds` are accepted.
+     */
+    uint32_t deviceIdCount;
+    int32_t deviceIds[GAMEACTIVITY_INPUT_FILTER_MAX_DEVICES];
+} GameActivityInputFilter;
+
+/**
+ * \brief Initialize `filter` to accept all events.
+ */
+inline void GameActivityInputFilter_init(GameActivityInputFilter* filter) {
+    filter->motionSourceMask = UINT32_MAX;
+    filter->motionActionMask = UINT32_MAX;
+    filter->keySourceMask = UINT32_MAX;
+    for (int i = 0; i < GAMEACTIVITY_INPUT_FILTER_KEYCODE_COUNT / 64; i++) {
+        filter->keyCodes[i] = UINT64_MAX;
+    }
+    filter->deviceIdCount = 0;
+}
+
+/**
+ * \brief Check whether a Java `MotionEvent` is accepted by `filter`, without
+ * converting it.
+ *
+ * This only makes the JNI calls needed by the parts of the filter that can
+ * reject events.
+ */
+bool GameActivityInputFilter_acceptsMotionEvent(
+    const GameActivityInputFilter* filter, JNIEnv* env, jobject motionEvent);
+
+/**
+ * \brief Check whether a Java `KeyEvent` is accepted by `filter`, without
+ * converting it.
+ *
+ * This only makes the JNI calls needed by the parts of the filter that can
+ * reject events.
+ */
+bool GameActivityInputFilter_acceptsKeyEvent(
+    const GameActivityInputFilter* filter, JNIEnv* env, jobject keyEvent);
+
 #ifdef __cplusplus
 }
+
+#include <vector>
+
+/**
+ * \brief Convert a Java `MotionEvent` to a `GameActivityMotionEvent`, storing
+ * its historical samples in `history`.
+ *
+ * `history` is only ever grown, so converting a stream of events doesn't
+ * allocate once it has grown to fit the largest event.
+ * The historical arrays of `out_event` point into `history` and are only valid
+ * until the next conversion into the same storage: `out_event` must not be
+ * passed to GameActivityMotionEvent_destroy.
+ */
+void GameActivityMotionEvent_fromJava(JNIEnv* env, jobject motionEvent,
+                                      GameActivityMotionEvent* out_event,
+                                      std::vector<int64_t>* history);
 #endif
 
 /** @} */
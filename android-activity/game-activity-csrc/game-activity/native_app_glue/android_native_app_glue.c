@@ -22,11 +22,17 @@
 #include <jni.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <time.h>
 #include <unistd.h>
 
-#define NATIVE_APP_GLUE_MOTION_EVENTS_DEFAULT_BUF_SIZE 16
-#define NATIVE_APP_GLUE_KEY_EVENTS_DEFAULT_BUF_SIZE 4
+// NB: the sizes of the input rings must be powers of two
+#define NATIVE_APP_GLUE_MOTION_EVENTS_RING_SIZE 128
+#define NATIVE_APP_GLUE_KEY_EVENTS_RING_SIZE 64
+#define NATIVE_APP_GLUE_MOTION_EVENT_STORAGE_MIN_SIZE 256
+#define NATIVE_APP_GLUE_MOTION_COALESCE_MAX_HISTORY 128
+#define NATIVE_APP_GLUE_CMD_COUNT (APP_CMD_WINDOW_INSETS_CHANGED + 1)
+#define NATIVE_APP_GLUE_CMD_POOL_SIZE 32
 
 #define LOGI(...) \
     ((void)__android_log_print(ANDROID_LOG_INFO, "threaded_app", __VA_ARGS__))
@@ -52,6 +58,146 @@
 #define LOGV(...) ((void)0)
 #endif
 
+struct android_motion_event_storage {
+    uint8_t* data;
+    uint64_t size;
+};
+
+struct android_app_cmd_node {
+    struct android_app_cmd_node* next;
+    struct android_app_cmd_record record;
+    int64_t writeNanos;
+    // The index of the next node in the pool's free list, while this node is
+    // free, accessed atomically.
+    uint32_t nextFree;
+};
+
+// Preallocated command nodes, so that writing a command doesn't allocate unless
+// more commands than this are queued at once.
+//
+// The free nodes form a lock-free stack, which producers pop from and the app
+// thread pushes to. `freeList` holds the index of the top node in its low 32
+// bits (or NATIVE_APP_GLUE_CMD_POOL_SIZE if there are none) and a count of its
+// updates in its high 32 bits, so that a producer doesn't pop with a stale
+// `nextFree` if the top node was popped and pushed again in the meantime.
+struct android_app_cmd_pool {
+    struct android_app_cmd_node nodes[NATIVE_APP_GLUE_CMD_POOL_SIZE];
+    uint64_t freeList;
+    // The number of nodes that were allocated because the pool was empty
+    uint64_t allocations;
+};
+
+struct android_app_cmd_stats {
+    // Each histogram is only updated by one thread (the app thread, or the
+    // main thread for the UNBLOCK and WAIT stages) but may be read by any
+    // thread, so its members are accessed atomically.
+    struct android_app_latency_histogram
+        latency[NATIVE_APP_GLUE_CMD_COUNT][APP_CMD_STAGE_COUNT];
+
+    // The timestamps of the command that the app thread is handling, which
+    // are only accessed by the app thread.
+    int32_t cmd;
+    int64_t writeNanos;
+    int64_t preExecNanos;
+
+    // When the app thread last acknowledged a command that the main thread may
+    // be waiting for, accessed with android_app->mutex held.
+    int64_t ackNanos;
+
+    // The command that the main thread is waiting for, or -1, and when it
+    // wrote it, accessed with android_app->mutex held.
+    int32_t waitCmd;
+    int64_t waitNanos;
+};
+
+static int64_t monotonicNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void recordCmdLatency(struct android_app* android_app, int32_t cmd,
+                             int stage, int64_t nanos) {
+    if (cmd < 0 || cmd >= NATIVE_APP_GLUE_CMD_COUNT) return;
+    struct android_app_latency_histogram* hist =
+        &android_app->cmdStats->latency[cmd][stage];
+    uint64_t latency = nanos > 0 ? (uint64_t)nanos : 0;
+    uint64_t micros = latency / 1000;
+    int bucket = micros == 0 ? 0 : 64 - __builtin_clzll(micros);
+    if (bucket >= NATIVE_APP_GLUE_LATENCY_BUCKETS) {
+        bucket = NATIVE_APP_GLUE_LATENCY_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->totalNanos, latency, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->buckets[bucket], 1, __ATOMIC_RELAXED);
+    if (latency > __atomic_load_n(&hist->maxNanos, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&hist->maxNanos, latency, __ATOMIC_RELAXED);
+    }
+}
+
+// NB: must be called with android_app->mutex held
+static void ackCmd(struct android_app* android_app) {
+    android_app->cmdStats->ackNanos = monotonicNanos();
+    pthread_cond_broadcast(&android_app->cond);
+}
+
+// Note that the main thread is about to wait for `cmd`, which it wrote at
+// `startNanos`, see android_app_get_pending_cmd().
+//
+// NB: must be called with android_app->mutex held
+static void beginCmdWait(struct android_app* android_app, int32_t cmd,
+                         int64_t startNanos) {
+    android_app->cmdStats->waitCmd = cmd;
+    android_app->cmdStats->waitNanos = startNanos;
+}
+
+// Record how long the main thread waited for `cmd`, which it wrote at
+// `startNanos`.
+//
+// NB: must be called with android_app->mutex held
+static void recordCmdWait(struct android_app* android_app, int32_t cmd,
+                          int64_t startNanos) {
+    android_app->cmdStats->waitCmd = -1;
+    int64_t now = monotonicNanos();
+    int64_t ackNanos = android_app->cmdStats->ackNanos;
+    if (ackNanos >= startNanos) {
+        recordCmdLatency(android_app, cmd, APP_CMD_STAGE_UNBLOCK,
+                         now - ackNanos);
+    }
+    recordCmdLatency(android_app, cmd, APP_CMD_STAGE_WAIT, now - startNanos);
+}
+
+bool android_app_get_pending_cmd(struct android_app* app, int32_t* outCmd,
+                                 int64_t* outWaitedNanos) {
+    pthread_mutex_lock(&app->mutex);
+    bool pending = app->cmdStats->waitCmd >= 0;
+    if (pending) {
+        *outCmd = app->cmdStats->waitCmd;
+        *outWaitedNanos = monotonicNanos() - app->cmdStats->waitNanos;
+    }
+    pthread_mutex_unlock(&app->mutex);
+    return pending;
+}
+
+bool android_app_get_cmd_latency(
+    struct android_app* app, int32_t cmd, int32_t stage,
+    struct android_app_latency_histogram* outHist) {
+    if (cmd < 0 || cmd >= NATIVE_APP_GLUE_CMD_COUNT || stage < 0 ||
+        stage >= APP_CMD_STAGE_COUNT) {
+        return false;
+    }
+    const struct android_app_latency_histogram* hist =
+        &app->cmdStats->latency[cmd][stage];
+    outHist->count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+    outHist->totalNanos = __atomic_load_n(&hist->totalNanos, __ATOMIC_RELAXED);
+    outHist->maxNanos = __atomic_load_n(&hist->maxNanos, __ATOMIC_RELAXED);
+    for (int i = 0; i < NATIVE_APP_GLUE_LATENCY_BUCKETS; i++) {
+        outHist->buckets[i] =
+            __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
 static void free_saved_state(struct android_app* android_app) {
     pthread_mutex_lock(&android_app->mutex);
     if (android_app->savedState != NULL) {
@@ -62,14 +208,144 @@ static void free_saved_state(struct android_app* android_app) {
     pthread_mutex_unlock(&android_app->mutex);
 }
 
+static uint64_t cmdPoolNextTop(uint64_t top, uint32_t index) {
+    return ((top & ~(uint64_t)UINT32_MAX) + ((uint64_t)1 << 32)) | index;
+}
+
+// Returns a node for a command from the pool, or allocates one if the pool is
+// empty.
+//
+// NB: may be called by any producer, as well as by android_app_create for the
+// initial stub node
+static struct android_app_cmd_node* cmdNodeAlloc(
+    struct android_app* android_app) {
+    struct android_app_cmd_pool* pool = android_app->cmdPool;
+    uint64_t top = __atomic_load_n(&pool->freeList, __ATOMIC_ACQUIRE);
+    for (;;) {
+        uint32_t index = (uint32_t)top;
+        if (index == NATIVE_APP_GLUE_CMD_POOL_SIZE) {
+            __atomic_fetch_add(&pool->allocations, 1, __ATOMIC_RELAXED);
+            return (struct android_app_cmd_node*)malloc(
+                sizeof(struct android_app_cmd_node));
+        }
+        uint32_t next =
+            __atomic_load_n(&pool->nodes[index].nextFree, __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&pool->freeList, &top,
+                                        cmdPoolNextTop(top, next), true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            return &pool->nodes[index];
+        }
+    }
+}
+
+// Returns a node to the pool, or frees it if it was allocated.
+//
+// NB: must only be called by the app thread, once the node has been popped
+static void cmdNodeFree(struct android_app* android_app,
+                        struct android_app_cmd_node* node) {
+    struct android_app_cmd_pool* pool = android_app->cmdPool;
+    uintptr_t offset = (uintptr_t)node - (uintptr_t)pool->nodes;
+    if (offset >= sizeof(pool->nodes)) {
+        free(node);
+        return;
+    }
+    uint32_t index = (uint32_t)(offset / sizeof(struct android_app_cmd_node));
+    uint64_t top = __atomic_load_n(&pool->freeList, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(&node->nextFree, (uint32_t)top, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&pool->freeList, &top,
+                                          cmdPoolNextTop(top, index), true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Sets up the command queue, with a stub node from the pool. Returns false if
+// it can't be allocated.
+static bool cmdQueueInit(struct android_app* android_app) {
+    struct android_app_cmd_pool* pool = (struct android_app_cmd_pool*)calloc(
+        1, sizeof(struct android_app_cmd_pool));
+    struct android_app_cmd_stats* stats = (struct android_app_cmd_stats*)calloc(
+        1, sizeof(struct android_app_cmd_stats));
+    if (pool == NULL || stats == NULL) {
+        free(pool);
+        free(stats);
+        return false;
+    }
+    for (uint32_t i = 0; i < NATIVE_APP_GLUE_CMD_POOL_SIZE; i++) {
+        pool->nodes[i].nextFree = i + 1;
+    }
+    android_app->cmdPool = pool;
+
+    struct android_app_cmd_node* stub = cmdNodeAlloc(android_app);
+    stub->next = NULL;
+    android_app->cmdQueueHead = stub;
+    android_app->cmdQueueTail = stub;
+    android_app->cmdStats = stats;
+    stats->cmd = -1;
+    stats->waitCmd = -1;
+    return true;
+}
+
+// NB: must only be called by the app thread, which is the single consumer of
+// the command queue
+static bool cmdQueuePop(struct android_app* android_app,
+                        struct android_app_cmd_record* record) {
+    struct android_app_cmd_node* tail = android_app->cmdQueueTail;
+    struct android_app_cmd_node* next =
+        __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next == NULL) {
+        // Empty, or a producer hasn't finished linking its command yet, in
+        // which case it will signal the eventfd once it has.
+        return false;
+    }
+    // `next` becomes the new stub node, once its record has been read
+    *record = next->record;
+    android_app->cmdStats->cmd = record->cmd;
+    android_app->cmdStats->writeNanos = next->writeNanos;
+    android_app->cmdQueueTail = next;
+    cmdNodeFree(android_app, tail);
+    return true;
+}
+
+bool android_app_read_cmd_record(struct android_app* android_app,
+                                 struct android_app_cmd_record* record) {
+    if (!cmdQueuePop(android_app, record)) {
+        // The queue looks empty, so clear the wake up flag and eventfd before
+        // checking again. A command that's pushed concurrently will either be
+        // seen by this second check or signal a new wake up.
+        //
+        // NB: this is sequentially consistent with producers setting the flag
+        // after pushing their command.
+        (void)__atomic_exchange_n(&android_app->cmdWakePending, false,
+                                  __ATOMIC_SEQ_CST);
+        uint64_t count;
+        if (read(android_app->cmdEventFd, &count, sizeof(count)) < 0 &&
+            errno != EAGAIN) {
+            LOGE("Failure reading android_app cmd eventfd: %s",
+                 strerror(errno));
+        }
+        if (!cmdQueuePop(android_app, record)) {
+            return false;
+        }
+    }
+    recordCmdLatency(android_app, record->cmd, APP_CMD_STAGE_QUEUED,
+                     monotonicNanos() - android_app->cmdStats->writeNanos);
+    if (record->cmd == APP_CMD_SAVE_STATE) free_saved_state(android_app);
+    if (record->cmd == APP_CMD_INIT_WINDOW) {
+        // NB: a window that was read but never pre-processed is replaced
+        if (android_app->handoffWindow != NULL) {
+            ANativeWindow_release(android_app->handoffWindow);
+        }
+        android_app->handoffWindow = record->window;
+    }
+    return true;
+}
+
 int8_t android_app_read_cmd(struct android_app* android_app) {
-    int8_t cmd;
-    if (read(android_app->msgread, &cmd, sizeof(cmd)) != sizeof(cmd)) {
-        LOGE("No data on command pipe!");
+    struct android_app_cmd_record record;
+    if (!android_app_read_cmd_record(android_app, &record)) {
         return -1;
     }
-    if (cmd == APP_CMD_SAVE_STATE) free_saved_state(android_app);
-    return cmd;
+    return record.cmd;
 }
 
 static void print_cur_config(struct android_app* android_app) {
@@ -99,6 +375,7 @@ static void print_cur_config(struct android_app* android_app) {
 }
 
 void android_app_pre_exec_cmd(struct android_app* android_app, int8_t cmd) {
+    int64_t startNanos = monotonicNanos();
     switch (cmd) {
         case UNUSED_APP_CMD_INPUT_CHANGED:
             LOGV("UNUSED_APP_CMD_INPUT_CHANGED");
@@ -109,8 +386,24 @@ void android_app_pre_exec_cmd(struct android_app* android_app, int8_t cmd) {
         case APP_CMD_INIT_WINDOW:
             LOGV("APP_CMD_INIT_WINDOW");
             pthread_mutex_lock(&android_app->mutex);
-            android_app->window = android_app->pendingWindow;
-            pthread_cond_broadcast(&android_app->cond);
+            if (android_app->handoffWindow != NULL) {
+                // Handed over in non-blocking mode, with a reference that's
+                // now owned by `window`
+                android_app->window = android_app->handoffWindow;
+                android_app->windowAcquired = true;
+                android_app->handoffWindow = NULL;
+            } else {
+                android_app->window = android_app->pendingWindow;
+                // The main thread may no longer be waiting for this, after
+                // switching to non-blocking mode
+                android_app->windowAcquired =
+                    android_app->nonBlockingLifecycle &&
+                    android_app->window != NULL;
+                if (android_app->windowAcquired) {
+                    ANativeWindow_acquire(android_app->window);
+                }
+            }
+            ackCmd(android_app);
             pthread_mutex_unlock(&android_app->mutex);
             break;
 
@@ -126,7 +419,7 @@ void android_app_pre_exec_cmd(struct android_app* android_app, int8_t cmd) {
             LOGV("activityState=%d", cmd);
             pthread_mutex_lock(&android_app->mutex);
             android_app->activityState = cmd;
-            pthread_cond_broadcast(&android_app->cond);
+            ackCmd(android_app);
             pthread_mutex_unlock(&android_app->mutex);
             break;
 
@@ -142,15 +435,29 @@ void android_app_pre_exec_cmd(struct android_app* android_app, int8_t cmd) {
             android_app->destroyRequested = 1;
             break;
     }
+    int64_t endNanos = monotonicNanos();
+    recordCmdLatency(android_app, cmd, APP_CMD_STAGE_PRE_EXEC,
+                     endNanos - startNanos);
+    android_app->cmdStats->preExecNanos = endNanos;
 }
 
 void android_app_post_exec_cmd(struct android_app* android_app, int8_t cmd) {
+    int64_t startNanos = monotonicNanos();
+    if (android_app->cmdStats->cmd == cmd) {
+        recordCmdLatency(android_app, cmd, APP_CMD_STAGE_CALLBACK,
+                         startNanos - android_app->cmdStats->preExecNanos);
+    }
     switch (cmd) {
         case APP_CMD_TERM_WINDOW:
             LOGV("APP_CMD_TERM_WINDOW");
             pthread_mutex_lock(&android_app->mutex);
+            if (android_app->windowAcquired) {
+                ANativeWindow_release(android_app->window);
+                android_app->windowAcquired = false;
+            }
             android_app->window = NULL;
-            pthread_cond_broadcast(&android_app->cond);
+            android_app->windowTermsHandled++;
+            ackCmd(android_app);
             pthread_mutex_unlock(&android_app->mutex);
             break;
 
@@ -158,7 +465,8 @@ void android_app_post_exec_cmd(struct android_app* android_app, int8_t cmd) {
             LOGV("APP_CMD_SAVE_STATE");
             pthread_mutex_lock(&android_app->mutex);
             android_app->stateSaved = 1;
-            pthread_cond_broadcast(&android_app->cond);
+            android_app->stateSavesHandled++;
+            ackCmd(android_app);
             pthread_mutex_unlock(&android_app->mutex);
             break;
 
@@ -166,6 +474,8 @@ void android_app_post_exec_cmd(struct android_app* android_app, int8_t cmd) {
             free_saved_state(android_app);
             break;
     }
+    recordCmdLatency(android_app, cmd, APP_CMD_STAGE_POST_EXEC,
+                     monotonicNanos() - startNanos);
 }
 
 void app_dummy() {}
@@ -176,24 +486,33 @@ static void android_app_destroy(struct android_app* android_app) {
     pthread_mutex_lock(&android_app->mutex);
 
     AConfiguration_delete(android_app->config);
-    android_app->destroyed = 1;
-    pthread_cond_broadcast(&android_app->cond);
+    if (android_app->windowAcquired) {
+        ANativeWindow_release(android_app->window);
+        android_app->windowAcquired = false;
+    }
+    if (android_app->handoffWindow != NULL) {
+        ANativeWindow_release(android_app->handoffWindow);
+        android_app->handoffWindow = NULL;
+    }
+    __atomic_store_n(&android_app->destroyed, 1, __ATOMIC_RELEASE);
+    ackCmd(android_app);
     pthread_mutex_unlock(&android_app->mutex);
     // Can't touch android_app object after this.
 }
 
 static void process_cmd(struct android_app* app,
                         struct android_poll_source* source) {
-    int8_t cmd = android_app_read_cmd(app);
-    android_app_pre_exec_cmd(app, cmd);
-    if (app->onAppCmd != NULL) app->onAppCmd(app, cmd);
-    android_app_post_exec_cmd(app, cmd);
+    int8_t cmd;
+    while ((cmd = android_app_read_cmd(app)) >= 0) {
+        android_app_pre_exec_cmd(app, cmd);
+        if (app->onAppCmd != NULL) app->onAppCmd(app, cmd);
+        android_app_post_exec_cmd(app, cmd);
+    }
 }
 
 // This is run on a separate thread (i.e: not the main thread).
 static void* android_app_entry(void* param) {
     struct android_app* android_app = (struct android_app*)param;
-    int input_buf_idx = 0;
 
     LOGV("android_app_entry called");
     android_app->config = AConfiguration_new();
@@ -207,24 +526,25 @@ static void* android_app_entry(void* param) {
     print_cur_config(android_app);
 
     /* initialize event buffers */
-    for (input_buf_idx = 0; input_buf_idx < NATIVE_APP_GLUE_MAX_INPUT_BUFFERS; input_buf_idx++) {
-        struct android_input_buffer *buf = &android_app->inputBuffers[input_buf_idx];
+    struct android_input_buffer *buf = &android_app->inputBuffer;
 
-        buf->motionEventsBufferSize = NATIVE_APP_GLUE_MOTION_EVENTS_DEFAULT_BUF_SIZE;
-        buf->motionEvents = (GameActivityMotionEvent *) malloc(sizeof(GameActivityMotionEvent) *
-                                                               buf->motionEventsBufferSize);
+    buf->motionEventsBufferSize = NATIVE_APP_GLUE_MOTION_EVENTS_RING_SIZE;
+    buf->motionEvents = (GameActivityMotionEvent *) malloc(sizeof(GameActivityMotionEvent) *
+                                                           buf->motionEventsBufferSize);
+    // NB: the storage has an extra spare entry for coalescing events
+    buf->motionEventStorage = (struct android_motion_event_storage *) calloc(
+        buf->motionEventsBufferSize + 1, sizeof(struct android_motion_event_storage));
 
-        buf->keyEventsBufferSize = NATIVE_APP_GLUE_KEY_EVENTS_DEFAULT_BUF_SIZE;
-        buf->keyEvents = (GameActivityKeyEvent *) malloc(sizeof(GameActivityKeyEvent) *
-                                                         buf->keyEventsBufferSize);
-    }
+    buf->keyEventsBufferSize = NATIVE_APP_GLUE_KEY_EVENTS_RING_SIZE;
+    buf->keyEvents = (GameActivityKeyEvent *) malloc(sizeof(GameActivityKeyEvent) *
+                                                     buf->keyEventsBufferSize);
 
     android_app->cmdPollSource.id = LOOPER_ID_MAIN;
     android_app->cmdPollSource.app = android_app;
     android_app->cmdPollSource.process = process_cmd;
 
     ALooper* looper = ALooper_prepare(ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
-    ALooper_addFd(looper, android_app->msgread, LOOPER_ID_MAIN,
+    ALooper_addFd(looper, android_app->cmdEventFd, LOOPER_ID_MAIN,
                   ALOOPER_EVENT_INPUT, NULL, &android_app->cmdPollSource);
     android_app->looper = looper;
 
@@ -281,7 +601,12 @@ static struct android_app* android_app_create(GameActivity* activity,
     android_app->activity = activity;
 
     pthread_mutex_init(&android_app->mutex, NULL);
-    pthread_cond_init(&android_app->cond, NULL);
+    // NB: timed waits for the window to be terminated use CLOCK_MONOTONIC
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&android_app->cond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
 
     if (savedState != NULL) {
         android_app->savedState = malloc(savedStateSize);
@@ -289,13 +614,16 @@ static struct android_app* android_app_create(GameActivity* activity,
         memcpy(android_app->savedState, savedState, savedStateSize);
     }
 
-    int msgpipe[2];
-    if (pipe(msgpipe)) {
-        LOGE("could not create pipe: %s", strerror(errno));
+    android_app->cmdEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (android_app->cmdEventFd < 0) {
+        LOGE("could not create eventfd: %s", strerror(errno));
         return NULL;
     }
-    android_app->msgread = msgpipe[0];
-    android_app->msgwrite = msgpipe[1];
+    if (!cmdQueueInit(android_app)) {
+        LOGE("could not allocate the android_app cmd queue");
+        return NULL;
+    }
+    android_app->windowTeardownTimeoutNanos = -1;
 
     android_app->keyEventFilter = default_key_filter;
     android_app->motionEventFilter = default_motion_filter;
@@ -316,12 +644,89 @@ static struct android_app* android_app_create(GameActivity* activity,
     return android_app;
 }
 
-static void android_app_write_cmd(struct android_app* android_app, int8_t cmd) {
-    if (write(android_app->msgwrite, &cmd, sizeof(cmd)) != sizeof(cmd)) {
+// NB: may be called from any thread, without the android_app->mutex held
+static void android_app_write_cmd_record(
+    struct android_app* android_app,
+    const struct android_app_cmd_record* record) {
+    struct android_app_cmd_node* node = cmdNodeAlloc(android_app);
+    if (node == NULL) {
+        LOGE("Failure allocating android_app cmd %d", record->cmd);
+        return;
+    }
+    node->next = NULL;
+    node->record = *record;
+    node->writeNanos = monotonicNanos();
+
+    struct android_app_cmd_node* prev = __atomic_exchange_n(
+        &android_app->cmdQueueHead, node, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+
+    // Don't signal the eventfd if a wake up is already pending, since the app
+    // thread will drain all the commands before clearing the flag.
+    if (__atomic_exchange_n(&android_app->cmdWakePending, true,
+                            __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(android_app->cmdEventFd, &one, sizeof(one)) != sizeof(one)) {
         LOGE("Failure writing android_app cmd: %s", strerror(errno));
     }
 }
 
+static void android_app_write_cmd(struct android_app* android_app, int8_t cmd) {
+    struct android_app_cmd_record record = {.cmd = cmd};
+    android_app_write_cmd_record(android_app, &record);
+}
+
+// Wait for android_app->cond to be signalled. In non-blocking mode, the wait
+// for a command that was written at `startNanos` is bounded by
+// `windowTeardownTimeoutNanos` (unless it's negative). Returns false if it
+// timed out, which is checked before waiting, since non-blocking mode may have
+// been switched on after the command was written.
+//
+// NB: must be called with android_app->mutex held
+static bool wait_for_cmd(struct android_app* android_app, int64_t startNanos) {
+    int64_t timeout = android_app->windowTeardownTimeoutNanos;
+    if (!android_app->nonBlockingLifecycle || timeout < 0 ||
+        timeout > INT64_MAX - startNanos) {
+        pthread_cond_wait(&android_app->cond, &android_app->mutex);
+        return true;
+    }
+    int64_t deadlineNanos = startNanos + timeout;
+    if (monotonicNanos() >= deadlineNanos) return false;
+    struct timespec deadline = {.tv_sec = deadlineNanos / 1000000000,
+                                .tv_nsec = deadlineNanos % 1000000000};
+    // Wait indefinitely if the deadline doesn't fit a (32-bit) time_t
+    if (deadline.tv_sec != deadlineNanos / 1000000000) {
+        pthread_cond_wait(&android_app->cond, &android_app->mutex);
+        return true;
+    }
+    // NB: a timeout is reported by the next call
+    pthread_cond_timedwait(&android_app->cond, &android_app->mutex, &deadline);
+    return true;
+}
+
+// Wait for the app thread to handle the APP_CMD_TERM_WINDOW commands that have
+// been written, for up to `windowTeardownTimeoutNanos` after `startNanos`.
+// Returns false if it timed out.
+//
+// NB: must be called with android_app->mutex held, in non-blocking mode
+static bool wait_for_window_term(struct android_app* android_app,
+                                 int64_t startNanos) {
+    // NB: the app thread may exit without handling the command
+    while (android_app->windowTermsHandled < android_app->windowTermsWritten &&
+           !android_app->destroyed) {
+        if (!wait_for_cmd(android_app, startNanos)) {
+            LOGW("APP_CMD_TERM_WINDOW wasn't handled within %lldms, "
+                 "not waiting any longer",
+                 (long long)(android_app->windowTeardownTimeoutNanos /
+                             1000000));
+            return false;
+        }
+    }
+    return true;
+}
+
 static void android_app_set_window(struct android_app* android_app,
                                    ANativeWindow* window) {
     LOGV("android_app_set_window called");
@@ -335,16 +740,47 @@ static void android_app_set_window(struct android_app* android_app,
         pthread_mutex_unlock(&android_app->mutex);
         return;
     }
-    if (android_app->pendingWindow != NULL) {
+    int64_t startNanos = monotonicNanos();
+    bool term = android_app->pendingWindow != NULL;
+    if (term) {
         android_app_write_cmd(android_app, APP_CMD_TERM_WINDOW);
+        android_app->windowTermsWritten++;
     }
     android_app->pendingWindow = window;
     if (window != NULL) {
-        android_app_write_cmd(android_app, APP_CMD_INIT_WINDOW);
+        struct android_app_cmd_record record = {.cmd = APP_CMD_INIT_WINDOW};
+        if (android_app->nonBlockingLifecycle) {
+            // The app thread takes over this reference, so the window stays
+            // valid for it regardless of what the main thread does next
+            ANativeWindow_acquire(window);
+            record.window = window;
+        }
+        android_app_write_cmd_record(android_app, &record);
+    }
+    if (android_app->nonBlockingLifecycle) {
+        if (term) {
+            beginCmdWait(android_app, APP_CMD_TERM_WINDOW, startNanos);
+            wait_for_window_term(android_app, startNanos);
+            recordCmdWait(android_app, APP_CMD_TERM_WINDOW, startNanos);
+        }
+        pthread_mutex_unlock(&android_app->mutex);
+        return;
     }
-    while (android_app->window != android_app->pendingWindow) {
+    // The wait is attributed to the last command, which it ends with
+    int32_t waitCmd =
+        window != NULL ? APP_CMD_INIT_WINDOW : APP_CMD_TERM_WINDOW;
+    beginCmdWait(android_app, waitCmd, startNanos);
+    // NB: switching to non-blocking mode stops the wait, e.g. if the app
+    // thread has stalled, apart from the bounded wait for the window to be
+    // terminated
+    while (android_app->window != android_app->pendingWindow &&
+           !android_app->nonBlockingLifecycle) {
         pthread_cond_wait(&android_app->cond, &android_app->mutex);
     }
+    if (android_app->nonBlockingLifecycle && term) {
+        wait_for_window_term(android_app, startNanos);
+    }
+    recordCmdWait(android_app, waitCmd, startNanos);
     pthread_mutex_unlock(&android_app->mutex);
 }
 
@@ -357,17 +793,26 @@ static void android_app_set_activity_state(struct android_app* android_app,
     // to be careful to avoid a deadlock waiting for a thread that's
     // already exit.
     if (!android_app->destroyed) {
+        int64_t startNanos = monotonicNanos();
         android_app_write_cmd(android_app, cmd);
-        while (android_app->activityState != cmd) {
+        if (android_app->nonBlockingLifecycle) {
+            // activityState is updated once the app thread reads the command
+            pthread_mutex_unlock(&android_app->mutex);
+            return;
+        }
+        // NB: switching to non-blocking mode stops the wait, e.g. if the app
+        // thread has stalled
+        beginCmdWait(android_app, cmd, startNanos);
+        while (android_app->activityState != cmd &&
+               !android_app->nonBlockingLifecycle) {
             pthread_cond_wait(&android_app->cond, &android_app->mutex);
         }
+        recordCmdWait(android_app, cmd, startNanos);
     }
     pthread_mutex_unlock(&android_app->mutex);
 }
 
 static void android_app_free(struct android_app* android_app) {
-    int input_buf_idx = 0;
-
     pthread_mutex_lock(&android_app->mutex);
 
     // It's possible that onDestroy is called after we have already 'destroyed'
@@ -377,22 +822,43 @@ static void android_app_free(struct android_app* android_app) {
     // the loop below) but we still need to close the messaging fds and finish
     // freeing the android_app
 
+    bool waited = !android_app->destroyed;
+    int64_t startNanos = monotonicNanos();
     android_app_write_cmd(android_app, APP_CMD_DESTROY);
+    if (waited) beginCmdWait(android_app, APP_CMD_DESTROY, startNanos);
     while (!android_app->destroyed) {
         pthread_cond_wait(&android_app->cond, &android_app->mutex);
     }
+    if (waited) recordCmdWait(android_app, APP_CMD_DESTROY, startNanos);
     pthread_mutex_unlock(&android_app->mutex);
 
-    for (input_buf_idx = 0; input_buf_idx < NATIVE_APP_GLUE_MAX_INPUT_BUFFERS; input_buf_idx++) {
-        struct android_input_buffer *buf = &android_app->inputBuffers[input_buf_idx];
-
-        android_app_clear_motion_events(buf);
-        free(buf->motionEvents);
-        free(buf->keyEvents);
+    struct android_input_buffer *buf = &android_app->inputBuffer;
+    for (uint64_t i = buf->motionEventsHead; i != buf->motionEventsTail; i++) {
+        GameActivityMotionEvent_releaseDeferred(
+            &buf->motionEvents[i & (buf->motionEventsBufferSize - 1)]);
     }
-
-    close(android_app->msgread);
-    close(android_app->msgwrite);
+    for (uint64_t i = 0; i <= buf->motionEventsBufferSize; i++) {
+        free(buf->motionEventStorage[i].data);
+    }
+    free(buf->motionEventStorage);
+    free(buf->motionEvents);
+    free(buf->keyEvents);
+
+    // Free any commands that weren't read before the app thread exit, along
+    // with the stub node, whose record has already been read
+    struct android_app_cmd_node* node = android_app->cmdQueueTail;
+    while (node != NULL) {
+        struct android_app_cmd_node* next = node->next;
+        if (node != android_app->cmdQueueTail &&
+            node->record.window != NULL) {
+            ANativeWindow_release(node->record.window);
+        }
+        cmdNodeFree(android_app, node);
+        node = next;
+    }
+    free(android_app->cmdPool);
+    free(android_app->cmdStats);
+    close(android_app->cmdEventFd);
     pthread_cond_destroy(&android_app->cond);
     pthread_mutex_destroy(&android_app->mutex);
     free(android_app);
@@ -434,13 +900,28 @@ static void onSaveInstanceState(GameActivity* activity,
         return;
     }
 
+    int64_t startNanos = monotonicNanos();
     android_app->stateSaved = 0;
     android_app_write_cmd(android_app, APP_CMD_SAVE_STATE);
-    while (!android_app->stateSaved) {
-        pthread_cond_wait(&android_app->cond, &android_app->mutex);
+    uint64_t save = ++android_app->stateSavesWritten;
+    beginCmdWait(android_app, APP_CMD_SAVE_STATE, startNanos);
+    // NB: the app thread may exit without handling the command
+    bool saved = true;
+    while (android_app->stateSavesHandled < save && !android_app->destroyed) {
+        if (!wait_for_cmd(android_app, startNanos)) {
+            LOGW("APP_CMD_SAVE_STATE wasn't handled within %lldms, "
+                 "not saving any state",
+                 (long long)(android_app->windowTeardownTimeoutNanos /
+                             1000000));
+            saved = false;
+            break;
+        }
     }
+    recordCmdWait(android_app, APP_CMD_SAVE_STATE, startNanos);
 
-    if (android_app->savedState != NULL) {
+    // NB: a state that was saved for an earlier command that timed out is
+    // freed when this command is read
+    if (saved && android_app->savedState != NULL) {
         // Tell the Java side about our state.
         recallback((const char*)android_app->savedState,
                    android_app->savedStateSize, context);
@@ -470,7 +951,9 @@ static void onConfigurationChanged(GameActivity* activity) {
 
 static void onTrimMemory(GameActivity* activity, int level) {
     LOGV("TrimMemory: %p %d", activity, level);
-    android_app_write_cmd(ToApp(activity), APP_CMD_LOW_MEMORY);
+    struct android_app_cmd_record record = {.cmd = APP_CMD_LOW_MEMORY,
+                                            .trimMemoryLevel = level};
+    android_app_write_cmd_record(ToApp(activity), &record);
 }
 
 static void onWindowFocusChanged(GameActivity* activity, bool focused) {
@@ -501,170 +984,562 @@ static void onNativeWindowResized(GameActivity* activity, ANativeWindow* window,
                                   int32_t width, int32_t height) {
     LOGV("NativeWindowResized: %p -- %p ( %d x %d )", activity, window, width,
          height);
-    android_app_write_cmd(ToApp(activity), APP_CMD_WINDOW_RESIZED);
+    struct android_app_cmd_record record = {
+        .cmd = APP_CMD_WINDOW_RESIZED, .width = width, .height = height};
+    android_app_write_cmd_record(ToApp(activity), &record);
+}
+
+void android_app_set_motion_event_pointer_arrays(struct android_app* app,
+                                                 bool enabled) {
+    __atomic_store_n(&app->motionEventPointerArrays, enabled, __ATOMIC_RELAXED);
+}
+
+void android_app_set_motion_coalescing(struct android_app* app, bool enabled) {
+    __atomic_store_n(&app->motionEventCoalescing, enabled, __ATOMIC_RELAXED);
+}
+
+void android_app_set_deferred_motion_event_decoding(struct android_app* app,
+                                                    bool enabled) {
+    GameActivity_setDeferredMotionEventDecoding(app->activity, enabled);
+}
+
+void android_app_set_input_overflow_policy(struct android_app* app,
+                                           int32_t policy) {
+    __atomic_store_n(&app->inputOverflowPolicy, policy, __ATOMIC_RELAXED);
+}
+
+void android_app_set_non_blocking_lifecycle(
+    struct android_app* app, bool enabled, int64_t windowTeardownTimeoutNanos) {
+    pthread_mutex_lock(&app->mutex);
+    app->nonBlockingLifecycle = enabled;
+    app->windowTeardownTimeoutNanos = windowTeardownTimeoutNanos;
+    // The main thread may stop waiting for the current window to be
+    // terminated, so the app thread needs its own reference to it
+    if (enabled && app->window != NULL && !app->windowAcquired) {
+        ANativeWindow_acquire(app->window);
+        app->windowAcquired = true;
+    }
+    // Release the main thread if it's waiting for a command to be handled
+    pthread_cond_broadcast(&app->cond);
+    pthread_mutex_unlock(&app->mutex);
 }
 
 void android_app_set_motion_event_filter(struct android_app* app,
                                          android_motion_event_filter filter) {
+    // NB: the filter is read by onTouchEvent without holding the mutex
     pthread_mutex_lock(&app->mutex);
-    app->motionEventFilter = filter;
+    __atomic_store_n(&app->motionEventFilter, filter, __ATOMIC_RELEASE);
     pthread_mutex_unlock(&app->mutex);
 }
 
 bool android_app_input_available_wake_up(struct android_app* app) {
-    pthread_mutex_lock(&app->mutex);
-    bool available = app->inputAvailableWakeUp;
-    app->inputAvailableWakeUp = false;
-    pthread_mutex_unlock(&app->mutex);
-    return available;
+    return __atomic_exchange_n(&app->inputAvailableWakeUp, false,
+                               __ATOMIC_ACQ_REL);
 }
 
-// NB: should be called with the android_app->mutex held already
+// NB: may be called without the android_app->mutex held
 static void notifyInput(struct android_app* android_app) {
+    if (android_app->looper == NULL) {
+        return;
+    }
+
     // Don't spam the mainloop with wake ups if we've already sent one
-    if (android_app->inputSwapPending) {
+    //
+    // NB: this is sequentially consistent with publishing new events and with
+    // android_app_swap_input_buffers clearing the flag before it acquires
+    // events, so that new events are either acquired or lead to a wake up.
+    if (__atomic_exchange_n(&android_app->inputSwapPending, true,
+                            __ATOMIC_SEQ_CST)) {
         return;
     }
 
-    if (android_app->looper != NULL) {
-        // for the app thread to know why it received the wake() up
-        android_app->inputAvailableWakeUp = true;
-        android_app->inputSwapPending = true;
-        ALooper_wake(android_app->looper);
+    // for the app thread to know why it received the wake() up
+    __atomic_store_n(&android_app->inputAvailableWakeUp, true, __ATOMIC_RELEASE);
+    ALooper_wake(android_app->looper);
+}
+
+// Handles an input event that can't be stored, because its ring is full or
+// there's no memory for its history, according to the overflow policy, and
+// returns whether the event should be reported as handled.
+static bool inputOverflow(struct android_app* android_app, uint64_t* dropped) {
+    __atomic_fetch_add(dropped, 1, __ATOMIC_RELAXED);
+
+    // Make sure the app thread is woken up to drain the ring
+    notifyInput(android_app);
+
+    int policy = __atomic_load_n(&android_app->inputOverflowPolicy,
+                                 __ATOMIC_RELAXED);
+    return policy == INPUT_OVERFLOW_DISCARD;
+}
+
+#define ALIGN8(size) (((size) + 7) & ~(uint64_t)7)
+
+// Returns at least `size` bytes of storage for the motion event in a ring slot,
+// or NULL if it can't be allocated, in which case the storage is unchanged.
+//
+// NB: only called by the producer, while it owns the slot, and the previous
+// contents of the storage don't need to be preserved.
+static uint8_t* motionEventStorageReserve(
+    struct android_motion_event_storage* storage, uint64_t size) {
+    if (size > storage->size) {
+        uint64_t newSize = storage->size > 0
+            ? storage->size * 2
+            : NATIVE_APP_GLUE_MOTION_EVENT_STORAGE_MIN_SIZE;
+        while (newSize < size) {
+            newSize *= 2;
+        }
+
+        uint8_t* data = (uint8_t*)malloc(newSize);
+        if (data == NULL) {
+            LOGW_ONCE("onTouchEvent: out of memory: dropping events");
+            return NULL;
+        }
+        free(storage->data);
+        storage->data = data;
+        storage->size = newSize;
+    }
+    return storage->data;
+}
+
+// Stores the pointers of `event` as arrays in `storage`, for `copy`.
+static void copyPointerArrays(GameActivityMotionEvent* copy,
+                              const GameActivityMotionEvent* event,
+                              uint8_t* storage) {
+    uint32_t pointerCount = event->pointerCount;
+    uint64_t axisMask = event->historicalAxisMask;
+
+    GameActivityPointerArrays* arrays = &copy->pointerArrays;
+    arrays->ids = (int32_t*)storage;
+    arrays->toolTypes = arrays->ids + pointerCount;
+    arrays->rawX = (float*)(arrays->toolTypes + pointerCount);
+    arrays->rawY = arrays->rawX + pointerCount;
+    arrays->axisValues = arrays->rawY + pointerCount;
+
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        const GameActivityPointerAxes* pointer = &event->pointers[i];
+        arrays->ids[i] = pointer->id;
+        arrays->toolTypes[i] = pointer->toolType;
+        arrays->rawX[i] = pointer->rawX;
+        arrays->rawY[i] = pointer->rawY;
+    }
+    float* values = arrays->axisValues;
+    for (int axis = 0; axis < GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT; axis++) {
+        if (!(axisMask & ((uint64_t)1 << axis))) {
+            continue;
+        }
+        for (uint32_t i = 0; i < pointerCount; i++) {
+            *values++ = event->pointers[i].axisValues[axis];
+        }
     }
 }
 
+// Copies the state of `event` into `copy`, except for its history.
+//
+// If `pointerArraysStorage` is not NULL then the pointers are stored there as
+// `pointerArrays`, instead of copying the `pointers` array.
+static void copyMotionEventState(GameActivityMotionEvent* copy,
+                                 const GameActivityMotionEvent* event,
+                                 uint8_t* pointerArraysStorage) {
+    if (pointerArraysStorage != NULL) {
+        // Skip copying the `pointers` array, and only store the enabled axes
+        size_t pointersStart = offsetof(GameActivityMotionEvent, pointers);
+        size_t pointersEnd = offsetof(GameActivityMotionEvent, historySize);
+        memcpy(copy, event, pointersStart);
+        memcpy((uint8_t*)copy + pointersEnd, (const uint8_t*)event + pointersEnd,
+               sizeof(GameActivityMotionEvent) - pointersEnd);
+        copyPointerArrays(copy, event, pointerArraysStorage);
+    } else {
+        memcpy(copy, event, sizeof(GameActivityMotionEvent));
+        copy->pointerArrays = (GameActivityPointerArrays){0};
+    }
+}
+
+// Copies `event` into the slot at `index` of the input ring, including its
+// history, and returns false if there's no memory for its history.
+//
+// NB: the event is only valid for the duration of the onTouchEvent callback, so
+// we can't hold on to its history pointers.
+static bool copyMotionEvent(struct android_input_buffer* inputBuffer,
+                            uint64_t index,
+                            const GameActivityMotionEvent* event,
+                            bool pointerArrays) {
+    uint64_t slot = index & (inputBuffer->motionEventsBufferSize - 1);
+
+    uint64_t axisCount = __builtin_popcountll(event->historicalAxisMask);
+    uint64_t historySize = event->historySize > 0 ? event->historySize : 0;
+    uint64_t timesSize = historySize * sizeof(int64_t);
+    uint64_t axisValuesSize =
+        historySize * event->pointerCount * axisCount * sizeof(float);
+    uint64_t pointerArraysSize = pointerArrays
+        ? event->pointerCount * (2 * sizeof(int32_t) + (2 + axisCount) * sizeof(float))
+        : 0;
+
+    uint8_t* storage = NULL;
+    uint64_t storageSize =
+        2 * timesSize + ALIGN8(axisValuesSize) + ALIGN8(pointerArraysSize);
+    if (storageSize > 0) {
+        storage = motionEventStorageReserve(
+            &inputBuffer->motionEventStorage[slot], storageSize);
+        if (storage == NULL) {
+            return false;
+        }
+    }
+
+    GameActivityMotionEvent* copy = &inputBuffer->motionEvents[slot];
+    copyMotionEventState(copy, event,
+                         pointerArrays
+                             ? storage + 2 * timesSize + ALIGN8(axisValuesSize)
+                             : NULL);
+
+    copy->historySize = (int)historySize;
+    if (historySize > 0) {
+        int64_t* times = (int64_t*)storage;
+        float* axisValues = (float*)(storage + 2 * timesSize);
+        memcpy(times, event->historicalEventTimesMillis, timesSize);
+        memcpy(times + historySize, event->historicalEventTimesNanos, timesSize);
+        memcpy(axisValues, event->historicalAxisValues, axisValuesSize);
+        copy->historicalEventTimesMillis = times;
+        copy->historicalEventTimesNanos = times + historySize;
+        copy->historicalAxisValues = axisValues;
+    } else {
+        copy->historicalEventTimesMillis = NULL;
+        copy->historicalEventTimesNanos = NULL;
+        copy->historicalAxisValues = NULL;
+    }
+    return true;
+}
+
+// Returns whether the ACTION_MOVE `event` can be merged into `last`, as Android
+// would batch them into a single MotionEvent.
+static bool canCoalesceMotionEvents(const GameActivityMotionEvent* last,
+                                    const GameActivityMotionEvent* event) {
+    // The history of deferred events hasn't been decoded, so can't be merged
+    if (last->deferredEvent != NULL || event->deferredEvent != NULL) {
+        return false;
+    }
+    if (last->action != AMOTION_EVENT_ACTION_MOVE ||
+        last->deviceId != event->deviceId || last->source != event->source ||
+        last->flags != event->flags || last->metaState != event->metaState ||
+        last->buttonState != event->buttonState ||
+        last->classification != event->classification ||
+        last->historicalAxisMask != event->historicalAxisMask ||
+        last->pointerCount != event->pointerCount) {
+        return false;
+    }
+
+    uint64_t historySize = (uint64_t)last->historySize + 1 +
+        (event->historySize > 0 ? event->historySize : 0);
+    if (historySize > NATIVE_APP_GLUE_MOTION_COALESCE_MAX_HISTORY) {
+        return false;
+    }
+
+    const GameActivityPointerArrays* arrays = &last->pointerArrays;
+    for (uint32_t i = 0; i < event->pointerCount; i++) {
+        int32_t id = arrays->ids != NULL ? arrays->ids[i] : last->pointers[i].id;
+        int32_t toolType = arrays->ids != NULL ? arrays->toolTypes[i]
+                                               : last->pointers[i].toolType;
+        if (id != event->pointers[i].id ||
+            toolType != event->pointers[i].toolType) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Merges `event` into the event in the slot at `slot` of the input ring, by
+// appending the current sample of that event, followed by the history of
+// `event`, to its history and taking the current state from `event`.
+//
+// Returns false, leaving the event in the slot unchanged, if there's no memory
+// for the merged history.
+//
+// NB: the merged history is written to the spare storage, which is then
+// swapped with the storage of the slot.
+static bool coalesceMotionEvent(struct android_input_buffer* inputBuffer,
+                                uint64_t slot,
+                                const GameActivityMotionEvent* event) {
+    GameActivityMotionEvent* last = &inputBuffer->motionEvents[slot];
+    bool pointerArrays = last->pointerArrays.ids != NULL;
+
+    uint64_t pointerCount = event->pointerCount;
+    uint64_t axisMask = event->historicalAxisMask;
+    uint64_t axisCount = __builtin_popcountll(axisMask);
+    uint64_t sampleSize = pointerCount * axisCount;
+    uint64_t lastHistorySize = last->historySize;
+    uint64_t newHistorySize = event->historySize > 0 ? event->historySize : 0;
+    uint64_t historySize = lastHistorySize + 1 + newHistorySize;
+    uint64_t timesSize = historySize * sizeof(int64_t);
+    uint64_t axisValuesSize = historySize * sampleSize * sizeof(float);
+    uint64_t pointerArraysSize = pointerArrays
+        ? pointerCount * (2 * sizeof(int32_t) + (2 + axisCount) * sizeof(float))
+        : 0;
+
+    struct android_motion_event_storage* spare =
+        &inputBuffer->motionEventStorage[inputBuffer->motionEventsBufferSize];
+    uint8_t* storage = motionEventStorageReserve(
+        spare, 2 * timesSize + ALIGN8(axisValuesSize) + ALIGN8(pointerArraysSize));
+    if (storage == NULL) {
+        return false;
+    }
+    int64_t* times = (int64_t*)storage;
+    float* axisValues = (float*)(storage + 2 * timesSize);
+
+    if (lastHistorySize > 0) {
+        memcpy(times, last->historicalEventTimesMillis,
+               lastHistorySize * sizeof(int64_t));
+        memcpy(times + historySize, last->historicalEventTimesNanos,
+               lastHistorySize * sizeof(int64_t));
+        memcpy(axisValues, last->historicalAxisValues,
+               lastHistorySize * sampleSize * sizeof(float));
+    }
+
+    // The current sample of `last` becomes a historical sample
+    times[lastHistorySize] = last->eventTime / 1000000;
+    times[historySize + lastHistorySize] = last->eventTime;
+    float* sample = axisValues + lastHistorySize * sampleSize;
+    for (uint64_t i = 0; i < pointerCount; i++) {
+        uint64_t axisIndex = 0;
+        for (int axis = 0; axis < GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT; axis++) {
+            if (!(axisMask & ((uint64_t)1 << axis))) {
+                continue;
+            }
+            sample[i * axisCount + axisIndex] = pointerArrays
+                ? last->pointerArrays.axisValues[axisIndex * pointerCount + i]
+                : last->pointers[i].axisValues[axis];
+            axisIndex++;
+        }
+    }
+
+    if (newHistorySize > 0) {
+        uint64_t start = lastHistorySize + 1;
+        memcpy(times + start, event->historicalEventTimesMillis,
+               newHistorySize * sizeof(int64_t));
+        memcpy(times + historySize + start, event->historicalEventTimesNanos,
+               newHistorySize * sizeof(int64_t));
+        memcpy(axisValues + start * sampleSize, event->historicalAxisValues,
+               newHistorySize * sampleSize * sizeof(float));
+    }
+
+    copyMotionEventState(last, event,
+                         pointerArrays
+                             ? storage + 2 * timesSize + ALIGN8(axisValuesSize)
+                             : NULL);
+    last->historySize = (int)historySize;
+    last->historicalEventTimesMillis = times;
+    last->historicalEventTimesNanos = times + historySize;
+    last->historicalAxisValues = axisValues;
+
+    struct android_motion_event_storage tmp = inputBuffer->motionEventStorage[slot];
+    inputBuffer->motionEventStorage[slot] = *spare;
+    *spare = tmp;
+    return true;
+}
+
+// Tries to merge the ACTION_MOVE `event` into the newest event in the input
+// ring, as long as the app thread hasn't acquired that event yet.
+static bool tryCoalesceMotionEvent(struct android_input_buffer* inputBuffer,
+                                   uint64_t tail,
+                                   const GameActivityMotionEvent* event) {
+    if (event->action != AMOTION_EVENT_ACTION_MOVE) {
+        return false;
+    }
+
+    // NB: this is sequentially consistent with android_app_swap_input_buffers
+    // updating `motionEventsAcquired` before checking `motionEventsCoalescing`,
+    // so either the app thread waits for us to finish, or we see that the
+    // newest event has been acquired.
+    __atomic_store_n(&inputBuffer->motionEventsCoalescing, true,
+                     __ATOMIC_SEQ_CST);
+    uint64_t acquired =
+        __atomic_load_n(&inputBuffer->motionEventsAcquired, __ATOMIC_SEQ_CST);
+
+    bool coalesced = false;
+    if (acquired < tail) {
+        uint64_t slot = (tail - 1) & (inputBuffer->motionEventsBufferSize - 1);
+        // NB: if the merged history can't be allocated then the event is
+        // pushed as a new event instead
+        coalesced =
+            canCoalesceMotionEvents(&inputBuffer->motionEvents[slot], event) &&
+            coalesceMotionEvent(inputBuffer, slot, event);
+    }
+
+    __atomic_store_n(&inputBuffer->motionEventsCoalescing, false,
+                     __ATOMIC_RELEASE);
+
+    if (coalesced) {
+        __atomic_fetch_add(&inputBuffer->motionEventsCoalesced, 1,
+                           __ATOMIC_RELAXED);
+    }
+    return coalesced;
+}
+
+// NB: input events are pushed into the input ring without holding the
+// android_app->mutex, so that input delivery doesn't contend with lifecycle
+// commands. The Java main thread is the only producer and the app thread is
+// the only consumer.
+//
+// NB: we own the `deferredEvent` of the event (if any), which is either passed
+// on to the app thread via the input ring or released here.
 static bool onTouchEvent(GameActivity* activity,
                          const GameActivityMotionEvent* event) {
     struct android_app* android_app = ToApp(activity);
-    pthread_mutex_lock(&android_app->mutex);
 
     // NB: we have to consider that the native thread could have already
     // (gracefully) exit (setting android_app->destroyed) and so we need
     // to be careful to avoid a deadlock waiting for a thread that's
     // already exit.
-    if (android_app->destroyed) {
-        pthread_mutex_unlock(&android_app->mutex);
+    if (__atomic_load_n(&android_app->destroyed, __ATOMIC_ACQUIRE)) {
+        GameActivityMotionEvent_releaseDeferred(event);
         return false;
     }
 
-    if (android_app->motionEventFilter != NULL &&
-        !android_app->motionEventFilter(event)) {
-        pthread_mutex_unlock(&android_app->mutex);
+    android_motion_event_filter filter =
+        __atomic_load_n(&android_app->motionEventFilter, __ATOMIC_ACQUIRE);
+    if (filter != NULL && !filter(event)) {
+        GameActivityMotionEvent_releaseDeferred(event);
         return false;
     }
 
-    struct android_input_buffer* inputBuffer =
-        &android_app->inputBuffers[android_app->currentInputBuffer];
+    struct android_input_buffer* inputBuffer = &android_app->inputBuffer;
+    uint64_t tail =
+        __atomic_load_n(&inputBuffer->motionEventsTail, __ATOMIC_RELAXED);
 
-    // Add to the list of active motion events
-    if (inputBuffer->motionEventsCount >= inputBuffer->motionEventsBufferSize) {
-        inputBuffer->motionEventsBufferSize *= 2;
-        inputBuffer->motionEvents = (GameActivityMotionEvent *) realloc(inputBuffer->motionEvents,
-            sizeof(GameActivityMotionEvent) * inputBuffer->motionEventsBufferSize);
+    if (__atomic_load_n(&android_app->motionEventCoalescing, __ATOMIC_RELAXED) &&
+        tryCoalesceMotionEvent(inputBuffer, tail, event)) {
+        notifyInput(android_app);
+        return true;
+    }
 
-        if (inputBuffer->motionEvents == NULL) {
-            LOGE("onTouchEvent: out of memory");
-            abort();
-        }
+    uint64_t head =
+        __atomic_load_n(&inputBuffer->motionEventsHead, __ATOMIC_ACQUIRE);
+    if (tail - head >= inputBuffer->motionEventsBufferSize) {
+        LOGW_ONCE("Input ring full: dropping events");
+        GameActivityMotionEvent_releaseDeferred(event);
+        return inputOverflow(android_app, &inputBuffer->motionEventsDropped);
     }
 
-    int new_ix = inputBuffer->motionEventsCount;
-    memcpy(&inputBuffer->motionEvents[new_ix], event, sizeof(GameActivityMotionEvent));
-    ++inputBuffer->motionEventsCount;
+    bool pointerArrays = __atomic_load_n(&android_app->motionEventPointerArrays,
+                                         __ATOMIC_RELAXED);
+    if (!copyMotionEvent(inputBuffer, tail, event, pointerArrays)) {
+        GameActivityMotionEvent_releaseDeferred(event);
+        return inputOverflow(android_app, &inputBuffer->motionEventsDropped);
+    }
+    __atomic_store_n(&inputBuffer->motionEventsTail, tail + 1, __ATOMIC_SEQ_CST);
     notifyInput(android_app);
 
-    pthread_mutex_unlock(&android_app->mutex);
     return true;
 }
 
 struct android_input_buffer* android_app_swap_input_buffers(
     struct android_app* android_app) {
-    pthread_mutex_lock(&android_app->mutex);
+    struct android_input_buffer* inputBuffer = &android_app->inputBuffer;
+
+    // NB: clear the flags before acquiring events, so that any events pushed
+    // after we read the tails will result in a new wake up.
+    __atomic_store_n(&android_app->inputSwapPending, false, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&android_app->inputAvailableWakeUp, false,
+                     __ATOMIC_RELAXED);
+
+    uint64_t motionEventsTail =
+        __atomic_load_n(&inputBuffer->motionEventsTail, __ATOMIC_SEQ_CST);
+    uint64_t keyEventsTail =
+        __atomic_load_n(&inputBuffer->keyEventsTail, __ATOMIC_SEQ_CST);
+
+    // NB: the newest motion event may be coalesced with new events until it
+    // has been acquired. If the producer may be coalescing into it, leave it
+    // for the next swap instead of waiting for the producer, which may have
+    // been preempted. The producer notifies us again after coalescing, so
+    // there will be a next swap.
+    __atomic_store_n(&inputBuffer->motionEventsAcquired, motionEventsTail,
+                     __ATOMIC_SEQ_CST);
+    if (motionEventsTail != inputBuffer->motionEventsHead &&
+        __atomic_load_n(&inputBuffer->motionEventsCoalescing,
+                        __ATOMIC_SEQ_CST)) {
+        motionEventsTail--;
+        __atomic_store_n(&inputBuffer->motionEventsAcquired, motionEventsTail,
+                         __ATOMIC_SEQ_CST);
+    }
 
-    struct android_input_buffer* inputBuffer =
-        &android_app->inputBuffers[android_app->currentInputBuffer];
+    inputBuffer->motionEventsCount =
+        motionEventsTail - inputBuffer->motionEventsHead;
+    inputBuffer->keyEventsCount = keyEventsTail - inputBuffer->keyEventsHead;
 
     if (inputBuffer->motionEventsCount == 0 &&
         inputBuffer->keyEventsCount == 0) {
-        inputBuffer = NULL;
-    } else {
-        android_app->currentInputBuffer =
-            (android_app->currentInputBuffer + 1) %
-            NATIVE_APP_GLUE_MAX_INPUT_BUFFERS;
+        return NULL;
     }
 
-    android_app->inputSwapPending = false;
-    android_app->inputAvailableWakeUp = false;
-
-    pthread_mutex_unlock(&android_app->mutex);
-
     return inputBuffer;
 }
 
 void android_app_clear_motion_events(struct android_input_buffer* inputBuffer) {
-    // We do not need to lock here if the inputBuffer has already been swapped
-    // as is handled by the game loop thread
-    while (inputBuffer->motionEventsCount > 0) {
-        GameActivityMotionEvent_destroy(
-            &inputBuffer->motionEvents[inputBuffer->motionEventsCount - 1]);
-
-        inputBuffer->motionEventsCount--;
+    for (uint64_t i = 0; i < inputBuffer->motionEventsCount; i++) {
+        uint64_t slot = (inputBuffer->motionEventsHead + i) &
+            (inputBuffer->motionEventsBufferSize - 1);
+        GameActivityMotionEvent* event = &inputBuffer->motionEvents[slot];
+        if (event->deferredEvent != NULL) {
+            GameActivityMotionEvent_releaseDeferred(event);
+            event->deferredEvent = NULL;
+        }
     }
-    assert(inputBuffer->motionEventsCount == 0);
+
+    // Release the slots of the acquired events back to the producer
+    //
+    // NB: the history of each event lives in the storage of its slot, which
+    // we keep around for the next event in that slot.
+    __atomic_store_n(&inputBuffer->motionEventsHead,
+                     inputBuffer->motionEventsHead + inputBuffer->motionEventsCount,
+                     __ATOMIC_RELEASE);
+    inputBuffer->motionEventsCount = 0;
 }
 
 void android_app_set_key_event_filter(struct android_app* app,
                                       android_key_event_filter filter) {
+    // NB: the filter is read by onKey without holding the mutex
     pthread_mutex_lock(&app->mutex);
-    app->keyEventFilter = filter;
+    __atomic_store_n(&app->keyEventFilter, filter, __ATOMIC_RELEASE);
     pthread_mutex_unlock(&app->mutex);
 }
 
 static bool onKey(GameActivity* activity, const GameActivityKeyEvent* event) {
     struct android_app* android_app = ToApp(activity);
-    pthread_mutex_lock(&android_app->mutex);
 
     // NB: we have to consider that the native thread could have already
     // (gracefully) exit (setting android_app->destroyed) and so we need
     // to be careful to avoid a deadlock waiting for a thread that's
     // already exit.
-    if (android_app->destroyed) {
-        pthread_mutex_unlock(&android_app->mutex);
+    if (__atomic_load_n(&android_app->destroyed, __ATOMIC_ACQUIRE)) {
         return false;
     }
 
-    if (android_app->keyEventFilter != NULL &&
-        !android_app->keyEventFilter(event)) {
-        pthread_mutex_unlock(&android_app->mutex);
+    android_key_event_filter filter =
+        __atomic_load_n(&android_app->keyEventFilter, __ATOMIC_ACQUIRE);
+    if (filter != NULL && !filter(event)) {
         return false;
     }
 
-    struct android_input_buffer* inputBuffer =
-        &android_app->inputBuffers[android_app->currentInputBuffer];
-
-    // Add to the list of active key down events
-    if (inputBuffer->keyEventsCount >= inputBuffer->keyEventsBufferSize) {
-        inputBuffer->keyEventsBufferSize = inputBuffer->keyEventsBufferSize * 2;
-        inputBuffer->keyEvents = (GameActivityKeyEvent *) realloc(inputBuffer->keyEvents,
-            sizeof(GameActivityKeyEvent) * inputBuffer->keyEventsBufferSize);
-
-        if (inputBuffer->keyEvents == NULL) {
-            LOGE("onKey: out of memory");
-            abort();
-        }
+    struct android_input_buffer* inputBuffer = &android_app->inputBuffer;
+    uint64_t tail =
+        __atomic_load_n(&inputBuffer->keyEventsTail, __ATOMIC_RELAXED);
+    uint64_t head =
+        __atomic_load_n(&inputBuffer->keyEventsHead, __ATOMIC_ACQUIRE);
+    if (tail - head >= inputBuffer->keyEventsBufferSize) {
+        LOGW_ONCE("Input ring full: dropping events");
+        return inputOverflow(android_app, &inputBuffer->keyEventsDropped);
     }
 
-    int new_ix = inputBuffer->keyEventsCount;
-    memcpy(&inputBuffer->keyEvents[new_ix], event, sizeof(GameActivityKeyEvent));
-    ++inputBuffer->keyEventsCount;
+    uint64_t slot = tail & (inputBuffer->keyEventsBufferSize - 1);
+    memcpy(&inputBuffer->keyEvents[slot], event, sizeof(GameActivityKeyEvent));
+    __atomic_store_n(&inputBuffer->keyEventsTail, tail + 1, __ATOMIC_SEQ_CST);
     notifyInput(android_app);
 
-    pthread_mutex_unlock(&android_app->mutex);
     return true;
 }
 
 void android_app_clear_key_events(struct android_input_buffer* inputBuffer) {
+    __atomic_store_n(&inputBuffer->keyEventsHead,
+                     inputBuffer->keyEventsHead + inputBuffer->keyEventsCount,
+                     __ATOMIC_RELEASE);
     inputBuffer->keyEventsCount = 0;
 }
 
@@ -681,7 +1556,15 @@ static void onTextInputEvent(GameActivity* activity,
 
 static void onWindowInsetsChanged(GameActivity* activity) {
     LOGV("WindowInsetsChanged: %p", activity);
-    android_app_write_cmd(ToApp(activity), APP_CMD_WINDOW_INSETS_CHANGED);
+    // This is called on the main thread as soon as the insets are updated, so
+    // the snapshot's changedMask is for this change.
+    GameActivityWindowInsets insets;
+    GameActivity_getWindowInsetsSnapshot(activity, &insets);
+
+    struct android_app_cmd_record record = {
+        .cmd = APP_CMD_WINDOW_INSETS_CHANGED,
+        .insetsChangedMask = insets.changedMask};
+    android_app_write_cmd_record(ToApp(activity), &record);
 }
 
 static void onContentRectChanged(GameActivity* activity, const ARect *rect) {
@@ -693,7 +1576,9 @@ static void onContentRectChanged(GameActivity* activity, const ARect *rect) {
     pthread_mutex_lock(&android_app->mutex);
     android_app->contentRect = *rect;
 
-    android_app_write_cmd(android_app, APP_CMD_CONTENT_RECT_CHANGED);
+    struct android_app_cmd_record record = {
+        .cmd = APP_CMD_CONTENT_RECT_CHANGED, .contentRect = *rect};
+    android_app_write_cmd_record(android_app, &record);
     pthread_mutex_unlock(&android_app->mutex);
 }
 
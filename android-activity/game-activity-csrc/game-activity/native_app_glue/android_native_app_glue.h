@@ -103,38 +103,119 @@ struct android_poll_source {
                     struct android_poll_source* source);
 };
 
+struct android_motion_event_storage;
+struct android_app_cmd_node;
+struct android_app_cmd_pool;
+struct android_app_cmd_stats;
+
+/**
+ * A bounded single-producer, single-consumer ring of input events.
+ *
+ * Events are pushed by the GameActivity callbacks on the Java main thread and
+ * consumed by the application thread, without taking the `android_app` mutex.
+ *
+ * The head and tail indices increase monotonically and are reduced modulo the
+ * ring size, which is a power of two, to index the events.
+ */
 struct android_input_buffer {
     /**
-     * Pointer to a read-only array of GameActivityMotionEvent.
-     * Only the first motionEventsCount events are valid.
+     * Pointer to a read-only ring of GameActivityMotionEvent.
+     * After android_app_swap_input_buffers() the valid events are the
+     * `motionEventsCount` events starting at index `motionEventsHead`.
      */
     GameActivityMotionEvent *motionEvents;
 
     /**
-     * The number of valid motion events in `motionEvents`.
+     * The number of motion events acquired by the consumer, starting at
+     * `motionEventsHead`.
      */
     uint64_t motionEventsCount;
 
     /**
-     * The size of the `motionEvents` buffer.
+     * The size of the `motionEvents` ring, a power of two.
      */
     uint64_t motionEventsBufferSize;
 
     /**
-     * Pointer to a read-only array of GameActivityKeyEvent.
-     * Only the first keyEventsCount events are valid.
+     * Pointer to a read-only ring of GameActivityKeyEvent.
+     * After android_app_swap_input_buffers() the valid events are the
+     * `keyEventsCount` events starting at index `keyEventsHead`.
      */
     GameActivityKeyEvent *keyEvents;
 
     /**
-     * The number of valid "Key" events in `keyEvents`.
+     * The number of "Key" events acquired by the consumer, starting at
+     * `keyEventsHead`.
      */
     uint64_t keyEventsCount;
 
     /**
-     * The size of the `keyEvents` buffer.
+     * The size of the `keyEvents` ring, a power of two.
      */
     uint64_t keyEventsBufferSize;
+
+    /**
+     * The index of the oldest motion event that hasn't been released by the
+     * consumer. Only written by the consumer.
+     */
+    uint64_t motionEventsHead;
+
+    /**
+     * The index after the newest motion event. Only written by the producer.
+     */
+    uint64_t motionEventsTail;
+
+    /**
+     * The index after the newest motion event acquired by the consumer. Only
+     * written by the consumer.
+     *
+     * Until it's acquired, the newest motion event may be coalesced with new
+     * events if android_app_set_motion_coalescing() is enabled.
+     */
+    uint64_t motionEventsAcquired;
+
+    /**
+     * The index of the oldest key event that hasn't been released by the
+     * consumer. Only written by the consumer.
+     */
+    uint64_t keyEventsHead;
+
+    /**
+     * The index after the newest key event. Only written by the producer.
+     */
+    uint64_t keyEventsTail;
+
+    /**
+     * The number of motion events that were dropped because the ring was
+     * full, or there was no memory for their history.
+     */
+    uint64_t motionEventsDropped;
+
+    /**
+     * The number of key events that were dropped because the ring was full.
+     */
+    uint64_t keyEventsDropped;
+
+    /**
+     * The number of motion events that were coalesced into a previous event,
+     * instead of taking up a slot in the ring.
+     */
+    uint64_t motionEventsCoalesced;
+
+    /**
+     * Set while the producer may be coalescing a new event into the newest
+     * motion event. The consumer doesn't wait for it to be cleared, but
+     * leaves the newest motion event for its next swap.
+     */
+    bool motionEventsCoalescing;
+
+    /**
+     * Storage for the historical samples of each event in `motionEvents`, and
+     * for their `pointerArrays` if enabled. Each slot of the ring has its own
+     * storage that's reused by subsequent events in that slot, plus one spare
+     * that's used for coalescing events.
+     */
+    struct android_motion_event_storage *motionEventStorage;
 };
 
 /**
@@ -222,16 +303,12 @@ struct android_app {
      */
     int destroyRequested;
 
-#define NATIVE_APP_GLUE_MAX_INPUT_BUFFERS 2
-
     /**
-     * This is used for buffering input from GameActivity. Once ready, the
-     * application thread switches the buffers and processes what was
-     * accumulated.
+     * This is used for buffering input from GameActivity. The application
+     * thread acquires the events accumulated so far with
+     * android_app_swap_input_buffers() and releases them once processed.
      */
-    struct android_input_buffer inputBuffers[NATIVE_APP_GLUE_MAX_INPUT_BUFFERS];
-
-    int currentInputBuffer;
+    struct android_input_buffer inputBuffer;
 
     /**
      * 0 if no text input event is outstanding, 1 if it is.
@@ -246,8 +323,51 @@ struct android_app {
     pthread_mutex_t mutex;
     pthread_cond_t cond;
 
-    int msgread;
-    int msgwrite;
+    // Commands are passed to the app thread via a lock-free, multi-producer,
+    // single-consumer queue of `android_app_cmd_record`s. Producers push at
+    // `cmdQueueHead` and the app thread pops after `cmdQueueTail`, which is a
+    // stub node. Nodes come from `cmdPool`, and are only allocated when it's
+    // empty.
+    //
+    // The looper is woken up by signalling `cmdEventFd`, which is only done
+    // when `cmdWakePending` wasn't already set, so a burst of commands costs a
+    // single wake up that drains all of them.
+    int cmdEventFd;
+    struct android_app_cmd_node* cmdQueueHead;
+    struct android_app_cmd_node* cmdQueueTail;
+    struct android_app_cmd_pool* cmdPool;
+    bool cmdWakePending;
+
+    // Latency histograms for each stage of handling each command, see
+    // android_app_get_cmd_latency().
+    struct android_app_cmd_stats* cmdStats;
+
+    // If set, the main thread doesn't wait for lifecycle commands to be
+    // handled, except for waiting up to `windowTeardownTimeoutNanos` for
+    // APP_CMD_TERM_WINDOW and APP_CMD_SAVE_STATE, see
+    // android_app_set_non_blocking_lifecycle().
+    bool nonBlockingLifecycle;
+    int64_t windowTeardownTimeoutNanos;
+
+    // The number of APP_CMD_TERM_WINDOW commands that have been written and
+    // handled, so the main thread can wait for the last one to be handled.
+    uint64_t windowTermsWritten;
+    uint64_t windowTermsHandled;
+
+    // The number of APP_CMD_SAVE_STATE commands that have been written and
+    // handled, so a saved state that's only handled after the main thread
+    // stopped waiting for it isn't taken for a later one.
+    uint64_t stateSavesWritten;
+    uint64_t stateSavesHandled;
+
+    // The window handed over by the last APP_CMD_INIT_WINDOW record that was
+    // read, if it was written in non-blocking mode, which becomes `window` in
+    // android_app_pre_exec_cmd(). Only accessed by the app thread.
+    ANativeWindow* handoffWindow;
+
+    // Whether `window` holds a reference that's released once the window has
+    // been terminated.
+    bool windowAcquired;
 
     pthread_t thread;
 
@@ -263,6 +383,18 @@ struct android_app {
     android_key_event_filter keyEventFilter;
     android_motion_event_filter motionEventFilter;
 
+    // If set, motion events are buffered with their pointers stored in
+    // `pointerArrays` instead of `pointers`.
+    bool motionEventPointerArrays;
+
+    // If set, ACTION_MOVE events are coalesced into the previous event, if
+    // possible, while it's waiting to be handled.
+    bool motionEventCoalescing;
+
+    // What to do with input events that arrive while the input ring is full,
+    // one of `NativeAppGlueInputOverflow`.
+    int inputOverflowPolicy;
+
     // When new input is received we set both of these flags and use the looper to
     // wake up the application mainloop.
     //
@@ -279,7 +411,8 @@ struct android_app {
     // The next time android_app_swap_input_buffers is called, both flags will be
     // cleared.
     //
-    // NB: both of these should only be read with the app mutex held
+    // NB: both of these are accessed atomically, without the app mutex, since
+    // they are set when input is pushed from the Java main thread.
     bool inputAvailableWakeUp;
     bool inputSwapPending;
 
@@ -306,10 +439,27 @@ enum NativeAppGlueLooperId {
      */
     LOOPER_ID_INPUT = 2,
 
+    /**
+     * Looper data ID of the file descriptor that android-activity makes
+     * readable when a requested vsync frame is ready.
+     */
+    LOOPER_ID_FRAME = 3,
+
+    /**
+     * Looper data ID of the file descriptors that an application registers
+     * with android-activity as event sources, which are told apart by the
+     * file descriptor that ALooper_pollOnce() returns.
+     */
+    LOOPER_ID_FD = 4,
+
     /**
      * Start of user-defined ALooper identifiers.
+     *
+     * NB: this used to be 3, before LOOPER_ID_FRAME and LOOPER_ID_FD were
+     * reserved, so code that hard-codes the old identifiers must be updated
+     * to start from this value instead.
      */
-    LOOPER_ID_USER = 3,
+    LOOPER_ID_USER = 5,
 };
 
 /**
@@ -422,12 +572,72 @@ enum NativeAppGlueAppCmd {
 
 };
 
+/**
+ * A command passed from the application's main Java thread to the game's
+ * thread, along with any data that was sent with it.
+ */
+struct android_app_cmd_record {
+    /** One of the `NativeAppGlueAppCmd` values. */
+    int32_t cmd;
+
+    /**
+     * For APP_CMD_WINDOW_RESIZED, the new width of the window.
+     */
+    int32_t width;
+
+    /**
+     * For APP_CMD_WINDOW_RESIZED, the new height of the window.
+     */
+    int32_t height;
+
+    /**
+     * For APP_CMD_LOW_MEMORY, the level passed to onTrimMemory(), see
+     * https://developer.android.com/reference/android/content/ComponentCallbacks2
+     */
+    int32_t trimMemoryLevel;
+
+    /**
+     * For APP_CMD_CONTENT_RECT_CHANGED, the new content rect.
+     */
+    ARect contentRect;
+
+    /**
+     * For APP_CMD_WINDOW_INSETS_CHANGED, a mask of `1 << GameCommonInsetsType`
+     * bits for the insets that changed, see
+     * GameActivity_getWindowInsetsSnapshot().
+     */
+    uint32_t insetsChangedMask;
+
+    /**
+     * For APP_CMD_INIT_WINDOW, when it's written in non-blocking mode (see
+     * android_app_set_non_blocking_lifecycle()), the new window, holding a
+     * reference that's owned by the glue. Otherwise NULL.
+     *
+     * Applications should use android_app->window, which is set from this by
+     * android_app_pre_exec_cmd().
+     */
+    ANativeWindow* window;
+};
+
 /**
  * Call when ALooper_pollAll() returns LOOPER_ID_MAIN, reading the next
  * app command message.
+ *
+ * Returns -1 if there are no more pending commands. All the commands that are
+ * pending when LOOPER_ID_MAIN is returned should be read and executed before
+ * polling again.
  */
 int8_t android_app_read_cmd(struct android_app* android_app);
 
+/**
+ * Like android_app_read_cmd(), but also returns the data that was sent with the
+ * command.
+ *
+ * Returns false if there are no more pending commands.
+ */
+bool android_app_read_cmd_record(struct android_app* android_app,
+                                 struct android_app_cmd_record* record);
+
 /**
  * Call with the command returned by android_app_read_cmd() to do the
  * initial pre-processing of the given command.  You can perform your own
@@ -443,8 +653,12 @@ void android_app_pre_exec_cmd(struct android_app* android_app, int8_t cmd);
 void android_app_post_exec_cmd(struct android_app* android_app, int8_t cmd);
 
 /**
- * Call this before processing input events to get the events buffer.
- * The function returns NULL if there are no events to process.
+ * Call this before processing input events to acquire the events buffered so
+ * far. The function returns NULL if there are no events to process.
+ *
+ * Events that are pushed after this call are only made visible by the next
+ * call, after the acquired events have been released with
+ * android_app_clear_motion_events() and android_app_clear_key_events().
  */
 struct android_input_buffer* android_app_swap_input_buffers(
     struct android_app* android_app);
@@ -453,6 +667,9 @@ struct android_input_buffer* android_app_swap_input_buffers(
  * Clear the array of motion events that were waiting to be handled, and release
  * each of them.
  *
+ * This returns their slots in the input ring to the producer, and the storage
+ * for the events and their history is kept for reuse by subsequent events.
+ *
  * This method should be called after you have processed the motion events in
  * your game loop. You should handle events at each iteration of your game loop.
  */
@@ -479,6 +696,9 @@ extern void _rust_glue_entry(struct android_app* app);
  * android_native_app_glue. If filter is set to NULL, no filtering is done.
  *
  * The default key filter will filter out volume and camera button presses.
+ *
+ * The filter is called after each event has been converted from Java. Use
+ * GameActivity_setInputFilter() to reject events before they're converted.
  */
 void android_app_set_key_event_filter(struct android_app* app,
                                       android_key_event_filter filter);
@@ -491,15 +711,225 @@ void android_app_set_key_event_filter(struct android_app* app,
  * Note that the default motion event filter will only allow touchscreen events
  * through, in order to mimic NativeActivity's behaviour, so for controller
  * events to be passed to the app, set the filter to NULL.
+ *
+ * As with key events, GameActivity_setInputFilter() can instead reject events
+ * before they're converted from Java.
  */
 void android_app_set_motion_event_filter(struct android_app* app,
                                          android_motion_event_filter filter);
 
+/**
+ * Set whether buffered motion events should store their pointers in
+ * `GameActivityMotionEvent::pointerArrays`, instead of `pointers`.
+ *
+ * This structure-of-arrays layout only stores the enabled axes for the
+ * pointers in each event, which avoids copying the full `pointers` array (over
+ * 1.6KB) for every event and keeps the values of each axis contiguous.
+ *
+ * This is disabled by default.
+ */
+void android_app_set_motion_event_pointer_arrays(struct android_app* app,
+                                                 bool enabled);
+
+/**
+ * Set whether ACTION_MOVE motion events should be coalesced while the
+ * application thread is falling behind.
+ *
+ * When enabled, a move event that arrives before the previous event has been
+ * acquired via android_app_swap_input_buffers() is merged into the previous
+ * event, if it's also a move from the same device with the same pointers and
+ * state. The samples of the previous event are appended to its history, as
+ * Android does when batching motion events, so no samples are lost while the
+ * number of events to dispatch stays bounded.
+ *
+ * This is disabled by default.
+ */
+void android_app_set_motion_coalescing(struct android_app* app, bool enabled);
+
+/**
+ * Set whether the axis values and history of motion events should only be
+ * decoded on demand, by the application thread.
+ *
+ * When enabled, the Java main thread only decodes the scalar state of each
+ * motion event (plus its pointer ids and tool types) before queuing it, and
+ * the rest of the event is read via its `deferredEvent`, see
+ * GameActivity_setDeferredMotionEventDecoding(). The `deferredEvent` of each
+ * event is released by android_app_clear_motion_events().
+ *
+ * Deferred events are never coalesced, and this has no effect before API 31.
+ *
+ * This is disabled by default.
+ */
+void android_app_set_deferred_motion_event_decoding(struct android_app* app,
+                                                    bool enabled);
+
+/**
+ * What happens to input events that arrive while the input ring is full,
+ * because the application thread isn't keeping up with them, or that can't be
+ * stored because there's no memory for the history of a motion event.
+ *
+ * In either case the event is counted in `motionEventsDropped` or
+ * `keyEventsDropped` of `android_app::inputBuffer`.
+ */
+enum NativeAppGlueInputOverflow {
+    /**
+     * The event is dropped and reported to GameActivity as unhandled, so that
+     * the system may handle it instead (e.g. for the back button).
+     */
+    INPUT_OVERFLOW_REJECT = 0,
+
+    /**
+     * The event is dropped and reported to GameActivity as handled.
+     */
+    INPUT_OVERFLOW_DISCARD = 1,
+};
+
+/**
+ * Set what happens to input events that arrive while the input ring is full,
+ * as one of `NativeAppGlueInputOverflow`.
+ *
+ * The default is INPUT_OVERFLOW_REJECT.
+ */
+void android_app_set_input_overflow_policy(struct android_app* app,
+                                           int32_t policy);
+
 /**
  * Determines if a looper wake up was due to new input becoming available
  */
 bool android_app_input_available_wake_up(struct android_app* app);
 
+/**
+ * Set whether the main thread hands over lifecycle changes without waiting
+ * for the app thread to handle them.
+ *
+ * By default, the main thread waits until the app thread has handled each
+ * change to the activity state or window, so a long frame on the app thread
+ * also stalls the UI thread.
+ *
+ * In non-blocking mode, APP_CMD_START, APP_CMD_RESUME, APP_CMD_PAUSE,
+ * APP_CMD_STOP and APP_CMD_INIT_WINDOW are written without waiting, and
+ * android_app->activityState and android_app->window are updated when the
+ * app thread pre-processes them. Each new window is handed over with its own
+ * reference (see ANativeWindow_acquire()), which is released once it has been
+ * terminated, so it stays valid for the app thread even if the main thread has
+ * moved on.
+ *
+ * Android requires that a window isn't used once onNativeWindowDestroyed()
+ * returns, so the main thread still waits for APP_CMD_TERM_WINDOW to be
+ * handled, but only for up to `windowTeardownTimeoutNanos` (or indefinitely,
+ * if it's negative). After a timeout, rendering to the window will fail, but
+ * the window itself stays valid until the app thread has terminated it.
+ *
+ * APP_CMD_SAVE_STATE is waited for with the same timeout, since the saved
+ * state has to be returned to Java. After a timeout, no state is saved.
+ * APP_CMD_DESTROY is always waited for, since the app thread has to exit
+ * before the android_app can be freed.
+ *
+ * This may be called from any thread and applies to subsequent changes. If
+ * the main thread is currently waiting for a lifecycle command to be handled,
+ * enabling this also stops that wait, or bounds it by the timeout (counted
+ * from when the command was written) for APP_CMD_TERM_WINDOW and
+ * APP_CMD_SAVE_STATE. The current window is then acquired for the app
+ * thread, as if it had been handed over in non-blocking mode.
+ */
+void android_app_set_non_blocking_lifecycle(struct android_app* app,
+                                            bool enabled,
+                                            int64_t windowTeardownTimeoutNanos);
+
+/**
+ * The stages of handling an app command, from the main thread writing it to
+ * the main thread being unblocked, for android_app_get_cmd_latency().
+ */
+enum NativeAppGlueCmdStage {
+    /**
+     * From the main thread writing the command to the app thread reading it.
+     */
+    APP_CMD_STAGE_QUEUED = 0,
+
+    /**
+     * The app thread calling android_app_pre_exec_cmd().
+     */
+    APP_CMD_STAGE_PRE_EXEC = 1,
+
+    /**
+     * From android_app_pre_exec_cmd() returning to android_app_post_exec_cmd()
+     * being called, which is the application's handling of the command.
+     */
+    APP_CMD_STAGE_CALLBACK = 2,
+
+    /**
+     * The app thread calling android_app_post_exec_cmd().
+     */
+    APP_CMD_STAGE_POST_EXEC = 3,
+
+    /**
+     * For commands that the main thread waits for, from the app thread
+     * acknowledging the command to the main thread waking up.
+     */
+    APP_CMD_STAGE_UNBLOCK = 4,
+
+    /**
+     * For commands that the main thread waits for, the whole time that it
+     * waited, from writing the command to waking up.
+     *
+     * The main thread waits for APP_CMD_START, APP_CMD_RESUME, APP_CMD_PAUSE
+     * and APP_CMD_STOP to be pre-processed, for APP_CMD_INIT_WINDOW or
+     * APP_CMD_TERM_WINDOW and APP_CMD_SAVE_STATE to be post-processed and for
+     * APP_CMD_DESTROY until the app thread exits. In non-blocking mode, it
+     * only waits for APP_CMD_TERM_WINDOW, APP_CMD_SAVE_STATE and
+     * APP_CMD_DESTROY.
+     */
+    APP_CMD_STAGE_WAIT = 5,
+
+    APP_CMD_STAGE_COUNT = 6,
+};
+
+/** The number of buckets in an `android_app_latency_histogram`. */
+#define NATIVE_APP_GLUE_LATENCY_BUCKETS 24
+
+/**
+ * A histogram of the latencies of one stage of handling a command.
+ */
+struct android_app_latency_histogram {
+    /** The number of latencies that have been recorded. */
+    uint64_t count;
+
+    /** The sum of the latencies, in nanoseconds. */
+    uint64_t totalNanos;
+
+    /** The longest latency, in nanoseconds. */
+    uint64_t maxNanos;
+
+    /**
+     * The number of latencies in each bucket. The first bucket counts
+     * latencies under 1 microsecond, bucket `i` counts latencies from 2^(i-1)
+     * up to 2^i microseconds and the last bucket also counts any longer
+     * latencies.
+     */
+    uint64_t buckets[NATIVE_APP_GLUE_LATENCY_BUCKETS];
+};
+
+/**
+ * Get the histogram of latencies for a stage of handling a command, as one of
+ * `NativeAppGlueCmdStage`, accumulated since the app was created.
+ *
+ * This may be called from any thread, and returns false if `cmd` or `stage`
+ * isn't valid.
+ */
+bool android_app_get_cmd_latency(struct android_app* app, int32_t cmd,
+                                 int32_t stage,
+                                 struct android_app_latency_histogram* outHist);
+
+/**
+ * Get the command that the main thread is currently waiting for the app
+ * thread to handle, if any, and how long it has been waiting, in nanoseconds.
+ *
+ * This may be called from any thread, to watch for an app thread that has
+ * stalled, and returns false if the main thread isn't waiting.
+ */
+bool android_app_get_pending_cmd(struct android_app* app, int32_t* outCmd,
+                                 int64_t* outWaitedNanos);
+
 #ifdef __cplusplus
 }
 #endif
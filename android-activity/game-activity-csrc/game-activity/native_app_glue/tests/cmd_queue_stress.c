@@ -0,0 +1,211 @@
+/*
+ * Stress test for the multi-producer, single-consumer command queue of the
+ * native app glue.
+ *
+ * Several producer threads write commands with android_app_write_cmd_record(),
+ * as the Java main thread and other callers of the glue do, while the main
+ * thread waits on the eventfd and drains the queue with
+ * android_app_read_cmd_record(), as an application's android_main thread
+ * would. Each command carries its producer and sequence number, so a command
+ * that's lost, duplicated or reordered by its producer shows up as a wrong
+ * value, and a wake up that's lost shows up as a timeout while commands are
+ * still expected.
+ *
+ * Then, from a single thread, it checks that nodes only get allocated once the
+ * node pool is exhausted, and that pooled nodes are reused.
+ *
+ * The glue is included directly, to reach its static functions. Build and
+ * run it on a device or emulator with the NDK, e.g.:
+ *
+ *   $CC -std=gnu11 -O2 -pthread -I../../.. -I.. cmd_queue_stress.c \
+ *       -landroid -llog -o cmd_queue_stress
+ *   adb push cmd_queue_stress /data/local/tmp
+ *   adb shell /data/local/tmp/cmd_queue_stress
+ *
+ * where $CC is the NDK's clang for the target, e.g.
+ * aarch64-linux-android30-clang. Adding -fsanitize=thread also checks the
+ * queue for data races.
+ */
+
+#include "android_native_app_glue.c"
+
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+/*
+ * The rest of GameActivity isn't needed for the command queue, and none of
+ * these are reached.
+ */
+void GameActivityMotionEvent_releaseDeferred(
+    const GameActivityMotionEvent* event) {
+    (void)event;
+    abort();
+}
+
+void GameActivity_setDeferredMotionEventDecoding(GameActivity* activity,
+                                                 bool enabled) {
+    (void)activity;
+    (void)enabled;
+    abort();
+}
+
+void GameActivity_getWindowInsetsSnapshot(GameActivity* activity,
+                                          GameActivityWindowInsets* insets) {
+    (void)activity;
+    (void)insets;
+    abort();
+}
+
+void _rust_glue_entry(struct android_app* app) {
+    (void)app;
+    abort();
+}
+
+#define PRODUCERS 3
+#define COMMANDS 300000
+// How long to wait for a wake up before treating it as lost
+#define WAKE_TIMEOUT_MILLIS 2000
+
+static struct android_app gApp;
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fprintf(stderr, "\n");                          \
+            exit(1);                                        \
+        }                                                   \
+    } while (0)
+
+static void* produce(void* arg) {
+    int32_t producer = (int32_t)(intptr_t)arg;
+    for (int32_t i = 0; i < COMMANDS; i++) {
+        struct android_app_cmd_record record = {
+            .cmd = APP_CMD_WINDOW_RESIZED,
+            .width = producer,
+            .height = i,
+        };
+        android_app_write_cmd_record(&gApp, &record);
+        // Let the consumer catch up now and then, so the queue is drained
+        // and the wake up flag cleared while commands are still being written
+        if (i % 64 == 0) sched_yield();
+    }
+    return NULL;
+}
+
+// Set up in the same way as android_app_create
+static void initApp(struct android_app* app) {
+    app->cmdEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    CHECK(app->cmdEventFd >= 0, "eventfd: %s", strerror(errno));
+    CHECK(cmdQueueInit(app), "cmdQueueInit");
+}
+
+static void testConcurrent(void) {
+    initApp(&gApp);
+
+    pthread_t producers[PRODUCERS];
+    for (intptr_t p = 0; p < PRODUCERS; p++) {
+        pthread_create(&producers[p], NULL, produce, (void*)p);
+    }
+
+    int32_t next[PRODUCERS] = {0};
+    uint64_t total = 0;
+    uint64_t wakes = 0;
+    while (total < (uint64_t)PRODUCERS * COMMANDS) {
+        struct pollfd pfd = {.fd = gApp.cmdEventFd, .events = POLLIN};
+        CHECK(poll(&pfd, 1, WAKE_TIMEOUT_MILLIS) == 1,
+              "lost wake up after %llu commands", (unsigned long long)total);
+        wakes++;
+
+        struct android_app_cmd_record record;
+        while (android_app_read_cmd_record(&gApp, &record)) {
+            CHECK(record.cmd == APP_CMD_WINDOW_RESIZED, "cmd %d", record.cmd);
+            CHECK(record.width >= 0 && record.width < PRODUCERS,
+                  "producer %d", record.width);
+            CHECK(record.height == next[record.width],
+                  "producer %d: command %d, expected %d", record.width,
+                  record.height, next[record.width]);
+            next[record.width]++;
+            total++;
+        }
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_join(producers[p], NULL);
+    }
+
+    // Once drained, there's no pending wake up and nothing left to read
+    struct android_app_cmd_record record;
+    CHECK(!android_app_read_cmd_record(&gApp, &record), "extra command");
+    struct pollfd pfd = {.fd = gApp.cmdEventFd, .events = POLLIN};
+    CHECK(poll(&pfd, 1, 0) == 0, "eventfd still signalled");
+    CHECK(!gApp.cmdWakePending, "wake up still pending");
+
+    uint64_t queued =
+        gApp.cmdStats->latency[APP_CMD_WINDOW_RESIZED][APP_CMD_STAGE_QUEUED]
+            .count;
+    CHECK(queued == total, "%llu queued latencies for %llu commands",
+          (unsigned long long)queued, (unsigned long long)total);
+
+    printf("concurrent: %llu commands in %llu wake ups, %llu nodes allocated\n",
+           (unsigned long long)total, (unsigned long long)wakes,
+           (unsigned long long)gApp.cmdPool->allocations);
+}
+
+static void writeCmds(struct android_app* app, int32_t first, int32_t count) {
+    for (int32_t i = first; i < first + count; i++) {
+        struct android_app_cmd_record record = {
+            .cmd = APP_CMD_WINDOW_RESIZED,
+            .height = i,
+        };
+        android_app_write_cmd_record(app, &record);
+    }
+}
+
+static void readCmds(struct android_app* app, int32_t first, int32_t count) {
+    struct android_app_cmd_record record;
+    for (int32_t i = first; i < first + count; i++) {
+        CHECK(android_app_read_cmd_record(app, &record), "command %d lost", i);
+        CHECK(record.height == i, "command %d, expected %d", record.height, i);
+    }
+    CHECK(!android_app_read_cmd_record(app, &record), "extra command");
+}
+
+static void testPool(void) {
+    static struct android_app app;
+    initApp(&app);
+
+    // The stub node takes one node from the pool, and each queued command
+    // another, until it's empty
+    const int32_t pooled = NATIVE_APP_GLUE_CMD_POOL_SIZE - 1;
+    writeCmds(&app, 0, pooled);
+    CHECK(app.cmdPool->allocations == 0, "%llu nodes allocated",
+          (unsigned long long)app.cmdPool->allocations);
+    writeCmds(&app, pooled, 2);
+    CHECK(app.cmdPool->allocations == 2, "%llu nodes allocated",
+          (unsigned long long)app.cmdPool->allocations);
+    readCmds(&app, 0, pooled + 2);
+
+    // Once drained, the pooled nodes are reused, while the allocated nodes
+    // are freed (except for the stub node, until the next command is read)
+    for (int round = 0; round < 3; round++) {
+        writeCmds(&app, 0, pooled);
+        readCmds(&app, 0, pooled);
+    }
+    CHECK(app.cmdPool->allocations == 2, "%llu nodes allocated",
+          (unsigned long long)app.cmdPool->allocations);
+    CHECK((uintptr_t)app.cmdQueueTail - (uintptr_t)app.cmdPool->nodes <
+              sizeof(app.cmdPool->nodes),
+          "stub node not pooled");
+
+    printf("pool: ok\n");
+}
+
+int main(void) {
+    testConcurrent();
+    testPool();
+    printf("ok\n");
+    return 0;
+}
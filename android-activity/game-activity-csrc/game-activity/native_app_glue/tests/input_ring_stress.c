@@ -0,0 +1,492 @@
+/*
+ * Stress test for the single-producer, single-consumer input rings of the
+ * native app glue.
+ *
+ * A producer thread pushes events through the same onTouchEvent and onKey
+ * callbacks that GameActivity calls on the Java main thread, while the main
+ * thread consumes them with android_app_swap_input_buffers(), as an
+ * application's android_main thread would. Every field that's checked is
+ * derived from the event's sequence number, so an event that's read before
+ * it has been published, or a slot that's reused before it's released, shows
+ * up as a wrong value.
+ *
+ * Some of the events are tagged as deferred, as they would be with deferred
+ * MotionEvent decoding, and each of these has to be released exactly once,
+ * whether it's consumed, dropped on overflow or rejected, and must never be
+ * coalesced.
+ *
+ * Finally, allocations are made to fail, to check that a motion event whose
+ * history can't be stored is handled like an overflow, and that an event that
+ * can't be coalesced for lack of memory is pushed as a new event instead.
+ *
+ * The glue is included directly, to reach its static callbacks. Build and
+ * run it on a device or emulator with the NDK, e.g.:
+ *
+ *   $CC -std=gnu11 -O2 -pthread -I../../.. -I.. input_ring_stress.c \
+ *       -landroid -llog -o input_ring_stress
+ *   adb push input_ring_stress /data/local/tmp
+ *   adb shell /data/local/tmp/input_ring_stress
+ *
+ * where $CC is the NDK's clang for the target, e.g.
+ * aarch64-linux-android30-clang. Adding -fsanitize=thread also checks the
+ * ring for data races.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Whether the glue's allocations fail
+static bool gFailAllocations;
+
+static void* testMalloc(size_t size) {
+    return gFailAllocations ? NULL : malloc(size);
+}
+
+#define malloc testMalloc
+#include "android_native_app_glue.c"
+#undef malloc
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+/*
+ * The rest of GameActivity isn't needed for the input rings, and none of
+ * these are reached.
+ */
+void GameActivity_setDeferredMotionEventDecoding(GameActivity* activity,
+                                                 bool enabled) {
+    (void)activity;
+    (void)enabled;
+    abort();
+}
+
+void GameActivity_getWindowInsetsSnapshot(GameActivity* activity,
+                                          GameActivityWindowInsets* insets) {
+    (void)activity;
+    (void)insets;
+    abort();
+}
+
+void _rust_glue_entry(struct android_app* app) {
+    (void)app;
+    abort();
+}
+
+#define MOTION_EVENTS 1000000
+#define KEY_EVENT_INTERVAL 16
+#define POINTERS 2
+#define AXES 3
+#define DEFERRED_EVENT_INTERVAL 7
+
+static const int32_t kAxes[AXES] = {AMOTION_EVENT_AXIS_X,
+                                    AMOTION_EVENT_AXIS_Y,
+                                    AMOTION_EVENT_AXIS_PRESSURE};
+
+static GameActivity gActivity;
+static struct android_app gApp;
+
+#define CHECK(cond, ...)                                \
+    do {                                                \
+        if (!(cond)) {                                  \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);               \
+            fprintf(stderr, "\n");                      \
+            exit(1);                                    \
+        }                                               \
+    } while (0)
+
+/*
+ * Deferred events have no decoded history, and their `deferredEvent` is
+ * tagged with the event number + 1, instead of pointing to an AInputEvent.
+ */
+static bool isDeferred(int64_t i) { return i % DEFERRED_EVENT_INTERVAL == 3; }
+
+static int historySize(int64_t i) { return isDeferred(i) ? 0 : (int)(i % 4); }
+
+// Whether each deferred event has been released
+static uint8_t* gDeferredReleased;
+static uint64_t gDeferredReleases;
+
+void GameActivityMotionEvent_releaseDeferred(
+    const GameActivityMotionEvent* event) {
+    if (event->deferredEvent == NULL) return;
+    uintptr_t tag = (uintptr_t)event->deferredEvent;
+    CHECK(tag >= 1 && tag <= MOTION_EVENTS && isDeferred((int64_t)tag - 1),
+          "release of deferred event %llu", (unsigned long long)tag);
+    CHECK(__atomic_exchange_n(&gDeferredReleased[tag - 1], 1,
+                              __ATOMIC_RELAXED) == 0,
+          "deferred event %llu released twice", (unsigned long long)tag - 1);
+    __atomic_fetch_add(&gDeferredReleases, 1, __ATOMIC_RELAXED);
+}
+
+static void resetApp(int32_t policy, bool coalescing) {
+    struct android_input_buffer* buf = &gApp.inputBuffer;
+    free(buf->motionEvents);
+    if (buf->motionEventStorage != NULL) {
+        for (uint64_t i = 0; i <= buf->motionEventsBufferSize; i++) {
+            free(buf->motionEventStorage[i].data);
+        }
+        free(buf->motionEventStorage);
+    }
+    free(buf->keyEvents);
+
+    ALooper* looper = gApp.looper;
+    memset(&gApp, 0, sizeof(gApp));
+    gApp.activity = &gActivity;
+    gApp.looper = looper;
+    gApp.inputOverflowPolicy = policy;
+    gApp.motionEventCoalescing = coalescing;
+
+    // Allocated in the same way as android_app_entry
+    buf->motionEventsBufferSize = NATIVE_APP_GLUE_MOTION_EVENTS_RING_SIZE;
+    buf->motionEvents = (GameActivityMotionEvent*)malloc(
+        sizeof(GameActivityMotionEvent) * buf->motionEventsBufferSize);
+    buf->motionEventStorage = (struct android_motion_event_storage*)calloc(
+        buf->motionEventsBufferSize + 1,
+        sizeof(struct android_motion_event_storage));
+    buf->keyEventsBufferSize = NATIVE_APP_GLUE_KEY_EVENTS_RING_SIZE;
+    buf->keyEvents = (GameActivityKeyEvent*)malloc(
+        sizeof(GameActivityKeyEvent) * buf->keyEventsBufferSize);
+
+    memset(gDeferredReleased, 0, MOTION_EVENTS);
+    gDeferredReleases = 0;
+}
+
+/*
+ * The value of an axis of a pointer in a sample of a motion event, where each
+ * sample has a unique, increasing time.
+ */
+static float axisValue(int64_t time, int pointer, int axis) {
+    return (float)((time % 100000) * 8 + pointer * AXES + axis);
+}
+
+struct producer {
+    // Whether to wait for the consumer when a ring is full
+    bool wait;
+    // The number of events that were reported as unhandled
+    uint64_t motionRejected;
+    uint64_t keyRejected;
+};
+
+static bool ringFull(uint64_t* tail, uint64_t* head, uint64_t size) {
+    return __atomic_load_n(tail, __ATOMIC_RELAXED) -
+               __atomic_load_n(head, __ATOMIC_ACQUIRE) >=
+           size;
+}
+
+static void* produce(void* arg) {
+    struct producer* producer = (struct producer*)arg;
+    struct android_input_buffer* buf = &gApp.inputBuffer;
+    GameActivityMotionEvent event;
+    GameActivityKeyEvent keyEvent;
+    int64_t times[4];
+    float values[4 * POINTERS * AXES];
+
+    memset(&event, 0, sizeof(event));
+    memset(&keyEvent, 0, sizeof(keyEvent));
+    event.pointerCount = POINTERS;
+    for (int a = 0; a < AXES; a++) {
+        event.historicalAxisMask |= UINT64_C(1) << kAxes[a];
+    }
+    event.historicalEventTimesNanos = times;
+    event.historicalEventTimesMillis = times;
+    event.historicalAxisValues = values;
+
+    for (int64_t i = 0; i < MOTION_EVENTS; i++) {
+        // Samples are numbered 10 apart, with up to 4 historical samples
+        // before the current one
+        event.action = i % 50 == 0 ? AMOTION_EVENT_ACTION_DOWN
+                                   : AMOTION_EVENT_ACTION_MOVE;
+        event.historySize = historySize(i);
+        event.deferredEvent =
+            isDeferred(i) ? (const AInputEvent*)(uintptr_t)(i + 1) : NULL;
+        for (int h = 0; h < event.historySize; h++) {
+            times[h] = i * 10 + h;
+            for (int p = 0; p < POINTERS; p++) {
+                for (int a = 0; a < AXES; a++) {
+                    values[(h * POINTERS + p) * AXES + a] =
+                        axisValue(times[h], p, a);
+                }
+            }
+        }
+        event.eventTime = i * 10 + 9;
+        for (int p = 0; p < POINTERS; p++) {
+            event.pointers[p].id = p;
+            for (int a = 0; a < AXES; a++) {
+                event.pointers[p].axisValues[kAxes[a]] =
+                    axisValue(event.eventTime, p, a);
+            }
+        }
+        __atomic_store_n(&gApp.motionEventPointerArrays, (i & 64) != 0,
+                         __ATOMIC_RELAXED);
+
+        while (producer->wait &&
+               ringFull(&buf->motionEventsTail, &buf->motionEventsHead,
+                        buf->motionEventsBufferSize)) {
+            sched_yield();
+        }
+        if (!onTouchEvent(&gActivity, &event)) {
+            producer->motionRejected++;
+        }
+
+        if (i % KEY_EVENT_INTERVAL == 0) {
+            keyEvent.eventTime = i;
+            while (producer->wait &&
+                   ringFull(&buf->keyEventsTail, &buf->keyEventsHead,
+                            buf->keyEventsBufferSize)) {
+                sched_yield();
+            }
+            if (!onKey(&gActivity, &keyEvent)) {
+                producer->keyRejected++;
+            }
+        }
+    }
+
+    __atomic_store_n(&gApp.destroyed, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+struct consumer {
+    // Whether to stall now and then, to let the rings fill up
+    bool stall;
+    uint64_t motionEvents;
+    uint64_t samples;
+    uint64_t keyEvents;
+    int64_t lastTime;
+    int64_t lastKeyTime;
+};
+
+static void checkSample(const GameActivityMotionEvent* event, int64_t time,
+                        int historyPos) {
+    for (int p = 0; p < POINTERS; p++) {
+        for (int a = 0; a < AXES; a++) {
+            float value;
+            if (historyPos < event->historySize) {
+                value = event->historicalAxisValues
+                            [(historyPos * POINTERS + p) * AXES + a];
+            } else if (event->pointerArrays.ids != NULL) {
+                // Only the enabled axes are stored, in order of axis
+                value = event->pointerArrays.axisValues[a * POINTERS + p];
+            } else {
+                value = event->pointers[p].axisValues[kAxes[a]];
+            }
+            CHECK(value == axisValue(time, p, a),
+                  "sample %lld pointer %d axis %d: got %f, expected %f",
+                  (long long)time, p, a, value, axisValue(time, p, a));
+        }
+    }
+}
+
+static void consume(struct consumer* consumer) {
+    consumer->lastTime = -1;
+    consumer->lastKeyTime = -KEY_EVENT_INTERVAL;
+
+    for (uint64_t iteration = 0;; iteration++) {
+        bool done = __atomic_load_n(&gApp.destroyed, __ATOMIC_ACQUIRE);
+        struct android_input_buffer* buf =
+            android_app_swap_input_buffers(&gApp);
+        if (buf == NULL) {
+            if (done) break;
+            sched_yield();
+            continue;
+        }
+
+        for (uint64_t i = 0; i < buf->motionEventsCount; i++) {
+            const GameActivityMotionEvent* event =
+                &buf->motionEvents[(buf->motionEventsHead + i) &
+                                   (buf->motionEventsBufferSize - 1)];
+            CHECK(event->pointerCount == POINTERS, "pointer count %u",
+                  event->pointerCount);
+            // Deferred events are never coalesced, in either direction
+            int64_t number = event->eventTime / 10;
+            const AInputEvent* deferred =
+                isDeferred(number) ? (const AInputEvent*)(uintptr_t)(number + 1)
+                                   : NULL;
+            CHECK(event->deferredEvent == deferred,
+                  "event %lld: deferred event %p, expected %p",
+                  (long long)number, (const void*)event->deferredEvent,
+                  (const void*)deferred);
+            for (int h = 0; h <= event->historySize; h++) {
+                int64_t time = h < event->historySize
+                                   ? event->historicalEventTimesNanos[h]
+                                   : event->eventTime;
+                CHECK(time > consumer->lastTime, "sample %lld after %lld",
+                      (long long)time, (long long)consumer->lastTime);
+                consumer->lastTime = time;
+                checkSample(event, time, h);
+                consumer->samples++;
+            }
+            consumer->motionEvents++;
+        }
+        for (uint64_t i = 0; i < buf->keyEventsCount; i++) {
+            const GameActivityKeyEvent* event =
+                &buf->keyEvents[(buf->keyEventsHead + i) &
+                                (buf->keyEventsBufferSize - 1)];
+            CHECK(event->eventTime > consumer->lastKeyTime &&
+                      event->eventTime % KEY_EVENT_INTERVAL == 0,
+                  "key event %lld after %lld", (long long)event->eventTime,
+                  (long long)consumer->lastKeyTime);
+            consumer->lastKeyTime = event->eventTime;
+            consumer->keyEvents++;
+        }
+
+        if (consumer->stall && iteration % 64 == 0) {
+            usleep(100);
+        }
+        android_app_clear_motion_events(buf);
+        android_app_clear_key_events(buf);
+    }
+}
+
+static uint64_t expectedSamples(void) {
+    uint64_t samples = 0;
+    for (int64_t i = 0; i < MOTION_EVENTS; i++) {
+        samples += 1 + historySize(i);
+    }
+    return samples;
+}
+
+static void run(const char* name, int32_t policy, bool coalescing,
+                bool wait) {
+    resetApp(policy, coalescing);
+    struct producer producer = {.wait = wait};
+    struct consumer consumer = {.stall = !wait};
+
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, produce, &producer) == 0,
+          "pthread_create");
+    consume(&consumer);
+    pthread_join(thread, NULL);
+
+    struct android_input_buffer* buf = &gApp.inputBuffer;
+    uint64_t motionDropped = buf->motionEventsDropped;
+    uint64_t keyDropped = buf->keyEventsDropped;
+    uint64_t coalesced = buf->motionEventsCoalesced;
+    uint64_t keyEvents = MOTION_EVENTS / KEY_EVENT_INTERVAL;
+
+    printf("%s: %llu motion events (%llu coalesced, %llu dropped), "
+           "%llu key events (%llu dropped)\n",
+           name, (unsigned long long)consumer.motionEvents,
+           (unsigned long long)coalesced, (unsigned long long)motionDropped,
+           (unsigned long long)consumer.keyEvents,
+           (unsigned long long)keyDropped);
+
+    // Every event is either consumed, coalesced into an event that's
+    // consumed, or counted as dropped
+    CHECK(consumer.motionEvents + coalesced + motionDropped == MOTION_EVENTS,
+          "lost motion events");
+    CHECK(consumer.keyEvents + keyDropped == keyEvents, "lost key events");
+    if (motionDropped == 0) {
+        CHECK(consumer.samples == expectedSamples(), "lost samples");
+    }
+    if (!coalescing) {
+        CHECK(coalesced == 0, "coalesced while disabled");
+    }
+    uint64_t deferred = 0;
+    for (int64_t i = 0; i < MOTION_EVENTS; i++) {
+        if (!isDeferred(i)) continue;
+        CHECK(gDeferredReleased[i], "deferred event %lld not released",
+              (long long)i);
+        deferred++;
+    }
+    CHECK(gDeferredReleases == deferred, "%llu releases of %llu events",
+          (unsigned long long)gDeferredReleases, (unsigned long long)deferred);
+    if (wait) {
+        CHECK(motionDropped == 0 && keyDropped == 0, "dropped while waiting");
+    }
+
+    // Dropped events are reported as unhandled, unless they're discarded
+    if (policy == INPUT_OVERFLOW_REJECT) {
+        CHECK(producer.motionRejected == motionDropped &&
+                  producer.keyRejected == keyDropped,
+              "rejected events don't match the dropped events");
+    } else {
+        CHECK(producer.motionRejected == 0 && producer.keyRejected == 0,
+              "discarded events were rejected");
+    }
+}
+
+static void testOutOfMemory(void) {
+    resetApp(INPUT_OVERFLOW_REJECT, true);
+    struct android_input_buffer* buf = &gApp.inputBuffer;
+    GameActivityMotionEvent event;
+    int64_t times[1] = {0};
+    float values[POINTERS] = {0};
+    memset(&event, 0, sizeof(event));
+    event.action = AMOTION_EVENT_ACTION_MOVE;
+    event.pointerCount = POINTERS;
+    event.historicalAxisMask = UINT64_C(1) << AMOTION_EVENT_AXIS_X;
+    event.historicalEventTimesNanos = times;
+    event.historicalEventTimesMillis = times;
+    event.historicalAxisValues = values;
+
+    // An event with history is rejected, or discarded, and counted as dropped
+    gFailAllocations = true;
+    event.historySize = 1;
+    CHECK(!onTouchEvent(&gActivity, &event), "event stored without memory");
+    gApp.inputOverflowPolicy = INPUT_OVERFLOW_DISCARD;
+    CHECK(onTouchEvent(&gActivity, &event), "discarded event rejected");
+    CHECK(buf->motionEventsDropped == 2 && buf->motionEventsTail == 0,
+          "%llu dropped, tail %llu",
+          (unsigned long long)buf->motionEventsDropped,
+          (unsigned long long)buf->motionEventsTail);
+
+    // As is a deferred event that needs storage for its pointer arrays, which
+    // is released
+    event.historySize = 0;
+    event.deferredEvent = (const AInputEvent*)(uintptr_t)4;
+    gApp.motionEventPointerArrays = true;
+    CHECK(onTouchEvent(&gActivity, &event), "discarded event rejected");
+    CHECK(gDeferredReleased[3] && gDeferredReleases == 1,
+          "deferred event not released");
+    CHECK(buf->motionEventsDropped == 3, "%llu dropped",
+          (unsigned long long)buf->motionEventsDropped);
+    event.deferredEvent = NULL;
+    gApp.motionEventPointerArrays = false;
+
+    // An event without history needs no storage of its own, but merging it
+    // into the previous event does, so it's pushed as a new event instead
+    gFailAllocations = false;
+    event.eventTime = 1;
+    CHECK(onTouchEvent(&gActivity, &event), "event rejected");
+    gFailAllocations = true;
+    event.eventTime = 2;
+    CHECK(onTouchEvent(&gActivity, &event), "event rejected");
+    gFailAllocations = false;
+    CHECK(buf->motionEventsTail == 2 && buf->motionEventsCoalesced == 0 &&
+              buf->motionEventsDropped == 3,
+          "tail %llu, %llu coalesced, %llu dropped",
+          (unsigned long long)buf->motionEventsTail,
+          (unsigned long long)buf->motionEventsCoalesced,
+          (unsigned long long)buf->motionEventsDropped);
+
+    CHECK(android_app_swap_input_buffers(&gApp) == buf &&
+              buf->motionEventsCount == 2,
+          "%llu events", (unsigned long long)buf->motionEventsCount);
+    for (uint64_t i = 0; i < 2; i++) {
+        const GameActivityMotionEvent* stored = &buf->motionEvents[i];
+        CHECK(stored->eventTime == (int64_t)i + 1 && stored->historySize == 0,
+              "event %llu: time %lld, %d samples", (unsigned long long)i,
+              (long long)stored->eventTime, stored->historySize);
+    }
+    android_app_clear_motion_events(buf);
+
+    printf("out of memory: ok\n");
+}
+
+int main(void) {
+    gActivity.instance = &gApp;
+    gApp.looper = ALooper_prepare(0);
+    gDeferredReleased = (uint8_t*)calloc(MOTION_EVENTS, 1);
+
+    run("ordering", INPUT_OVERFLOW_REJECT, false, true);
+    run("coalescing", INPUT_OVERFLOW_REJECT, true, true);
+    run("overflow reject", INPUT_OVERFLOW_REJECT, false, false);
+    run("overflow discard", INPUT_OVERFLOW_DISCARD, false, false);
+    run("overflow coalescing", INPUT_OVERFLOW_DISCARD, true, false);
+    testOutOfMemory();
+
+    printf("ok\n");
+    return 0;
+}
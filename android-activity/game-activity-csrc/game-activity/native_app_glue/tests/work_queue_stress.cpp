@@ -0,0 +1,348 @@
+/*
+ * Stress test for the multi-producer, single-consumer work queue that
+ * GameActivity uses to run work on the application's main thread.
+ *
+ * Several producer threads queue work with write_work(), as
+ * GameActivity_showSoftInput() and the other GameActivity_* functions do
+ * from any thread, while the main thread waits on the eventfd and drains the
+ * queue with mainWorkCallback(), as the main thread's looper would. Each
+ * CMD_SHOW_SOFT_INPUT carries its producer and sequence number, so work
+ * that's lost, duplicated or reordered by its producer shows up as a wrong
+ * value, and a wake up that's lost shows up as a timeout while work is still
+ * expected. Producers retry work that's dropped because the queue is full.
+ *
+ * Then, with no consumer running, it checks that work is dropped once the
+ * queue is full, that only the last CMD_SET_SOFT_INPUT_STATE of a batch is
+ * executed, and the depth and latency statistics that
+ * GameActivity_getWorkQueueStats() reports, along with the JNI statistics
+ * that GameActivity_getJniStats() reports for mainWorkCallback().
+ *
+ * GameActivity.cpp is included directly, to reach its static functions, and
+ * the GameTextInput functions that it calls are replaced with stubs that
+ * record the work that's executed. Build and run it on a device or emulator
+ * with the NDK, e.g.:
+ *
+ *   $CXX -std=c++17 -O2 -pthread -I../../.. -I../.. work_queue_stress.cpp \
+ *       ../../GameActivityEvents.cpp -landroid -llog -o work_queue_stress
+ *   adb push work_queue_stress /data/local/tmp
+ *   adb shell /data/local/tmp/work_queue_stress
+ *
+ * where $CXX is the NDK's clang++ for the target, e.g.
+ * aarch64-linux-android30-clang++. Adding -fsanitize=thread also checks the
+ * queue for data races.
+ */
+
+#include "GameActivity.cpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#define PRODUCERS 3
+#define WORK 200000
+// How long to wait for a wake up before treating it as lost
+#define WAKE_TIMEOUT_MILLIS 2000
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fprintf(stderr, "\n");                          \
+            exit(1);                                        \
+        }                                                   \
+    } while (0)
+
+/*
+ * The work that's executed on the main thread, as recorded by the
+ * GameTextInput stubs. Only the consumer thread writes these.
+ */
+static int64_t gNext[PRODUCERS];
+static uint64_t gShown;
+static uint64_t gStatesSet;
+
+void GameTextInput_showIme(GameTextInput *, uint32_t flags) {
+    int32_t producer = (int32_t)(flags >> 24);
+    int64_t sequence = flags & 0xffffff;
+    CHECK(producer >= 0 && producer < PRODUCERS, "producer %d", producer);
+    CHECK(sequence == gNext[producer], "producer %d: work %lld, expected %lld",
+          producer, (long long)sequence, (long long)gNext[producer]);
+    gNext[producer]++;
+    gShown++;
+}
+void GameTextInput_setState(GameTextInput *, const GameTextInputState *) {
+    gStatesSet++;
+}
+
+/*
+ * The rest of GameActivity isn't needed for the work queue, and none of these
+ * are reached.
+ */
+extern "C" void GameActivity_onCreate_C(GameActivity *, void *, size_t) {
+    abort();
+}
+GameTextInput *GameTextInput_init(JNIEnv *, uint32_t) { abort(); }
+void GameTextInput_destroy(GameTextInput *) {}
+void GameTextInput_setInputConnection(GameTextInput *, jobject) { abort(); }
+void GameTextInput_processEvent(GameTextInput *, jobject) { abort(); }
+void GameTextInput_hideIme(GameTextInput *, uint32_t) { abort(); }
+void GameTextInput_getState(GameTextInput *, GameTextInputGetStateCallback,
+                            void *) {
+    abort();
+}
+uint64_t GameTextInput_getGeneration(const GameTextInput *) { abort(); }
+void GameTextInput_takeEdit(GameTextInput *, bool, GameTextInputEditCallback,
+                            void *) {
+    abort();
+}
+void GameTextInput_setEventCallback(GameTextInput *, GameTextInputEventCallback,
+                                    void *) {
+    abort();
+}
+void GameTextInput_processImeInsets(GameTextInput *, const ARect *) {
+    abort();
+}
+
+/*
+ * CMD_SET_SOFT_INPUT_STATE checks for a Java exception, so the main thread
+ * needs a JNIEnv, which never has one pending.
+ */
+static jboolean mockExceptionCheck(JNIEnv *) { return JNI_FALSE; }
+
+static JNIEnv *mockJNIEnv() {
+    static JNINativeInterface functions;
+    static JNIEnv env;
+    functions.ExceptionCheck = mockExceptionCheck;
+    env.functions = &functions;
+    return &env;
+}
+
+static jint mockGetEnv(JavaVM *, void **env, jint) {
+    *env = mockJNIEnv();
+    return JNI_OK;
+}
+
+static JavaVM *mockJavaVM() {
+    static JNIInvokeInterface functions;
+    static JavaVM vm;
+    functions.GetEnv = mockGetEnv;
+    vm.functions = &functions;
+    return &vm;
+}
+
+// Set up the parts of the NativeCode that the work queue needs, in the same
+// way as initializeNativeCode_native
+static NativeCode *createCode() {
+    NativeCode *code = new NativeCode();
+    code->looper = ALooper_prepare(0);
+    ALooper_acquire(code->looper);
+    code->vm = mockJavaVM();
+    code->mainWorkEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    CHECK(code->mainWorkEventFd >= 0, "eventfd: %s", strerror(errno));
+    code->mainWorkBatch.reserve(ACTIVITY_WORK_QUEUE_SIZE);
+    return code;
+}
+
+static GameActivityWorkQueueStats getStats(NativeCode *code) {
+    GameActivityWorkQueueStats stats;
+    GameActivity_getWorkQueueStats(code, &stats);
+    return stats;
+}
+
+static NativeCode *gCode;
+static uint64_t gDropped[PRODUCERS];
+
+static void *produce(void *arg) {
+    int32_t producer = (int32_t)(intptr_t)arg;
+    for (int32_t i = 0; i < WORK; i++) {
+        uint32_t flags = ((uint32_t)producer << 24) | (uint32_t)i;
+        while (!write_work(gCode, CMD_SHOW_SOFT_INPUT, flags)) {
+            // The queue is full, so let the consumer drain it
+            gDropped[producer]++;
+            sched_yield();
+        }
+        // Interleave text input state updates, which may be collapsed
+        if (i % 16 == 0) {
+            while (!write_work(gCode, CMD_SET_SOFT_INPUT_STATE)) {
+                gDropped[producer]++;
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+
+static void testConcurrent() {
+    gCode = createCode();
+
+    pthread_t producers[PRODUCERS];
+    for (intptr_t p = 0; p < PRODUCERS; p++) {
+        pthread_create(&producers[p], NULL, produce, (void *)p);
+    }
+
+    while (gShown < (uint64_t)PRODUCERS * WORK) {
+        struct pollfd pfd = {gCode->mainWorkEventFd, POLLIN, 0};
+        CHECK(poll(&pfd, 1, WAKE_TIMEOUT_MILLIS) == 1,
+              "lost wake up after %llu work items",
+              (unsigned long long)gShown);
+        mainWorkCallback(gCode->mainWorkEventFd, POLLIN, gCode);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_join(producers[p], NULL);
+    }
+    // Drain the last text input state updates, if they're still queued
+    mainWorkCallback(gCode->mainWorkEventFd, POLLIN, gCode);
+
+    uint64_t dropped = 0;
+    for (int p = 0; p < PRODUCERS; p++) dropped += gDropped[p];
+    uint64_t statesQueued = (uint64_t)PRODUCERS * ((WORK + 15) / 16);
+    GameActivityWorkQueueStats stats = getStats(gCode);
+    printf("concurrent: %llu queued (%llu dropped, %llu collapsed), "
+           "%llu wake ups, max depth %u, mean latency %lldns, max %lldns\n",
+           (unsigned long long)stats.queued, (unsigned long long)stats.dropped,
+           (unsigned long long)stats.collapsed,
+           (unsigned long long)stats.wakeUps, stats.maxDepth,
+           (long long)(stats.totalLatencyNanos / (int64_t)stats.handled),
+           (long long)stats.maxLatencyNanos);
+
+    CHECK(stats.queued == (uint64_t)PRODUCERS * WORK + statesQueued,
+          "%llu queued", (unsigned long long)stats.queued);
+    CHECK(stats.dropped == dropped, "%llu dropped, expected %llu",
+          (unsigned long long)stats.dropped, (unsigned long long)dropped);
+    CHECK(stats.handled + stats.collapsed == stats.queued,
+          "%llu handled and %llu collapsed of %llu queued",
+          (unsigned long long)stats.handled,
+          (unsigned long long)stats.collapsed,
+          (unsigned long long)stats.queued);
+    CHECK(gStatesSet + stats.collapsed == statesQueued,
+          "%llu states set and %llu collapsed of %llu",
+          (unsigned long long)gStatesSet, (unsigned long long)stats.collapsed,
+          (unsigned long long)statesQueued);
+    CHECK(stats.depth == 0, "depth %u", stats.depth);
+    // NB: a wake up may handle more work than fits in the queue, since
+    // producers can refill it while it's being drained
+    CHECK(stats.maxDepth > 0, "max depth %u", stats.maxDepth);
+    CHECK(stats.maxLatencyNanos <= stats.totalLatencyNanos,
+          "max latency %lld of %lld", (long long)stats.maxLatencyNanos,
+          (long long)stats.totalLatencyNanos);
+
+    // Once drained, there's no pending wake up and nothing left to read
+    ActivityWork work;
+    CHECK(!gCode->mainWorkQueue.pop(&work), "extra work");
+    struct pollfd pfd = {gCode->mainWorkEventFd, POLLIN, 0};
+    CHECK(poll(&pfd, 1, 0) == 0, "eventfd still signalled");
+    CHECK(!gCode->mainWorkWakePending, "wake up still pending");
+
+    delete gCode;
+}
+
+static void testFullQueue() {
+    NativeCode *code = createCode();
+    gShown = 0;
+    for (int p = 0; p < PRODUCERS; p++) gNext[p] = 0;
+
+    for (uint32_t i = 0; i < ACTIVITY_WORK_QUEUE_SIZE; i++) {
+        CHECK(write_work(code, CMD_SHOW_SOFT_INPUT, i), "work %u dropped", i);
+    }
+    CHECK(!write_work(code, CMD_SHOW_SOFT_INPUT, ACTIVITY_WORK_QUEUE_SIZE),
+          "work queued when full");
+    GameActivityWorkQueueStats stats = getStats(code);
+    CHECK(stats.queued == ACTIVITY_WORK_QUEUE_SIZE, "%llu queued",
+          (unsigned long long)stats.queued);
+    CHECK(stats.dropped == 1, "%llu dropped",
+          (unsigned long long)stats.dropped);
+    CHECK(stats.depth == ACTIVITY_WORK_QUEUE_SIZE, "depth %u", stats.depth);
+
+    // The dropped work doesn't reach the main thread, and the queue has room
+    // again once it's drained
+    mainWorkCallback(code->mainWorkEventFd, POLLIN, code);
+    CHECK(gShown == ACTIVITY_WORK_QUEUE_SIZE, "%llu shown",
+          (unsigned long long)gShown);
+    CHECK(write_work(code, CMD_SHOW_SOFT_INPUT, ACTIVITY_WORK_QUEUE_SIZE),
+          "work dropped once drained");
+    mainWorkCallback(code->mainWorkEventFd, POLLIN, code);
+    stats = getStats(code);
+    CHECK(stats.handled == ACTIVITY_WORK_QUEUE_SIZE + 1, "%llu handled",
+          (unsigned long long)stats.handled);
+    CHECK(stats.maxDepth == ACTIVITY_WORK_QUEUE_SIZE, "max depth %u",
+          stats.maxDepth);
+    CHECK(stats.depth == 0, "depth %u", stats.depth);
+
+    delete code;
+}
+
+static void testCollapseAndLatency() {
+    NativeCode *code = createCode();
+    gShown = 0;
+    gStatesSet = 0;
+    for (int p = 0; p < PRODUCERS; p++) gNext[p] = 0;
+
+    // Repeated text input state updates around other work, of which only the
+    // last update is executed
+    write_work(code, CMD_SET_SOFT_INPUT_STATE);
+    write_work(code, CMD_SET_SOFT_INPUT_STATE);
+    write_work(code, CMD_SHOW_SOFT_INPUT, 0);
+    write_work(code, CMD_SET_SOFT_INPUT_STATE);
+    write_work(code, CMD_SET_SOFT_INPUT_STATE);
+    write_work(code, CMD_SHOW_SOFT_INPUT, 1);
+    CHECK(getStats(code).depth == 6, "depth %u", getStats(code).depth);
+
+    // Every item waits in the queue for at least this long
+    const int64_t waitNanos = 20000000;
+    struct timespec wait = {0, waitNanos};
+    nanosleep(&wait, NULL);
+    GameActivityJniStats jniBefore;
+    CHECK(GameActivity_getJniStats(GAMEACTIVITY_JNI_ENTRY_MAIN_WORK,
+                                   &jniBefore),
+          "no JNI stats");
+    mainWorkCallback(code->mainWorkEventFd, POLLIN, code);
+
+    // The executed CMD_SET_SOFT_INPUT_STATE checks for an exception, which is
+    // the only JNI call
+    GameActivityJniStats jniAfter;
+    GameActivity_getJniStats(GAMEACTIVITY_JNI_ENTRY_MAIN_WORK, &jniAfter);
+    CHECK(strcmp(jniAfter.name, "mainWorkCallback") == 0, "JNI stats of %s",
+          jniAfter.name);
+    CHECK(jniAfter.calls == jniBefore.calls + 1, "%llu calls",
+          (unsigned long long)(jniAfter.calls - jniBefore.calls));
+    CHECK(jniAfter.jniCalls == jniBefore.jniCalls + 1, "%llu JNI calls",
+          (unsigned long long)(jniAfter.jniCalls - jniBefore.jniCalls));
+    CHECK(jniAfter.localRefs == jniBefore.localRefs, "%llu local refs",
+          (unsigned long long)(jniAfter.localRefs - jniBefore.localRefs));
+    CHECK(!GameActivity_getJniStats(GAMEACTIVITY_JNI_ENTRY_COUNT, &jniAfter),
+          "JNI stats of an unknown entry point");
+
+    GameActivityWorkQueueStats stats = getStats(code);
+    CHECK(gStatesSet == 1, "%llu states set", (unsigned long long)gStatesSet);
+    CHECK(gShown == 2, "%llu shown", (unsigned long long)gShown);
+    CHECK(stats.collapsed == 3, "%llu collapsed",
+          (unsigned long long)stats.collapsed);
+    CHECK(stats.handled == 3, "%llu handled",
+          (unsigned long long)stats.handled);
+    CHECK(stats.wakeUps == 1, "%llu wake ups",
+          (unsigned long long)stats.wakeUps);
+    CHECK(stats.depth == 0, "depth %u", stats.depth);
+    CHECK(stats.maxDepth == 6, "max depth %u", stats.maxDepth);
+    CHECK(stats.maxLatencyNanos >= waitNanos, "max latency %lld",
+          (long long)stats.maxLatencyNanos);
+    CHECK(stats.totalLatencyNanos >= 3 * waitNanos, "total latency %lld",
+          (long long)stats.totalLatencyNanos);
+
+    // Updates in separate batches are each executed
+    write_work(code, CMD_SET_SOFT_INPUT_STATE);
+    mainWorkCallback(code->mainWorkEventFd, POLLIN, code);
+    write_work(code, CMD_SET_SOFT_INPUT_STATE);
+    mainWorkCallback(code->mainWorkEventFd, POLLIN, code);
+    CHECK(gStatesSet == 3, "%llu states set", (unsigned long long)gStatesSet);
+    CHECK(getStats(code).collapsed == 3, "%llu collapsed",
+          (unsigned long long)getStats(code).collapsed);
+
+    delete code;
+}
+
+int main(void) {
+    testConcurrent();
+    testFullQueue();
+    testCollapseAndLatency();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Tests for the packed axis values of GameActivityMotionEvent.
+ *
+ * Only the axes in `historicalAxisMask` are stored in `historicalAxisValues`,
+ * and in `pointerArrays.axisValues` for the compact pointer layout, so
+ * GameActivityMotionEvent_getHistoricalAxisValue and
+ * GameActivityMotionEvent_getPointerAxisValue have to remap each axis to its
+ * index among the enabled axes. Events are built with several sets of enabled
+ * axes, including the default X and Y, and every axis of every pointer and
+ * sample is read back through the accessors.
+ *
+ * For each set of axes, it also prints how many bytes the native app glue
+ * copies into its input ring per event, with both pointer layouts, and how
+ * many it copied before the history was packed, when every sample stored all
+ * of the axes.
+ *
+ * Build and run it on a device or emulator with the NDK, e.g.:
+ *
+ *   $CXX -std=c++17 -O2 -I../.. -I.. motion_event_axes_test.cpp \
+ *       ../GameActivityEvents.cpp -landroid -llog -o motion_event_axes_test
+ *   adb push motion_event_axes_test /data/local/tmp
+ *   adb shell /data/local/tmp/motion_event_axes_test
+ *
+ * where $CXX is the NDK's clang++ for the target, e.g.
+ * aarch64-linux-android30-clang++.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "GameActivityEvents.h"
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fprintf(stderr, "\n");                          \
+            exit(1);                                        \
+        }                                                   \
+    } while (0)
+
+#define POINTERS 3
+#define HISTORY 4
+
+// The value of an axis of a pointer in a sample, where the current sample
+// follows the historical ones
+static float axisValue(int sample, int pointer, int axis) {
+    return (float)(sample * 1000 + pointer * 100 + axis);
+}
+
+// Prints the bytes copied by copyMotionEvent() in android_native_app_glue.c
+static void printCopiedBytes(const GameActivityMotionEvent *event) {
+    size_t axisCount = GameActivityMotionEvent_getHistoricalAxisCount(event);
+    size_t times = 2 * event->historySize * sizeof(int64_t);
+    size_t samples = event->historySize * event->pointerCount * sizeof(float);
+    size_t packed = sizeof(*event) + times + samples * axisCount;
+    size_t unpacked = sizeof(*event) + times +
+                      samples * GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT;
+
+    // With pointer arrays, the `pointers` array is skipped, and only the id,
+    // tool type, raw coordinates and enabled axes of each pointer are copied
+    size_t pointers = offsetof(GameActivityMotionEvent, historySize) -
+                      offsetof(GameActivityMotionEvent, pointers);
+    size_t compact =
+        packed - pointers +
+        event->pointerCount *
+            (2 * sizeof(int32_t) + (2 + axisCount) * sizeof(float));
+
+    printf("%2zu axes, %u pointers, %d samples: %zu bytes copied per event, "
+           "%zu with pointer arrays, %zu before packing\n",
+           axisCount, event->pointerCount, event->historySize, packed,
+           compact, unpacked);
+}
+
+static void testAxes(const std::vector<int> &axes) {
+    GameActivityMotionEvent event;
+    memset(&event, 0, sizeof(event));
+    for (int axis : axes) event.historicalAxisMask |= UINT64_C(1) << axis;
+    int axisCount = (int)axes.size();
+    CHECK(GameActivityMotionEvent_getHistoricalAxisCount(&event) == axisCount,
+          "%d axes counted as %d", axisCount,
+          GameActivityMotionEvent_getHistoricalAxisCount(&event));
+
+    // Laid out as GameActivityMotionEvent_fromJava and the native app glue
+    // store them, with `axes` in ascending order
+    std::vector<int64_t> times(HISTORY);
+    std::vector<float> history(HISTORY * POINTERS * axisCount);
+    std::vector<int32_t> ids(POINTERS), toolTypes(POINTERS);
+    std::vector<float> raw(POINTERS);
+    std::vector<float> values(axisCount * POINTERS);
+    event.pointerCount = POINTERS;
+    event.historySize = HISTORY;
+    event.historicalEventTimesMillis = times.data();
+    event.historicalEventTimesNanos = times.data();
+    event.historicalAxisValues = history.data();
+    for (int h = 0; h < HISTORY; h++) {
+        for (int p = 0; p < POINTERS; p++) {
+            for (int a = 0; a < axisCount; a++) {
+                history[(h * POINTERS + p) * axisCount + a] =
+                    axisValue(h, p, axes[a]);
+            }
+        }
+    }
+    for (int p = 0; p < POINTERS; p++) {
+        for (int a = 0; a < axisCount; a++) {
+            event.pointers[p].axisValues[axes[a]] =
+                axisValue(HISTORY, p, axes[a]);
+            values[a * POINTERS + p] = axisValue(HISTORY, p, axes[a]);
+        }
+    }
+
+    for (int axis = 0; axis < GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT; axis++) {
+        bool enabled = (event.historicalAxisMask >> axis) & 1;
+        for (int p = 0; p < POINTERS; p++) {
+            for (int h = 0; h < HISTORY; h++) {
+                float value = GameActivityMotionEvent_getHistoricalAxisValue(
+                    &event, axis, p, h);
+                float expected = enabled ? axisValue(h, p, axis) : 0.0f;
+                CHECK(value == expected,
+                      "axis %d pointer %d sample %d: got %f, expected %f",
+                      axis, p, h, value, expected);
+            }
+
+            // Both pointer layouts
+            event.pointerArrays.ids = NULL;
+            float value =
+                GameActivityMotionEvent_getPointerAxisValue(&event, axis, p);
+            float expected = enabled ? axisValue(HISTORY, p, axis) : 0.0f;
+            CHECK(value == expected, "axis %d pointer %d: got %f, expected %f",
+                  axis, p, value, expected);
+            event.pointerArrays = {ids.data(), toolTypes.data(), raw.data(),
+                                   raw.data(), values.data()};
+            value =
+                GameActivityMotionEvent_getPointerAxisValue(&event, axis, p);
+            CHECK(value == expected,
+                  "compact axis %d pointer %d: got %f, expected %f", axis, p,
+                  value, expected);
+        }
+    }
+
+    printCopiedBytes(&event);
+
+    // Out of range indices
+    CHECK(GameActivityMotionEvent_getHistoricalAxisValue(&event, axes[0],
+                                                         POINTERS, 0) == -1,
+          "pointer index out of range");
+    CHECK(GameActivityMotionEvent_getHistoricalAxisValue(&event, axes[0], -1,
+                                                         0) == -1,
+          "negative pointer index");
+    CHECK(GameActivityMotionEvent_getHistoricalAxisValue(&event, axes[0], 0,
+                                                         HISTORY) == -1,
+          "history index out of range");
+    CHECK(GameActivityMotionEvent_getPointerAxisValue(
+              &event, GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT, 0) == -1,
+          "axis out of range");
+}
+
+int main(void) {
+    // The default axes
+    testAxes({AMOTION_EVENT_AXIS_X, AMOTION_EVENT_AXIS_Y});
+    testAxes({AMOTION_EVENT_AXIS_X, AMOTION_EVENT_AXIS_Y,
+              AMOTION_EVENT_AXIS_PRESSURE, AMOTION_EVENT_AXIS_GENERIC_1});
+    testAxes({AMOTION_EVENT_AXIS_ORIENTATION});
+
+    std::vector<int> all;
+    for (int axis = 0; axis < GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT; axis++) {
+        all.push_back(axis);
+    }
+    testAxes(all);
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,386 @@
+/*
+ * Counts the JNI calls made to decode a MotionEvent, with the per-axis JNI
+ * fallback and with the one-pass decode over AMotionEvent_fromJava().
+ *
+ * Events are decoded through a mock JNIEnv, whose function table counts each
+ * call and answers MotionEvent's getters from a mock event, and a mock
+ * libandroid.so, whose AMotionEvent accessors read the same mock event. The
+ * mock AMotionEvent_fromJava() returns null for events that are marked as not
+ * having a native view, which makes GameActivityMotionEvent_fromJava() fall
+ * back to calling each MotionEvent getter through JNI, as it does before API
+ * 31. Both decodes are checked against each other, and against the counts of
+ * the JniEntryScope that's open around them.
+ *
+ * Build the mock libandroid.so and the benchmark, and run them on a device or
+ * emulator (API 31 or later) with the NDK, e.g.:
+ *
+ *   $CXX -std=c++17 -O2 -shared -fPIC -DMOCK_LIBANDROID -I../.. -I.. \
+ *       motion_event_jni_bench.cpp -o libandroid.so
+ *   $CXX -std=c++17 -O2 -I../.. -I.. motion_event_jni_bench.cpp \
+ *       ../GameActivityEvents.cpp -L. -landroid -llog \
+ *       -o motion_event_jni_bench
+ *   adb push libandroid.so motion_event_jni_bench /data/local/tmp
+ *   adb shell LD_LIBRARY_PATH=/data/local/tmp \
+ *       /data/local/tmp/motion_event_jni_bench
+ *
+ * where $CXX is the NDK's clang++ for the target, e.g.
+ * aarch64-linux-android31-clang++.
+ */
+
+#include <android/input.h>
+#include <jni.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A MotionEvent, as seen through both the mock JNIEnv and the mock
+// libandroid.so. The current sample follows the historical ones.
+struct MockMotionEvent {
+    bool hasNativeView;
+    int pointerCount;
+    int historySize;
+};
+
+// The value of an axis of a pointer in a sample
+static float mockAxisValue(int sample, int pointer, int axis) {
+    return (float)(sample * 1000 + pointer * 100 + axis);
+}
+
+// The time of a sample, in milliseconds
+static int64_t mockEventTimeMillis(int sample) { return 5000 + sample; }
+
+#ifdef MOCK_LIBANDROID
+
+static const MockMotionEvent *mock(const AInputEvent *event) {
+    return reinterpret_cast<const MockMotionEvent *>(event);
+}
+
+extern "C" {
+
+const AInputEvent *AMotionEvent_fromJava(JNIEnv *, jobject motionEvent) {
+    auto event = reinterpret_cast<const MockMotionEvent *>(motionEvent);
+    return event->hasNativeView ? reinterpret_cast<const AInputEvent *>(event)
+                                : nullptr;
+}
+void AInputEvent_release(const AInputEvent *) {}
+
+int32_t AInputEvent_getDeviceId(const AInputEvent *) { return 1; }
+int32_t AInputEvent_getSource(const AInputEvent *) {
+    return AINPUT_SOURCE_TOUCHSCREEN;
+}
+int32_t AMotionEvent_getAction(const AInputEvent *) {
+    return AMOTION_EVENT_ACTION_MOVE;
+}
+int32_t AMotionEvent_getActionButton(const AInputEvent *) { return 0; }
+int32_t AMotionEvent_getButtonState(const AInputEvent *) { return 0; }
+int32_t AMotionEvent_getClassification(const AInputEvent *) { return 0; }
+int32_t AMotionEvent_getEdgeFlags(const AInputEvent *) { return 0; }
+int32_t AMotionEvent_getFlags(const AInputEvent *) { return 0; }
+int32_t AMotionEvent_getMetaState(const AInputEvent *) { return 0; }
+int64_t AMotionEvent_getDownTime(const AInputEvent *) {
+    return mockEventTimeMillis(0) * 1000000;
+}
+int64_t AMotionEvent_getEventTime(const AInputEvent *event) {
+    return mockEventTimeMillis(mock(event)->historySize) * 1000000;
+}
+float AMotionEvent_getXPrecision(const AInputEvent *) { return 1; }
+float AMotionEvent_getYPrecision(const AInputEvent *) { return 1; }
+
+size_t AMotionEvent_getPointerCount(const AInputEvent *event) {
+    return mock(event)->pointerCount;
+}
+int32_t AMotionEvent_getPointerId(const AInputEvent *, size_t pointer) {
+    return (int32_t)pointer;
+}
+int32_t AMotionEvent_getToolType(const AInputEvent *, size_t) {
+    return AMOTION_EVENT_TOOL_TYPE_FINGER;
+}
+float AMotionEvent_getRawX(const AInputEvent *event, size_t pointer) {
+    return mockAxisValue(mock(event)->historySize, (int)pointer,
+                         AMOTION_EVENT_AXIS_X);
+}
+float AMotionEvent_getRawY(const AInputEvent *event, size_t pointer) {
+    return mockAxisValue(mock(event)->historySize, (int)pointer,
+                         AMOTION_EVENT_AXIS_Y);
+}
+float AMotionEvent_getAxisValue(const AInputEvent *event, int32_t axis,
+                                size_t pointer) {
+    return mockAxisValue(mock(event)->historySize, (int)pointer, axis);
+}
+
+size_t AMotionEvent_getHistorySize(const AInputEvent *event) {
+    return mock(event)->historySize;
+}
+int64_t AMotionEvent_getHistoricalEventTime(const AInputEvent *,
+                                            size_t sample) {
+    return mockEventTimeMillis((int)sample) * 1000000;
+}
+float AMotionEvent_getHistoricalAxisValue(const AInputEvent *, int32_t axis,
+                                          size_t pointer, size_t sample) {
+    return mockAxisValue((int)sample, (int)pointer, axis);
+}
+
+}  // extern "C"
+
+#else  // MOCK_LIBANDROID
+
+#include <vector>
+
+#include "GameActivityEvents.h"
+#include "common/jni_stats.h"
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fprintf(stderr, "\n");                          \
+            exit(1);                                        \
+        }                                                   \
+    } while (0)
+
+// The MotionEvent getters, which are identified by the jmethodID that
+// GetMethodID returns for their name
+static const char *const kMethods[] = {
+    "getDeviceId",
+    "getSource",
+    "getAction",
+    "getEventTime",
+    "getDownTime",
+    "getFlags",
+    "getMetaState",
+    "getActionButton",
+    "getButtonState",
+    "getClassification",
+    "getEdgeFlags",
+    "getHistorySize",
+    "getHistoricalEventTime",
+    "getPointerCount",
+    "getPointerId",
+    "getToolType",
+    "getRawX",
+    "getRawY",
+    "getXPrecision",
+    "getYPrecision",
+    "getAxisValue",
+    "getHistoricalAxisValue",
+};
+#define METHOD_COUNT (sizeof(kMethods) / sizeof(kMethods[0]))
+
+static uint64_t gJniCalls;
+static _jclass gMotionEventClass;
+
+static const char *methodName(jmethodID method) {
+    return *reinterpret_cast<const char *const *>(method);
+}
+
+static jclass mockFindClass(JNIEnv *, const char *) {
+    gJniCalls++;
+    return &gMotionEventClass;
+}
+
+static jmethodID mockGetMethodID(JNIEnv *, jclass, const char *name,
+                                 const char *) {
+    gJniCalls++;
+    for (size_t i = 0; i < METHOD_COUNT; i++) {
+        if (strcmp(kMethods[i], name) == 0) {
+            return reinterpret_cast<jmethodID>(
+                const_cast<const char **>(&kMethods[i]));
+        }
+    }
+    // Not available at this API level
+    return nullptr;
+}
+
+static void mockDeleteLocalRef(JNIEnv *, jobject) { gJniCalls++; }
+
+static jint mockCallIntMethodV(JNIEnv *, jobject obj, jmethodID method,
+                               va_list args) {
+    gJniCalls++;
+    auto event = reinterpret_cast<const MockMotionEvent *>(obj);
+    const char *name = methodName(method);
+    if (strcmp(name, "getSource") == 0) return AINPUT_SOURCE_TOUCHSCREEN;
+    if (strcmp(name, "getAction") == 0) return AMOTION_EVENT_ACTION_MOVE;
+    if (strcmp(name, "getDeviceId") == 0) return 1;
+    if (strcmp(name, "getPointerCount") == 0) return event->pointerCount;
+    if (strcmp(name, "getHistorySize") == 0) return event->historySize;
+    if (strcmp(name, "getPointerId") == 0) return va_arg(args, jint);
+    if (strcmp(name, "getToolType") == 0) return AMOTION_EVENT_TOOL_TYPE_FINGER;
+    return 0;
+}
+
+static jlong mockCallLongMethodV(JNIEnv *, jobject obj, jmethodID method,
+                                 va_list args) {
+    gJniCalls++;
+    auto event = reinterpret_cast<const MockMotionEvent *>(obj);
+    const char *name = methodName(method);
+    if (strcmp(name, "getEventTime") == 0) {
+        return mockEventTimeMillis(event->historySize);
+    }
+    if (strcmp(name, "getDownTime") == 0) return mockEventTimeMillis(0);
+    if (strcmp(name, "getHistoricalEventTime") == 0) {
+        return mockEventTimeMillis(va_arg(args, jint));
+    }
+    return 0;
+}
+
+static jfloat mockCallFloatMethodV(JNIEnv *, jobject obj, jmethodID method,
+                                   va_list args) {
+    gJniCalls++;
+    auto event = reinterpret_cast<const MockMotionEvent *>(obj);
+    const char *name = methodName(method);
+    if (strcmp(name, "getRawX") == 0 || strcmp(name, "getRawY") == 0) {
+        int pointer = va_arg(args, jint);
+        return mockAxisValue(event->historySize, pointer,
+                             name[6] == 'X' ? AMOTION_EVENT_AXIS_X
+                                            : AMOTION_EVENT_AXIS_Y);
+    }
+    if (strcmp(name, "getAxisValue") == 0) {
+        int axis = va_arg(args, jint);
+        int pointer = va_arg(args, jint);
+        return mockAxisValue(event->historySize, pointer, axis);
+    }
+    if (strcmp(name, "getHistoricalAxisValue") == 0) {
+        int axis = va_arg(args, jint);
+        int pointer = va_arg(args, jint);
+        int sample = va_arg(args, jint);
+        return mockAxisValue(sample, pointer, axis);
+    }
+    if (strcmp(name, "getXPrecision") == 0) return 1;
+    if (strcmp(name, "getYPrecision") == 0) return 1;
+    return 0;
+}
+
+static JNIEnv *mockJNIEnv() {
+    static JNINativeInterface functions;
+    static JNIEnv env;
+    functions.FindClass = mockFindClass;
+    functions.GetMethodID = mockGetMethodID;
+    functions.DeleteLocalRef = mockDeleteLocalRef;
+    functions.CallIntMethodV = mockCallIntMethodV;
+    functions.CallLongMethodV = mockCallLongMethodV;
+    functions.CallFloatMethodV = mockCallFloatMethodV;
+    env.functions = &functions;
+    return &env;
+}
+
+// Decodes `event` and returns the number of JNI calls that it took, which
+// are also checked against the JniEntryScope that's open around the decode.
+static uint64_t decode(JNIEnv *env, MockMotionEvent *event,
+                       GameActivityMotionEvent *out) {
+    gamesdk::JniEntryCounters counters;
+    uint64_t before = gJniCalls;
+    {
+        gamesdk::JniEntryScope scope(counters);
+        GameActivityMotionEvent_fromJava(env, reinterpret_cast<jobject>(event),
+                                         out);
+    }
+    uint64_t calls = gJniCalls - before;
+    CHECK(counters.jniCalls.load() == calls,
+          "JniEntryScope counted %llu JNI calls, the mock JNIEnv %llu",
+          (unsigned long long)counters.jniCalls.load(),
+          (unsigned long long)calls);
+    return calls;
+}
+
+static void checkSameEvent(const GameActivityMotionEvent *a,
+                           const GameActivityMotionEvent *b) {
+    CHECK(a->pointerCount == b->pointerCount, "pointer count");
+    CHECK(a->historySize == b->historySize, "history size");
+    CHECK(a->historicalAxisMask == b->historicalAxisMask, "axis mask");
+    CHECK(a->eventTime == b->eventTime, "event time");
+    for (uint32_t p = 0; p < a->pointerCount; p++) {
+        CHECK(a->pointers[p].id == b->pointers[p].id, "pointer %u id", p);
+        CHECK(a->pointers[p].rawX == b->pointers[p].rawX, "pointer %u rawX",
+              p);
+        for (int axis = 0; axis < GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT;
+             axis++) {
+            CHECK(GameActivityMotionEvent_getPointerAxisValue(a, axis, p) ==
+                      GameActivityMotionEvent_getPointerAxisValue(b, axis, p),
+                  "pointer %u axis %d", p, axis);
+            for (int h = 0; h < a->historySize; h++) {
+                CHECK(GameActivityMotionEvent_getHistoricalAxisValue(
+                          a, axis, p, h) ==
+                          GameActivityMotionEvent_getHistoricalAxisValue(
+                              b, axis, p, h),
+                      "pointer %u axis %d sample %d", p, axis, h);
+            }
+        }
+    }
+    for (int h = 0; h < a->historySize; h++) {
+        CHECK(a->historicalEventTimesMillis[h] ==
+                  b->historicalEventTimesMillis[h],
+              "sample %d time", h);
+    }
+}
+
+static void run(JNIEnv *env, int pointerCount, int historySize,
+                const std::vector<int> &extraAxes) {
+    for (int axis : extraAxes) GameActivityPointerAxes_enableAxis(axis);
+
+    MockMotionEvent fallback = {false, pointerCount, historySize};
+    MockMotionEvent onePass = {true, pointerCount, historySize};
+    GameActivityMotionEvent fallbackEvent, onePassEvent;
+    uint64_t fallbackCalls = decode(env, &fallback, &fallbackEvent);
+    uint64_t onePassCalls = decode(env, &onePass, &onePassEvent);
+    checkSameEvent(&fallbackEvent, &onePassEvent);
+
+    int axisCount =
+        GameActivityMotionEvent_getHistoricalAxisCount(&onePassEvent);
+    printf("%d pointers, %2d samples, %2d axes: %5llu JNI calls per-axis, "
+           "%llu one-pass\n",
+           pointerCount, historySize, axisCount,
+           (unsigned long long)fallbackCalls,
+           (unsigned long long)onePassCalls);
+
+    // One call per pointer for its id, tool type, raw X and Y and each axis,
+    // one per sample for its time and each axis of each pointer, and the
+    // pointer count, history size and 13 scalar fields of the event
+    uint64_t expected = (uint64_t)pointerCount * (4 + axisCount) +
+                        (uint64_t)historySize * (1 + pointerCount * axisCount) +
+                        2 + 13;
+    CHECK(fallbackCalls == expected, "%llu JNI calls per-axis, expected %llu",
+          (unsigned long long)fallbackCalls, (unsigned long long)expected);
+    // The mock libandroid.so has the API 33 accessors, so nothing is left
+    // to be read through JNI
+    CHECK(onePassCalls == 0, "%llu JNI calls one-pass",
+          (unsigned long long)onePassCalls);
+
+    GameActivityMotionEvent_destroy(&fallbackEvent);
+    GameActivityMotionEvent_destroy(&onePassEvent);
+    for (int axis : extraAxes) GameActivityPointerAxes_disableAxis(axis);
+}
+
+int main(void) {
+    JNIEnv *env = mockJNIEnv();
+
+    // The first decode also looks up the MotionEvent class and its methods
+    MockMotionEvent first = {false, 1, 0};
+    GameActivityMotionEvent event;
+    uint64_t calls = decode(env, &first, &event);
+    GameActivityMotionEvent_destroy(&event);
+    printf("first decode: %llu JNI calls\n", (unsigned long long)calls);
+
+    MockMotionEvent onePass = {true, 1, 0};
+    CHECK(GameActivityMotionEvent_fromJavaDeferred(
+              env, reinterpret_cast<jobject>(&onePass), &event),
+          "AMotionEvent_fromJava wasn't loaded, API 31 is required");
+    GameActivityMotionEvent_releaseDeferred(&event);
+
+    // The default X and Y axes, and with pressure and size
+    std::vector<int> defaultAxes;
+    std::vector<int> moreAxes = {AMOTION_EVENT_AXIS_PRESSURE,
+                                 AMOTION_EVENT_AXIS_SIZE};
+    for (int pointerCount : {1, 2, 5}) {
+        for (int historySize : {0, 4, 16}) {
+            run(env, pointerCount, historySize, defaultAxes);
+            run(env, pointerCount, historySize, moreAxes);
+        }
+    }
+
+    printf("ok\n");
+    return 0;
+}
+
+#endif  // MOCK_LIBANDROID
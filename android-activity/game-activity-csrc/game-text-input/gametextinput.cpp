@@ -21,13 +21,118 @@
 #include <string.h>
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 
+#include "common/jni_stats.h"
+#include "game-text-input/textcodec.h"
+
 #define LOG_TAG "GameTextInput"
 
 static constexpr int32_t DEFAULT_MAX_STRING_SIZE = 1 << 16;
 
+// Whether a byte of UTF-8 text is a continuation byte, i.e. doesn't
+// start a character.
+static bool isContinuationByte(char c) { return (c & 0xC0) == 0x80; }
+
+static bool isHighSurrogate(uint16_t c) { return c >= 0xD800 && c <= 0xDBFF; }
+static bool isLowSurrogate(uint16_t c) { return c >= 0xDC00 && c <= 0xDFFF; }
+
+static bool spansEqual(const GameTextInputSpan &a, const GameTextInputSpan &b) {
+    return a.start == b.start && a.end == b.end;
+}
+
+// A growable text buffer with a gap at the last edit position, so that a
+// sequence of nearby edits only moves the bytes between them.
+class TextGapBuffer {
+   public:
+    explicit TextGapBuffer(size_t capacity)
+        : buffer_(std::max<size_t>(capacity, 1)), gapEnd_(buffer_.size()) {}
+
+    size_t length() const { return buffer_.size() - gapLength(); }
+
+    char at(size_t i) const {
+        return i < gapStart_ ? buffer_[i] : buffer_[i + gapLength()];
+    }
+
+    // Replace the bytes in [start, end) with `text`.
+    void replace(size_t start, size_t end, const char *text, size_t length) {
+        moveGap(end);
+        gapStart_ = start;
+        reserveGap(length);
+        std::copy(text, text + length, buffer_.data() + gapStart_);
+        gapStart_ += length;
+    }
+
+    // The bytes in [start, end), which are made contiguous if needed. The
+    // pointer is valid until the next call of a non-const method.
+    const char *range(size_t start, size_t end) {
+        if (start < gapStart_ && end > gapStart_) moveGap(end);
+        size_t offset = start < gapStart_ ? start : start + gapLength();
+        return buffer_.data() + offset;
+    }
+
+    // The whole null-terminated text. The pointer is valid until the next
+    // call of a non-const method.
+    const char *text() {
+        moveGap(length());
+        reserveGap(1);
+        buffer_[gapStart_] = 0;
+        return buffer_.data();
+    }
+
+    // The length of the longest common prefix with `text`.
+    size_t commonPrefix(const char *text, size_t length) const {
+        size_t n = std::min(length, this->length());
+        size_t i = 0;
+        while (i < n && at(i) == text[i]) i++;
+        return i;
+    }
+
+    // The length of the longest common suffix with `text`, of at most `max`
+    // bytes.
+    size_t commonSuffix(const char *text, size_t length, size_t max) const {
+        size_t ownLength = this->length();
+        size_t n = std::min(max, std::min(length, ownLength));
+        size_t i = 0;
+        while (i < n && at(ownLength - i - 1) == text[length - i - 1]) i++;
+        return i;
+    }
+
+   private:
+    size_t gapLength() const { return gapEnd_ - gapStart_; }
+
+    void moveGap(size_t position) {
+        if (position < gapStart_) {
+            size_t n = gapStart_ - position;
+            memmove(buffer_.data() + gapEnd_ - n, buffer_.data() + position, n);
+            gapStart_ -= n;
+            gapEnd_ -= n;
+        } else if (position > gapStart_) {
+            size_t n = position - gapStart_;
+            memmove(buffer_.data() + gapStart_, buffer_.data() + gapEnd_, n);
+            gapStart_ += n;
+            gapEnd_ += n;
+        }
+    }
+
+    void reserveGap(size_t length) {
+        if (gapLength() >= length) return;
+        size_t tail = buffer_.size() - gapEnd_;
+        size_t size =
+            std::max(buffer_.size() * 2, this->length() + length + 1);
+        buffer_.resize(size);
+        memmove(buffer_.data() + size - tail, buffer_.data() + gapEnd_, tail);
+        gapEnd_ = size - tail;
+    }
+
+    std::vector<char> buffer_;
+    size_t gapStart_ = 0;
+    size_t gapEnd_;
+};
+
 // Cache of field ids in the Java GameTextInputState class
 struct StateClassInfo {
     jfieldID text;
@@ -43,7 +148,12 @@ struct GameTextInput {
     GameTextInput(JNIEnv *env, uint32_t max_string_size);
     ~GameTextInput();
     void setState(const GameTextInputState &state);
-    const GameTextInputState &getState() const { return currentState_; }
+    void getState(GameTextInputGetStateCallback callback, void *context);
+    uint64_t getGeneration() const {
+        return generation_.load(std::memory_order_acquire);
+    }
+    void takeEdit(bool wholeText, GameTextInputEditCallback callback,
+                  void *context);
     void setInputConnection(jobject inputConnection);
     void processEvent(jobject textInputEvent);
     void showIme(uint32_t flags);
@@ -60,10 +170,31 @@ struct GameTextInput {
     const ARect &getImeInsets() const { return currentInsets_; }
 
    private:
-    // Copy string and set other fields
+    // Apply the difference in text and set other fields
     void setStateInner(const GameTextInputState &state);
-    static void processCallback(void *context, const GameTextInputState *state);
-    JNIEnv *env_ = nullptr;
+    // Set the selection and composing region, and bump the generation if
+    // they or the text changed.
+    void setSpans(const GameTextInputState &state, bool textChanged);
+    // Apply a State object from Java, only converting the part of its text
+    // that differs from javaText_.
+    void applyStateFromJava(jobject textInputEvent);
+    // Replace [start, end) of the text and track the change for takeEdit.
+    void replaceText(size_t start, size_t end, const char *text,
+                     size_t length);
+    // The current state, with text_UTF8 pointing to the whole text.
+    const GameTextInputState &currentState();
+    // The JNIEnv of the calling thread, or null (after logging an error) if
+    // the thread isn't attached to the JVM.
+    gamesdk::InstrumentedJNIEnv env() const {
+        gamesdk::InstrumentedJNIEnv env = gamesdk::currentThreadEnv(vm_);
+        if (!env) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "Called from a thread that isn't attached to "
+                                "the JVM");
+        }
+        return env;
+    }
+    JavaVM *vm_ = nullptr;
     // Cached at initialization from
     // com/google/androidgamesdk/gametextinput/State.
     jclass stateJavaClass_ = nullptr;
@@ -83,8 +214,27 @@ struct GameTextInput {
     ARect currentInsets_ = {};
     void *insetsCallbackContext_ = nullptr;
     StateClassInfo stateClassInfo_ = {};
-    // Constant-sized buffer used to store state text.
-    std::vector<char> stateStringBuffer_;
+    // Guards the text, whose gap is moved by reads as well as writes, and the
+    // conversion buffers. This is recursive since callbacks are called with it
+    // held.
+    mutable std::recursive_mutex textMutex_;
+    // The state text.
+    TextGapBuffer text_;
+    // The bytes at the start and end of the text that haven't changed since
+    // the last takeEdit, and the length of the text at that point.
+    size_t editPrefix_ = 0;
+    size_t editSuffix_ = 0;
+    size_t editBaseLength_ = 0;
+    // Incremented, with textMutex_ held, each time the state changes.
+    std::atomic<uint64_t> generation_{0};
+    // The UTF-16 text that the text was last converted from, if
+    // javaTextValid_, which is the text that Java has unless the state has
+    // since been set from native code.
+    std::vector<uint16_t> javaText_;
+    bool javaTextValid_ = false;
+    // Reused for converting text to and from Java strings.
+    mutable std::vector<uint16_t> utf16Buffer_;
+    mutable std::vector<char> utf8Buffer_;
 };
 
 std::unique_ptr<GameTextInput> s_gameTextInput;
@@ -142,7 +292,17 @@ void GameTextInput_setState(GameTextInput *input,
 void GameTextInput_getState(GameTextInput *input,
                             GameTextInputGetStateCallback callback,
                             void *context) {
-    callback(context, &input->getState());
+    input->getState(callback, context);
+}
+
+uint64_t GameTextInput_getGeneration(const GameTextInput *input) {
+    return input->getGeneration();
+}
+
+void GameTextInput_takeEdit(GameTextInput *input, bool wholeText,
+                            GameTextInputEditCallback callback,
+                            void *context) {
+    input->takeEdit(wholeText, callback, context);
 }
 
 void GameTextInput_setInputConnection(GameTextInput *input,
@@ -192,102 +352,193 @@ void GameTextInput_getImeInsets(const GameTextInput *input, ARect *insets) {
 /// GameTextInput C++ class Implementation
 ///////////////////////////////////////////////////////////
 
-GameTextInput::GameTextInput(JNIEnv *env, uint32_t max_string_size)
-    : env_(env),
-      stateStringBuffer_(max_string_size == 0 ? DEFAULT_MAX_STRING_SIZE
-                                              : max_string_size) {
-    stateJavaClass_ = (jclass)env_->NewGlobalRef(
-        env_->FindClass("com/google/androidgamesdk/gametextinput/State"));
-    inputConnectionClass_ = (jclass)env_->NewGlobalRef(env_->FindClass(
+GameTextInput::GameTextInput(JNIEnv *jniEnv, uint32_t max_string_size)
+    : text_(max_string_size == 0 ? DEFAULT_MAX_STRING_SIZE
+                                 : max_string_size) {
+    gamesdk::InstrumentedJNIEnv env(jniEnv);
+    env->GetJavaVM(&vm_);
+    stateJavaClass_ = (jclass)env->NewGlobalRef(
+        env->FindClass("com/google/androidgamesdk/gametextinput/State"));
+    inputConnectionClass_ = (jclass)env->NewGlobalRef(env->FindClass(
         "com/google/androidgamesdk/gametextinput/InputConnection"));
     inputConnectionSetStateMethod_ =
-        env_->GetMethodID(inputConnectionClass_, "setState",
+        env->GetMethodID(inputConnectionClass_, "setState",
                           "(Lcom/google/androidgamesdk/gametextinput/State;)V");
-    setSoftKeyboardActiveMethod_ = env_->GetMethodID(
+    setSoftKeyboardActiveMethod_ = env->GetMethodID(
         inputConnectionClass_, "setSoftKeyboardActive", "(ZI)V");
     restartInputMethod_ =
-        env_->GetMethodID(inputConnectionClass_, "restartInput", "()V");
+        env->GetMethodID(inputConnectionClass_, "restartInput", "()V");
 
     stateClassInfo_.text =
-        env_->GetFieldID(stateJavaClass_, "text", "Ljava/lang/String;");
+        env->GetFieldID(stateJavaClass_, "text", "Ljava/lang/String;");
     stateClassInfo_.selectionStart =
-        env_->GetFieldID(stateJavaClass_, "selectionStart", "I");
+        env->GetFieldID(stateJavaClass_, "selectionStart", "I");
     stateClassInfo_.selectionEnd =
-        env_->GetFieldID(stateJavaClass_, "selectionEnd", "I");
+        env->GetFieldID(stateJavaClass_, "selectionEnd", "I");
     stateClassInfo_.composingRegionStart =
-        env_->GetFieldID(stateJavaClass_, "composingRegionStart", "I");
+        env->GetFieldID(stateJavaClass_, "composingRegionStart", "I");
     stateClassInfo_.composingRegionEnd =
-        env_->GetFieldID(stateJavaClass_, "composingRegionEnd", "I");
+        env->GetFieldID(stateJavaClass_, "composingRegionEnd", "I");
 }
 
 GameTextInput::~GameTextInput() {
+    gamesdk::InstrumentedJNIEnv env = this->env();
+    // The global references are leaked if the thread isn't attached
+    if (!env) return;
     if (stateJavaClass_ != NULL) {
-        env_->DeleteGlobalRef(stateJavaClass_);
+        env->DeleteGlobalRef(stateJavaClass_);
         stateJavaClass_ = NULL;
     }
     if (inputConnectionClass_ != NULL) {
-        env_->DeleteGlobalRef(inputConnectionClass_);
+        env->DeleteGlobalRef(inputConnectionClass_);
         inputConnectionClass_ = NULL;
     }
     if (inputConnection_ != NULL) {
-        env_->DeleteGlobalRef(inputConnection_);
+        env->DeleteGlobalRef(inputConnection_);
         inputConnection_ = NULL;
     }
 }
 
 void GameTextInput::setState(const GameTextInputState &state) {
     if (inputConnection_ == nullptr) return;
+    gamesdk::InstrumentedJNIEnv env = this->env();
+    if (!env) return;
     jobject jstate = stateToJava(state);
-    env_->CallVoidMethod(inputConnection_, inputConnectionSetStateMethod_,
-                         jstate);
-    env_->DeleteLocalRef(jstate);
+    env->CallVoidMethod(inputConnection_, inputConnectionSetStateMethod_,
+                        jstate);
+    env->DeleteLocalRef(jstate);
+    std::lock_guard<std::recursive_mutex> lock(textMutex_);
     setStateInner(state);
+    javaTextValid_ = false;
+}
+
+void GameTextInput::getState(GameTextInputGetStateCallback callback,
+                             void *context) {
+    std::lock_guard<std::recursive_mutex> lock(textMutex_);
+    callback(context, &currentState());
+}
+
+void GameTextInput::takeEdit(bool wholeText,
+                             GameTextInputEditCallback callback,
+                             void *context) {
+    std::lock_guard<std::recursive_mutex> lock(textMutex_);
+    size_t length = text_.length();
+    GameTextInputEdit edit = {};
+    if (wholeText) {
+        edit.replaced = {0, static_cast<int32_t>(editBaseLength_)};
+        edit.text_UTF8 = text_.range(0, length);
+        edit.text_length = static_cast<int32_t>(length);
+    } else {
+        // If nothing changed, the prefix and suffix both cover the whole text.
+        size_t prefix = editPrefix_;
+        size_t suffix = std::min(editSuffix_, length - prefix);
+        edit.replaced = {static_cast<int32_t>(prefix),
+                         static_cast<int32_t>(editBaseLength_ - suffix)};
+        edit.text_UTF8 = text_.range(prefix, length - suffix);
+        edit.text_length = static_cast<int32_t>(length - suffix - prefix);
+    }
+    edit.new_length = static_cast<int32_t>(length);
+    edit.selection = currentState_.selection;
+    edit.composingRegion = currentState_.composingRegion;
+    callback(context, &edit);
+    editPrefix_ = length;
+    editSuffix_ = length;
+    editBaseLength_ = length;
+}
+
+const GameTextInputState &GameTextInput::currentState() {
+    currentState_.text_UTF8 = text_.text();
+    currentState_.text_length = static_cast<int32_t>(text_.length());
+    return currentState_;
+}
+
+void GameTextInput::replaceText(size_t start, size_t end, const char *text,
+                                size_t length) {
+    editPrefix_ = std::min(editPrefix_, start);
+    editSuffix_ = std::min(editSuffix_, text_.length() - end);
+    text_.replace(start, end, text, length);
+    // The text may have moved, or have a gap in it.
+    currentState_.text_UTF8 = nullptr;
 }
 
 void GameTextInput::setStateInner(const GameTextInputState &state) {
+    bool changed = false;
     // Check if we're setting using our own string (other parts may be
     // different)
-    if (state.text_UTF8 == currentState_.text_UTF8) {
-        currentState_ = state;
-        return;
+    bool ownText = state.text_UTF8 != nullptr &&
+                   state.text_UTF8 == currentState_.text_UTF8 &&
+                   static_cast<size_t>(state.text_length) == text_.length();
+    if (!ownText) {
+        // Otherwise, only replace the part of the text that's different,
+        // making sure not to split a character.
+        const char *text = state.text_UTF8 ? state.text_UTF8 : "";
+        size_t length = state.text_UTF8 ? std::max(state.text_length, 0) : 0;
+        if (!gamesdk::isValidUtf8(text, length)) {
+            // Keep the same text as Java, which gets the invalid sequences
+            // replaced.
+            gamesdk::utf8ToUtf16(text, length, utf16Buffer_);
+            length = gamesdk::utf16ToUtf8(utf16Buffer_.data(),
+                                          utf16Buffer_.size(), utf8Buffer_);
+            text = utf8Buffer_.data();
+        }
+        size_t ownLength = text_.length();
+        size_t prefix = text_.commonPrefix(text, length);
+        while (prefix > 0 &&
+               ((prefix < length && isContinuationByte(text[prefix])) ||
+                (prefix < ownLength && isContinuationByte(text_.at(prefix))))) {
+            prefix--;
+        }
+        size_t suffix = text_.commonSuffix(
+            text, length, std::min(length, ownLength) - prefix);
+        while (suffix > 0 &&
+               (isContinuationByte(text[length - suffix]) ||
+                isContinuationByte(text_.at(ownLength - suffix)))) {
+            suffix--;
+        }
+        if (prefix + suffix != length || prefix + suffix != ownLength) {
+            replaceText(prefix, ownLength - suffix, text + prefix,
+                        length - suffix - prefix);
+            changed = true;
+        }
+    }
+    setSpans(state, changed);
+}
+
+void GameTextInput::setSpans(const GameTextInputState &state,
+                             bool textChanged) {
+    bool changed = textChanged;
+    if (!spansEqual(currentState_.selection, state.selection) ||
+        !spansEqual(currentState_.composingRegion, state.composingRegion)) {
+        changed = true;
     }
-    // Otherwise, copy across the string.
-    auto bytes_needed =
-        std::min(static_cast<uint32_t>(state.text_length + 1),
-                 static_cast<uint32_t>(stateStringBuffer_.size()));
-    currentState_.text_UTF8 = stateStringBuffer_.data();
-    std::copy(state.text_UTF8, state.text_UTF8 + bytes_needed - 1,
-              stateStringBuffer_.data());
-    currentState_.text_length = state.text_length;
     currentState_.selection = state.selection;
     currentState_.composingRegion = state.composingRegion;
-    stateStringBuffer_[bytes_needed - 1] = 0;
+    if (changed) generation_.fetch_add(1, std::memory_order_release);
 }
 
 void GameTextInput::setInputConnection(jobject inputConnection) {
+    gamesdk::InstrumentedJNIEnv env = this->env();
+    if (!env) return;
     if (inputConnection_ != NULL) {
-        env_->DeleteGlobalRef(inputConnection_);
+        env->DeleteGlobalRef(inputConnection_);
     }
-    inputConnection_ = env_->NewGlobalRef(inputConnection);
-}
-
-/*static*/ void GameTextInput::processCallback(
-    void *context, const GameTextInputState *state) {
-    auto thiz = static_cast<GameTextInput *>(context);
-    if (state != nullptr) thiz->setStateInner(*state);
+    inputConnection_ = env->NewGlobalRef(inputConnection);
 }
 
 void GameTextInput::processEvent(jobject textInputEvent) {
-    stateFromJava(textInputEvent, processCallback, this);
+    std::lock_guard<std::recursive_mutex> lock(textMutex_);
+    applyStateFromJava(textInputEvent);
     if (eventCallback_) {
-        eventCallback_(eventCallbackContext_, &currentState_);
+        eventCallback_(eventCallbackContext_, &currentState());
     }
 }
 
 void GameTextInput::showIme(uint32_t flags) {
     if (inputConnection_ == nullptr) return;
-    env_->CallVoidMethod(inputConnection_, setSoftKeyboardActiveMethod_, true,
-                         flags);
+    gamesdk::InstrumentedJNIEnv env = this->env();
+    if (!env) return;
+    env->CallVoidMethod(inputConnection_, setSoftKeyboardActiveMethod_, true,
+                        flags);
 }
 
 void GameTextInput::setEventCallback(GameTextInputEventCallback callback,
@@ -311,20 +562,26 @@ void GameTextInput::processImeInsets(const ARect *insets) {
 
 void GameTextInput::hideIme(uint32_t flags) {
     if (inputConnection_ == nullptr) return;
-    env_->CallVoidMethod(inputConnection_, setSoftKeyboardActiveMethod_, false,
-                         flags);
+    gamesdk::InstrumentedJNIEnv env = this->env();
+    if (!env) return;
+    env->CallVoidMethod(inputConnection_, setSoftKeyboardActiveMethod_, false,
+                        flags);
 }
 
 void GameTextInput::restartInput() {
     if (inputConnection_ == nullptr) return;
-    env_->CallVoidMethod(inputConnection_, restartInputMethod_, false);
+    gamesdk::InstrumentedJNIEnv env = this->env();
+    if (!env) return;
+    env->CallVoidMethod(inputConnection_, restartInputMethod_, false);
 }
 
 jobject GameTextInput::stateToJava(const GameTextInputState &state) const {
+    gamesdk::InstrumentedJNIEnv env = this->env();
+    if (!env) return nullptr;
     static jmethodID constructor = nullptr;
     if (constructor == nullptr) {
-        constructor = env_->GetMethodID(stateJavaClass_, "<init>",
-                                        "(Ljava/lang/String;IIII)V");
+        constructor = env->GetMethodID(stateJavaClass_, "<init>",
+                                       "(Ljava/lang/String;IIII)V");
         if (constructor == nullptr) {
             __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
                                 "Can't find gametextinput.State constructor");
@@ -332,46 +589,116 @@ jobject GameTextInput::stateToJava(const GameTextInputState &state) const {
         }
     }
     const char *text = state.text_UTF8;
+    size_t length = std::max(state.text_length, 0);
     if (text == nullptr) {
-        static char empty_string[] = "";
-        text = empty_string;
+        text = "";
+        length = 0;
     }
-    // Note that this expects 'modified' UTF-8 which is not the same as UTF-8
-    // https://en.wikipedia.org/wiki/UTF-8#Modified_UTF-8
-    jstring jtext = env_->NewStringUTF(text);
+    std::lock_guard<std::recursive_mutex> lock(textMutex_);
+    gamesdk::utf8ToUtf16(text, length, utf16Buffer_);
+    jstring jtext = env->NewString(utf16Buffer_.data(),
+                                   static_cast<jsize>(utf16Buffer_.size()));
     jobject jobj =
-        env_->NewObject(stateJavaClass_, constructor, jtext,
-                        state.selection.start, state.selection.end,
-                        state.composingRegion.start, state.composingRegion.end);
-    env_->DeleteLocalRef(jtext);
+        env->NewObject(stateJavaClass_, constructor, jtext,
+                       state.selection.start, state.selection.end,
+                       state.composingRegion.start, state.composingRegion.end);
+    env->DeleteLocalRef(jtext);
     return jobj;
 }
 
 void GameTextInput::stateFromJava(jobject textInputEvent,
                                   GameTextInputGetStateCallback callback,
                                   void *context) const {
+    gamesdk::InstrumentedJNIEnv env = this->env();
+    if (!env) return;
     jstring text =
-        (jstring)env_->GetObjectField(textInputEvent, stateClassInfo_.text);
-    // Note this is 'modified' UTF-8, not true UTF-8. It has no NULLs in it,
-    // except at the end. It's actually not specified whether the value returned
-    // by GetStringUTFChars includes a null at the end, but it *seems to* on
-    // Android.
-    const char *text_chars = env_->GetStringUTFChars(text, NULL);
-    int text_len = env_->GetStringUTFLength(
-        text);  // Length in bytes, *not* including the null.
+        (jstring)env->GetObjectField(textInputEvent, stateClassInfo_.text);
+    // Copy the UTF-16 text out of the string and convert it to (standard)
+    // UTF-8 ourselves, rather than with GetStringUTFChars, which allocates
+    // and gives 'modified' UTF-8 (with surrogate pairs encoded separately).
+    std::lock_guard<std::recursive_mutex> lock(textMutex_);
+    jsize text_units = text != nullptr ? env->GetStringLength(text) : 0;
+    utf16Buffer_.resize(text_units);
+    if (text_units > 0) {
+        env->GetStringRegion(text, 0, text_units, utf16Buffer_.data());
+    }
+    size_t text_len =
+        gamesdk::utf16ToUtf8(utf16Buffer_.data(), text_units, utf8Buffer_);
     int selectionStart =
-        env_->GetIntField(textInputEvent, stateClassInfo_.selectionStart);
+        env->GetIntField(textInputEvent, stateClassInfo_.selectionStart);
     int selectionEnd =
-        env_->GetIntField(textInputEvent, stateClassInfo_.selectionEnd);
+        env->GetIntField(textInputEvent, stateClassInfo_.selectionEnd);
     int composingRegionStart =
-        env_->GetIntField(textInputEvent, stateClassInfo_.composingRegionStart);
+        env->GetIntField(textInputEvent, stateClassInfo_.composingRegionStart);
     int composingRegionEnd =
-        env_->GetIntField(textInputEvent, stateClassInfo_.composingRegionEnd);
-    GameTextInputState state{text_chars,
-                             text_len,
+        env->GetIntField(textInputEvent, stateClassInfo_.composingRegionEnd);
+    GameTextInputState state{utf8Buffer_.data(),
+                             static_cast<int32_t>(text_len),
                              {selectionStart, selectionEnd},
                              {composingRegionStart, composingRegionEnd}};
     callback(context, &state);
-    env_->ReleaseStringUTFChars(text, text_chars);
-    env_->DeleteLocalRef(text);
+    env->DeleteLocalRef(text);
+}
+
+void GameTextInput::applyStateFromJava(jobject textInputEvent) {
+    gamesdk::InstrumentedJNIEnv env = this->env();
+    if (!env) return;
+    jstring text =
+        (jstring)env->GetObjectField(textInputEvent, stateClassInfo_.text);
+    std::lock_guard<std::recursive_mutex> lock(textMutex_);
+    // Java only hands over the whole string, so it's still copied and
+    // compared, but only the part that changed is converted and replaced.
+    size_t units = text != nullptr ? env->GetStringLength(text) : 0;
+    utf16Buffer_.resize(units);
+    if (units > 0) {
+        env->GetStringRegion(text, 0, units, utf16Buffer_.data());
+    }
+    GameTextInputState state = {};
+    state.selection = {
+        env->GetIntField(textInputEvent, stateClassInfo_.selectionStart),
+        env->GetIntField(textInputEvent, stateClassInfo_.selectionEnd)};
+    state.composingRegion = {
+        env->GetIntField(textInputEvent,
+                         stateClassInfo_.composingRegionStart),
+        env->GetIntField(textInputEvent, stateClassInfo_.composingRegionEnd)};
+    env->DeleteLocalRef(text);
+
+    if (!javaTextValid_) {
+        size_t length =
+            gamesdk::utf16ToUtf8(utf16Buffer_.data(), units, utf8Buffer_);
+        state.text_UTF8 = utf8Buffer_.data();
+        state.text_length = static_cast<int32_t>(length);
+        setStateInner(state);
+    } else {
+        // The text is the conversion of javaText_, so the common prefix and
+        // suffix of the UTF-16 text convert to a common prefix and suffix of
+        // the UTF-8 text, as long as they don't split a surrogate pair.
+        const uint16_t *oldText = javaText_.data();
+        const uint16_t *newText = utf16Buffer_.data();
+        size_t oldUnits = javaText_.size();
+        size_t n = std::min(oldUnits, units);
+        size_t prefix = 0;
+        while (prefix < n && oldText[prefix] == newText[prefix]) prefix++;
+        if (prefix > 0 && isHighSurrogate(newText[prefix - 1])) prefix--;
+        size_t suffix = 0;
+        while (suffix < n - prefix &&
+               oldText[oldUnits - suffix - 1] == newText[units - suffix - 1]) {
+            suffix++;
+        }
+        if (suffix > 0 && isLowSurrogate(newText[units - suffix])) suffix--;
+
+        bool changed = prefix + suffix != oldUnits || prefix + suffix != units;
+        if (changed) {
+            size_t start = gamesdk::utf16ToUtf8Length(oldText, prefix);
+            size_t end = text_.length() -
+                         gamesdk::utf16ToUtf8Length(
+                             oldText + oldUnits - suffix, suffix);
+            size_t length = gamesdk::utf16ToUtf8(
+                newText + prefix, units - suffix - prefix, utf8Buffer_);
+            replaceText(start, end, utf8Buffer_.data(), length);
+        }
+        setSpans(state, changed);
+    }
+    javaText_.swap(utf16Buffer_);
+    javaTextValid_ = true;
 }
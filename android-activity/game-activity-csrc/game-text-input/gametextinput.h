@@ -24,6 +24,7 @@
 
 #include <android/rect.h>
 #include <jni.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "common/gamesdk_common.h"
@@ -67,8 +68,9 @@ enum GameTextInputSpanFlag { SPAN_UNDEFINED = -1 };
  */
 typedef struct GameTextInputState {
     /**
-     * Text owned by the state, as a modified UTF-8 string. Null-terminated.
-     * https://en.wikipedia.org/wiki/UTF-8#Modified_UTF-8
+     * Text owned by the state, as a UTF-8 string. Null-terminated, although
+     * the text may also contain nulls, if they were entered. Invalid UTF-8
+     * given to GameTextInput_setState is replaced with U+FFFD.
      */
     const char *text_UTF8;
     /**
@@ -104,9 +106,9 @@ typedef struct GameTextInput GameTextInput;
  * If called twice without GameTextInput_destroy being called, the same pointer
  * will be returned and a warning will be issued.
  * @param env A JNI env valid on the calling thread.
- * @param max_string_size The maximum length of a string that can be edited. If
- * zero, the maximum defaults to 65536 bytes. A buffer of this size is allocated
- * at initialization.
+ * @param max_string_size The initial capacity, in bytes, of the buffer that
+ * holds the text being edited. If zero, this defaults to 65536 bytes. The
+ * buffer grows as needed, so this doesn't limit the length of the text.
  * @return A handle to the library.
  */
 GameTextInput *GameTextInput_init(JNIEnv *env, uint32_t max_string_size);
@@ -202,6 +204,18 @@ void GameTextInput_getState(GameTextInput *input,
                             GameTextInputGetStateCallback callback,
                             void *context);
 
+/**
+ * Get a counter that's incremented each time the GameTextInput state changes,
+ * which can be used to cheaply check whether the state needs to be read again.
+ *
+ * This doesn't take a lock, so it may be called from any thread. When called
+ * from the callback of GameTextInput_getState, it returns the generation of
+ * the state given to the callback.
+ * @param input A valid GameTextInput library handle.
+ * @return The generation of the current state, starting at 0.
+ */
+uint64_t GameTextInput_getGeneration(const GameTextInput *input);
+
 /**
  * Set the current GameTextInput state. This state is reflected to any active
  * IME.
@@ -212,6 +226,70 @@ void GameTextInput_getState(GameTextInput *input,
 void GameTextInput_setState(GameTextInput *input,
                             const GameTextInputState *state);
 
+/**
+ * A change to the text of a GameTextInputState, along with the selection and
+ * composing region after the change. Several changes may be merged into one
+ * edit, see GameTextInput_takeEdit.
+ */
+typedef struct GameTextInputEdit {
+    /**
+     * The range of bytes in the previous text that were replaced. This is
+     * empty if only the selection or composing region changed.
+     */
+    GameTextInputSpan replaced;
+    /**
+     * The UTF-8 text that replaced that range. This is *not*
+     * null-terminated.
+     */
+    const char *text_UTF8;
+    /**
+     * Length in bytes of text_UTF8.
+     */
+    int32_t text_length;
+    /**
+     * The length in bytes of the whole text after the edit.
+     */
+    int32_t new_length;
+    /**
+     * The selection after the edit.
+     */
+    GameTextInputSpan selection;
+    /**
+     * The composing region after the edit.
+     */
+    GameTextInputSpan composingRegion;
+} GameTextInputEdit;
+
+/**
+ * A callback called by GameTextInput_takeEdit.
+ * @param context User-defined context.
+ * @param edit Edit, owned by the library, that will be valid for the duration
+ * of the callback.
+ */
+typedef void (*GameTextInputEditCallback)(void *context,
+                                          const GameTextInputEdit *edit);
+
+/**
+ * Call a callback with a single edit that transforms the text as it was at the
+ * last call of this function (or empty text, for the first call) into the
+ * current text, and then start tracking changes from the current text.
+ *
+ * The text is kept in a gap buffer, and the edit covers only the bytes between
+ * the first and last changes that were made, so a consumer that keeps its own
+ * copy of the text can stay up to date at a cost proportional to the size of
+ * the changes, rather than to the size of the text.
+ *
+ * The replaced range always starts and ends on a character boundary.
+ * @param input A valid GameTextInput library handle.
+ * @param wholeText If true, the edit replaces all of the previous text with all
+ * of the current text, which can be used to resynchronize a copy of the text.
+ * @param callback A function that will be called with the edit.
+ * @param context Context used by the callback.
+ */
+void GameTextInput_takeEdit(GameTextInput *input, bool wholeText,
+                            GameTextInputEditCallback callback,
+                            void *context);
+
 /**
  * Type of the callback needed by GameTextInput_setEventCallback that will be
  * called every time the IME state changes.
@@ -0,0 +1,341 @@
+/*
+ * Round-trip and fuzz tests for the UTF-16 <-> UTF-8 conversion in
+ * textcodec.cpp.
+ *
+ * Valid text is checked to round trip in both directions. Random UTF-16, with
+ * unpaired surrogates, and random bytes, with overlong forms, encoded
+ * surrogates, values above U+10FFFF and truncated sequences, are checked
+ * against a simple reference conversion. The reference decoder replaces the
+ * maximal subparts of invalid UTF-8 by looking them up in the set of all
+ * prefixes of well-formed sequences, straight from the definition in the
+ * Unicode standard, instead of decoding them like textcodec.cpp does.
+ *
+ * The codec doesn't depend on Android, so this builds and runs on the host:
+ *
+ *   c++ -std=c++17 -O2 -I../.. textcodec_test.cpp ../textcodec.cpp \
+ *       -o textcodec_test && ./textcodec_test
+ *
+ * This uses the SSE2 or NEON path of the host. Adding -U__SSE2__ on x86 or
+ * -U__ARM_NEON on arm tests the scalar path instead, and
+ * -fsanitize=address,undefined checks for out-of-bounds accesses.
+ */
+
+#include "game-text-input/textcodec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace gamesdk;
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fprintf(stderr, "\n");                          \
+            exit(1);                                        \
+        }                                                   \
+    } while (0)
+
+static constexpr uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+static void appendUtf8(std::string &out, uint32_t c) {
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    } else if (c < 0x800) {
+        out += static_cast<char>(0xC0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        out += static_cast<char>(0xE0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (c >> 18));
+        out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+}
+
+static void appendUtf16(std::vector<uint16_t> &out, uint32_t c) {
+    if (c < 0x10000) {
+        out.push_back(static_cast<uint16_t>(c));
+    } else {
+        out.push_back(static_cast<uint16_t>(0xD800 + ((c - 0x10000) >> 10)));
+        out.push_back(static_cast<uint16_t>(0xDC00 + ((c - 0x10000) & 0x3FF)));
+    }
+}
+
+static bool isScalarValue(uint32_t c) {
+    return c <= 0x10FFFF && (c < 0xD800 || c > 0xDFFF);
+}
+
+// A byte sequence of up to 4 bytes, with its length, as a set key
+static uint64_t sequenceKey(const uint8_t *bytes, size_t length) {
+    uint64_t key = length;
+    for (size_t i = 0; i < length; i++) key = (key << 8) | bytes[i];
+    return key;
+}
+
+// Every prefix of every well-formed UTF-8 sequence, and every well-formed
+// sequence
+static std::unordered_set<uint64_t> gPrefixes;
+static std::unordered_set<uint64_t> gSequences;
+
+static void buildSequenceSets() {
+    for (uint32_t c = 0x80; c <= 0x10FFFF; c++) {
+        if (!isScalarValue(c)) continue;
+        std::string s;
+        appendUtf8(s, c);
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(s.data());
+        for (size_t n = 1; n <= s.size(); n++) {
+            gPrefixes.insert(sequenceKey(bytes, n));
+        }
+        gSequences.insert(sequenceKey(bytes, s.size()));
+    }
+}
+
+static uint32_t decodeSequence(const uint8_t *bytes, size_t length) {
+    static const uint8_t kLeadMask[] = {0, 0x7F, 0x1F, 0x0F, 0x07};
+    uint32_t c = bytes[0] & kLeadMask[length];
+    for (size_t i = 1; i < length; i++) c = (c << 6) | (bytes[i] & 0x3F);
+    return c;
+}
+
+static bool referenceUtf8ToUtf16(const std::string &text,
+                                 std::vector<uint16_t> &out) {
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(text.data());
+    bool valid = true;
+    out.clear();
+    size_t i = 0;
+    while (i < text.size()) {
+        if (src[i] < 0x80) {
+            out.push_back(src[i++]);
+            continue;
+        }
+        // The longest prefix of a well-formed sequence starting here is either
+        // a whole character or the maximal subpart to replace.
+        size_t n = 0;
+        while (n < 4 && i + n < text.size() &&
+               gPrefixes.count(sequenceKey(src + i, n + 1))) {
+            n++;
+        }
+        if (n > 0 && gSequences.count(sequenceKey(src + i, n))) {
+            appendUtf16(out, decodeSequence(src + i, n));
+        } else {
+            out.push_back(REPLACEMENT_CHARACTER);
+            valid = false;
+        }
+        i += n > 0 ? n : 1;
+    }
+    return valid;
+}
+
+static std::string referenceUtf16ToUtf8(const std::vector<uint16_t> &text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); i++) {
+        uint32_t c = text[i];
+        if (c >= 0xD800 && c <= 0xDBFF && i + 1 < text.size() &&
+            text[i + 1] >= 0xDC00 && text[i + 1] <= 0xDFFF) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (text[++i] - 0xDC00);
+        } else if (c >= 0xD800 && c <= 0xDFFF) {
+            c = REPLACEMENT_CHARACTER;
+        }
+        appendUtf8(out, c);
+    }
+    return out;
+}
+
+static void checkUtf16(const std::vector<uint16_t> &text) {
+    std::string expected = referenceUtf16ToUtf8(text);
+    std::vector<char> utf8;
+    size_t length = utf16ToUtf8(text.data(), text.size(), utf8);
+    CHECK(length == expected.size() && utf8.size() == length + 1 &&
+              utf8[length] == 0 &&
+              std::string(utf8.data(), length) == expected,
+          "utf16ToUtf8 mismatch for %zu code units", text.size());
+    CHECK(utf16ToUtf8Length(text.data(), text.size()) == length,
+          "utf16ToUtf8Length mismatch for %zu code units", text.size());
+}
+
+static void checkUtf8(const std::string &text) {
+    std::vector<uint16_t> expected;
+    bool expectedValid = referenceUtf8ToUtf16(text, expected);
+    std::vector<uint16_t> utf16;
+    bool valid = utf8ToUtf16(text.data(), text.size(), utf16);
+    CHECK(utf16 == expected, "utf8ToUtf16 mismatch for %zu bytes",
+          text.size());
+    CHECK(valid == expectedValid, "utf8ToUtf16 validity mismatch");
+    CHECK(isValidUtf8(text.data(), text.size()) == expectedValid,
+          "isValidUtf8 mismatch for %zu bytes", text.size());
+}
+
+// The example of maximal subpart replacement from the Unicode standard
+// (Table 3-8), and other known sequences
+static void testKnownSequences() {
+    std::vector<uint16_t> utf16;
+    CHECK(!utf8ToUtf16("\x61\xF1\x80\x80\xE1\x80\xC2\x62\x80\x63\x80\xBF\x64",
+                       13, utf16),
+          "invalid text reported as valid");
+    CHECK((utf16 == std::vector<uint16_t>{0x61, 0xFFFD, 0xFFFD, 0xFFFD, 0x62,
+                                          0xFFFD, 0x63, 0xFFFD, 0xFFFD,
+                                          0x64}),
+          "Table 3-8 replacement mismatch");
+
+    static const char *const kInvalid[] = {
+        "\xC0\xAF",          // overlong '/'
+        "\xE0\x80\xAF",      // overlong '/'
+        "\xF0\x80\x80\xAF",  // overlong '/'
+        "\xED\xA0\x80",      // encoded high surrogate
+        "\xED\xBF\xBF",      // encoded low surrogate
+        "\xF4\x90\x80\x80",  // above U+10FFFF
+        "\xF5\x80\x80\x80",  // invalid lead byte
+        "\xE2\x82",          // truncated
+        "\xF0\x9F\x98",      // truncated
+        "\x80",              // lone continuation byte
+        "\xFF",
+    };
+    for (const char *text : kInvalid) {
+        CHECK(!isValidUtf8(text, strlen(text)), "invalid text is valid");
+        checkUtf8(text);
+    }
+
+    const std::string valid = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80";
+    CHECK(utf8ToUtf16(valid.data(), valid.size(), utf16) &&
+              (utf16 == std::vector<uint16_t>{0x61, 0xE9, 0x20AC, 0xD83D,
+                                              0xDE00}),
+          "valid text mismatch");
+    checkUtf16({0xD83D});
+    checkUtf16({0xDE00, 0xD83D});
+    checkUtf16({0x61, 0xD83D, 0x62, 0xDE00});
+}
+
+// A random scalar value, mostly ASCII, in runs long enough for the SIMD
+// blocks
+static uint32_t randomCharacter(std::mt19937 &rng) {
+    switch (rng() % 8) {
+        case 0:
+            return 0x80 + rng() % (0x800 - 0x80);
+        case 1: {
+            uint32_t c = 0x800 + rng() % (0x10000 - 0x800);
+            return isScalarValue(c) ? c : 0xE000;
+        }
+        case 2:
+            return 0x10000 + rng() % (0x110000 - 0x10000);
+        default:
+            return 0x20 + rng() % 0x5F;
+    }
+}
+
+static void testRoundTrip(std::mt19937 &rng) {
+    for (int iteration = 0; iteration < 20000; iteration++) {
+        std::string utf8;
+        std::vector<uint16_t> utf16;
+        size_t length = rng() % 80;
+        for (size_t i = 0; i < length; i++) {
+            uint32_t c = randomCharacter(rng);
+            size_t run = c < 0x80 ? 1 + rng() % 24 : 1;
+            for (size_t j = 0; j < run; j++) {
+                appendUtf8(utf8, c);
+                appendUtf16(utf16, c);
+            }
+        }
+
+        std::vector<uint16_t> toUtf16;
+        CHECK(utf8ToUtf16(utf8.data(), utf8.size(), toUtf16) &&
+                  toUtf16 == utf16,
+              "UTF-8 round trip failed");
+        CHECK(isValidUtf8(utf8.data(), utf8.size()), "valid text is invalid");
+        std::vector<char> toUtf8;
+        size_t written = utf16ToUtf8(utf16.data(), utf16.size(), toUtf8);
+        CHECK(std::string(toUtf8.data(), written) == utf8,
+              "UTF-16 round trip failed");
+    }
+}
+
+static void testRandomUtf16(std::mt19937 &rng) {
+    for (int iteration = 0; iteration < 50000; iteration++) {
+        std::vector<uint16_t> text;
+        size_t length = rng() % 40;
+        for (size_t i = 0; i < length; i++) {
+            switch (rng() % 10) {
+                case 0:
+                    // An unpaired surrogate, unless the next one pairs it
+                    text.push_back(
+                        static_cast<uint16_t>(0xD800 + rng() % 0x800));
+                    break;
+                case 1:
+                    text.push_back(
+                        static_cast<uint16_t>(0xD800 + rng() % 0x400));
+                    text.push_back(
+                        static_cast<uint16_t>(0xDC00 + rng() % 0x400));
+                    break;
+                case 2:
+                    text.push_back(static_cast<uint16_t>(rng()));
+                    break;
+                default:
+                    text.insert(text.end(), 1 + rng() % 12,
+                                static_cast<uint16_t>(0x20 + rng() % 0x5F));
+                    break;
+            }
+        }
+        checkUtf16(text);
+    }
+}
+
+static void testRandomUtf8(std::mt19937 &rng) {
+    static const char *const kPieces[] = {
+        "a",
+        "hello world, ",
+        "xxxxxxxxxxxxxxxxxxxx",
+        "\xC3\xA9",
+        "\xE2\x82\xAC",
+        "\xF0\x9F\x98\x80",
+        "\x80",
+        "\xC0\xAF",
+        "\xE0\x80\x80",
+        "\xED\xA0\x80",
+        "\xF4\x90\x80\x80",
+        "\xF5",
+        "\xFF",
+        "\xE2\x82",
+        "\xF0\x9F\x98",
+        "\xE0\xA0",
+    };
+    static const size_t kPieceCount = sizeof(kPieces) / sizeof(kPieces[0]);
+    for (int iteration = 0; iteration < 50000; iteration++) {
+        std::string text;
+        size_t length = rng() % 40;
+        if (rng() % 3 == 0) {
+            for (size_t i = 0; i < length; i++) {
+                text += static_cast<char>(rng());
+            }
+        } else {
+            for (size_t i = 0; i < length; i++) {
+                text += kPieces[rng() % kPieceCount];
+            }
+        }
+        // Embedded nulls are plain ASCII
+        if (rng() % 16 == 0) text += '\0';
+        checkUtf8(text);
+    }
+}
+
+int main(void) {
+    buildSequenceSets();
+    std::mt19937 rng(1);
+
+    testKnownSequences();
+    testRoundTrip(rng);
+    testRandomUtf16(rng);
+    testRandomUtf8(rng);
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,274 @@
+#include "game-text-input/textcodec.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace gamesdk {
+
+static constexpr uint16_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+// After a block that isn't all ASCII, at least this many code units are
+// converted one at a time before trying a whole block again, so that text
+// with frequent non-ASCII characters doesn't keep failing the block check.
+static constexpr size_t UTF16_BLOCK = 8;
+static constexpr size_t UTF8_BLOCK = 16;
+
+// Convert the leading run of ASCII characters, in whole blocks, returning the
+// number of characters converted. The caller converts the remainder.
+static size_t asciiUtf16ToUtf8(const uint16_t *src, size_t length,
+                               char *dst) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + UTF16_BLOCK <= length; i += UTF16_BLOCK) {
+        __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(v, nonAscii), zero);
+        if (_mm_movemask_epi8(ascii) != 0xFFFF) break;
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_packus_epi16(v, v));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + UTF16_BLOCK <= length; i += UTF16_BLOCK) {
+        uint16x8_t v = vld1q_u16(src + i);
+        uint16x4_t folded = vorr_u16(vget_low_u16(v), vget_high_u16(v));
+        if (vget_lane_u64(vreinterpret_u64_u16(folded), 0) &
+            0xFF80FF80FF80FF80ULL) {
+            break;
+        }
+        vst1_u8(reinterpret_cast<uint8_t *>(dst + i), vmovn_u16(v));
+    }
+#endif
+    return i;
+}
+
+// As asciiUtf16ToUtf8, in the other direction.
+static size_t asciiUtf8ToUtf16(const uint8_t *src, size_t length,
+                               uint16_t *dst) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + UTF8_BLOCK <= length; i += UTF8_BLOCK) {
+        __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (_mm_movemask_epi8(v) != 0) break;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8),
+                         _mm_unpackhi_epi8(v, zero));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + UTF8_BLOCK <= length; i += UTF8_BLOCK) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint8x8_t folded = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+        if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) &
+            0x8080808080808080ULL) {
+            break;
+        }
+        vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(dst + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+#else
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, src + i, sizeof(word));
+        if (word & 0x8080808080808080ULL) break;
+        for (size_t j = 0; j < 8; j++) dst[i + j] = src[i + j];
+    }
+#endif
+    return i;
+}
+
+// As asciiUtf8ToUtf16, without converting the characters.
+static size_t asciiLength(const uint8_t *src, size_t length) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + UTF8_BLOCK <= length; i += UTF8_BLOCK) {
+        __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (_mm_movemask_epi8(v) != 0) break;
+    }
+#elif defined(__ARM_NEON)
+    for (; i + UTF8_BLOCK <= length; i += UTF8_BLOCK) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint8x8_t folded = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+        if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) &
+            0x8080808080808080ULL) {
+            break;
+        }
+    }
+#else
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, src + i, sizeof(word));
+        if (word & 0x8080808080808080ULL) break;
+    }
+#endif
+    return i;
+}
+
+size_t utf16ToUtf8(const uint16_t *src, size_t length, std::vector<char> &dst) {
+    // Each UTF-16 code unit needs at most 3 bytes.
+    dst.resize(length * 3 + 1);
+    char *out = dst.data();
+    size_t i = 0;
+    while (i < length) {
+        size_t ascii = asciiUtf16ToUtf8(src + i, length - i, out);
+        i += ascii;
+        out += ascii;
+
+        size_t blockEnd = std::min(length, i + UTF16_BLOCK);
+        while (i < blockEnd) {
+            uint32_t c = src[i++];
+            if (c >= 0xD800 && c <= 0xDFFF) {
+                if (c <= 0xDBFF && i < length && src[i] >= 0xDC00 &&
+                    src[i] <= 0xDFFF) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (src[i++] - 0xDC00);
+                } else {
+                    c = REPLACEMENT_CHARACTER;
+                }
+            }
+            if (c < 0x80) {
+                *out++ = static_cast<char>(c);
+            } else if (c < 0x800) {
+                *out++ = static_cast<char>(0xC0 | (c >> 6));
+                *out++ = static_cast<char>(0x80 | (c & 0x3F));
+            } else if (c < 0x10000) {
+                *out++ = static_cast<char>(0xE0 | (c >> 12));
+                *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                *out++ = static_cast<char>(0x80 | (c & 0x3F));
+            } else {
+                *out++ = static_cast<char>(0xF0 | (c >> 18));
+                *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                *out++ = static_cast<char>(0x80 | (c & 0x3F));
+            }
+        }
+    }
+    size_t written = out - dst.data();
+    dst.resize(written + 1);
+    dst[written] = 0;
+    return written;
+}
+
+size_t utf16ToUtf8Length(const uint16_t *src, size_t length) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint16_t c = src[i];
+        if (c < 0x80) {
+            bytes += 1;
+        } else if (c < 0x800) {
+            bytes += 2;
+        } else if (c <= 0xDBFF && c >= 0xD800 && i + 1 < length &&
+                   src[i + 1] >= 0xDC00 && src[i + 1] <= 0xDFFF) {
+            bytes += 4;
+            i++;
+        } else {
+            // Including unpaired surrogates, which become U+FFFD
+            bytes += 3;
+        }
+    }
+    return bytes;
+}
+
+// Decode the character at src[i], advancing i past it, or past the maximal
+// invalid subsequence there, in which case false is returned.
+static inline bool decodeUtf8(const uint8_t *src, size_t length, size_t &i,
+                              uint32_t &c) {
+    uint8_t lead = src[i];
+    if (lead < 0x80) {
+        c = lead;
+        i++;
+        return true;
+    }
+
+    // The number of continuation bytes, and the range of the first one, which
+    // excludes overlong encodings, surrogates and values above U+10FFFF.
+    size_t continuations;
+    uint8_t low = 0x80;
+    uint8_t high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        continuations = 1;
+        c = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        continuations = 2;
+        c = lead & 0x0F;
+        if (lead == 0xE0) low = 0xA0;
+        if (lead == 0xED) high = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        continuations = 3;
+        c = lead & 0x07;
+        if (lead == 0xF0) low = 0x90;
+        if (lead == 0xF4) high = 0x8F;
+    } else {
+        i++;
+        return false;
+    }
+
+    size_t n = 1;
+    for (; n <= continuations && i + n < length; n++) {
+        uint8_t b = src[i + n];
+        if (b < low || b > high) break;
+        c = (c << 6) | (b & 0x3F);
+        low = 0x80;
+        high = 0xBF;
+    }
+    i += n;
+    return n > continuations;
+}
+
+bool utf8ToUtf16(const char *text, size_t length, std::vector<uint16_t> &dst) {
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(text);
+    // Each byte produces at most one UTF-16 code unit.
+    dst.resize(length);
+    uint16_t *out = dst.data();
+    bool valid = true;
+    size_t i = 0;
+    while (i < length) {
+        size_t ascii = asciiUtf8ToUtf16(src + i, length - i, out);
+        i += ascii;
+        out += ascii;
+
+        size_t blockEnd = std::min(length, i + UTF8_BLOCK);
+        while (i < blockEnd) {
+            uint32_t c;
+            if (!decodeUtf8(src, length, i, c)) {
+                *out++ = REPLACEMENT_CHARACTER;
+                valid = false;
+            } else if (c >= 0x10000) {
+                c -= 0x10000;
+                *out++ = static_cast<uint16_t>(0xD800 | (c >> 10));
+                *out++ = static_cast<uint16_t>(0xDC00 | (c & 0x3FF));
+            } else {
+                *out++ = static_cast<uint16_t>(c);
+            }
+        }
+    }
+    dst.resize(out - dst.data());
+    return valid;
+}
+
+bool isValidUtf8(const char *text, size_t length) {
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(text);
+    size_t i = 0;
+    while (i < length) {
+        i += asciiLength(src + i, length - i);
+
+        size_t blockEnd = std::min(length, i + UTF8_BLOCK);
+        while (i < blockEnd) {
+            uint32_t c;
+            if (!decodeUtf8(src, length, i, c)) return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace gamesdk
@@ -0,0 +1,49 @@
+/*
+ * Conversion between the UTF-16 text of Java strings and the (standard) UTF-8
+ * text of GameTextInputState.
+ *
+ * Runs of ASCII characters, which are the common case for text input, are
+ * converted 8 or 16 characters at a time with SSE2 or NEON, where available,
+ * and everything else is converted one character at a time.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace gamesdk {
+
+/*
+ * Convert UTF-16 text to UTF-8, replacing any unpaired surrogates with
+ * U+FFFD.
+ *
+ * `dst` is resized to hold the text followed by a null, which isn't included
+ * in the returned length.
+ */
+size_t utf16ToUtf8(const uint16_t *src, size_t length, std::vector<char> &dst);
+
+/*
+ * The length of the UTF-8 text that utf16ToUtf8 converts UTF-16 text to,
+ * without converting it.
+ */
+size_t utf16ToUtf8Length(const uint16_t *src, size_t length);
+
+/*
+ * Convert UTF-8 text to UTF-16, replacing each maximal invalid subsequence
+ * (as per the Unicode standard) with U+FFFD.
+ *
+ * `dst` is resized to hold the text, and the returned value is true if no
+ * replacements were needed.
+ */
+bool utf8ToUtf16(const char *src, size_t length, std::vector<uint16_t> &dst);
+
+/*
+ * Whether text is valid UTF-8, i.e. utf8ToUtf16 wouldn't need to replace any
+ * of it.
+ */
+bool isValidUtf8(const char *src, size_t length);
+
+}  // namespace gamesdk
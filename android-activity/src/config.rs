@@ -1,11 +1,156 @@
 use core::fmt;
+use std::sync::atomic::{fence, AtomicI32, AtomicU32, Ordering};
 use std::sync::{Arc, RwLock};
 
+use bitflags::bitflags;
 use ndk::configuration::{
     Configuration, Keyboard, KeysHidden, LayoutDir, NavHidden, Navigation, Orientation, ScreenLong,
     ScreenSize, Touchscreen, UiModeNight, UiModeType,
 };
 
+bitflags! {
+    /// The parts of the application's configuration that changed, as reported by
+    /// [`MainEvent::ConfigChanged`](crate::MainEvent::ConfigChanged)
+    ///
+    /// These are the `ACONFIGURATION_*` bits that are returned by
+    /// [`AConfiguration_diff`](https://developer.android.com/ndk/reference/group/configuration#aconfiguration_diff)
+    #[derive(Clone, Copy, Debug, Default, Eq, Hash, PartialEq)]
+    pub struct ConfigChanges: u32 {
+        const MCC = 0x0001;
+        const MNC = 0x0002;
+        const LOCALE = 0x0004;
+        const TOUCHSCREEN = 0x0008;
+        const KEYBOARD = 0x0010;
+        const KEYBOARD_HIDDEN = 0x0020;
+        const NAVIGATION = 0x0040;
+        const ORIENTATION = 0x0080;
+        const DENSITY = 0x0100;
+        const SCREEN_SIZE = 0x0200;
+        const VERSION = 0x0400;
+        const SCREEN_LAYOUT = 0x0800;
+        const UI_MODE = 0x1000;
+        const SMALLEST_SCREEN_SIZE = 0x2000;
+        const LAYOUTDIR = 0x4000;
+        const SCREEN_ROUND = 0x8000;
+        const COLOR_MODE = 0x10000;
+
+        // Any bits that are added by future versions of Android
+        const _ = !0;
+    }
+}
+
+/// The raw `AConfiguration_get*` values that are kept in a [`ConfigurationSnapshot`]
+#[derive(Clone, Copy)]
+enum Field {
+    Country,
+    Density,
+    Keyboard,
+    KeysHidden,
+    Language,
+    LayoutDirection,
+    Mcc,
+    Mnc,
+    NavHidden,
+    Navigation,
+    Orientation,
+    ScreenHeightDp,
+    ScreenLong,
+    ScreenSize,
+    ScreenWidthDp,
+    SdkVersion,
+    SmallestScreenWidthDp,
+    Touchscreen,
+    UiModeNight,
+    UiModeType,
+}
+const FIELD_COUNT: usize = Field::UiModeType as usize + 1;
+
+fn read_fields(config: &Configuration) -> [i32; FIELD_COUNT] {
+    let ptr = config.ptr().as_ptr();
+    let mut values = [0; FIELD_COUNT];
+    // Safety: `ptr` is valid while `config` is borrowed, and the language and
+    // country codes are both written as two chars (without a nul terminator)
+    unsafe {
+        let mut code = [0u8; 4];
+        ndk_sys::AConfiguration_getCountry(ptr, code.as_mut_ptr() as *mut _);
+        values[Field::Country as usize] = i32::from_le_bytes(code);
+        let mut code = [0u8; 4];
+        ndk_sys::AConfiguration_getLanguage(ptr, code.as_mut_ptr() as *mut _);
+        values[Field::Language as usize] = i32::from_le_bytes(code);
+
+        values[Field::Density as usize] = ndk_sys::AConfiguration_getDensity(ptr);
+        values[Field::Keyboard as usize] = ndk_sys::AConfiguration_getKeyboard(ptr);
+        values[Field::KeysHidden as usize] = ndk_sys::AConfiguration_getKeysHidden(ptr);
+        values[Field::LayoutDirection as usize] = ndk_sys::AConfiguration_getLayoutDirection(ptr);
+        values[Field::Mcc as usize] = ndk_sys::AConfiguration_getMcc(ptr);
+        values[Field::Mnc as usize] = ndk_sys::AConfiguration_getMnc(ptr);
+        values[Field::NavHidden as usize] = ndk_sys::AConfiguration_getNavHidden(ptr);
+        values[Field::Navigation as usize] = ndk_sys::AConfiguration_getNavigation(ptr);
+        values[Field::Orientation as usize] = ndk_sys::AConfiguration_getOrientation(ptr);
+        values[Field::ScreenHeightDp as usize] = ndk_sys::AConfiguration_getScreenHeightDp(ptr);
+        values[Field::ScreenLong as usize] = ndk_sys::AConfiguration_getScreenLong(ptr);
+        values[Field::ScreenSize as usize] = ndk_sys::AConfiguration_getScreenSize(ptr);
+        values[Field::ScreenWidthDp as usize] = ndk_sys::AConfiguration_getScreenWidthDp(ptr);
+        values[Field::SdkVersion as usize] = ndk_sys::AConfiguration_getSdkVersion(ptr);
+        values[Field::SmallestScreenWidthDp as usize] =
+            ndk_sys::AConfiguration_getSmallestScreenWidthDp(ptr);
+        values[Field::Touchscreen as usize] = ndk_sys::AConfiguration_getTouchscreen(ptr);
+        values[Field::UiModeNight as usize] = ndk_sys::AConfiguration_getUiModeNight(ptr);
+        values[Field::UiModeType as usize] = ndk_sys::AConfiguration_getUiModeType(ptr);
+    }
+    values
+}
+
+/// A copy of the values that [`ConfigurationRef`]'s getters read, which is
+/// updated in place with a sequence lock so that they can be read without
+/// blocking or allocating.
+///
+/// `seq` is odd while the values are being updated and a reader retries if it
+/// was odd, or changed, while it copied the values. The values are atomics so
+/// that a reader that races with an update just discards what it copied.
+#[derive(Default)]
+struct SharedValues {
+    seq: AtomicU32,
+    values: [AtomicI32; FIELD_COUNT],
+}
+
+impl SharedValues {
+    // There must only be one writer at a time, which is ensured by only
+    // publishing while holding the `Configuration` write lock
+    fn publish(&self, values: &[i32; FIELD_COUNT]) {
+        let seq = self.seq.load(Ordering::Relaxed);
+        self.seq.store(seq.wrapping_add(1), Ordering::Relaxed);
+        fence(Ordering::Release);
+        for (dest, value) in self.values.iter().zip(values) {
+            dest.store(*value, Ordering::Relaxed);
+        }
+        self.seq.store(seq.wrapping_add(2), Ordering::Release);
+    }
+
+    fn load(&self) -> ConfigurationSnapshot {
+        let mut values = [0; FIELD_COUNT];
+        loop {
+            let seq = self.seq.load(Ordering::Acquire);
+            for (dest, value) in values.iter_mut().zip(&self.values) {
+                *dest = value.load(Ordering::Relaxed);
+            }
+            fence(Ordering::Acquire);
+            if seq & 1 == 0 && self.seq.load(Ordering::Relaxed) == seq {
+                return ConfigurationSnapshot {
+                    generation: seq / 2,
+                    values,
+                };
+            }
+            std::hint::spin_loop();
+        }
+    }
+}
+
+struct SharedConfiguration {
+    config: RwLock<Configuration>,
+    values: SharedValues,
+}
+
 /// A (cheaply clonable) reference to this application's [`ndk::configuration::Configuration`]
 ///
 /// This provides a thread-safe way to access the latest configuration state for
@@ -13,17 +158,22 @@ use ndk::configuration::{
 ///
 /// If the application is notified of configuration changes then those changes
 /// will become visible via pre-existing configuration references.
+///
+/// The getters don't block or allocate (except for returning [`String`]s), so
+/// they may be called every frame. Each getter reads the latest configuration
+/// independently, so use [`Self::snapshot()`] to read several values that
+/// are consistent with each other.
 #[derive(Clone)]
 pub struct ConfigurationRef {
-    config: Arc<RwLock<Configuration>>,
+    shared: Arc<SharedConfiguration>,
 }
 impl PartialEq for ConfigurationRef {
     fn eq(&self, other: &Self) -> bool {
-        if Arc::ptr_eq(&self.config, &other.config) {
+        if Arc::ptr_eq(&self.shared, &other.shared) {
             true
         } else {
-            let other_guard = other.config.read().unwrap();
-            self.config.read().unwrap().eq(&*other_guard)
+            let other_guard = other.shared.config.read().unwrap();
+            self.shared.config.read().unwrap().eq(&*other_guard)
         }
     }
 }
@@ -33,119 +183,408 @@ unsafe impl Sync for ConfigurationRef {}
 
 impl fmt::Debug for ConfigurationRef {
     fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
-        self.config.read().unwrap().fmt(f)
+        self.shared.config.read().unwrap().fmt(f)
     }
 }
 
 impl ConfigurationRef {
     pub(crate) fn new(config: Configuration) -> Self {
+        let values = SharedValues::default();
+        values.publish(&read_fields(&config));
         Self {
-            config: Arc::new(RwLock::new(config)),
+            shared: Arc::new(SharedConfiguration {
+                config: RwLock::new(config),
+                values,
+            }),
         }
     }
 
-    pub(crate) fn replace(&self, src: Configuration) {
-        self.config.write().unwrap().copy(&src);
+    /// Updates the configuration and returns what changed
+    pub(crate) fn replace(&self, src: Configuration) -> ConfigChanges {
+        let mut config = self.shared.config.write().unwrap();
+        // Safety: both configurations are valid while they are borrowed
+        let changes =
+            unsafe { ndk_sys::AConfiguration_diff(config.ptr().as_ptr(), src.ptr().as_ptr()) };
+        config.copy(&src);
+        self.shared.values.publish(&read_fields(&config));
+        ConfigChanges::from_bits_retain(changes as u32)
+    }
+
+    /// Returns a consistent copy of the values that can be queried via this
+    /// reference's getters, without blocking or allocating
+    pub fn snapshot(&self) -> ConfigurationSnapshot {
+        self.shared.values.load()
     }
 
     // Returns a deep copy of the full application configuration
     pub fn copy(&self) -> Configuration {
         let mut dest = Configuration::new();
-        dest.copy(&self.config.read().unwrap());
+        dest.copy(&self.shared.config.read().unwrap());
         dest
     }
     /// Returns the country code, as a [`String`] of two characters, if set
     pub fn country(&self) -> Option<String> {
-        self.config.read().unwrap().country()
+        self.snapshot().country()
     }
 
     /// Returns the screen density in dpi.
     ///
     /// On some devices it can return values outside of the density enum.
     pub fn density(&self) -> Option<u32> {
-        self.config.read().unwrap().density()
+        self.snapshot().density()
     }
 
     /// Returns the keyboard type.
     pub fn keyboard(&self) -> Keyboard {
-        self.config.read().unwrap().keyboard()
+        self.snapshot().keyboard()
     }
 
     /// Returns keyboard visibility/availability.
     pub fn keys_hidden(&self) -> KeysHidden {
-        self.config.read().unwrap().keys_hidden()
+        self.snapshot().keys_hidden()
     }
 
     /// Returns the language, as a `String` of two characters, if a language is set
     pub fn language(&self) -> Option<String> {
-        self.config.read().unwrap().language()
+        self.snapshot().language()
     }
 
     /// Returns the layout direction
     pub fn layout_direction(&self) -> LayoutDir {
-        self.config.read().unwrap().layout_direction()
+        self.snapshot().layout_direction()
     }
 
     /// Returns the mobile country code.
     pub fn mcc(&self) -> i32 {
-        self.config.read().unwrap().mcc()
+        self.snapshot().mcc()
     }
 
     /// Returns the mobile network code, if one is defined
     pub fn mnc(&self) -> Option<i32> {
-        self.config.read().unwrap().mnc()
+        self.snapshot().mnc()
     }
 
     pub fn nav_hidden(&self) -> NavHidden {
-        self.config.read().unwrap().nav_hidden()
+        self.snapshot().nav_hidden()
     }
 
     pub fn navigation(&self) -> Navigation {
-        self.config.read().unwrap().navigation()
+        self.snapshot().navigation()
     }
 
     pub fn orientation(&self) -> Orientation {
-        self.config.read().unwrap().orientation()
+        self.snapshot().orientation()
     }
 
     pub fn screen_height_dp(&self) -> Option<i32> {
-        self.config.read().unwrap().screen_height_dp()
+        self.snapshot().screen_height_dp()
     }
 
     pub fn screen_width_dp(&self) -> Option<i32> {
-        self.config.read().unwrap().screen_width_dp()
+        self.snapshot().screen_width_dp()
     }
 
     pub fn screen_long(&self) -> ScreenLong {
-        self.config.read().unwrap().screen_long()
+        self.snapshot().screen_long()
     }
 
     #[cfg(feature = "api-level-30")]
     pub fn screen_round(&self) -> ScreenRound {
-        self.config.read().unwrap().screen_round()
+        self.shared.config.read().unwrap().screen_round()
     }
 
     pub fn screen_size(&self) -> ScreenSize {
-        self.config.read().unwrap().screen_size()
+        self.snapshot().screen_size()
     }
 
     pub fn sdk_version(&self) -> i32 {
-        self.config.read().unwrap().sdk_version()
+        self.snapshot().sdk_version()
     }
 
     pub fn smallest_screen_width_dp(&self) -> Option<i32> {
-        self.config.read().unwrap().smallest_screen_width_dp()
+        self.snapshot().smallest_screen_width_dp()
     }
 
     pub fn touchscreen(&self) -> Touchscreen {
-        self.config.read().unwrap().touchscreen()
+        self.snapshot().touchscreen()
     }
 
     pub fn ui_mode_night(&self) -> UiModeNight {
-        self.config.read().unwrap().ui_mode_night()
+        self.snapshot().ui_mode_night()
     }
 
     pub fn ui_mode_type(&self) -> UiModeType {
-        self.config.read().unwrap().ui_mode_type()
+        self.snapshot().ui_mode_type()
+    }
+}
+
+/// A consistent copy of the values that can be queried via a [`ConfigurationRef`]
+///
+/// This is a small, plain value that's cheap to copy, see [`ConfigurationRef::snapshot()`]
+#[derive(Clone, Copy)]
+pub struct ConfigurationSnapshot {
+    generation: u32,
+    values: [i32; FIELD_COUNT],
+}
+
+impl PartialEq for ConfigurationSnapshot {
+    fn eq(&self, other: &Self) -> bool {
+        self.values == other.values
+    }
+}
+impl Eq for ConfigurationSnapshot {}
+
+impl fmt::Debug for ConfigurationSnapshot {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("ConfigurationSnapshot")
+            .field("generation", &self.generation)
+            .field("country", &self.country())
+            .field("density", &self.density())
+            .field("keyboard", &self.keyboard())
+            .field("keys_hidden", &self.keys_hidden())
+            .field("language", &self.language())
+            .field("layout_direction", &self.layout_direction())
+            .field("mcc", &self.mcc())
+            .field("mnc", &self.mnc())
+            .field("nav_hidden", &self.nav_hidden())
+            .field("navigation", &self.navigation())
+            .field("orientation", &self.orientation())
+            .field("screen_height_dp", &self.screen_height_dp())
+            .field("screen_long", &self.screen_long())
+            .field("screen_size", &self.screen_size())
+            .field("screen_width_dp", &self.screen_width_dp())
+            .field("sdk_version", &self.sdk_version())
+            .field("smallest_screen_width_dp", &self.smallest_screen_width_dp())
+            .field("touchscreen", &self.touchscreen())
+            .field("ui_mode_night", &self.ui_mode_night())
+            .field("ui_mode_type", &self.ui_mode_type())
+            .finish()
+    }
+}
+
+impl ConfigurationSnapshot {
+    fn get(&self, field: Field) -> i32 {
+        self.values[field as usize]
+    }
+
+    fn code(&self, field: Field) -> Option<String> {
+        let code = self.get(field).to_le_bytes();
+        if code[0] == 0 {
+            None
+        } else {
+            std::str::from_utf8(&code[..2]).ok().map(str::to_owned)
+        }
+    }
+
+    /// Returns a number that increases each time that the configuration is
+    /// updated, which can be compared with an earlier snapshot's generation
+    /// to check for changes without comparing all of the values.
+    ///
+    /// Generations are only comparable between snapshots of the same
+    /// [`ConfigurationRef`], and may wrap.
+    pub fn generation(&self) -> u32 {
+        self.generation
+    }
+
+    /// Returns the country code, as a [`String`] of two characters, if set
+    pub fn country(&self) -> Option<String> {
+        self.code(Field::Country)
+    }
+
+    /// Returns the screen density in dpi.
+    ///
+    /// On some devices it can return values outside of the density enum.
+    pub fn density(&self) -> Option<u32> {
+        match self.get(Field::Density) as u32 {
+            ndk_sys::ACONFIGURATION_DENSITY_DEFAULT => Some(160),
+            ndk_sys::ACONFIGURATION_DENSITY_ANY => None,
+            ndk_sys::ACONFIGURATION_DENSITY_NONE => None,
+            density => Some(density),
+        }
+    }
+
+    /// Returns the keyboard type.
+    pub fn keyboard(&self) -> Keyboard {
+        self.get(Field::Keyboard).into()
+    }
+
+    /// Returns keyboard visibility/availability.
+    pub fn keys_hidden(&self) -> KeysHidden {
+        self.get(Field::KeysHidden).into()
+    }
+
+    /// Returns the language, as a `String` of two characters, if a language is set
+    pub fn language(&self) -> Option<String> {
+        self.code(Field::Language)
+    }
+
+    /// Returns the layout direction
+    pub fn layout_direction(&self) -> LayoutDir {
+        self.get(Field::LayoutDirection).into()
+    }
+
+    /// Returns the mobile country code.
+    pub fn mcc(&self) -> i32 {
+        self.get(Field::Mcc)
+    }
+
+    /// Returns the mobile network code, if one is defined
+    pub fn mnc(&self) -> Option<i32> {
+        match self.get(Field::Mnc) {
+            0 => None,
+            x if x == ndk_sys::ACONFIGURATION_MNC_ZERO as i32 => Some(0),
+            x => Some(x),
+        }
+    }
+
+    pub fn nav_hidden(&self) -> NavHidden {
+        self.get(Field::NavHidden).into()
+    }
+
+    pub fn navigation(&self) -> Navigation {
+        self.get(Field::Navigation).into()
+    }
+
+    pub fn orientation(&self) -> Orientation {
+        self.get(Field::Orientation).into()
+    }
+
+    pub fn screen_height_dp(&self) -> Option<i32> {
+        match self.get(Field::ScreenHeightDp) {
+            x if x == ndk_sys::ACONFIGURATION_SCREEN_HEIGHT_DP_ANY as i32 => None,
+            x => Some(x),
+        }
+    }
+
+    pub fn screen_width_dp(&self) -> Option<i32> {
+        match self.get(Field::ScreenWidthDp) {
+            x if x == ndk_sys::ACONFIGURATION_SCREEN_WIDTH_DP_ANY as i32 => None,
+            x => Some(x),
+        }
+    }
+
+    pub fn screen_long(&self) -> ScreenLong {
+        self.get(Field::ScreenLong).into()
+    }
+
+    pub fn screen_size(&self) -> ScreenSize {
+        self.get(Field::ScreenSize).into()
+    }
+
+    pub fn sdk_version(&self) -> i32 {
+        self.get(Field::SdkVersion)
+    }
+
+    pub fn smallest_screen_width_dp(&self) -> Option<i32> {
+        match self.get(Field::SmallestScreenWidthDp) {
+            x if x == ndk_sys::ACONFIGURATION_SMALLEST_SCREEN_WIDTH_DP_ANY as i32 => None,
+            x => Some(x),
+        }
+    }
+
+    pub fn touchscreen(&self) -> Touchscreen {
+        self.get(Field::Touchscreen).into()
+    }
+
+    pub fn ui_mode_night(&self) -> UiModeNight {
+        self.get(Field::UiModeNight).into()
+    }
+
+    pub fn ui_mode_type(&self) -> UiModeType {
+        self.get(Field::UiModeType).into()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::AtomicBool;
+
+    #[test]
+    fn snapshot_is_never_torn() {
+        const LOADS: usize = 1_000_000;
+        let shared = Arc::new(SharedValues::default());
+        let done = Arc::new(AtomicBool::new(false));
+
+        // Each update sets every value to the update's number, which is also
+        // the snapshot's generation, so a torn snapshot has mixed values
+        let writer = {
+            let shared = shared.clone();
+            let done = done.clone();
+            std::thread::spawn(move || {
+                let mut update = 0i32;
+                while !done.load(Ordering::Relaxed) {
+                    update = update.wrapping_add(1);
+                    shared.publish(&[update; FIELD_COUNT]);
+                }
+            })
+        };
+
+        let readers: Vec<_> = (0..2)
+            .map(|_| {
+                let shared = shared.clone();
+                std::thread::spawn(move || {
+                    let mut last = 0;
+                    for _ in 0..LOADS {
+                        let snapshot = shared.load();
+                        let generation = snapshot.generation();
+                        assert!(
+                            snapshot
+                                .values
+                                .iter()
+                                .all(|value| *value == generation as i32),
+                            "torn snapshot of generation {generation}: {:?}",
+                            snapshot.values
+                        );
+                        assert!(generation >= last, "generation {generation} after {last}");
+                        last = generation;
+                    }
+                })
+            })
+            .collect();
+
+        let result = readers
+            .into_iter()
+            .map(|reader| reader.join())
+            .collect::<Vec<_>>();
+        done.store(true, Ordering::Relaxed);
+        writer.join().unwrap();
+        for result in result {
+            result.unwrap();
+        }
+    }
+
+    #[test]
+    fn replace_reports_changes() {
+        let config = ConfigurationRef::new(Configuration::new());
+        let before = config.snapshot();
+
+        let updated = config.copy();
+        // Safety: `updated` is a valid configuration
+        unsafe {
+            ndk_sys::AConfiguration_setOrientation(
+                updated.ptr().as_ptr(),
+                ndk_sys::ACONFIGURATION_ORIENTATION_LAND as i32,
+            );
+        }
+        assert_eq!(config.replace(updated), ConfigChanges::ORIENTATION);
+
+        let after = config.snapshot();
+        assert_eq!(after.generation(), before.generation().wrapping_add(1));
+        assert_eq!(after.orientation(), Orientation::Land);
+        assert_eq!(config.orientation(), Orientation::Land);
+        assert_ne!(after, before);
+        for (field, (new, old)) in after.values.iter().zip(before.values).enumerate() {
+            if field != Field::Orientation as usize {
+                assert_eq!(*new, old, "field {field} changed");
+            }
+        }
+
+        // Replacing the configuration with an equal one changes nothing, but
+        // is still a new generation
+        assert_eq!(config.replace(config.copy()), ConfigChanges::empty());
+        let same = config.snapshot();
+        assert_eq!(same, after);
+        assert_eq!(same.generation(), after.generation().wrapping_add(1));
     }
 }
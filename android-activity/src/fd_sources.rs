@@ -0,0 +1,254 @@
+//! File descriptors that applications register as event sources on the `android_main` looper
+//!
+//! All of the file descriptors are added to the looper with the same identifier, the backend's
+//! `LOOPER_ID_FD`, and are told apart by the file descriptor that `ALooper_pollAll` returns,
+//! which is mapped back to the [`Token`] that was handed out when it was registered.
+//!
+//! This only depends on the looper, so it's tested with pipes and socket pairs, which also works
+//! on Linux.
+
+use std::{collections::HashMap, io, os::fd::RawFd, ptr, sync::Mutex};
+
+use crate::{FdEvents, Token};
+
+#[derive(Debug, Default)]
+struct FdSourcesState {
+    tokens: HashMap<RawFd, Token>,
+    next_token: u64,
+}
+
+/// The file descriptors that are registered with the looper of an `AndroidApp`, which can be
+/// registered and unregistered from any thread
+#[derive(Debug)]
+pub(crate) struct FdSources {
+    /// The identifier that the file descriptors are added to the looper with
+    looper_id: libc::c_int,
+
+    state: Mutex<FdSourcesState>,
+}
+
+impl FdSources {
+    /// File descriptors that polling the looper returns as `looper_id`
+    pub fn new(looper_id: libc::c_int) -> Self {
+        Self {
+            looper_id,
+            state: Mutex::default(),
+        }
+    }
+
+    pub fn register(
+        &self,
+        looper: *mut ndk_sys::ALooper,
+        fd: RawFd,
+        interest: FdEvents,
+    ) -> io::Result<Token> {
+        if fd < 0 {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidInput,
+                "Invalid file descriptor",
+            ));
+        }
+
+        // The token is mapped before the file descriptor is added, so it's known as soon as the
+        // looper can report it
+        let mut guard = self.state.lock().unwrap();
+        if guard.tokens.contains_key(&fd) {
+            return Err(io::Error::new(
+                io::ErrorKind::AlreadyExists,
+                "File descriptor is already registered",
+            ));
+        }
+        let token = Token(guard.next_token);
+        let ret = unsafe {
+            ndk_sys::ALooper_addFd(
+                looper,
+                fd,
+                self.looper_id,
+                interest.bits() as libc::c_int,
+                None,
+                ptr::null_mut(),
+            )
+        };
+        if ret != 1 {
+            return Err(io::Error::last_os_error());
+        }
+        guard.next_token += 1;
+        guard.tokens.insert(fd, token);
+        Ok(token)
+    }
+
+    pub fn unregister(&self, looper: *mut ndk_sys::ALooper, token: Token) -> bool {
+        let mut guard = self.state.lock().unwrap();
+        let Some(fd) = guard
+            .tokens
+            .iter()
+            .find_map(|(&fd, &fd_token)| (fd_token == token).then_some(fd))
+        else {
+            return false;
+        };
+        guard.tokens.remove(&fd);
+        unsafe { ndk_sys::ALooper_removeFd(looper, fd) };
+        true
+    }
+
+    /// The token for a file descriptor that `ALooper_pollAll` returned with the looper
+    /// identifier, unless it has been unregistered since
+    pub fn token(&self, fd: RawFd) -> Option<Token> {
+        self.state.lock().unwrap().tokens.get(&fd).copied()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const LOOPER_ID: libc::c_int = 42;
+
+    fn prepare_looper() -> *mut ndk_sys::ALooper {
+        unsafe {
+            ndk_sys::ALooper_prepare(ndk_sys::ALOOPER_PREPARE_ALLOW_NON_CALLBACKS as libc::c_int)
+        }
+    }
+
+    /// Poll the looper without blocking, and map the file descriptor that's ready back to its
+    /// token, like `poll_events`
+    fn poll(sources: &FdSources) -> Option<(Token, FdEvents)> {
+        let mut fd: libc::c_int = -1;
+        let mut events: libc::c_int = 0;
+        let id = unsafe { ndk_sys::ALooper_pollAll(0, &mut fd, &mut events, ptr::null_mut()) };
+        if id != LOOPER_ID {
+            assert_eq!(id, ndk_sys::ALOOPER_POLL_TIMEOUT);
+            return None;
+        }
+        let token = sources.token(fd)?;
+        Some((token, FdEvents::from_bits_truncate(events as u32)))
+    }
+
+    fn pipe() -> (RawFd, RawFd) {
+        let mut fds = [0; 2];
+        assert_eq!(
+            unsafe { libc::pipe2(fds.as_mut_ptr(), libc::O_CLOEXEC | libc::O_NONBLOCK) },
+            0
+        );
+        (fds[0], fds[1])
+    }
+
+    fn socketpair() -> (RawFd, RawFd) {
+        let mut fds = [0; 2];
+        assert_eq!(
+            unsafe {
+                libc::socketpair(
+                    libc::AF_UNIX,
+                    libc::SOCK_STREAM | libc::SOCK_CLOEXEC | libc::SOCK_NONBLOCK,
+                    0,
+                    fds.as_mut_ptr(),
+                )
+            },
+            0
+        );
+        (fds[0], fds[1])
+    }
+
+    fn write_byte(fd: RawFd) {
+        assert_eq!(unsafe { libc::write(fd, b"x".as_ptr().cast(), 1) }, 1);
+    }
+
+    fn drain(fd: RawFd) {
+        let mut buf = [0u8; 64];
+        while unsafe { libc::read(fd, buf.as_mut_ptr().cast(), buf.len()) } > 0 {}
+    }
+
+    fn close(fds: &[RawFd]) {
+        for &fd in fds {
+            unsafe { libc::close(fd) };
+        }
+    }
+
+    #[test]
+    fn register_and_unregister() {
+        let looper = prepare_looper();
+        let sources = FdSources::new(LOOPER_ID);
+        let (read_fd, write_fd) = pipe();
+
+        let token = sources.register(looper, read_fd, FdEvents::INPUT).unwrap();
+        assert_eq!(sources.token(read_fd), Some(token));
+        assert_eq!(poll(&sources), None);
+        write_byte(write_fd);
+        assert_eq!(poll(&sources), Some((token, FdEvents::INPUT)));
+        drain(read_fd);
+        assert_eq!(poll(&sources), None);
+
+        assert!(sources.unregister(looper, token));
+        assert!(!sources.unregister(looper, token));
+        assert_eq!(sources.token(read_fd), None);
+        write_byte(write_fd);
+        assert_eq!(poll(&sources), None);
+
+        close(&[read_fd, write_fd]);
+    }
+
+    #[test]
+    fn reregistering_same_fd() {
+        let looper = prepare_looper();
+        let sources = FdSources::new(LOOPER_ID);
+        let (read_fd, write_fd) = pipe();
+
+        let token = sources.register(looper, read_fd, FdEvents::INPUT).unwrap();
+        let err = sources
+            .register(looper, read_fd, FdEvents::INPUT)
+            .unwrap_err();
+        assert_eq!(err.kind(), io::ErrorKind::AlreadyExists);
+        assert_eq!(sources.token(read_fd), Some(token));
+
+        // Once unregistered, it can be registered again, with a new token
+        assert!(sources.unregister(looper, token));
+        let new_token = sources.register(looper, read_fd, FdEvents::INPUT).unwrap();
+        assert_ne!(new_token, token);
+        write_byte(write_fd);
+        assert_eq!(poll(&sources), Some((new_token, FdEvents::INPUT)));
+        assert!(!sources.unregister(looper, token));
+        assert!(sources.unregister(looper, new_token));
+
+        close(&[read_fd, write_fd]);
+    }
+
+    #[test]
+    fn invalid_fd() {
+        let looper = prepare_looper();
+        let sources = FdSources::new(LOOPER_ID);
+        let err = sources.register(looper, -1, FdEvents::INPUT).unwrap_err();
+        assert_eq!(err.kind(), io::ErrorKind::InvalidInput);
+    }
+
+    #[test]
+    fn events_are_mapped_to_tokens() {
+        let looper = prepare_looper();
+        let sources = FdSources::new(LOOPER_ID);
+        let (read_fd, write_fd) = pipe();
+        let (socket, peer) = socketpair();
+
+        let pipe_token = sources.register(looper, read_fd, FdEvents::INPUT).unwrap();
+        let socket_token = sources.register(looper, socket, FdEvents::OUTPUT).unwrap();
+        assert_ne!(pipe_token, socket_token);
+
+        // The socket is writable straight away
+        assert_eq!(poll(&sources), Some((socket_token, FdEvents::OUTPUT)));
+        assert!(sources.unregister(looper, socket_token));
+        assert_eq!(poll(&sources), None);
+
+        write_byte(write_fd);
+        assert_eq!(poll(&sources), Some((pipe_token, FdEvents::INPUT)));
+        drain(read_fd);
+
+        // A hang up is reported without being asked for
+        let socket_token = sources.register(looper, socket, FdEvents::INPUT).unwrap();
+        close(&[peer]);
+        let (token, events) = poll(&sources).unwrap();
+        assert_eq!(token, socket_token);
+        assert!(events.contains(FdEvents::HANGUP), "{events:?}");
+        assert!(sources.unregister(looper, socket_token));
+        assert!(sources.unregister(looper, pipe_token));
+
+        close(&[read_fd, write_fd, socket]);
+    }
+}
@@ -0,0 +1,615 @@
+//! Vsync-driven frame events, from `AChoreographer`
+//!
+//! Frames are delivered through the `android_main` thread's looper: a [`FrameClock`] makes a
+//! file descriptor readable when a requested frame is ready, which is added to the looper with
+//! the backend's `LOOPER_ID_FRAME` identifier, so `poll_events` wakes up once per frame, without
+//! a timeout.
+//!
+//! `AChoreographer` posts its callbacks to the looper of the thread that it's used from, where
+//! they're dispatched from within `ALooper_pollAll`. The callbacks just store the frame's timing
+//! and signal an eventfd, so `ALooper_pollAll` then returns `LOOPER_ID_FRAME` like for any other
+//! event.
+//!
+//! Apart from the [`Choreographer`] clock, this only depends on the looper, so its tests drive it
+//! with a timerfd instead, which also works on Linux.
+
+use std::{
+    ffi::CStr,
+    mem,
+    os::fd::RawFd,
+    ptr,
+    sync::{
+        atomic::{AtomicBool, Ordering},
+        Arc, Mutex,
+    },
+};
+
+use libc::c_void;
+
+use crate::util::abort_on_panic;
+
+/// The timing of a frame
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub(crate) struct FrameTiming {
+    /// When the frame started, in the `CLOCK_MONOTONIC` time base
+    pub frame_time_nanos: i64,
+
+    /// The vsync ID of the preferred frame timeline, if known
+    pub vsync_id: Option<i64>,
+
+    /// When the preferred frame timeline's frame needs to be ready by, in the
+    /// `CLOCK_MONOTONIC` time base, if known
+    pub deadline_nanos: Option<i64>,
+}
+
+/// A source of frames, which signals that a frame is ready by making a file descriptor readable
+pub(crate) trait FrameClock: Send {
+    /// The file descriptor that becomes readable once a requested frame is ready
+    fn fd(&self) -> RawFd;
+
+    /// Request the next frame, which is only done once the last requested frame has been taken
+    fn request_frame(&mut self);
+
+    /// Take the last frame that's ready, if any, so the file descriptor is no longer readable
+    fn take_frame(&mut self) -> Option<FrameTiming>;
+}
+
+struct FrameState {
+    clock: Option<Box<dyn FrameClock>>,
+
+    /// Whether `new_clock` failed, so it's not retried
+    unsupported: bool,
+
+    /// The looper that the clock's file descriptor has been added to, if it's currently added
+    looper: *mut ndk_sys::ALooper,
+
+    /// Whether a frame has been requested and not yet taken
+    requested: bool,
+}
+
+/// Frame events for an `AndroidApp`, which can be enabled from any thread, but are only
+/// requested and delivered on the `android_main` thread
+pub(crate) struct FrameEvents {
+    new_clock: fn() -> Option<Box<dyn FrameClock>>,
+
+    /// The identifier that the clock's file descriptor is added to the looper with
+    looper_id: libc::c_int,
+
+    /// Whether the application wants frame events
+    enabled: AtomicBool,
+
+    /// The value of `enabled` when the looper was last synced with it, which is checked on
+    /// every poll, without locking the state
+    synced: AtomicBool,
+
+    state: Mutex<FrameState>,
+}
+
+unsafe impl Send for FrameEvents {}
+unsafe impl Sync for FrameEvents {}
+
+impl std::fmt::Debug for FrameEvents {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("FrameEvents")
+            .field("enabled", &self.enabled.load(Ordering::Relaxed))
+            .field("synced", &self.synced.load(Ordering::Relaxed))
+            .finish_non_exhaustive()
+    }
+}
+
+impl FrameEvents {
+    /// Frame events from a clock that's created by `new_clock` on the `android_main` thread,
+    /// once they're first enabled, which polling the looper returns as `looper_id`
+    pub fn new(new_clock: fn() -> Option<Box<dyn FrameClock>>, looper_id: libc::c_int) -> Self {
+        Self {
+            new_clock,
+            looper_id,
+            enabled: AtomicBool::new(false),
+            synced: AtomicBool::new(false),
+            state: Mutex::new(FrameState {
+                clock: None,
+                unsupported: false,
+                looper: ptr::null_mut(),
+                requested: false,
+            }),
+        }
+    }
+
+    /// Enable or disable frame events, which takes effect the next time `looper` is polled
+    ///
+    /// If this isn't called on the `android_main` thread, `looper` is woken up, so a blocking
+    /// poll can pick up the change.
+    pub fn set_enabled(&self, enabled: bool, looper: *mut ndk_sys::ALooper) {
+        if self.enabled.swap(enabled, Ordering::Relaxed) != enabled
+            && unsafe { ndk_sys::ALooper_forThread() } != looper
+        {
+            unsafe { ndk_sys::ALooper_wake(looper) };
+        }
+    }
+
+    /// Add the clock's file descriptor to `looper`, or remove it, if frame events have been
+    /// enabled or disabled since the last poll, which must be called on the `android_main`
+    /// thread before polling
+    pub fn sync(&self, looper: *mut ndk_sys::ALooper) {
+        let enabled = self.enabled.load(Ordering::Relaxed);
+        if enabled == self.synced.load(Ordering::Relaxed) {
+            return;
+        }
+        self.synced.store(enabled, Ordering::Relaxed);
+
+        let mut guard = self.state.lock().unwrap();
+        let state = &mut *guard;
+        if enabled {
+            if state.clock.is_none() && !state.unsupported {
+                state.clock = (self.new_clock)();
+                if state.clock.is_none() {
+                    log::warn!("Frame events aren't supported on this device");
+                    state.unsupported = true;
+                }
+            }
+            let Some(clock) = state.clock.as_mut() else {
+                return;
+            };
+
+            // Discard a frame that was requested before frame events were last disabled, which
+            // would be stale by now
+            if state.requested && clock.take_frame().is_some() {
+                state.requested = false;
+            }
+            unsafe {
+                ndk_sys::ALooper_addFd(
+                    looper,
+                    clock.fd(),
+                    self.looper_id,
+                    ndk_sys::ALOOPER_EVENT_INPUT as libc::c_int,
+                    None,
+                    ptr::null_mut(),
+                );
+            }
+            state.looper = looper;
+            if !state.requested {
+                clock.request_frame();
+                state.requested = true;
+            }
+        } else if let Some(clock) = state.clock.as_ref() {
+            // NB: a frame that's already been requested can't be cancelled, and is discarded
+            // if frame events are enabled again
+            unsafe { ndk_sys::ALooper_removeFd(state.looper, clock.fd()) };
+            state.looper = ptr::null_mut();
+        }
+    }
+
+    /// Take the frame that's ready, after polling returned the frame looper identifier, and
+    /// request the next one
+    pub fn take_frame(&self) -> Option<FrameTiming> {
+        let mut guard = self.state.lock().unwrap();
+        let state = &mut *guard;
+        let clock = state.clock.as_mut()?;
+        let frame = clock.take_frame();
+        if frame.is_some() {
+            state.requested = false;
+        }
+
+        // Request the next frame before the application handles this one, so it won't be missed
+        if !state.requested && self.enabled.load(Ordering::Relaxed) {
+            clock.request_frame();
+            state.requested = true;
+        }
+        frame
+    }
+}
+
+impl Drop for FrameEvents {
+    fn drop(&mut self) {
+        let state = self.state.get_mut().unwrap();
+        if let Some(clock) = state.clock.as_ref() {
+            // The looper belongs to the `android_main` thread, which may have already exited
+            if !state.looper.is_null() && unsafe { ndk_sys::ALooper_forThread() } == state.looper {
+                unsafe { ndk_sys::ALooper_removeFd(state.looper, clock.fd()) };
+            }
+        }
+    }
+}
+
+type FrameCallback64 = unsafe extern "C" fn(frame_time_nanos: i64, data: *mut c_void);
+type VsyncCallback = unsafe extern "C" fn(callback_data: *const c_void, data: *mut c_void);
+
+/// The `AChoreographerFrameCallbackData` API, from API level 33
+#[derive(Clone, Copy)]
+struct VsyncApi {
+    post_vsync_callback: unsafe extern "C" fn(*mut c_void, VsyncCallback, *mut c_void),
+    get_frame_time_nanos: unsafe extern "C" fn(*const c_void) -> i64,
+    get_preferred_frame_timeline_index: unsafe extern "C" fn(*const c_void) -> libc::size_t,
+    get_frame_timeline_vsync_id: unsafe extern "C" fn(*const c_void, libc::size_t) -> i64,
+    get_frame_timeline_deadline_nanos: unsafe extern "C" fn(*const c_void, libc::size_t) -> i64,
+}
+
+/// The `AChoreographer` API, which is looked up at runtime, since
+/// `AChoreographer_postFrameCallback64` is only available from API level 29
+#[derive(Clone, Copy)]
+struct ChoreographerApi {
+    get_instance: unsafe extern "C" fn() -> *mut c_void,
+    post_frame_callback_64: unsafe extern "C" fn(*mut c_void, FrameCallback64, *mut c_void),
+    vsync: Option<VsyncApi>,
+}
+
+unsafe fn symbol<T: Copy>(lib: *mut c_void, name: &CStr) -> Option<T> {
+    let sym = libc::dlsym(lib, name.as_ptr());
+    if sym.is_null() {
+        None
+    } else {
+        Some(mem::transmute_copy::<*mut c_void, T>(&sym))
+    }
+}
+
+impl ChoreographerApi {
+    fn load() -> Option<Self> {
+        unsafe {
+            let lib = libc::dlopen(
+                b"libandroid.so\0".as_ptr().cast(),
+                libc::RTLD_NOW | libc::RTLD_LOCAL,
+            );
+            if lib.is_null() {
+                return None;
+            }
+            let cstr = |name: &'static [u8]| CStr::from_bytes_with_nul(name).unwrap();
+            let vsync = (|| {
+                Some(VsyncApi {
+                    post_vsync_callback: symbol(lib, cstr(b"AChoreographer_postVsyncCallback\0"))?,
+                    get_frame_time_nanos: symbol(
+                        lib,
+                        cstr(b"AChoreographerFrameCallbackData_getFrameTimeNanos\0"),
+                    )?,
+                    get_preferred_frame_timeline_index: symbol(
+                        lib,
+                        cstr(b"AChoreographerFrameCallbackData_getPreferredFrameTimelineIndex\0"),
+                    )?,
+                    get_frame_timeline_vsync_id: symbol(
+                        lib,
+                        cstr(b"AChoreographerFrameCallbackData_getFrameTimelineVsyncId\0"),
+                    )?,
+                    get_frame_timeline_deadline_nanos: symbol(
+                        lib,
+                        cstr(b"AChoreographerFrameCallbackData_getFrameTimelineDeadlineNanos\0"),
+                    )?,
+                })
+            })();
+            // NB: libandroid.so stays loaded (and is linked anyway), so the handle isn't closed
+            Some(Self {
+                get_instance: symbol(lib, cstr(b"AChoreographer_getInstance\0"))?,
+                post_frame_callback_64: symbol(lib, cstr(b"AChoreographer_postFrameCallback64\0"))?,
+                vsync,
+            })
+        }
+    }
+}
+
+/// The state that's shared with pending `AChoreographer` callbacks, which can't be cancelled
+struct ChoreographerShared {
+    eventfd: RawFd,
+    vsync: Option<VsyncApi>,
+    frame: Mutex<Option<FrameTiming>>,
+}
+
+impl ChoreographerShared {
+    fn set_frame(&self, frame: FrameTiming) {
+        *self.frame.lock().unwrap() = Some(frame);
+        let one: u64 = 1;
+        unsafe {
+            libc::write(
+                self.eventfd,
+                (&one as *const u64).cast(),
+                mem::size_of::<u64>(),
+            );
+        }
+    }
+}
+
+impl Drop for ChoreographerShared {
+    fn drop(&mut self) {
+        unsafe { libc::close(self.eventfd) };
+    }
+}
+
+unsafe extern "C" fn on_frame_64(frame_time_nanos: i64, data: *mut c_void) {
+    abort_on_panic(|| {
+        let shared = Arc::from_raw(data as *const ChoreographerShared);
+        shared.set_frame(FrameTiming {
+            frame_time_nanos,
+            vsync_id: None,
+            deadline_nanos: None,
+        });
+    })
+}
+
+unsafe extern "C" fn on_vsync(callback_data: *const c_void, data: *mut c_void) {
+    abort_on_panic(|| {
+        let shared = Arc::from_raw(data as *const ChoreographerShared);
+        let vsync = shared.vsync.unwrap();
+        let index = (vsync.get_preferred_frame_timeline_index)(callback_data);
+        shared.set_frame(FrameTiming {
+            frame_time_nanos: (vsync.get_frame_time_nanos)(callback_data),
+            vsync_id: Some((vsync.get_frame_timeline_vsync_id)(callback_data, index)),
+            deadline_nanos: Some((vsync.get_frame_timeline_deadline_nanos)(
+                callback_data,
+                index,
+            )),
+        });
+    })
+}
+
+/// Frames from the `AChoreographer` of the `android_main` thread
+pub(crate) struct Choreographer {
+    api: ChoreographerApi,
+    choreographer: *mut c_void,
+    shared: Arc<ChoreographerShared>,
+}
+
+// The choreographer is only used on the `android_main` thread, where it was created
+unsafe impl Send for Choreographer {}
+
+impl Choreographer {
+    /// Creates a clock for the calling thread's `AChoreographer`, if supported, which must be
+    /// called on a thread with a looper
+    pub fn new_clock() -> Option<Box<dyn FrameClock>> {
+        let api = ChoreographerApi::load()?;
+        unsafe {
+            let choreographer = (api.get_instance)();
+            if choreographer.is_null() {
+                return None;
+            }
+            let eventfd = libc::eventfd(0, libc::EFD_CLOEXEC | libc::EFD_NONBLOCK);
+            if eventfd < 0 {
+                log::error!(
+                    "Failed to create eventfd for frame events: {}",
+                    std::io::Error::last_os_error()
+                );
+                return None;
+            }
+            Some(Box::new(Self {
+                api,
+                choreographer,
+                shared: Arc::new(ChoreographerShared {
+                    eventfd,
+                    vsync: api.vsync,
+                    frame: Mutex::new(None),
+                }),
+            }))
+        }
+    }
+}
+
+impl FrameClock for Choreographer {
+    fn fd(&self) -> RawFd {
+        self.shared.eventfd
+    }
+
+    fn request_frame(&mut self) {
+        // The callback takes over a reference to the shared state, which stays valid for as long
+        // as the callback is pending
+        let data = Arc::into_raw(self.shared.clone()) as *mut c_void;
+        unsafe {
+            match self.api.vsync {
+                Some(vsync) => (vsync.post_vsync_callback)(self.choreographer, on_vsync, data),
+                None => (self.api.post_frame_callback_64)(self.choreographer, on_frame_64, data),
+            }
+        }
+    }
+
+    fn take_frame(&mut self) -> Option<FrameTiming> {
+        let mut count: u64 = 0;
+        unsafe {
+            libc::read(
+                self.shared.eventfd,
+                (&mut count as *mut u64).cast(),
+                mem::size_of::<u64>(),
+            );
+        }
+        self.shared.frame.lock().unwrap().take()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::{thread, time::Duration};
+
+    const LOOPER_ID: libc::c_int = 42;
+
+    /// The vsync period of `TimerClock`, for 60Hz
+    const PERIOD_NANOS: i64 = 16_666_667;
+
+    fn monotonic_nanos() -> i64 {
+        let mut ts: libc::timespec = unsafe { mem::zeroed() };
+        unsafe { libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut ts) };
+        ts.tv_sec as i64 * 1_000_000_000 + ts.tv_nsec as i64
+    }
+
+    /// A fake clock that's driven by a timerfd, with a vsync at every multiple of
+    /// `PERIOD_NANOS`
+    struct TimerClock {
+        timerfd: RawFd,
+
+        /// The time of the requested frame
+        next_nanos: i64,
+
+        vsync_id: i64,
+    }
+
+    impl TimerClock {
+        fn new_clock() -> Option<Box<dyn FrameClock>> {
+            let timerfd = unsafe {
+                libc::timerfd_create(
+                    libc::CLOCK_MONOTONIC,
+                    libc::TFD_CLOEXEC | libc::TFD_NONBLOCK,
+                )
+            };
+            assert!(timerfd >= 0, "{}", std::io::Error::last_os_error());
+            Some(Box::new(Self {
+                timerfd,
+                next_nanos: 0,
+                vsync_id: 0,
+            }))
+        }
+    }
+
+    impl Drop for TimerClock {
+        fn drop(&mut self) {
+            unsafe { libc::close(self.timerfd) };
+        }
+    }
+
+    impl FrameClock for TimerClock {
+        fn fd(&self) -> RawFd {
+            self.timerfd
+        }
+
+        fn request_frame(&mut self) {
+            self.next_nanos = (monotonic_nanos() / PERIOD_NANOS + 1) * PERIOD_NANOS;
+            let mut spec: libc::itimerspec = unsafe { mem::zeroed() };
+            spec.it_value.tv_sec = (self.next_nanos / 1_000_000_000) as _;
+            spec.it_value.tv_nsec = (self.next_nanos % 1_000_000_000) as _;
+            unsafe {
+                libc::timerfd_settime(
+                    self.timerfd,
+                    libc::TFD_TIMER_ABSTIME,
+                    &spec,
+                    ptr::null_mut(),
+                )
+            };
+        }
+
+        fn take_frame(&mut self) -> Option<FrameTiming> {
+            let mut expirations: u64 = 0;
+            let len = unsafe {
+                libc::read(
+                    self.timerfd,
+                    (&mut expirations as *mut u64).cast(),
+                    mem::size_of::<u64>(),
+                )
+            };
+            if len != mem::size_of::<u64>() as isize {
+                return None;
+            }
+            self.vsync_id += 1;
+            Some(FrameTiming {
+                frame_time_nanos: self.next_nanos,
+                vsync_id: Some(self.vsync_id),
+                deadline_nanos: Some(self.next_nanos + PERIOD_NANOS),
+            })
+        }
+    }
+
+    fn unsupported_clock() -> Option<Box<dyn FrameClock>> {
+        None
+    }
+
+    fn prepare_looper() -> *mut ndk_sys::ALooper {
+        unsafe {
+            ndk_sys::ALooper_prepare(ndk_sys::ALOOPER_PREPARE_ALLOW_NON_CALLBACKS as libc::c_int)
+        }
+    }
+
+    /// Sync `frame_events` and poll the looper, like `poll_events`
+    fn poll(
+        frame_events: &FrameEvents,
+        looper: *mut ndk_sys::ALooper,
+        timeout: Duration,
+    ) -> libc::c_int {
+        frame_events.sync(looper);
+        unsafe {
+            ndk_sys::ALooper_pollAll(
+                timeout.as_millis() as libc::c_int,
+                ptr::null_mut(),
+                ptr::null_mut(),
+                ptr::null_mut(),
+            )
+        }
+    }
+
+    #[test]
+    fn frames_are_polled_from_clock() {
+        let looper = prepare_looper();
+        let frame_events = FrameEvents::new(TimerClock::new_clock, LOOPER_ID);
+        assert_eq!(
+            poll(&frame_events, looper, Duration::from_millis(50)),
+            ndk_sys::ALOOPER_POLL_TIMEOUT
+        );
+
+        frame_events.set_enabled(true, looper);
+        let mut last: Option<FrameTiming> = None;
+        for _ in 0..10 {
+            assert_eq!(
+                poll(&frame_events, looper, Duration::from_secs(1)),
+                LOOPER_ID
+            );
+            let frame = frame_events.take_frame().expect("No frame after a wake up");
+            assert!(frame.frame_time_nanos <= monotonic_nanos());
+            if let Some(last) = last {
+                // Vsyncs may be missed if the test thread isn't scheduled in time
+                let elapsed = frame.frame_time_nanos - last.frame_time_nanos;
+                assert!(elapsed > 0 && elapsed % PERIOD_NANOS == 0, "{elapsed}ns");
+                assert_eq!(frame.vsync_id, last.vsync_id.map(|id| id + 1));
+            }
+            last = Some(frame);
+        }
+    }
+
+    #[test]
+    fn no_frames_while_disabled() {
+        let looper = prepare_looper();
+        let frame_events = FrameEvents::new(TimerClock::new_clock, LOOPER_ID);
+        frame_events.set_enabled(true, looper);
+        assert_eq!(
+            poll(&frame_events, looper, Duration::from_secs(1)),
+            LOOPER_ID
+        );
+        assert!(frame_events.take_frame().is_some());
+
+        // The next frame has been requested, and becomes ready while disabled
+        frame_events.set_enabled(false, looper);
+        assert_eq!(
+            poll(&frame_events, looper, Duration::from_millis(50)),
+            ndk_sys::ALOOPER_POLL_TIMEOUT
+        );
+
+        // The stale frame is discarded when enabled again
+        let enabled_nanos = monotonic_nanos();
+        frame_events.set_enabled(true, looper);
+        assert_eq!(
+            poll(&frame_events, looper, Duration::from_secs(1)),
+            LOOPER_ID
+        );
+        let frame = frame_events.take_frame().unwrap();
+        assert!(frame.frame_time_nanos > enabled_nanos);
+    }
+
+    #[test]
+    fn missed_frames_are_coalesced() {
+        let looper = prepare_looper();
+        let frame_events = FrameEvents::new(TimerClock::new_clock, LOOPER_ID);
+        frame_events.set_enabled(true, looper);
+        thread::sleep(Duration::from_millis(100));
+        assert_eq!(
+            poll(&frame_events, looper, Duration::from_secs(1)),
+            LOOPER_ID
+        );
+        assert!(frame_events.take_frame().is_some());
+        assert_eq!(
+            poll(&frame_events, looper, Duration::ZERO),
+            ndk_sys::ALOOPER_POLL_TIMEOUT
+        );
+    }
+
+    #[test]
+    fn unsupported_clock_has_no_frames() {
+        let looper = prepare_looper();
+        let frame_events = FrameEvents::new(unsupported_clock, LOOPER_ID);
+        frame_events.set_enabled(true, looper);
+        assert_eq!(
+            poll(&frame_events, looper, Duration::from_millis(50)),
+            ndk_sys::ALOOPER_POLL_TIMEOUT
+        );
+        assert!(frame_events.take_frame().is_none());
+    }
+}
@@ -224,6 +224,26 @@ pub const SCNxMAX: &[u8; 3] = b"jx\0";
 pub const SCNxPTR: &[u8; 3] = b"lx\0";
 pub const GAME_ACTIVITY_POINTER_INFO_AXIS_COUNT: u32 = 48;
 pub const GAMEACTIVITY_MAX_NUM_POINTERS_IN_MOTION_EVENT: u32 = 8;
+pub const GAMEACTIVITY_INPUT_FILTER_KEYCODE_COUNT: u32 = 512;
+pub const GAMEACTIVITY_INPUT_FILTER_MAX_DEVICES: u32 = 8;
+pub const GAMEACTIVITY_CONFIGURATION_COLOR_MODE: u32 = 1;
+pub const GAMEACTIVITY_CONFIGURATION_DENSITY_DPI: u32 = 2;
+pub const GAMEACTIVITY_CONFIGURATION_FONT_SCALE: u32 = 4;
+pub const GAMEACTIVITY_CONFIGURATION_FONT_WEIGHT_ADJUSTMENT: u32 = 8;
+pub const GAMEACTIVITY_CONFIGURATION_HARD_KEYBOARD_HIDDEN: u32 = 16;
+pub const GAMEACTIVITY_CONFIGURATION_KEYBOARD: u32 = 32;
+pub const GAMEACTIVITY_CONFIGURATION_KEYBOARD_HIDDEN: u32 = 64;
+pub const GAMEACTIVITY_CONFIGURATION_MCC: u32 = 128;
+pub const GAMEACTIVITY_CONFIGURATION_MNC: u32 = 256;
+pub const GAMEACTIVITY_CONFIGURATION_NAVIGATION: u32 = 512;
+pub const GAMEACTIVITY_CONFIGURATION_NAVIGATION_HIDDEN: u32 = 1024;
+pub const GAMEACTIVITY_CONFIGURATION_ORIENTATION: u32 = 2048;
+pub const GAMEACTIVITY_CONFIGURATION_SCREEN_HEIGHT_DP: u32 = 4096;
+pub const GAMEACTIVITY_CONFIGURATION_SCREEN_LAYOUT: u32 = 8192;
+pub const GAMEACTIVITY_CONFIGURATION_SCREEN_WIDTH_DP: u32 = 16384;
+pub const GAMEACTIVITY_CONFIGURATION_SMALLEST_SCREEN_WIDTH_DP: u32 = 32768;
+pub const GAMEACTIVITY_CONFIGURATION_TOUCHSCREEN: u32 = 65536;
+pub const GAMEACTIVITY_CONFIGURATION_UI_MODE: u32 = 131072;
 pub const GAMETEXTINPUT_MAJOR_VERSION: u32 = 2;
 pub const GAMETEXTINPUT_MINOR_VERSION: u32 = 0;
 pub const GAMETEXTINPUT_BUGFIX_VERSION: u32 = 0;
@@ -650,7 +670,7 @@ pub const PTHREAD_PROCESS_PRIVATE: u32 = 0;
 pub const PTHREAD_PROCESS_SHARED: u32 = 1;
 pub const PTHREAD_SCOPE_SYSTEM: u32 = 0;
 pub const PTHREAD_SCOPE_PROCESS: u32 = 1;
-pub const NATIVE_APP_GLUE_MAX_INPUT_BUFFERS: u32 = 2;
+pub const NATIVE_APP_GLUE_LATENCY_BUCKETS: u32 = 24;
 extern "C" {
     pub fn android_get_application_target_sdk_version() -> ::std::os::raw::c_int;
 }
@@ -2401,6 +2421,82 @@ extern "C" {
         axis: i32,
     ) -> f32;
 }
+#[doc = " \\brief Structure-of-arrays storage for the pointers of a\n GameActivityMotionEvent.\n\n Each array holds `pointerCount` elements, except `axisValues` which holds\n `pointerCount` values for each axis in `historicalAxisMask`, in ascending\n axis order. This way the values of an axis (such as X) are contiguous for\n all the pointers of the event.\n\n \\see GameActivityMotionEvent"]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct GameActivityPointerArrays {
+    pub ids: *mut i32,
+    pub toolTypes: *mut i32,
+    pub rawX: *mut f32,
+    pub rawY: *mut f32,
+    pub axisValues: *mut f32,
+}
+#[test]
+fn bindgen_test_layout_GameActivityPointerArrays() {
+    const UNINIT: ::std::mem::MaybeUninit<GameActivityPointerArrays> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<GameActivityPointerArrays>(),
+        40usize,
+        concat!("Size of: ", stringify!(GameActivityPointerArrays))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<GameActivityPointerArrays>(),
+        8usize,
+        concat!("Alignment of ", stringify!(GameActivityPointerArrays))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).ids) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityPointerArrays),
+            "::",
+            stringify!(ids)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).toolTypes) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityPointerArrays),
+            "::",
+            stringify!(toolTypes)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).rawX) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityPointerArrays),
+            "::",
+            stringify!(rawX)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).rawY) as usize - ptr as usize },
+        24usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityPointerArrays),
+            "::",
+            stringify!(rawY)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).axisValues) as usize - ptr as usize },
+        32usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityPointerArrays),
+            "::",
+            stringify!(axisValues)
+        )
+    );
+}
 #[doc = " \\brief Describe a motion event that happened on the GameActivity SurfaceView.\n\n This is 1:1 mapping to the information contained in a Java `MotionEvent`\n (see https://developer.android.com/reference/android/view/MotionEvent)."]
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
@@ -2424,6 +2520,12 @@ pub struct GameActivityMotionEvent {
     pub historicalAxisValues: *mut f32,
     pub precisionX: f32,
     pub precisionY: f32,
+    #[doc = " Bitmask (`1 << axis`) of the axes that were enabled when the event was\n received.\n\n To avoid storing values for axes that aren't enabled,\n `historicalAxisValues` only holds values for these axes, in ascending\n axis order, for each pointer of each historical sample. Use\n GameActivityMotionEvent_getHistoricalAxisValue to look up a value."]
+    pub historicalAxisMask: u64,
+    #[doc = " If `pointerArrays.ids` is not NULL then the pointers are stored in\n `pointerArrays`, instead of `pointers`, which is left uninitialized.\n\n This compact layout is only used for events that have been copied by\n code that has opted in to it, such as the native app glue.\n GameActivityMotionEvent_getPointerAxisValue supports both layouts."]
+    pub pointerArrays: GameActivityPointerArrays,
+    #[doc = " If not NULL then the event was captured without decoding its axis\n values, raw coordinates or history, which can instead be read on demand\n from this native copy of the Java `MotionEvent`, with the NDK\n `AMotionEvent_*` accessors. In this case `historySize` is 0 and the\n `rawX`, `rawY` and `axisValues` of the pointers are left unset.\n\n GameActivityMotionEvent_getPointerAxisValue,\n GameActivityMotionEvent_getHistorySize and\n GameActivityMotionEvent_getHistoricalAxisValue support both forms.\n\n The event must be released with GameActivityMotionEvent_releaseDeferred\n by its owner.\n\n \\see GameActivityMotionEvent_fromJavaDeferred"]
+    pub deferredEvent: *const AInputEvent,
 }
 #[test]
 fn bindgen_test_layout_GameActivityMotionEvent() {
@@ -2432,7 +2534,7 @@ fn bindgen_test_layout_GameActivityMotionEvent() {
     let ptr = UNINIT.as_ptr();
     assert_eq!(
         ::std::mem::size_of::<GameActivityMotionEvent>(),
-        1760usize,
+        1816usize,
         concat!("Size of: ", stringify!(GameActivityMotionEvent))
     );
     assert_eq!(
@@ -2630,6 +2732,44 @@ fn bindgen_test_layout_GameActivityMotionEvent() {
             stringify!(precisionY)
         )
     );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).historicalAxisMask) as usize - ptr as usize },
+        1760usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityMotionEvent),
+            "::",
+            stringify!(historicalAxisMask)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).pointerArrays) as usize - ptr as usize },
+        1768usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityMotionEvent),
+            "::",
+            stringify!(pointerArrays)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).deferredEvent) as usize - ptr as usize },
+        1808usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityMotionEvent),
+            "::",
+            stringify!(deferredEvent)
+        )
+    );
+}
+extern "C" {
+    #[doc = " \\brief Get the value of the requested axis for the given pointer, whether\n the event stores its pointers in `pointers` or `pointerArrays`.\n\n @return The value of the axis, or 0 if the axis is invalid or was not\n enabled."]
+    pub fn GameActivityMotionEvent_getPointerAxisValue(
+        event: *const GameActivityMotionEvent,
+        axis: ::std::os::raw::c_int,
+        pointerIndex: ::std::os::raw::c_int,
+    ) -> f32;
 }
 extern "C" {
     pub fn GameActivityMotionEvent_getHistoricalAxisValue(
@@ -2651,6 +2791,18 @@ extern "C" {
         out_event: *mut GameActivityMotionEvent,
     );
 }
+extern "C" {
+    #[doc = " \\brief Capture a Java `MotionEvent` as a `GameActivityMotionEvent` without\n decoding its axis values, raw coordinates or history.\n\n Only the event's scalar state and its pointer ids and tool types are\n decoded. The rest of the event is kept in a native copy of the\n `MotionEvent`, in `out_event->deferredEvent`, so that it can be decoded\n later, on any thread, only if it's needed.\n\n This relies on `AMotionEvent_fromJava`, which is only available from\n API 31. Returns false, without touching `out_event`, if the event can't be\n captured this way, in which case GameActivityMotionEvent_fromJava can be\n used instead.\n\n `out_event->deferredEvent` must be released with\n GameActivityMotionEvent_releaseDeferred."]
+    pub fn GameActivityMotionEvent_fromJavaDeferred(
+        env: *mut JNIEnv,
+        motionEvent: jobject,
+        out_event: *mut GameActivityMotionEvent,
+    ) -> bool;
+}
+extern "C" {
+    #[doc = " \\brief Release the native `MotionEvent` copy of an event that was captured\n with GameActivityMotionEvent_fromJavaDeferred, if any.\n\n The event's `deferredEvent` must not be used afterwards."]
+    pub fn GameActivityMotionEvent_releaseDeferred(event: *const GameActivityMotionEvent);
+}
 #[doc = " \\brief Describe a key event that happened on the GameActivity SurfaceView.\n\n This is 1:1 mapping to the information contained in a Java `KeyEvent`\n (see https://developer.android.com/reference/android/view/KeyEvent).\n The only exception is the event times, which are reported as\n nanoseconds in this struct."]
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
@@ -2800,6 +2952,114 @@ extern "C" {
         out_event: *mut GameActivityKeyEvent,
     );
 }
+#[doc = " \\brief A declarative filter for the input events of a GameActivity.\n\n Unlike a filter callback, this can be checked with a few JNI calls on the\n Java event, before it's converted to a GameActivityMotionEvent or\n GameActivityKeyEvent, so rejected events are never converted.\n\n Use GameActivityInputFilter_init to start from a filter that accepts all\n events.\n\n \\see GameActivity_setInputFilter"]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct GameActivityInputFilter {
+    #[doc = " The `AINPUT_SOURCE_*` bits that motion events may have. A motion event\n is rejected if its source has any bits that aren't in this mask."]
+    pub motionSourceMask: u32,
+    #[doc = " Bitmask (`1 << (action & AMOTION_EVENT_ACTION_MASK)`) of the motion\n actions that are accepted."]
+    pub motionActionMask: u32,
+    #[doc = " The `AINPUT_SOURCE_*` bits that key events may have. A key event is\n rejected if its source has any bits that aren't in this mask."]
+    pub keySourceMask: u32,
+    #[doc = " Bitset (bit `keyCode % 64` of word `keyCode / 64`) of the key codes that\n are accepted. Key codes beyond GAMEACTIVITY_INPUT_FILTER_KEYCODE_COUNT\n are always accepted."]
+    pub keyCodes: [u64; 8usize],
+    #[doc = " If not 0, only events from the first `deviceIdCount` devices in\n `deviceIds` are accepted."]
+    pub deviceIdCount: u32,
+    pub deviceIds: [i32; 8usize],
+}
+#[test]
+fn bindgen_test_layout_GameActivityInputFilter() {
+    const UNINIT: ::std::mem::MaybeUninit<GameActivityInputFilter> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<GameActivityInputFilter>(),
+        120usize,
+        concat!("Size of: ", stringify!(GameActivityInputFilter))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<GameActivityInputFilter>(),
+        8usize,
+        concat!("Alignment of ", stringify!(GameActivityInputFilter))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionSourceMask) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityInputFilter),
+            "::",
+            stringify!(motionSourceMask)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionActionMask) as usize - ptr as usize },
+        4usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityInputFilter),
+            "::",
+            stringify!(motionActionMask)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).keySourceMask) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityInputFilter),
+            "::",
+            stringify!(keySourceMask)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).keyCodes) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityInputFilter),
+            "::",
+            stringify!(keyCodes)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).deviceIdCount) as usize - ptr as usize },
+        80usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityInputFilter),
+            "::",
+            stringify!(deviceIdCount)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).deviceIds) as usize - ptr as usize },
+        84usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityInputFilter),
+            "::",
+            stringify!(deviceIds)
+        )
+    );
+}
+extern "C" {
+    #[doc = " \\brief Check whether a Java `MotionEvent` is accepted by `filter`, without\n converting it.\n\n This only makes the JNI calls needed by the parts of the filter that can\n reject events."]
+    pub fn GameActivityInputFilter_acceptsMotionEvent(
+        filter: *const GameActivityInputFilter,
+        env: *mut JNIEnv,
+        motionEvent: jobject,
+    ) -> bool;
+}
+extern "C" {
+    #[doc = " \\brief Check whether a Java `KeyEvent` is accepted by `filter`, without\n converting it.\n\n This only makes the JNI calls needed by the parts of the filter that can\n reject events."]
+    pub fn GameActivityInputFilter_acceptsKeyEvent(
+        filter: *const GameActivityInputFilter,
+        env: *mut JNIEnv,
+        keyEvent: jobject,
+    ) -> bool;
+}
 pub const GameCommonInsetsType_GAMECOMMON_INSETS_TYPE_CAPTION_BAR: GameCommonInsetsType = 0;
 pub const GameCommonInsetsType_GAMECOMMON_INSETS_TYPE_DISPLAY_CUTOUT: GameCommonInsetsType = 1;
 pub const GameCommonInsetsType_GAMECOMMON_INSETS_TYPE_IME: GameCommonInsetsType = 2;
@@ -2865,7 +3125,7 @@ pub type GameTextInputSpanFlag = ::std::os::raw::c_int;
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
 pub struct GameTextInputState {
-    #[doc = " Text owned by the state, as a modified UTF-8 string. Null-terminated.\n https://en.wikipedia.org/wiki/UTF-8#Modified_UTF-8"]
+    #[doc = " Text owned by the state, as a UTF-8 string. Null-terminated, although\n the text may also contain nulls, if they were entered. Invalid UTF-8\n given to GameTextInput_setState is replaced with U+FFFD."]
     pub text_UTF8: *const ::std::os::raw::c_char,
     #[doc = " Length in bytes of text_UTF8, *not* including the null at end."]
     pub text_length: i32,
@@ -2939,7 +3199,7 @@ pub struct GameTextInput {
     _unused: [u8; 0],
 }
 extern "C" {
-    #[doc = " Initialize the GameTextInput library.\n If called twice without GameTextInput_destroy being called, the same pointer\n will be returned and a warning will be issued.\n @param env A JNI env valid on the calling thread.\n @param max_string_size The maximum length of a string that can be edited. If\n zero, the maximum defaults to 65536 bytes. A buffer of this size is allocated\n at initialization.\n @return A handle to the library."]
+    #[doc = " Initialize the GameTextInput library.\n If called twice without GameTextInput_destroy being called, the same pointer\n will be returned and a warning will be issued.\n @param env A JNI env valid on the calling thread.\n @param max_string_size The initial capacity, in bytes, of the buffer that\n holds the text being edited. If zero, this defaults to 65536 bytes. The\n buffer grows as needed, so this doesn't limit the length of the text.\n @return A handle to the library."]
     pub fn GameTextInput_init(env: *mut JNIEnv, max_string_size: u32) -> *mut GameTextInput;
 }
 extern "C" {
@@ -2984,10 +3244,119 @@ extern "C" {
         context: *mut ::std::os::raw::c_void,
     );
 }
+extern "C" {
+    #[doc = " Get a counter that's incremented each time the GameTextInput state changes,\n which can be used to cheaply check whether the state needs to be read again.\n\n This doesn't take a lock, so it may be called from any thread. When called\n from the callback of GameTextInput_getState, it returns the generation of\n the state given to the callback.\n @param input A valid GameTextInput library handle.\n @return The generation of the current state, starting at 0."]
+    pub fn GameTextInput_getGeneration(input: *const GameTextInput) -> u64;
+}
 extern "C" {
     #[doc = " Set the current GameTextInput state. This state is reflected to any active\n IME.\n @param input A valid GameTextInput library handle.\n @param state The state to set. Ownership is maintained by the caller and must\n remain valid for the duration of the call."]
     pub fn GameTextInput_setState(input: *mut GameTextInput, state: *const GameTextInputState);
 }
+#[doc = " A change to the text of a GameTextInputState, along with the selection and\n composing region after the change. Several changes may be merged into one\n edit, see GameTextInput_takeEdit."]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct GameTextInputEdit {
+    #[doc = " The range of bytes in the previous text that were replaced. This is\n empty if only the selection or composing region changed."]
+    pub replaced: GameTextInputSpan,
+    #[doc = " The UTF-8 text that replaced that range. This is *not*\n null-terminated."]
+    pub text_UTF8: *const ::std::os::raw::c_char,
+    #[doc = " Length in bytes of text_UTF8."]
+    pub text_length: i32,
+    #[doc = " The length in bytes of the whole text after the edit."]
+    pub new_length: i32,
+    #[doc = " The selection after the edit."]
+    pub selection: GameTextInputSpan,
+    #[doc = " The composing region after the edit."]
+    pub composingRegion: GameTextInputSpan,
+}
+#[test]
+fn bindgen_test_layout_GameTextInputEdit() {
+    const UNINIT: ::std::mem::MaybeUninit<GameTextInputEdit> = ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<GameTextInputEdit>(),
+        40usize,
+        concat!("Size of: ", stringify!(GameTextInputEdit))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<GameTextInputEdit>(),
+        8usize,
+        concat!("Alignment of ", stringify!(GameTextInputEdit))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).replaced) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameTextInputEdit),
+            "::",
+            stringify!(replaced)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).text_UTF8) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameTextInputEdit),
+            "::",
+            stringify!(text_UTF8)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).text_length) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameTextInputEdit),
+            "::",
+            stringify!(text_length)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).new_length) as usize - ptr as usize },
+        20usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameTextInputEdit),
+            "::",
+            stringify!(new_length)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).selection) as usize - ptr as usize },
+        24usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameTextInputEdit),
+            "::",
+            stringify!(selection)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).composingRegion) as usize - ptr as usize },
+        32usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameTextInputEdit),
+            "::",
+            stringify!(composingRegion)
+        )
+    );
+}
+#[doc = " A callback called by GameTextInput_takeEdit.\n @param context User-defined context.\n @param edit Edit, owned by the library, that will be valid for the duration\n of the callback."]
+pub type GameTextInputEditCallback = ::std::option::Option<
+    unsafe extern "C" fn(context: *mut ::std::os::raw::c_void, edit: *const GameTextInputEdit),
+>;
+extern "C" {
+    #[doc = " Call a callback with a single edit that transforms the text as it was at the\n last call of this function (or empty text, for the first call) into the\n current text, and then start tracking changes from the current text.\n\n The text is kept in a gap buffer, and the edit covers only the bytes between\n the first and last changes that were made, so a consumer that keeps its own\n copy of the text can stay up to date at a cost proportional to the size of\n the changes, rather than to the size of the text.\n\n The replaced range always starts and ends on a character boundary.\n @param input A valid GameTextInput library handle.\n @param wholeText If true, the edit replaces all of the previous text with all\n of the current text, which can be used to resynchronize a copy of the text.\n @param callback A function that will be called with the edit.\n @param context Context used by the callback."]
+    pub fn GameTextInput_takeEdit(
+        input: *mut GameTextInput,
+        wholeText: bool,
+        callback: GameTextInputEditCallback,
+        context: *mut ::std::os::raw::c_void,
+    );
+}
 #[doc = " Type of the callback needed by GameTextInput_setEventCallback that will be\n called every time the IME state changes.\n @param context User-defined context set in GameTextInput_setEventCallback.\n @param current_state Current IME state, owned by the library and valid during\n the callback."]
 pub type GameTextInputEventCallback = ::std::option::Option<
     unsafe extern "C" fn(
@@ -3239,7 +3608,7 @@ pub struct GameActivityCallbacks {
     pub onTrimMemory: ::std::option::Option<
         unsafe extern "C" fn(activity: *mut GameActivity, level: ::std::os::raw::c_int),
     >,
-    #[doc = " Callback called for every MotionEvent done on the GameActivity\n SurfaceView. Ownership of `event` is maintained by the library and it is\n only valid during the callback."]
+    #[doc = " Callback called for every MotionEvent done on the GameActivity\n SurfaceView. Ownership of `event` is maintained by the library and it is\n only valid during the callback.\n\n The exception is the `deferredEvent` of events that are captured while\n deferred decoding is enabled (see\n GameActivity_setDeferredMotionEventDecoding): the callback takes\n ownership of it, whether or not it handles the event, and must release it\n with GameActivityMotionEvent_releaseDeferred."]
     pub onTouchEvent: ::std::option::Option<
         unsafe extern "C" fn(
             activity: *mut GameActivity,
@@ -3264,7 +3633,7 @@ pub struct GameActivityCallbacks {
     pub onTextInputEvent: ::std::option::Option<
         unsafe extern "C" fn(activity: *mut GameActivity, state: *const GameTextInputState),
     >,
-    #[doc = " Callback called when WindowInsets of the main app window have changed.\n Call GameActivity_getWindowInsets to retrieve the insets themselves."]
+    #[doc = " Callback called when WindowInsets of the main app window have changed.\n Call GameActivity_getWindowInsets to retrieve the insets themselves, or\n GameActivity_getWindowInsetsSnapshot to also find out which of them\n changed. This is only called if at least one of the insets changed."]
     pub onWindowInsetsChanged:
         ::std::option::Option<unsafe extern "C" fn(activity: *mut GameActivity)>,
     #[doc = " Callback called when the rectangle in the window where the content\n should be placed has changed."]
@@ -3591,6 +3960,19 @@ extern "C" {
         context: *mut ::std::os::raw::c_void,
     );
 }
+extern "C" {
+    #[doc = " Get the change to the text entry state since the last call of this\n function, as a single edit (see documentation of GameTextInput_takeEdit in\n the Game Text Input library reference).\n\n Edits are only tracked once, so this should only be used by a single\n consumer."]
+    pub fn GameActivity_takeTextInputEdit(
+        activity: *mut GameActivity,
+        wholeText: bool,
+        callback: GameTextInputEditCallback,
+        context: *mut ::std::os::raw::c_void,
+    );
+}
+extern "C" {
+    #[doc = " Get a counter that's incremented each time the text entry state changes (see\n documentation of GameTextInput_getGeneration in the Game Text Input library\n reference)."]
+    pub fn GameActivity_getTextInputGeneration(activity: *mut GameActivity) -> u64;
+}
 extern "C" {
     #[doc = " Get a pointer to the GameTextInput library instance."]
     pub fn GameActivity_getTextInput(activity: *const GameActivity) -> *mut GameTextInput;
@@ -3615,29 +3997,632 @@ extern "C" {
         insets: *mut ARect,
     );
 }
-extern "C" {
-    #[doc = " Set options on how the IME behaves when it is requested for text input.\n See\n https://developer.android.com/reference/android/view/inputmethod/EditorInfo\n for the meaning of inputType, actionId and imeOptions.\n\n Note that this function will attach the current thread to the JVM if it is\n not already attached, so the caller must detach the thread from the JVM\n before the thread is destroyed using DetachCurrentThread."]
-    pub fn GameActivity_setImeEditorInfo(
-        activity: *mut GameActivity,
-        inputType: ::std::os::raw::c_int,
-        actionId: ::std::os::raw::c_int,
-        imeOptions: ::std::os::raw::c_int,
-    );
-}
-extern "C" {
-    #[doc = " These are getters for Configuration class members. They may be called from\n any thread."]
-    pub fn GameActivity_getOrientation(activity: *mut GameActivity) -> ::std::os::raw::c_int;
-}
-extern "C" {
-    pub fn GameActivity_getColorMode(activity: *mut GameActivity) -> ::std::os::raw::c_int;
-}
-extern "C" {
-    pub fn GameActivity_getDensityDpi(activity: *mut GameActivity) -> ::std::os::raw::c_int;
-}
-extern "C" {
-    pub fn GameActivity_getFontScale(activity: *mut GameActivity) -> f32;
+#[doc = " A consistent snapshot of all of the window insets, see\n GameActivity_getWindowInsetsSnapshot()."]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct GameActivityWindowInsets {
+    #[doc = " Incremented each time that any of the insets change. This is 0 until\n the insets are first known."]
+    pub version: u32,
+    #[doc = " A mask of `1 << GameCommonInsetsType` bits for the insets that differ\n from the previous version."]
+    pub changedMask: u32,
+    #[doc = " The insets of each GameCommonInsetsType."]
+    pub insets: [ARect; 10usize],
 }
-extern "C" {
+#[test]
+fn bindgen_test_layout_GameActivityWindowInsets() {
+    const UNINIT: ::std::mem::MaybeUninit<GameActivityWindowInsets> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<GameActivityWindowInsets>(),
+        168usize,
+        concat!("Size of: ", stringify!(GameActivityWindowInsets))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<GameActivityWindowInsets>(),
+        4usize,
+        concat!("Alignment of ", stringify!(GameActivityWindowInsets))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).version) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWindowInsets),
+            "::",
+            stringify!(version)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).changedMask) as usize - ptr as usize },
+        4usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWindowInsets),
+            "::",
+            stringify!(changedMask)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).insets) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWindowInsets),
+            "::",
+            stringify!(insets)
+        )
+    );
+}
+extern "C" {
+    #[doc = " Get the current window insets of every component. This may be called from\n any thread, and never blocks; all of the insets come from the same version,\n even if they change while they're being read.\n\n When called from GameActivityCallbacks::onWindowInsetsChanged, `changedMask`\n says which insets that callback is for."]
+    pub fn GameActivity_getWindowInsetsSnapshot(
+        activity: *mut GameActivity,
+        outInsets: *mut GameActivityWindowInsets,
+    );
+}
+extern "C" {
+    #[doc = " Set options on how the IME behaves when it is requested for text input.\n See\n https://developer.android.com/reference/android/view/inputmethod/EditorInfo\n for the meaning of inputType, actionId and imeOptions.\n\n Note that this function will attach the current thread to the JVM if it is\n not already attached, so the caller must detach the thread from the JVM\n before the thread is destroyed using DetachCurrentThread."]
+    pub fn GameActivity_setImeEditorInfo(
+        activity: *mut GameActivity,
+        inputType: ::std::os::raw::c_int,
+        actionId: ::std::os::raw::c_int,
+        imeOptions: ::std::os::raw::c_int,
+    );
+}
+#[doc = " Statistics about the work that's queued for the application's main thread,\n by functions such as GameActivity_setTextInputState() and\n GameActivity_showSoftInput()."]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct GameActivityWorkQueueStats {
+    #[doc = " The number of work items that have been queued."]
+    pub queued: u64,
+    #[doc = " The number of work items that were dropped because the queue was full."]
+    pub dropped: u64,
+    #[doc = " The number of queued work items that were skipped because a later item\n superseded them, such as redundant text input state updates."]
+    pub collapsed: u64,
+    #[doc = " The number of queued work items that have been executed."]
+    pub handled: u64,
+    #[doc = " The number of main thread wake ups that handled work."]
+    pub wakeUps: u64,
+    #[doc = " The number of work items that are currently queued."]
+    pub depth: u32,
+    #[doc = " The largest number of work items handled by a single wake up."]
+    pub maxDepth: u32,
+    #[doc = " The total time between work items being queued and executed, in\n nanoseconds. Divide by `handled` for the mean latency."]
+    pub totalLatencyNanos: i64,
+    #[doc = " The longest time between a work item being queued and executed, in\n nanoseconds."]
+    pub maxLatencyNanos: i64,
+}
+#[test]
+fn bindgen_test_layout_GameActivityWorkQueueStats() {
+    const UNINIT: ::std::mem::MaybeUninit<GameActivityWorkQueueStats> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<GameActivityWorkQueueStats>(),
+        64usize,
+        concat!("Size of: ", stringify!(GameActivityWorkQueueStats))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<GameActivityWorkQueueStats>(),
+        8usize,
+        concat!("Alignment of ", stringify!(GameActivityWorkQueueStats))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).queued) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWorkQueueStats),
+            "::",
+            stringify!(queued)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).dropped) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWorkQueueStats),
+            "::",
+            stringify!(dropped)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).collapsed) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWorkQueueStats),
+            "::",
+            stringify!(collapsed)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).handled) as usize - ptr as usize },
+        24usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWorkQueueStats),
+            "::",
+            stringify!(handled)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).wakeUps) as usize - ptr as usize },
+        32usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWorkQueueStats),
+            "::",
+            stringify!(wakeUps)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).depth) as usize - ptr as usize },
+        40usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWorkQueueStats),
+            "::",
+            stringify!(depth)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).maxDepth) as usize - ptr as usize },
+        44usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWorkQueueStats),
+            "::",
+            stringify!(maxDepth)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).totalLatencyNanos) as usize - ptr as usize },
+        48usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWorkQueueStats),
+            "::",
+            stringify!(totalLatencyNanos)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).maxLatencyNanos) as usize - ptr as usize },
+        56usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityWorkQueueStats),
+            "::",
+            stringify!(maxLatencyNanos)
+        )
+    );
+}
+extern "C" {
+    #[doc = " Get statistics about the work that's queued for the application's main\n thread. This may be called from any thread."]
+    pub fn GameActivity_getWorkQueueStats(
+        activity: *mut GameActivity,
+        outStats: *mut GameActivityWorkQueueStats,
+    );
+}
+extern "C" {
+    #[doc = " Enable or disable deferred decoding of motion events.\n\n When enabled, motion events are captured with\n GameActivityMotionEvent_fromJavaDeferred, so that the Java main thread only\n decodes their scalar state before calling `onTouchEvent`, and their axis\n values and history are only decoded if and when they're read. Events that\n can't be captured this way (before API 31) are still decoded in full.\n\n This may be called from any thread, and applies to subsequent events."]
+    pub fn GameActivity_setDeferredMotionEventDecoding(activity: *mut GameActivity, enabled: bool);
+}
+extern "C" {
+    #[doc = " Set a declarative filter for the motion and key events of the activity, or\n clear it if `filter` is NULL.\n\n The filter is checked on the Java main thread before an event is converted,\n and events that it rejects are reported as unhandled without calling\n `onTouchEvent`, `onKeyDown` or `onKeyUp`.\n\n The filter is copied, and may be replaced from any thread without blocking\n input delivery. It applies to subsequent events."]
+    pub fn GameActivity_setInputFilter(
+        activity: *mut GameActivity,
+        filter: *const GameActivityInputFilter,
+    );
+}
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_INITIALIZE_NATIVE_CODE:
+    GameActivityJniEntryPoint = 0;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_TERMINATE_NATIVE_CODE:
+    GameActivityJniEntryPoint = 1;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_START: GameActivityJniEntryPoint = 2;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_RESUME: GameActivityJniEntryPoint = 3;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_SAVE_INSTANCE_STATE:
+    GameActivityJniEntryPoint = 4;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_PAUSE: GameActivityJniEntryPoint = 5;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_STOP: GameActivityJniEntryPoint = 6;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_CONFIGURATION_CHANGED:
+    GameActivityJniEntryPoint = 7;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_TRIM_MEMORY:
+    GameActivityJniEntryPoint = 8;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_WINDOW_FOCUS_CHANGED:
+    GameActivityJniEntryPoint = 9;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_CREATED:
+    GameActivityJniEntryPoint = 10;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_CHANGED:
+    GameActivityJniEntryPoint = 11;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_REDRAW_NEEDED:
+    GameActivityJniEntryPoint = 12;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_SURFACE_DESTROYED:
+    GameActivityJniEntryPoint = 13;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_TOUCH_EVENT:
+    GameActivityJniEntryPoint = 14;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_KEY_UP: GameActivityJniEntryPoint =
+    15;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_KEY_DOWN: GameActivityJniEntryPoint =
+    16;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_TEXT_INPUT:
+    GameActivityJniEntryPoint = 17;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_WINDOW_INSETS_CHANGED:
+    GameActivityJniEntryPoint = 18;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_SET_INPUT_CONNECTION:
+    GameActivityJniEntryPoint = 19;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_ON_CONTENT_RECT_CHANGED:
+    GameActivityJniEntryPoint = 20;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_MAIN_WORK: GameActivityJniEntryPoint =
+    21;
+pub const GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_COUNT: GameActivityJniEntryPoint = 22;
+#[doc = " The native methods of GameActivity (plus the main thread's handler for\n queued work) that keep JNI usage statistics, see GameActivity_getJniStats()."]
+pub type GameActivityJniEntryPoint = ::std::os::raw::c_uint;
+#[doc = " JNI usage statistics for one of the GameActivityJniEntryPoint methods.\n\n The time spent in a method includes the time spent in any application\n callbacks that it calls, such as GameActivityCallbacks::onTouchEvent."]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct GameActivityJniStats {
+    #[doc = " The name of the native method."]
+    pub name: *const ::std::os::raw::c_char,
+    #[doc = " The number of times the method has been called."]
+    pub calls: u64,
+    #[doc = " The number of JNI functions that the method has called."]
+    pub jniCalls: u64,
+    #[doc = " The number of JNI local references that the method has created."]
+    pub localRefs: u64,
+    #[doc = " The total time spent in the method, in nanoseconds."]
+    pub totalNanos: i64,
+    #[doc = " The longest time spent in a single call of the method, in nanoseconds."]
+    pub maxNanos: i64,
+}
+#[test]
+fn bindgen_test_layout_GameActivityJniStats() {
+    const UNINIT: ::std::mem::MaybeUninit<GameActivityJniStats> = ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<GameActivityJniStats>(),
+        48usize,
+        concat!("Size of: ", stringify!(GameActivityJniStats))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<GameActivityJniStats>(),
+        8usize,
+        concat!("Alignment of ", stringify!(GameActivityJniStats))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).name) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityJniStats),
+            "::",
+            stringify!(name)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).calls) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityJniStats),
+            "::",
+            stringify!(calls)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).jniCalls) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityJniStats),
+            "::",
+            stringify!(jniCalls)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).localRefs) as usize - ptr as usize },
+        24usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityJniStats),
+            "::",
+            stringify!(localRefs)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).totalNanos) as usize - ptr as usize },
+        32usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityJniStats),
+            "::",
+            stringify!(totalNanos)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).maxNanos) as usize - ptr as usize },
+        40usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityJniStats),
+            "::",
+            stringify!(maxNanos)
+        )
+    );
+}
+extern "C" {
+    #[doc = " Get the JNI usage statistics for the given native method, which are\n accumulated for the lifetime of the process. This may be called from any\n thread.\n\n Returns false if `entryPoint` isn't a valid GameActivityJniEntryPoint."]
+    pub fn GameActivity_getJniStats(
+        entryPoint: GameActivityJniEntryPoint,
+        outStats: *mut GameActivityJniStats,
+    ) -> bool;
+}
+#[doc = " A consistent snapshot of the Configuration class members that GameActivity\n tracks, see GameActivity_getConfiguration()."]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct GameActivityConfiguration {
+    #[doc = " Incremented each time that GameActivity reads a new Configuration,\n starting from 1."]
+    pub version: u32,
+    #[doc = " The GAMEACTIVITY_CONFIGURATION_* bits of the members that differ from\n the previous version."]
+    pub changedMask: u32,
+    pub colorMode: i32,
+    pub densityDpi: i32,
+    pub fontScale: f32,
+    pub fontWeightAdjustment: i32,
+    pub hardKeyboardHidden: i32,
+    pub keyboard: i32,
+    pub keyboardHidden: i32,
+    pub mcc: i32,
+    pub mnc: i32,
+    pub navigation: i32,
+    pub navigationHidden: i32,
+    pub orientation: i32,
+    pub screenHeightDp: i32,
+    pub screenLayout: i32,
+    pub screenWidthDp: i32,
+    pub smallestScreenWidthDp: i32,
+    pub touchscreen: i32,
+    pub uiMode: i32,
+}
+#[test]
+fn bindgen_test_layout_GameActivityConfiguration() {
+    const UNINIT: ::std::mem::MaybeUninit<GameActivityConfiguration> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<GameActivityConfiguration>(),
+        80usize,
+        concat!("Size of: ", stringify!(GameActivityConfiguration))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<GameActivityConfiguration>(),
+        4usize,
+        concat!("Alignment of ", stringify!(GameActivityConfiguration))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).version) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(version)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).changedMask) as usize - ptr as usize },
+        4usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(changedMask)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).colorMode) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(colorMode)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).densityDpi) as usize - ptr as usize },
+        12usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(densityDpi)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).fontScale) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(fontScale)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).fontWeightAdjustment) as usize - ptr as usize },
+        20usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(fontWeightAdjustment)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).hardKeyboardHidden) as usize - ptr as usize },
+        24usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(hardKeyboardHidden)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).keyboard) as usize - ptr as usize },
+        28usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(keyboard)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).keyboardHidden) as usize - ptr as usize },
+        32usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(keyboardHidden)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).mcc) as usize - ptr as usize },
+        36usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(mcc)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).mnc) as usize - ptr as usize },
+        40usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(mnc)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).navigation) as usize - ptr as usize },
+        44usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(navigation)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).navigationHidden) as usize - ptr as usize },
+        48usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(navigationHidden)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).orientation) as usize - ptr as usize },
+        52usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(orientation)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).screenHeightDp) as usize - ptr as usize },
+        56usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(screenHeightDp)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).screenLayout) as usize - ptr as usize },
+        60usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(screenLayout)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).screenWidthDp) as usize - ptr as usize },
+        64usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(screenWidthDp)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).smallestScreenWidthDp) as usize - ptr as usize },
+        68usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(smallestScreenWidthDp)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).touchscreen) as usize - ptr as usize },
+        72usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(touchscreen)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).uiMode) as usize - ptr as usize },
+        76usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(GameActivityConfiguration),
+            "::",
+            stringify!(uiMode)
+        )
+    );
+}
+extern "C" {
+    #[doc = " Get the last known Configuration. This may be called from any thread, and\n never blocks or allocates; all of the members come from the same version,\n even if the Configuration changes while they're being read.\n\n An application that's notified of a change by\n GameActivityCallbacks::onConfigurationChanged can use `changedMask` to find\n out what changed, but if it polls for changes from another thread then it\n should compare `version` with the last version that it saw, since it may\n have missed some."]
+    pub fn GameActivity_getConfiguration(
+        activity: *mut GameActivity,
+        outConfig: *mut GameActivityConfiguration,
+    );
+}
+extern "C" {
+    #[doc = " These are getters for Configuration class members. They may be called from\n any thread. Use GameActivity_getConfiguration() to read several members\n that are consistent with each other."]
+    pub fn GameActivity_getOrientation(activity: *mut GameActivity) -> ::std::os::raw::c_int;
+}
+extern "C" {
+    pub fn GameActivity_getColorMode(activity: *mut GameActivity) -> ::std::os::raw::c_int;
+}
+extern "C" {
+    pub fn GameActivity_getDensityDpi(activity: *mut GameActivity) -> ::std::os::raw::c_int;
+}
+extern "C" {
+    pub fn GameActivity_getFontScale(activity: *mut GameActivity) -> f32;
+}
+extern "C" {
     pub fn GameActivity_getFontWeightAdjustment(
         activity: *mut GameActivity,
     ) -> ::std::os::raw::c_int;
@@ -9383,19 +10368,60 @@ fn bindgen_test_layout_android_poll_source() {
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
+pub struct android_motion_event_storage {
+    _unused: [u8; 0],
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct android_app_cmd_node {
+    _unused: [u8; 0],
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct android_app_cmd_pool {
+    _unused: [u8; 0],
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct android_app_cmd_stats {
+    _unused: [u8; 0],
+}
+#[doc = " A bounded single-producer, single-consumer ring of input events.\n\n Events are pushed by the GameActivity callbacks on the Java main thread and\n consumed by the application thread, without taking the `android_app` mutex.\n\n The head and tail indices increase monotonically and are reduced modulo the\n ring size, which is a power of two, to index the events."]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
 pub struct android_input_buffer {
-    #[doc = " Pointer to a read-only array of GameActivityMotionEvent.\n Only the first motionEventsCount events are valid."]
+    #[doc = " Pointer to a read-only ring of GameActivityMotionEvent.\n After android_app_swap_input_buffers() the valid events are the\n `motionEventsCount` events starting at index `motionEventsHead`."]
     pub motionEvents: *mut GameActivityMotionEvent,
-    #[doc = " The number of valid motion events in `motionEvents`."]
+    #[doc = " The number of motion events acquired by the consumer, starting at\n `motionEventsHead`."]
     pub motionEventsCount: u64,
-    #[doc = " The size of the `motionEvents` buffer."]
+    #[doc = " The size of the `motionEvents` ring, a power of two."]
     pub motionEventsBufferSize: u64,
-    #[doc = " Pointer to a read-only array of GameActivityKeyEvent.\n Only the first keyEventsCount events are valid."]
+    #[doc = " Pointer to a read-only ring of GameActivityKeyEvent.\n After android_app_swap_input_buffers() the valid events are the\n `keyEventsCount` events starting at index `keyEventsHead`."]
     pub keyEvents: *mut GameActivityKeyEvent,
-    #[doc = " The number of valid \"Key\" events in `keyEvents`."]
+    #[doc = " The number of \"Key\" events acquired by the consumer, starting at\n `keyEventsHead`."]
     pub keyEventsCount: u64,
-    #[doc = " The size of the `keyEvents` buffer."]
+    #[doc = " The size of the `keyEvents` ring, a power of two."]
     pub keyEventsBufferSize: u64,
+    #[doc = " The index of the oldest motion event that hasn't been released by the\n consumer. Only written by the consumer."]
+    pub motionEventsHead: u64,
+    #[doc = " The index after the newest motion event. Only written by the producer."]
+    pub motionEventsTail: u64,
+    #[doc = " The index after the newest motion event acquired by the consumer. Only\n written by the consumer.\n\n Until it's acquired, the newest motion event may be coalesced with new\n events if android_app_set_motion_coalescing() is enabled."]
+    pub motionEventsAcquired: u64,
+    #[doc = " The index of the oldest key event that hasn't been released by the\n consumer. Only written by the consumer."]
+    pub keyEventsHead: u64,
+    #[doc = " The index after the newest key event. Only written by the producer."]
+    pub keyEventsTail: u64,
+    #[doc = " The number of motion events that were dropped because the ring was\n full."]
+    pub motionEventsDropped: u64,
+    #[doc = " The number of key events that were dropped because the ring was full."]
+    pub keyEventsDropped: u64,
+    #[doc = " The number of motion events that were coalesced into a previous event,\n instead of taking up a slot in the ring."]
+    pub motionEventsCoalesced: u64,
+    #[doc = " Set while the producer may be coalescing a new event into the newest\n motion event."]
+    pub motionEventsCoalescing: bool,
+    #[doc = " Storage for the historical samples of each event in `motionEvents`, and\n for their `pointerArrays` if enabled. Each slot of the ring has its own\n storage that's reused by subsequent events in that slot, plus one spare\n that's used for coalescing events."]
+    pub motionEventStorage: *mut android_motion_event_storage,
 }
 #[test]
 fn bindgen_test_layout_android_input_buffer() {
@@ -9403,7 +10429,7 @@ fn bindgen_test_layout_android_input_buffer() {
     let ptr = UNINIT.as_ptr();
     assert_eq!(
         ::std::mem::size_of::<android_input_buffer>(),
-        48usize,
+        128usize,
         concat!("Size of: ", stringify!(android_input_buffer))
     );
     assert_eq!(
@@ -9471,6 +10497,106 @@ fn bindgen_test_layout_android_input_buffer() {
             stringify!(keyEventsBufferSize)
         )
     );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionEventsHead) as usize - ptr as usize },
+        48usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(motionEventsHead)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionEventsTail) as usize - ptr as usize },
+        56usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(motionEventsTail)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionEventsAcquired) as usize - ptr as usize },
+        64usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(motionEventsAcquired)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).keyEventsHead) as usize - ptr as usize },
+        72usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(keyEventsHead)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).keyEventsTail) as usize - ptr as usize },
+        80usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(keyEventsTail)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionEventsDropped) as usize - ptr as usize },
+        88usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(motionEventsDropped)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).keyEventsDropped) as usize - ptr as usize },
+        96usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(keyEventsDropped)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionEventsCoalesced) as usize - ptr as usize },
+        104usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(motionEventsCoalesced)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionEventsCoalescing) as usize - ptr as usize },
+        112usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(motionEventsCoalescing)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionEventStorage) as usize - ptr as usize },
+        120usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_input_buffer),
+            "::",
+            stringify!(motionEventStorage)
+        )
+    );
 }
 #[doc = " Function pointer declaration for the filtering of key events.\n A function with this signature should be passed to\n android_app_set_key_event_filter and return false for any events that should\n not be handled by android_native_app_glue. These events will be handled by\n the system instead."]
 pub type android_key_event_filter =
@@ -9503,16 +10629,27 @@ pub struct android_app {
     pub activityState: ::std::os::raw::c_int,
     #[doc = " This is non-zero when the application's GameActivity is being\n destroyed and waiting for the app thread to complete."]
     pub destroyRequested: ::std::os::raw::c_int,
-    #[doc = " This is used for buffering input from GameActivity. Once ready, the\n application thread switches the buffers and processes what was\n accumulated."]
-    pub inputBuffers: [android_input_buffer; 2usize],
-    pub currentInputBuffer: ::std::os::raw::c_int,
+    #[doc = " This is used for buffering input from GameActivity. The application\n thread acquires the events accumulated so far with\n android_app_swap_input_buffers() and releases them once processed."]
+    pub inputBuffer: android_input_buffer,
     #[doc = " 0 if no text input event is outstanding, 1 if it is.\n Use `GameActivity_getTextInputState` to get information\n about the text entered by the user."]
     pub textInputState: ::std::os::raw::c_int,
     #[doc = " @cond INTERNAL"]
     pub mutex: pthread_mutex_t,
     pub cond: pthread_cond_t,
-    pub msgread: ::std::os::raw::c_int,
-    pub msgwrite: ::std::os::raw::c_int,
+    pub cmdEventFd: ::std::os::raw::c_int,
+    pub cmdQueueHead: *mut android_app_cmd_node,
+    pub cmdQueueTail: *mut android_app_cmd_node,
+    pub cmdPool: *mut android_app_cmd_pool,
+    pub cmdWakePending: bool,
+    pub cmdStats: *mut android_app_cmd_stats,
+    pub nonBlockingLifecycle: bool,
+    pub windowTeardownTimeoutNanos: i64,
+    pub windowTermsWritten: u64,
+    pub windowTermsHandled: u64,
+    pub stateSavesWritten: u64,
+    pub stateSavesHandled: u64,
+    pub handoffWindow: *mut ANativeWindow,
+    pub windowAcquired: bool,
     pub thread: pthread_t,
     pub cmdPollSource: android_poll_source,
     pub running: ::std::os::raw::c_int,
@@ -9523,6 +10660,9 @@ pub struct android_app {
     pub pendingContentRect: ARect,
     pub keyEventFilter: android_key_event_filter,
     pub motionEventFilter: android_motion_event_filter,
+    pub motionEventPointerArrays: bool,
+    pub motionEventCoalescing: bool,
+    pub inputOverflowPolicy: ::std::os::raw::c_int,
     pub inputAvailableWakeUp: bool,
     pub inputSwapPending: bool,
 }
@@ -9531,198 +10671,308 @@ fn bindgen_test_layout_android_app() {
     const UNINIT: ::std::mem::MaybeUninit<android_app> = ::std::mem::MaybeUninit::uninit();
     let ptr = UNINIT.as_ptr();
     assert_eq!(
-        ::std::mem::size_of::<android_app>(),
-        384usize,
-        concat!("Size of: ", stringify!(android_app))
+        ::std::mem::size_of::<android_app>(),
+        520usize,
+        concat!("Size of: ", stringify!(android_app))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<android_app>(),
+        8usize,
+        concat!("Alignment of ", stringify!(android_app))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).userData) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(userData)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).onAppCmd) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(onAppCmd)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).activity) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(activity)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).config) as usize - ptr as usize },
+        24usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(config)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).savedState) as usize - ptr as usize },
+        32usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(savedState)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).savedStateSize) as usize - ptr as usize },
+        40usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(savedStateSize)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).looper) as usize - ptr as usize },
+        48usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(looper)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).window) as usize - ptr as usize },
+        56usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(window)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).contentRect) as usize - ptr as usize },
+        64usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(contentRect)
+        )
     );
     assert_eq!(
-        ::std::mem::align_of::<android_app>(),
-        8usize,
-        concat!("Alignment of ", stringify!(android_app))
+        unsafe { ::std::ptr::addr_of!((*ptr).activityState) as usize - ptr as usize },
+        80usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(activityState)
+        )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).userData) as usize - ptr as usize },
-        0usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).destroyRequested) as usize - ptr as usize },
+        84usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(userData)
+            stringify!(destroyRequested)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).onAppCmd) as usize - ptr as usize },
-        8usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).inputBuffer) as usize - ptr as usize },
+        88usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(onAppCmd)
+            stringify!(inputBuffer)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).activity) as usize - ptr as usize },
-        16usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).textInputState) as usize - ptr as usize },
+        216usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(activity)
+            stringify!(textInputState)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).config) as usize - ptr as usize },
-        24usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).mutex) as usize - ptr as usize },
+        220usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(config)
+            stringify!(mutex)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).savedState) as usize - ptr as usize },
-        32usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).cond) as usize - ptr as usize },
+        260usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(savedState)
+            stringify!(cond)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).savedStateSize) as usize - ptr as usize },
-        40usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).cmdEventFd) as usize - ptr as usize },
+        308usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(savedStateSize)
+            stringify!(cmdEventFd)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).looper) as usize - ptr as usize },
-        48usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).cmdQueueHead) as usize - ptr as usize },
+        312usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(looper)
+            stringify!(cmdQueueHead)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).window) as usize - ptr as usize },
-        56usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).cmdQueueTail) as usize - ptr as usize },
+        320usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(window)
+            stringify!(cmdQueueTail)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).contentRect) as usize - ptr as usize },
-        64usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).cmdPool) as usize - ptr as usize },
+        328usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(contentRect)
+            stringify!(cmdPool)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).activityState) as usize - ptr as usize },
-        80usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).cmdWakePending) as usize - ptr as usize },
+        336usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(activityState)
+            stringify!(cmdWakePending)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).destroyRequested) as usize - ptr as usize },
-        84usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).cmdStats) as usize - ptr as usize },
+        344usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(destroyRequested)
+            stringify!(cmdStats)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).inputBuffers) as usize - ptr as usize },
-        88usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).nonBlockingLifecycle) as usize - ptr as usize },
+        352usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(inputBuffers)
+            stringify!(nonBlockingLifecycle)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).currentInputBuffer) as usize - ptr as usize },
-        184usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).windowTeardownTimeoutNanos) as usize - ptr as usize },
+        360usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(currentInputBuffer)
+            stringify!(windowTeardownTimeoutNanos)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).textInputState) as usize - ptr as usize },
-        188usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).windowTermsWritten) as usize - ptr as usize },
+        368usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(textInputState)
+            stringify!(windowTermsWritten)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).mutex) as usize - ptr as usize },
-        192usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).windowTermsHandled) as usize - ptr as usize },
+        376usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(mutex)
+            stringify!(windowTermsHandled)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).cond) as usize - ptr as usize },
-        232usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).stateSavesWritten) as usize - ptr as usize },
+        384usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(cond)
+            stringify!(stateSavesWritten)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).stateSavesHandled) as usize - ptr as usize },
+        392usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(stateSavesHandled)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).msgread) as usize - ptr as usize },
-        280usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).handoffWindow) as usize - ptr as usize },
+        400usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(msgread)
+            stringify!(handoffWindow)
         )
     );
     assert_eq!(
-        unsafe { ::std::ptr::addr_of!((*ptr).msgwrite) as usize - ptr as usize },
-        284usize,
+        unsafe { ::std::ptr::addr_of!((*ptr).windowAcquired) as usize - ptr as usize },
+        408usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
             "::",
-            stringify!(msgwrite)
+            stringify!(windowAcquired)
         )
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).thread) as usize - ptr as usize },
-        288usize,
+        416usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9732,7 +10982,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).cmdPollSource) as usize - ptr as usize },
-        296usize,
+        424usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9742,7 +10992,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).running) as usize - ptr as usize },
-        320usize,
+        448usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9752,7 +11002,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).stateSaved) as usize - ptr as usize },
-        324usize,
+        452usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9762,7 +11012,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).destroyed) as usize - ptr as usize },
-        328usize,
+        456usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9772,7 +11022,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).redrawNeeded) as usize - ptr as usize },
-        332usize,
+        460usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9782,7 +11032,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).pendingWindow) as usize - ptr as usize },
-        336usize,
+        464usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9792,7 +11042,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).pendingContentRect) as usize - ptr as usize },
-        344usize,
+        472usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9802,7 +11052,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).keyEventFilter) as usize - ptr as usize },
-        360usize,
+        488usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9812,7 +11062,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).motionEventFilter) as usize - ptr as usize },
-        368usize,
+        496usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9820,9 +11070,39 @@ fn bindgen_test_layout_android_app() {
             stringify!(motionEventFilter)
         )
     );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionEventPointerArrays) as usize - ptr as usize },
+        504usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(motionEventPointerArrays)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).motionEventCoalescing) as usize - ptr as usize },
+        505usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(motionEventCoalescing)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).inputOverflowPolicy) as usize - ptr as usize },
+        508usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app),
+            "::",
+            stringify!(inputOverflowPolicy)
+        )
+    );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).inputAvailableWakeUp) as usize - ptr as usize },
-        376usize,
+        512usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9832,7 +11112,7 @@ fn bindgen_test_layout_android_app() {
     );
     assert_eq!(
         unsafe { ::std::ptr::addr_of!((*ptr).inputSwapPending) as usize - ptr as usize },
-        377usize,
+        513usize,
         concat!(
             "Offset of field: ",
             stringify!(android_app),
@@ -9845,8 +11125,12 @@ fn bindgen_test_layout_android_app() {
 pub const NativeAppGlueLooperId_LOOPER_ID_MAIN: NativeAppGlueLooperId = 1;
 #[doc = " Unused. Reserved for future use when usage of AInputQueue will be\n supported."]
 pub const NativeAppGlueLooperId_LOOPER_ID_INPUT: NativeAppGlueLooperId = 2;
-#[doc = " Start of user-defined ALooper identifiers."]
-pub const NativeAppGlueLooperId_LOOPER_ID_USER: NativeAppGlueLooperId = 3;
+#[doc = " Looper data ID of the file descriptor that android-activity makes\n readable when a requested vsync frame is ready."]
+pub const NativeAppGlueLooperId_LOOPER_ID_FRAME: NativeAppGlueLooperId = 3;
+#[doc = " Looper data ID of the file descriptors that an application registers\n with android-activity as event sources, which are told apart by the\n file descriptor that ALooper_pollOnce() returns."]
+pub const NativeAppGlueLooperId_LOOPER_ID_FD: NativeAppGlueLooperId = 4;
+#[doc = " Start of user-defined ALooper identifiers.\n\n NB: this used to be 3, before LOOPER_ID_FRAME and LOOPER_ID_FD were\n reserved, so code that hard-codes the old identifiers must be updated\n to start from this value instead."]
+pub const NativeAppGlueLooperId_LOOPER_ID_USER: NativeAppGlueLooperId = 5;
 #[doc = " Looper ID of commands coming from the app's main thread, an AInputQueue or\n user-defined sources."]
 pub type NativeAppGlueLooperId = ::std::os::raw::c_uint;
 #[doc = " Unused. Reserved for future use when usage of AInputQueue will be\n supported."]
@@ -9885,10 +11169,122 @@ pub const NativeAppGlueAppCmd_APP_CMD_DESTROY: NativeAppGlueAppCmd = 15;
 pub const NativeAppGlueAppCmd_APP_CMD_WINDOW_INSETS_CHANGED: NativeAppGlueAppCmd = 16;
 #[doc = " Commands passed from the application's main Java thread to the game's thread."]
 pub type NativeAppGlueAppCmd = ::std::os::raw::c_uint;
+#[doc = " A command passed from the application's main Java thread to the game's\n thread, along with any data that was sent with it."]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct android_app_cmd_record {
+    #[doc = " One of the `NativeAppGlueAppCmd` values."]
+    pub cmd: i32,
+    #[doc = " For APP_CMD_WINDOW_RESIZED, the new width of the window."]
+    pub width: i32,
+    #[doc = " For APP_CMD_WINDOW_RESIZED, the new height of the window."]
+    pub height: i32,
+    #[doc = " For APP_CMD_LOW_MEMORY, the level passed to onTrimMemory(), see\n https://developer.android.com/reference/android/content/ComponentCallbacks2"]
+    pub trimMemoryLevel: i32,
+    #[doc = " For APP_CMD_CONTENT_RECT_CHANGED, the new content rect."]
+    pub contentRect: ARect,
+    #[doc = " For APP_CMD_WINDOW_INSETS_CHANGED, a mask of `1 << GameCommonInsetsType`\n bits for the insets that changed, see\n GameActivity_getWindowInsetsSnapshot()."]
+    pub insetsChangedMask: u32,
+    #[doc = " For APP_CMD_INIT_WINDOW, when it's written in non-blocking mode (see\n android_app_set_non_blocking_lifecycle()), the new window, holding a\n reference that's owned by the glue. Otherwise NULL.\n\n Applications should use android_app->window, which is set from this by\n android_app_pre_exec_cmd()."]
+    pub window: *mut ANativeWindow,
+}
+#[test]
+fn bindgen_test_layout_android_app_cmd_record() {
+    const UNINIT: ::std::mem::MaybeUninit<android_app_cmd_record> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<android_app_cmd_record>(),
+        48usize,
+        concat!("Size of: ", stringify!(android_app_cmd_record))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<android_app_cmd_record>(),
+        8usize,
+        concat!("Alignment of ", stringify!(android_app_cmd_record))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).cmd) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_cmd_record),
+            "::",
+            stringify!(cmd)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).width) as usize - ptr as usize },
+        4usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_cmd_record),
+            "::",
+            stringify!(width)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).height) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_cmd_record),
+            "::",
+            stringify!(height)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).trimMemoryLevel) as usize - ptr as usize },
+        12usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_cmd_record),
+            "::",
+            stringify!(trimMemoryLevel)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).contentRect) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_cmd_record),
+            "::",
+            stringify!(contentRect)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).insetsChangedMask) as usize - ptr as usize },
+        32usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_cmd_record),
+            "::",
+            stringify!(insetsChangedMask)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).window) as usize - ptr as usize },
+        40usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_cmd_record),
+            "::",
+            stringify!(window)
+        )
+    );
+}
 extern "C" {
-    #[doc = " Call when ALooper_pollAll() returns LOOPER_ID_MAIN, reading the next\n app command message."]
+    #[doc = " Call when ALooper_pollAll() returns LOOPER_ID_MAIN, reading the next\n app command message.\n\n Returns -1 if there are no more pending commands. All the commands that are\n pending when LOOPER_ID_MAIN is returned should be read and executed before\n polling again."]
     pub fn android_app_read_cmd(android_app: *mut android_app) -> i8;
 }
+extern "C" {
+    #[doc = " Like android_app_read_cmd(), but also returns the data that was sent with the\n command.\n\n Returns false if there are no more pending commands."]
+    pub fn android_app_read_cmd_record(
+        android_app: *mut android_app,
+        record: *mut android_app_cmd_record,
+    ) -> bool;
+}
 extern "C" {
     #[doc = " Call with the command returned by android_app_read_cmd() to do the\n initial pre-processing of the given command.  You can perform your own\n actions for the command after calling this function."]
     pub fn android_app_pre_exec_cmd(android_app: *mut android_app, cmd: i8);
@@ -9898,13 +11294,13 @@ extern "C" {
     pub fn android_app_post_exec_cmd(android_app: *mut android_app, cmd: i8);
 }
 extern "C" {
-    #[doc = " Call this before processing input events to get the events buffer.\n The function returns NULL if there are no events to process."]
+    #[doc = " Call this before processing input events to acquire the events buffered so\n far. The function returns NULL if there are no events to process.\n\n Events that are pushed after this call are only made visible by the next\n call, after the acquired events have been released with\n android_app_clear_motion_events() and android_app_clear_key_events()."]
     pub fn android_app_swap_input_buffers(
         android_app: *mut android_app,
     ) -> *mut android_input_buffer;
 }
 extern "C" {
-    #[doc = " Clear the array of motion events that were waiting to be handled, and release\n each of them.\n\n This method should be called after you have processed the motion events in\n your game loop. You should handle events at each iteration of your game loop."]
+    #[doc = " Clear the array of motion events that were waiting to be handled, and release\n each of them.\n\n This returns their slots in the input ring to the producer, and the storage\n for the events and their history is kept for reuse by subsequent events.\n\n This method should be called after you have processed the motion events in\n your game loop. You should handle events at each iteration of your game loop."]
     pub fn android_app_clear_motion_events(inputBuffer: *mut android_input_buffer);
 }
 extern "C" {
@@ -9916,23 +11312,154 @@ extern "C" {
     pub fn _rust_glue_entry(app: *mut android_app);
 }
 extern "C" {
-    #[doc = " Set the filter to use when processing key events.\n Any events for which the filter returns false will be ignored by\n android_native_app_glue. If filter is set to NULL, no filtering is done.\n\n The default key filter will filter out volume and camera button presses."]
+    #[doc = " Set the filter to use when processing key events.\n Any events for which the filter returns false will be ignored by\n android_native_app_glue. If filter is set to NULL, no filtering is done.\n\n The default key filter will filter out volume and camera button presses.\n\n The filter is called after each event has been converted from Java. Use\n GameActivity_setInputFilter() to reject events before they're converted."]
     pub fn android_app_set_key_event_filter(
         app: *mut android_app,
         filter: android_key_event_filter,
     );
 }
 extern "C" {
-    #[doc = " Set the filter to use when processing touch and motion events.\n Any events for which the filter returns false will be ignored by\n android_native_app_glue. If filter is set to NULL, no filtering is done.\n\n Note that the default motion event filter will only allow touchscreen events\n through, in order to mimic NativeActivity's behaviour, so for controller\n events to be passed to the app, set the filter to NULL."]
+    #[doc = " Set the filter to use when processing touch and motion events.\n Any events for which the filter returns false will be ignored by\n android_native_app_glue. If filter is set to NULL, no filtering is done.\n\n Note that the default motion event filter will only allow touchscreen events\n through, in order to mimic NativeActivity's behaviour, so for controller\n events to be passed to the app, set the filter to NULL.\n\n As with key events, GameActivity_setInputFilter() can instead reject events\n before they're converted from Java."]
     pub fn android_app_set_motion_event_filter(
         app: *mut android_app,
         filter: android_motion_event_filter,
     );
 }
+extern "C" {
+    #[doc = " Set whether buffered motion events should store their pointers in\n `GameActivityMotionEvent::pointerArrays`, instead of `pointers`.\n\n This structure-of-arrays layout only stores the enabled axes for the\n pointers in each event, which avoids copying the full `pointers` array (over\n 1.6KB) for every event and keeps the values of each axis contiguous.\n\n This is disabled by default."]
+    pub fn android_app_set_motion_event_pointer_arrays(app: *mut android_app, enabled: bool);
+}
+extern "C" {
+    #[doc = " Set whether ACTION_MOVE motion events should be coalesced while the\n application thread is falling behind.\n\n When enabled, a move event that arrives before the previous event has been\n acquired via android_app_swap_input_buffers() is merged into the previous\n event, if it's also a move from the same device with the same pointers and\n state. The samples of the previous event are appended to its history, as\n Android does when batching motion events, so no samples are lost while the\n number of events to dispatch stays bounded.\n\n This is disabled by default."]
+    pub fn android_app_set_motion_coalescing(app: *mut android_app, enabled: bool);
+}
+extern "C" {
+    #[doc = " Set whether the axis values and history of motion events should only be\n decoded on demand, by the application thread.\n\n When enabled, the Java main thread only decodes the scalar state of each\n motion event (plus its pointer ids and tool types) before queuing it, and\n the rest of the event is read via its `deferredEvent`, see\n GameActivity_setDeferredMotionEventDecoding(). The `deferredEvent` of each\n event is released by android_app_clear_motion_events().\n\n Deferred events are never coalesced, and this has no effect before API 31.\n\n This is disabled by default."]
+    pub fn android_app_set_deferred_motion_event_decoding(app: *mut android_app, enabled: bool);
+}
+#[doc = " The event is dropped and reported to GameActivity as unhandled, so that\n the system may handle it instead (e.g. for the back button)."]
+pub const NativeAppGlueInputOverflow_INPUT_OVERFLOW_REJECT: NativeAppGlueInputOverflow = 0;
+#[doc = " The event is dropped and reported to GameActivity as handled."]
+pub const NativeAppGlueInputOverflow_INPUT_OVERFLOW_DISCARD: NativeAppGlueInputOverflow = 1;
+#[doc = " What happens to input events that arrive while the input ring is full,\n because the application thread isn't keeping up with them.\n\n In either case the event is counted in `motionEventsDropped` or\n `keyEventsDropped` of `android_app::inputBuffer`."]
+pub type NativeAppGlueInputOverflow = ::std::os::raw::c_uint;
+extern "C" {
+    #[doc = " Set what happens to input events that arrive while the input ring is full,\n as one of `NativeAppGlueInputOverflow`.\n\n The default is INPUT_OVERFLOW_REJECT."]
+    pub fn android_app_set_input_overflow_policy(app: *mut android_app, policy: i32);
+}
 extern "C" {
     #[doc = " Determines if a looper wake up was due to new input becoming available"]
     pub fn android_app_input_available_wake_up(app: *mut android_app) -> bool;
 }
+extern "C" {
+    #[doc = " Set whether the main thread hands over lifecycle changes without waiting\n for the app thread to handle them.\n\n By default, the main thread waits until the app thread has handled each\n change to the activity state or window, so a long frame on the app thread\n also stalls the UI thread.\n\n In non-blocking mode, APP_CMD_START, APP_CMD_RESUME, APP_CMD_PAUSE,\n APP_CMD_STOP and APP_CMD_INIT_WINDOW are written without waiting, and\n android_app->activityState and android_app->window are updated when the\n app thread pre-processes them. Each new window is handed over with its own\n reference (see ANativeWindow_acquire()), which is released once it has been\n terminated, so it stays valid for the app thread even if the main thread has\n moved on.\n\n Android requires that a window isn't used once onNativeWindowDestroyed()\n returns, so the main thread still waits for APP_CMD_TERM_WINDOW to be\n handled, but only for up to `windowTeardownTimeoutNanos` (or indefinitely,\n if it's negative). After a timeout, rendering to the window will fail, but\n the window itself stays valid until the app thread has terminated it.\n\n APP_CMD_SAVE_STATE is waited for with the same timeout, since the saved\n state has to be returned to Java. After a timeout, no state is saved.\n APP_CMD_DESTROY is always waited for, since the app thread has to exit\n before the android_app can be freed.\n\n This may be called from any thread and applies to subsequent changes. If\n the main thread is currently waiting for a lifecycle command to be handled,\n enabling this also stops that wait, or bounds it by the timeout (counted\n from when the command was written) for APP_CMD_TERM_WINDOW and\n APP_CMD_SAVE_STATE. The current window is then acquired for the app\n thread, as if it had been handed over in non-blocking mode."]
+    pub fn android_app_set_non_blocking_lifecycle(
+        app: *mut android_app,
+        enabled: bool,
+        windowTeardownTimeoutNanos: i64,
+    );
+}
+#[doc = " From the main thread writing the command to the app thread reading it."]
+pub const NativeAppGlueCmdStage_APP_CMD_STAGE_QUEUED: NativeAppGlueCmdStage = 0;
+#[doc = " The app thread calling android_app_pre_exec_cmd()."]
+pub const NativeAppGlueCmdStage_APP_CMD_STAGE_PRE_EXEC: NativeAppGlueCmdStage = 1;
+#[doc = " From android_app_pre_exec_cmd() returning to android_app_post_exec_cmd()\n being called, which is the application's handling of the command."]
+pub const NativeAppGlueCmdStage_APP_CMD_STAGE_CALLBACK: NativeAppGlueCmdStage = 2;
+#[doc = " The app thread calling android_app_post_exec_cmd()."]
+pub const NativeAppGlueCmdStage_APP_CMD_STAGE_POST_EXEC: NativeAppGlueCmdStage = 3;
+#[doc = " For commands that the main thread waits for, from the app thread\n acknowledging the command to the main thread waking up."]
+pub const NativeAppGlueCmdStage_APP_CMD_STAGE_UNBLOCK: NativeAppGlueCmdStage = 4;
+#[doc = " For commands that the main thread waits for, the whole time that it\n waited, from writing the command to waking up.\n\n The main thread waits for APP_CMD_START, APP_CMD_RESUME, APP_CMD_PAUSE\n and APP_CMD_STOP to be pre-processed, for APP_CMD_INIT_WINDOW or\n APP_CMD_TERM_WINDOW and APP_CMD_SAVE_STATE to be post-processed and for\n APP_CMD_DESTROY until the app thread exits."]
+pub const NativeAppGlueCmdStage_APP_CMD_STAGE_WAIT: NativeAppGlueCmdStage = 5;
+pub const NativeAppGlueCmdStage_APP_CMD_STAGE_COUNT: NativeAppGlueCmdStage = 6;
+#[doc = " The stages of handling an app command, from the main thread writing it to\n the main thread being unblocked, for android_app_get_cmd_latency()."]
+pub type NativeAppGlueCmdStage = ::std::os::raw::c_uint;
+#[doc = " A histogram of the latencies of one stage of handling a command."]
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct android_app_latency_histogram {
+    #[doc = " The number of latencies that have been recorded."]
+    pub count: u64,
+    #[doc = " The sum of the latencies, in nanoseconds."]
+    pub totalNanos: u64,
+    #[doc = " The longest latency, in nanoseconds."]
+    pub maxNanos: u64,
+    #[doc = " The number of latencies in each bucket. The first bucket counts\n latencies under 1 microsecond, bucket `i` counts latencies from 2^(i-1)\n up to 2^i microseconds and the last bucket also counts any longer\n latencies."]
+    pub buckets: [u64; 24usize],
+}
+#[test]
+fn bindgen_test_layout_android_app_latency_histogram() {
+    const UNINIT: ::std::mem::MaybeUninit<android_app_latency_histogram> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<android_app_latency_histogram>(),
+        216usize,
+        concat!("Size of: ", stringify!(android_app_latency_histogram))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<android_app_latency_histogram>(),
+        8usize,
+        concat!("Alignment of ", stringify!(android_app_latency_histogram))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).count) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_latency_histogram),
+            "::",
+            stringify!(count)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).totalNanos) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_latency_histogram),
+            "::",
+            stringify!(totalNanos)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).maxNanos) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_latency_histogram),
+            "::",
+            stringify!(maxNanos)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).buckets) as usize - ptr as usize },
+        24usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(android_app_latency_histogram),
+            "::",
+            stringify!(buckets)
+        )
+    );
+}
+extern "C" {
+    #[doc = " Get the histogram of latencies for a stage of handling a command, as one of\n `NativeAppGlueCmdStage`, accumulated since the app was created.\n\n This may be called from any thread, and returns false if `cmd` or `stage`\n isn't valid."]
+    pub fn android_app_get_cmd_latency(
+        app: *mut android_app,
+        cmd: i32,
+        stage: i32,
+        outHist: *mut android_app_latency_histogram,
+    ) -> bool;
+}
+extern "C" {
+    #[doc = " Get the command that the main thread is currently waiting for the app\n thread to handle, if any, and how long it has been waiting, in nanoseconds.\n\n This may be called from any thread, to watch for an app thread that has\n stalled, and returns false if the main thread isn't waiting."]
+    pub fn android_app_get_pending_cmd(
+        app: *mut android_app,
+        outCmd: *mut i32,
+        outWaitedNanos: *mut i64,
+    ) -> bool;
+}
 pub type __builtin_va_list = [__va_list_tag; 1usize];
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
@@ -13,9 +13,12 @@
 // The `Class` was also bound differently to `android-ndk-rs` considering how the class is defined
 // by masking bits from the `Source`.
 
-use crate::activity_impl::ffi::{GameActivityKeyEvent, GameActivityMotionEvent};
+use crate::activity_impl::ffi::{
+    self, AInputEvent, GameActivityKeyEvent, GameActivityMotionEvent, GameActivityPointerArrays,
+};
 use crate::input::{
-    Axis, Button, ButtonState, EdgeFlags, KeyAction, KeyEventFlags, Keycode, MetaState,
+    Axis, Button, ButtonState, EdgeFlags, HistoricalMotionEvent, HistoricalMotionEventsIter,
+    HistoricalPointer, HistoricalPointersIter, KeyAction, KeyEventFlags, Keycode, MetaState,
     MotionAction, MotionEventFlags, Pointer, PointersIter, Source, ToolType,
 };
 
@@ -140,27 +143,30 @@ impl<'a> MotionEvent<'a> {
         }
     }
 
-    /*
     /// Returns the size of the history contained in this event.
     ///
-    /// See [the NDK
-    /// docs](https://developer.android.com/ndk/reference/group/input#amotionevent_gethistorysize)
+    /// See [the MotionEvent docs](https://developer.android.com/reference/android/view/MotionEvent#getHistorySize())
     #[inline]
     pub fn history_size(&self) -> usize {
-        unsafe { ndk_sys::AMotionEvent_getHistorySize(self.ga_event.ptr.as_ptr()) as usize }
+        match deferred_event(self.ga_event) {
+            Some(event) => unsafe { ffi::AMotionEvent_getHistorySize(event) },
+            None => self.ga_event.historySize.max(0) as usize,
+        }
     }
 
     /// An iterator over the historical events contained in this event.
+    ///
+    /// Only the axes that were enabled when the event was received are recorded in the history.
     #[inline]
     pub fn history(&self) -> HistoricalMotionEventsIter<'_> {
         HistoricalMotionEventsIter {
-            event: self.ga_event.ptr,
-            next_history_index: 0,
-            history_size: self.history_size(),
-            _marker: std::marker::PhantomData,
+            inner: HistoricalMotionEventsIterImpl {
+                ga_event: self.ga_event,
+                next_history_index: 0,
+                history_size: self.history_size(),
+            },
         }
     }
-    */
 
     /// Returns the state of any modifier keys that were pressed during the event.
     ///
@@ -256,6 +262,43 @@ impl<'a> MotionEvent<'a> {
     }
 }
 
+/// Returns the index of `axis` among the axes set in `axis_mask`, or `None` if it's not set.
+///
+/// Axis values may be stored compactly, only for the axes that were enabled when an event was
+/// received, and this maps an axis to its position in that storage.
+#[inline]
+fn enabled_axis_index(axis_mask: u64, axis: Axis) -> Option<usize> {
+    let axis: u32 = axis.into();
+    match 1u64.checked_shl(axis) {
+        Some(bit) if axis_mask & bit != 0 => Some((axis_mask & (bit - 1)).count_ones() as usize),
+        _ => None,
+    }
+}
+
+/// Returns the structure-of-arrays storage for the pointers of the event, if it's used instead
+/// of the `pointers` array.
+#[inline]
+fn pointer_arrays(ga_event: &GameActivityMotionEvent) -> Option<&GameActivityPointerArrays> {
+    if ga_event.pointerArrays.ids.is_null() {
+        None
+    } else {
+        Some(&ga_event.pointerArrays)
+    }
+}
+
+/// Returns the native copy of the event that its axis values and history should be read from, if
+/// they weren't decoded when it was received.
+///
+/// See [`crate::AndroidApp::set_deferred_motion_event_decoding`]
+#[inline]
+fn deferred_event(ga_event: &GameActivityMotionEvent) -> Option<*const AInputEvent> {
+    if ga_event.deferredEvent.is_null() {
+        None
+    } else {
+        Some(ga_event.deferredEvent)
+    }
+}
+
 /// A view into the data of a specific pointer in a motion event.
 #[derive(Debug)]
 pub(crate) struct PointerImpl<'a> {
@@ -271,34 +314,76 @@ impl<'a> PointerImpl<'a> {
 
     #[inline]
     pub fn pointer_id(&self) -> i32 {
-        let pointer = &self.event.ga_event.pointers[self.index];
-        pointer.id
+        let ga_event = self.event.ga_event;
+        match pointer_arrays(ga_event) {
+            Some(arrays) => unsafe { *arrays.ids.add(self.index) },
+            None => ga_event.pointers[self.index].id,
+        }
     }
 
     #[inline]
     pub fn axis_value(&self, axis: Axis) -> f32 {
-        let pointer = &self.event.ga_event.pointers[self.index];
-        let axis: u32 = axis.into();
-        pointer.axisValues[axis as usize]
+        let ga_event = self.event.ga_event;
+        if let Some(event) = deferred_event(ga_event) {
+            // Consistent with events that are decoded up front, only enabled axes are readable
+            return match enabled_axis_index(ga_event.historicalAxisMask, axis) {
+                Some(_) => unsafe {
+                    let axis: u32 = axis.into();
+                    ffi::AMotionEvent_getAxisValue(event, axis as i32, self.index)
+                },
+                None => 0.0,
+            };
+        }
+        match pointer_arrays(ga_event) {
+            Some(arrays) => match enabled_axis_index(ga_event.historicalAxisMask, axis) {
+                Some(axis_index) => unsafe {
+                    let pointer_count = ga_event.pointerCount as usize;
+                    *arrays
+                        .axisValues
+                        .add(axis_index * pointer_count + self.index)
+                },
+                None => 0.0,
+            },
+            None => {
+                let pointer = &ga_event.pointers[self.index];
+                let axis: u32 = axis.into();
+                pointer.axisValues[axis as usize]
+            }
+        }
     }
 
     #[inline]
     pub fn raw_x(&self) -> f32 {
-        let pointer = &self.event.ga_event.pointers[self.index];
-        pointer.rawX
+        let ga_event = self.event.ga_event;
+        if let Some(event) = deferred_event(ga_event) {
+            return unsafe { ffi::AMotionEvent_getRawX(event, self.index) };
+        }
+        match pointer_arrays(ga_event) {
+            Some(arrays) => unsafe { *arrays.rawX.add(self.index) },
+            None => ga_event.pointers[self.index].rawX,
+        }
     }
 
     #[inline]
     pub fn raw_y(&self) -> f32 {
-        let pointer = &self.event.ga_event.pointers[self.index];
-        pointer.rawY
+        let ga_event = self.event.ga_event;
+        if let Some(event) = deferred_event(ga_event) {
+            return unsafe { ffi::AMotionEvent_getRawY(event, self.index) };
+        }
+        match pointer_arrays(ga_event) {
+            Some(arrays) => unsafe { *arrays.rawY.add(self.index) },
+            None => ga_event.pointers[self.index].rawY,
+        }
     }
 
     #[inline]
     pub fn tool_type(&self) -> ToolType {
-        let pointer = &self.event.ga_event.pointers[self.index];
-        let tool_type = pointer.toolType as u32;
-        tool_type.into()
+        let ga_event = self.event.ga_event;
+        let tool_type = match pointer_arrays(ga_event) {
+            Some(arrays) => unsafe { *arrays.toolTypes.add(self.index) },
+            None => ga_event.pointers[self.index].toolType,
+        };
+        (tool_type as u32).into()
     }
 }
 
@@ -339,75 +424,63 @@ impl<'a> ExactSizeIterator for PointersIterImpl<'a> {
     }
 }
 
-/*
-/// Represents a view into a past moment of a motion event
+/// A view into a past moment of a motion event
 #[derive(Debug)]
-pub struct HistoricalMotionEvent<'a> {
-    event: NonNull<ndk_sys::AInputEvent>,
+pub(crate) struct HistoricalMotionEventImpl<'a> {
+    ga_event: &'a GameActivityMotionEvent,
     history_index: usize,
-    _marker: std::marker::PhantomData<&'a MotionEvent>,
 }
 
-// TODO: thread safety?
-
-impl<'a> HistoricalMotionEvent<'a> {
-    /// Returns the "history index" associated with this historical event.  Older events have smaller indices.
+impl<'a> HistoricalMotionEventImpl<'a> {
     #[inline]
     pub fn history_index(&self) -> usize {
         self.history_index
     }
 
-    /// Returns the time of the historical event, in the `java.lang.System.nanoTime()` time base
-    ///
-    /// See [the NDK
-    /// docs](https://developer.android.com/ndk/reference/group/input#amotionevent_gethistoricaleventtime)
     #[inline]
     pub fn event_time(&self) -> i64 {
+        if let Some(event) = deferred_event(self.ga_event) {
+            return unsafe { ffi::AMotionEvent_getHistoricalEventTime(event, self.history_index) };
+        }
         unsafe {
-            ndk_sys::AMotionEvent_getHistoricalEventTime(
-                self.event.as_ptr(),
-                self.history_index as ndk_sys::size_t,
-            )
+            *self
+                .ga_event
+                .historicalEventTimesNanos
+                .add(self.history_index)
         }
     }
 
-    /// An iterator over the pointers of this historical motion event
     #[inline]
     pub fn pointers(&self) -> HistoricalPointersIter<'a> {
         HistoricalPointersIter {
-            event: self.event,
-            history_index: self.history_index,
-            next_pointer_index: 0,
-            pointer_count: unsafe {
-                ndk_sys::AMotionEvent_getPointerCount(self.event.as_ptr()) as usize
+            inner: HistoricalPointersIterImpl {
+                ga_event: self.ga_event,
+                history_index: self.history_index,
+                next_pointer_index: 0,
+                pointer_count: self.ga_event.pointerCount as usize,
             },
-            _marker: std::marker::PhantomData,
         }
     }
 }
 
 /// An iterator over all the historical moments in a [`MotionEvent`].
-///
-/// It iterates from oldest to newest.
 #[derive(Debug)]
-pub struct HistoricalMotionEventsIter<'a> {
-    event: NonNull<ndk_sys::AInputEvent>,
+pub(crate) struct HistoricalMotionEventsIterImpl<'a> {
+    ga_event: &'a GameActivityMotionEvent,
     next_history_index: usize,
     history_size: usize,
-    _marker: std::marker::PhantomData<&'a MotionEvent>,
 }
 
-// TODO: thread safety?
-
-impl<'a> Iterator for HistoricalMotionEventsIter<'a> {
+impl<'a> Iterator for HistoricalMotionEventsIterImpl<'a> {
     type Item = HistoricalMotionEvent<'a>;
 
     fn next(&mut self) -> Option<HistoricalMotionEvent<'a>> {
         if self.next_history_index < self.history_size {
             let res = HistoricalMotionEvent {
-                event: self.event,
-                history_index: self.next_history_index,
-                _marker: std::marker::PhantomData,
+                inner: HistoricalMotionEventImpl {
+                    ga_event: self.ga_event,
+                    history_index: self.next_history_index,
+                },
             };
             self.next_history_index += 1;
             Some(res)
@@ -421,19 +494,22 @@ impl<'a> Iterator for HistoricalMotionEventsIter<'a> {
         (size, Some(size))
     }
 }
-impl ExactSizeIterator for HistoricalMotionEventsIter<'_> {
+
+impl<'a> ExactSizeIterator for HistoricalMotionEventsIterImpl<'a> {
     fn len(&self) -> usize {
         self.history_size - self.next_history_index
     }
 }
-impl<'a> DoubleEndedIterator for HistoricalMotionEventsIter<'a> {
+
+impl<'a> DoubleEndedIterator for HistoricalMotionEventsIterImpl<'a> {
     fn next_back(&mut self) -> Option<HistoricalMotionEvent<'a>> {
         if self.next_history_index < self.history_size {
             self.history_size -= 1;
             Some(HistoricalMotionEvent {
-                event: self.event,
-                history_index: self.history_size,
-                _marker: std::marker::PhantomData,
+                inner: HistoricalMotionEventImpl {
+                    ga_event: self.ga_event,
+                    history_index: self.history_size,
+                },
             })
         } else {
             None
@@ -443,16 +519,13 @@ impl<'a> DoubleEndedIterator for HistoricalMotionEventsIter<'a> {
 
 /// A view into a pointer at a historical moment
 #[derive(Debug)]
-pub struct HistoricalPointer<'a> {
-    event: NonNull<ndk_sys::AInputEvent>,
+pub(crate) struct HistoricalPointerImpl<'a> {
+    ga_event: &'a GameActivityMotionEvent,
     pointer_index: usize,
     history_index: usize,
-    _marker: std::marker::PhantomData<&'a MotionEvent>,
 }
 
-// TODO: thread safety?
-
-impl<'a> HistoricalPointer<'a> {
+impl<'a> HistoricalPointerImpl<'a> {
     #[inline]
     pub fn pointer_index(&self) -> usize {
         self.pointer_index
@@ -460,8 +533,9 @@ impl<'a> HistoricalPointer<'a> {
 
     #[inline]
     pub fn pointer_id(&self) -> i32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getPointerId(self.event.as_ptr(), self.pointer_index as ndk_sys::size_t)
+        match pointer_arrays(self.ga_event) {
+            Some(arrays) => unsafe { *arrays.ids.add(self.pointer_index) },
+            None => self.ga_event.pointers[self.pointer_index].id,
         }
     }
 
@@ -472,160 +546,53 @@ impl<'a> HistoricalPointer<'a> {
 
     #[inline]
     pub fn axis_value(&self, axis: Axis) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalAxisValue(
-                self.event.as_ptr(),
-                axis as i32,
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn orientation(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalOrientation(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn pressure(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalPressure(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn raw_x(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalRawX(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn raw_y(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalRawY(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn x(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalX(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn y(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalY(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn size(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalSize(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn tool_major(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalToolMajor(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
+        let mask = self.ga_event.historicalAxisMask;
+        let Some(axis_index) = enabled_axis_index(mask, axis) else {
+            // The axis wasn't enabled, consistent with `Pointer::axis_value()`
+            return 0.0;
+        };
+
+        if let Some(event) = deferred_event(self.ga_event) {
+            let axis: u32 = axis.into();
+            return unsafe {
+                ffi::AMotionEvent_getHistoricalAxisValue(
+                    event,
+                    axis as i32,
+                    self.pointer_index,
+                    self.history_index,
+                )
+            };
         }
-    }
 
-    #[inline]
-    pub fn tool_minor(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalToolMinor(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn touch_major(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalTouchMajor(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
-    }
-
-    #[inline]
-    pub fn touch_minor(&self) -> f32 {
-        unsafe {
-            ndk_sys::AMotionEvent_getHistoricalTouchMinor(
-                self.event.as_ptr(),
-                self.pointer_index as ndk_sys::size_t,
-                self.history_index as ndk_sys::size_t,
-            )
-        }
+        // Only enabled axes are stored, so use the axis's index among the enabled axes
+        let axis_count = mask.count_ones() as usize;
+        let pointer_count = self.ga_event.pointerCount as usize;
+        let offset =
+            (self.history_index * pointer_count + self.pointer_index) * axis_count + axis_index;
+        unsafe { *self.ga_event.historicalAxisValues.add(offset) }
     }
 }
 
 /// An iterator over the pointers in a historical motion event
 #[derive(Debug)]
-pub struct HistoricalPointersIter<'a> {
-    event: NonNull<ndk_sys::AInputEvent>,
+pub(crate) struct HistoricalPointersIterImpl<'a> {
+    ga_event: &'a GameActivityMotionEvent,
     history_index: usize,
     next_pointer_index: usize,
     pointer_count: usize,
-    _marker: std::marker::PhantomData<&'a MotionEvent>,
 }
 
-// TODO: thread safety?
-
-impl<'a> Iterator for HistoricalPointersIter<'a> {
+impl<'a> Iterator for HistoricalPointersIterImpl<'a> {
     type Item = HistoricalPointer<'a>;
 
     fn next(&mut self) -> Option<HistoricalPointer<'a>> {
         if self.next_pointer_index < self.pointer_count {
             let ptr = HistoricalPointer {
-                event: self.event,
-                history_index: self.history_index,
-                pointer_index: self.next_pointer_index,
-                _marker: std::marker::PhantomData,
+                inner: HistoricalPointerImpl {
+                    ga_event: self.ga_event,
+                    history_index: self.history_index,
+                    pointer_index: self.next_pointer_index,
+                },
             };
             self.next_pointer_index += 1;
             Some(ptr)
@@ -639,14 +606,13 @@ impl<'a> Iterator for HistoricalPointersIter<'a> {
         (size, Some(size))
     }
 }
-impl ExactSizeIterator for HistoricalPointersIter<'_> {
+
+impl<'a> ExactSizeIterator for HistoricalPointersIterImpl<'a> {
     fn len(&self) -> usize {
         self.pointer_count - self.next_pointer_index
     }
 }
 
-*/
-
 /// A key event.
 ///
 /// For general discussion of key events in Android, see [the relevant
@@ -758,3 +724,59 @@ impl<'a> KeyEvent<'a> {
         MetaState(self.ga_event.metaState as u32)
     }
 }
+
+/// The key events of an input batch, borrowed from the input ring.
+///
+/// Since the events may wrap around the end of the ring they are stored as two slices.
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct KeyEventsImpl<'a> {
+    slices: [&'a [GameActivityKeyEvent]; 2],
+}
+
+impl<'a> KeyEventsImpl<'a> {
+    pub(crate) fn new(slices: [&'a [GameActivityKeyEvent]; 2]) -> Self {
+        Self { slices }
+    }
+
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.slices[0].len() + self.slices[1].len()
+    }
+
+    #[inline]
+    pub fn get(&self, index: usize) -> Option<KeyEvent<'a>> {
+        let [first, second] = self.slices;
+        match first.get(index) {
+            Some(ga_event) => Some(KeyEvent::new(ga_event)),
+            None => second.get(index - first.len()).map(KeyEvent::new),
+        }
+    }
+}
+
+/// The motion events of an input batch, borrowed from the input ring.
+///
+/// Since the events may wrap around the end of the ring they are stored as two slices.
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct MotionEventsImpl<'a> {
+    slices: [&'a [GameActivityMotionEvent]; 2],
+}
+
+impl<'a> MotionEventsImpl<'a> {
+    pub(crate) fn new(slices: [&'a [GameActivityMotionEvent]; 2]) -> Self {
+        Self { slices }
+    }
+
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.slices[0].len() + self.slices[1].len()
+    }
+
+    #[inline]
+    pub fn get(&self, index: usize) -> Option<MotionEvent<'a>> {
+        let [first, second] = self.slices;
+        match first.get(index) {
+            Some(ga_event) => Some(MotionEvent::new(ga_event)),
+            None => second.get(index - first.len()).map(MotionEvent::new),
+        }
+    }
+}
@@ -1,8 +1,10 @@
 #![cfg(feature = "game-activity")]
 
 use std::collections::HashMap;
+use std::ffi::CStr;
 use std::marker::PhantomData;
 use std::ops::Deref;
+use std::os::fd::RawFd;
 use std::panic::catch_unwind;
 use std::ptr;
 use std::ptr::NonNull;
@@ -23,18 +25,24 @@ use ndk::configuration::Configuration;
 use ndk::native_window::NativeWindow;
 
 use crate::error::InternalResult;
-use crate::input::{Axis, KeyCharacterMap, KeyCharacterMapBinding};
+use crate::fd_sources::FdSources;
+use crate::frame::{Choreographer, FrameEvents};
+use crate::input::{Axis, InputFilter, KeyCharacterMap, KeyCharacterMapBinding};
 use crate::jni_utils::{self, CloneJavaVM};
+use crate::saved_state::{SavedState, SavedStateStore, StateChunk};
 use crate::util::{abort_on_panic, forward_stdio_to_logcat, log_panic, try_get_path_from_ptr};
+use crate::watchdog::{HandshakeWatchdog, Handshakes, PendingHandshake, Watchdog};
 use crate::{
-    AndroidApp, ConfigurationRef, InputStatus, MainEvent, PollEvent, Rect, WindowManagerFlags,
+    AndroidApp, ConfigChanges, ConfigurationRef, FdEvents, InputStatus, InsetsChanges,
+    JniEntryStats, LatencyHistogram, LifecycleHandoff, LifecycleLatencyStats, MainEvent,
+    PollBatchStats, PollEvent, Rect, Token, WindowManagerFlags,
 };
 
 mod ffi;
 
 pub mod input;
-use crate::input::{TextInputState, TextSpan};
-use input::{InputEvent, KeyEvent, MotionEvent};
+use crate::input::{TextInputState, TextInputStateRef, TextSpan};
+use input::{InputEvent, KeyEvent, KeyEventsImpl, MotionEvent, MotionEventsImpl};
 
 // The only time it's safe to update the android_app->savedState pointer is
 // while handling a SaveState event, so this API is only exposed for those
@@ -46,6 +54,40 @@ pub struct StateSaver<'a> {
 
 impl<'a> StateSaver<'a> {
     pub fn store(&self, state: &'a [u8]) {
+        if let Some(handle) = self
+            .app
+            .saved_state
+            .store(self.app.internal_data_path(), state)
+        {
+            self.store_bytes(&handle);
+        } else {
+            self.store_bytes(state);
+        }
+    }
+
+    /// Stores the state as a sequence of chunks, such that the chunks will be available to
+    /// load (as one state) the next time that the application resumes, and only writes the
+    /// chunks that changed
+    ///
+    /// Chunks are written to a content-addressed store under the application's internal data
+    /// path and only a small manifest, with the hash and length of each chunk, is saved in
+    /// memory. A [`StateChunk::Changed`] chunk is only written if an identical chunk isn't
+    /// already stored, and a [`StateChunk::Unchanged`] chunk refers to the chunk at the same
+    /// index in the last state that was stored (or loaded) with chunks, so it doesn't need to
+    /// be serialized again. Chunks that aren't part of the new state are removed.
+    ///
+    /// If an error is returned then nothing is stored, and the application may want to
+    /// [`store()`](Self::store) its whole state instead.
+    pub fn store_chunks(&self, chunks: &[StateChunk<'_>]) -> std::io::Result<()> {
+        let manifest = self
+            .app
+            .saved_state
+            .store_chunks(self.app.internal_data_path(), chunks)?;
+        self.store_bytes(&manifest);
+        Ok(())
+    }
+
+    fn store_bytes(&self, state: &[u8]) {
         // android_native_app_glue specifically expects savedState to have been allocated
         // via libc::malloc since it will automatically handle freeing the data once it
         // has been handed over to the Java Activity / main thread.
@@ -86,15 +128,25 @@ pub struct StateLoader<'a> {
 }
 impl<'a> StateLoader<'a> {
     pub fn load(&self) -> Option<Vec<u8>> {
+        self.load_mapped().map(SavedState::into_vec)
+    }
+
+    /// Returns whatever state was saved during the last [MainEvent::SaveState] event or `None`,
+    /// without copying it if it was spilled to a file
+    ///
+    /// A spilled state is mapped into memory, and is only read from the file as it's accessed.
+    /// A state that was stored with chunks is reassembled from its chunks.
+    pub fn load_mapped(&self) -> Option<SavedState> {
         unsafe {
             let app_ptr = self.app.native_app.as_ptr();
             if !(*app_ptr).savedState.is_null() && (*app_ptr).savedStateSize > 0 {
-                let buf: &mut [u8] = std::slice::from_raw_parts_mut(
+                let buf: &[u8] = std::slice::from_raw_parts(
                     (*app_ptr).savedState.cast(),
                     (*app_ptr).savedStateSize,
                 );
-                let state = buf.to_vec();
-                Some(state)
+                self.app
+                    .saved_state
+                    .load(buf, self.app.internal_data_path())
             } else {
                 None
             }
@@ -139,20 +191,47 @@ impl AndroidApp {
         Self {
             inner: Arc::new(RwLock::new(AndroidAppInner {
                 jvm,
-                native_app: NativeAppGlue { ptr },
+                native_app: NativeAppGlue {
+                    ptr,
+                    text_input: Default::default(),
+                },
                 config: ConfigurationRef::new(config),
                 native_window: Default::default(),
                 key_map_binding: Arc::new(key_map_binding),
                 key_maps: Mutex::new(HashMap::new()),
                 input_receiver: Mutex::new(None),
+                saved_state: SavedStateStore::default(),
+                watchdog: Arc::new(Watchdog::new(Arc::new(GameActivityHandshakes {
+                    native_app: ptr,
+                }))),
+                frame_events: FrameEvents::new(
+                    Choreographer::new_clock,
+                    ffi::NativeAppGlueLooperId_LOOPER_ID_FRAME as libc::c_int,
+                ),
+                fd_sources: FdSources::new(ffi::NativeAppGlueLooperId_LOOPER_ID_FD as libc::c_int),
             })),
         }
     }
 }
 
+/// A copy of the GameTextInput state that's kept up to date by applying the
+/// edits that were made since it was last synchronized, so that reading the
+/// state after each keystroke doesn't need to copy and decode all of the text.
+#[derive(Debug, Default)]
+struct TextInputCache {
+    /// The state, as of the last edit that was taken from GameTextInput, or
+    /// `None` if it needs to be resynchronized with the whole text
+    state: Option<TextInputState>,
+
+    /// Whether `state` has been lent out by `take_text_input_state()` and may
+    /// be given back by `restore_text_input_state()`
+    lent: bool,
+}
+
 #[derive(Debug, Clone)]
 struct NativeAppGlue {
     ptr: NonNull<ffi::android_app>,
+    text_input: Arc<Mutex<TextInputCache>>,
 }
 impl Deref for NativeAppGlue {
     type Target = NonNull<ffi::android_app>;
@@ -165,56 +244,92 @@ unsafe impl Send for NativeAppGlue {}
 unsafe impl Sync for NativeAppGlue {}
 
 impl NativeAppGlue {
-    // TODO: move into a trait
-    pub fn text_input_state(&self) -> TextInputState {
+    /// Apply any changes to the text input state since it was last read
+    fn sync_text_input_state(&self, cache: &mut TextInputCache) {
         unsafe {
             let activity = (*self.as_ptr()).activity;
-            let mut out_state = TextInputState {
-                text: String::new(),
-                selection: TextSpan { start: 0, end: 0 },
-                compose_region: None,
-            };
-            let out_ptr = &mut out_state as *mut TextInputState;
 
             let app_ptr = self.as_ptr();
             (*app_ptr).textInputState = 0;
 
-            // NEON WARNING:
-            //
-            // It's not clearly documented but the GameActivity API over the
-            // GameTextInput library directly exposes _modified_ UTF8 text
-            // from Java so we need to be careful to convert text to and
-            // from UTF8
-            //
-            // GameTextInput also uses a pre-allocated, fixed-sized buffer for
-            // the current text state and has shared `currentState_` that
-            // appears to have no lock to guard access from multiple threads.
-            //
-            // There's also no locking at the GameActivity level, so I'm fairly
-            // certain that `GameActivity_getTextInputState` isn't thread
-            // safe: https://issuetracker.google.com/issues/294112477
-            //
-            // Overall this is all quite gnarly - and probably a good reminder
-            // of why we want to use Rust instead of C/C++.
-            ffi::GameActivity_getTextInputState(
+            // GameTextInput converts text from Java to (standard) UTF8, so
+            // edits can be applied to our copy of the text using the same
+            // byte offsets
+            let whole_text = cache.state.is_none();
+            if whole_text {
+                cache.state = None;
+                cache.lent = false;
+            }
+            let cache_ptr = cache as *mut TextInputCache;
+            ffi::GameActivity_takeTextInputEdit(
                 activity,
-                Some(AndroidAppInner::map_input_state_to_text_event_callback),
-                out_ptr.cast(),
+                whole_text,
+                Some(AndroidAppInner::apply_text_input_edit_callback),
+                cache_ptr.cast(),
             );
+            if !whole_text && cache.state.is_none() {
+                // The edit couldn't be applied
+                ffi::GameActivity_takeTextInputEdit(
+                    activity,
+                    true,
+                    Some(AndroidAppInner::apply_text_input_edit_callback),
+                    cache_ptr.cast(),
+                );
+            }
+        }
+    }
 
-            out_state
+    fn empty_text_input_state() -> TextInputState {
+        TextInputState {
+            text: String::new(),
+            selection: TextSpan { start: 0, end: 0 },
+            compose_region: None,
         }
     }
 
+    // TODO: move into a trait
+    pub fn text_input_state(&self) -> TextInputState {
+        let mut cache = self.text_input.lock().unwrap();
+        self.sync_text_input_state(&mut cache);
+        cache
+            .state
+            .clone()
+            .unwrap_or_else(Self::empty_text_input_state)
+    }
+
+    /// Like `text_input_state()`, except the state is moved out of the cache
+    /// instead of being cloned, so it should be given back with
+    /// `restore_text_input_state()` once it's no longer needed
+    fn take_text_input_state(&self) -> TextInputState {
+        let mut cache = self.text_input.lock().unwrap();
+        self.sync_text_input_state(&mut cache);
+        match cache.state.take() {
+            Some(state) => {
+                cache.lent = true;
+                state
+            }
+            None => Self::empty_text_input_state(),
+        }
+    }
+
+    fn restore_text_input_state(&self, state: TextInputState) {
+        let mut cache = self.text_input.lock().unwrap();
+        // The cache may have been resynchronized in the meantime
+        if cache.lent && cache.state.is_none() {
+            cache.state = Some(state);
+        }
+        cache.lent = false;
+    }
+
     // TODO: move into a trait
     pub fn set_text_input_state(&self, state: TextInputState) {
         unsafe {
             let activity = (*self.as_ptr()).activity;
-            let modified_utf8 = cesu8::to_java_cesu8(&state.text);
-            let text_length = modified_utf8.len() as i32;
-            let modified_utf8_bytes = modified_utf8.as_ptr();
+            // GameTextInput takes (standard) UTF8 and doesn't need it to be
+            // null terminated, since it's given the length
+            let text_length = state.text.len() as i32;
             let ffi_state = ffi::GameTextInputState {
-                text_UTF8: modified_utf8_bytes.cast(), // NB: may be signed or unsigned depending on target
+                text_UTF8: state.text.as_ptr().cast(), // NB: may be signed or unsigned depending on target
                 text_length,
                 selection: ffi::GameTextInputSpan {
                     start: state.selection.start as i32,
@@ -251,6 +366,83 @@ impl NativeAppGlue {
     }
 }
 
+/// The lifecycle commands, with the names of their corresponding `MainEvent`s
+const LIFECYCLE_COMMANDS: [(u32, &str); 16] = [
+    (ffi::NativeAppGlueAppCmd_APP_CMD_INIT_WINDOW, "InitWindow"),
+    (
+        ffi::NativeAppGlueAppCmd_APP_CMD_TERM_WINDOW,
+        "TerminateWindow",
+    ),
+    (
+        ffi::NativeAppGlueAppCmd_APP_CMD_WINDOW_RESIZED,
+        "WindowResized",
+    ),
+    (
+        ffi::NativeAppGlueAppCmd_APP_CMD_WINDOW_REDRAW_NEEDED,
+        "RedrawNeeded",
+    ),
+    (
+        ffi::NativeAppGlueAppCmd_APP_CMD_CONTENT_RECT_CHANGED,
+        "ContentRectChanged",
+    ),
+    (ffi::NativeAppGlueAppCmd_APP_CMD_GAINED_FOCUS, "GainedFocus"),
+    (ffi::NativeAppGlueAppCmd_APP_CMD_LOST_FOCUS, "LostFocus"),
+    (
+        ffi::NativeAppGlueAppCmd_APP_CMD_CONFIG_CHANGED,
+        "ConfigChanged",
+    ),
+    (ffi::NativeAppGlueAppCmd_APP_CMD_LOW_MEMORY, "LowMemory"),
+    (ffi::NativeAppGlueAppCmd_APP_CMD_START, "Start"),
+    (ffi::NativeAppGlueAppCmd_APP_CMD_RESUME, "Resume"),
+    (ffi::NativeAppGlueAppCmd_APP_CMD_SAVE_STATE, "SaveState"),
+    (ffi::NativeAppGlueAppCmd_APP_CMD_PAUSE, "Pause"),
+    (ffi::NativeAppGlueAppCmd_APP_CMD_STOP, "Stop"),
+    (ffi::NativeAppGlueAppCmd_APP_CMD_DESTROY, "Destroy"),
+    (
+        ffi::NativeAppGlueAppCmd_APP_CMD_WINDOW_INSETS_CHANGED,
+        "InsetsChanged",
+    ),
+];
+
+/// Lets the watchdog see which lifecycle command the Java main thread is waiting for
+struct GameActivityHandshakes {
+    native_app: NonNull<ffi::android_app>,
+}
+unsafe impl Send for GameActivityHandshakes {}
+unsafe impl Sync for GameActivityHandshakes {}
+
+impl Handshakes for GameActivityHandshakes {
+    fn pending_handshake(&self) -> Option<PendingHandshake> {
+        let mut cmd = 0;
+        let mut waited_nanos = 0;
+        let pending = unsafe {
+            ffi::android_app_get_pending_cmd(self.native_app.as_ptr(), &mut cmd, &mut waited_nanos)
+        };
+        if !pending {
+            return None;
+        }
+        let name = LIFECYCLE_COMMANDS
+            .iter()
+            .find(|&&(lifecycle_cmd, _)| lifecycle_cmd as i32 == cmd)
+            .map_or("Unknown", |&(_, name)| name);
+        Some(PendingHandshake {
+            name,
+            waited: Duration::from_nanos(waited_nanos.max(0) as u64),
+        })
+    }
+
+    fn degrade_to_non_blocking(&self, window_teardown_timeout: Duration) {
+        let timeout_nanos = i64::try_from(window_teardown_timeout.as_nanos()).unwrap_or(-1);
+        unsafe {
+            ffi::android_app_set_non_blocking_lifecycle(
+                self.native_app.as_ptr(),
+                true,
+                timeout_nanos,
+            )
+        }
+    }
+}
+
 #[derive(Debug)]
 pub struct AndroidAppInner {
     pub(crate) jvm: CloneJavaVM,
@@ -270,9 +462,24 @@ pub struct AndroidAppInner {
     /// InputReceiver reference which we track to ensure
     /// we don't hand out more than one receiver at a time
     input_receiver: Mutex<Option<Weak<InputReceiver>>>,
+
+    /// Options and bookkeeping for spilling saved states to files, or storing them as chunks
+    saved_state: SavedStateStore,
+
+    /// Watches for the Java main thread being blocked by a stalled `android_main` thread
+    pub(crate) watchdog: Arc<Watchdog>,
+
+    frame_events: FrameEvents,
+
+    /// File descriptors that the application has registered with the looper
+    fd_sources: FdSources,
 }
 
 impl AndroidAppInner {
+    pub fn set_saved_state_spill_threshold(&self, threshold: Option<usize>) {
+        self.saved_state.set_spill_threshold(threshold);
+    }
+
     pub fn vm_as_ptr(&self) -> *mut c_void {
         let app_ptr = self.native_app.as_ptr();
         unsafe { (*(*app_ptr).activity).vm as _ }
@@ -292,9 +499,31 @@ impl AndroidAppInner {
         F: FnMut(PollEvent),
     {
         trace!("poll_events");
+        self.watchdog.note_poll();
 
+        if !self.poll_once(timeout, &mut callback) {
+            callback(PollEvent::Timeout);
+        }
+    }
+
+    pub fn poll_events_batch<F>(&self, timeout: Option<Duration>, mut callback: F) -> PollBatchStats
+    where
+        F: FnMut(PollEvent),
+    {
+        trace!("poll_events_batch");
+        self.watchdog.note_poll();
+
+        PollBatchStats::drain(timeout, &mut callback, |timeout, callback| {
+            self.poll_once(timeout, callback)
+        })
+    }
+
+    /// Polls the looper once and handles whatever it returns, or returns `false` if it timed
+    /// out, without notifying the callback
+    fn poll_once(&self, timeout: Option<Duration>, callback: &mut dyn FnMut(PollEvent)) -> bool {
         unsafe {
             let native_app = &self.native_app;
+            self.frame_events.sync((*native_app.as_ptr()).looper);
 
             let mut fd: i32 = 0;
             let mut events: i32 = 0;
@@ -330,10 +559,10 @@ impl AndroidAppInner {
                 }
                 ffi::ALOOPER_POLL_TIMEOUT => {
                     trace!("ALooper_pollAll returned POLL_TIMEOUT");
-                    callback(PollEvent::Timeout);
+                    return false;
                 }
                 ffi::ALOOPER_POLL_ERROR => {
-                    // If we have an IO error with our pipe to the main Java thread that's surely
+                    // If we have an IO error with our eventfd from the main Java thread that's surely
                     // not something we can recover from
                     panic!("ALooper_pollAll returned POLL_ERROR");
                 }
@@ -343,90 +572,133 @@ impl AndroidAppInner {
                             trace!("ALooper_pollAll returned ID_MAIN");
                             let source: *mut ffi::android_poll_source = source.cast();
                             if !source.is_null() {
-                                let cmd_i = ffi::android_app_read_cmd(native_app.as_ptr());
-
-                                let cmd = match cmd_i as u32 {
-                                    //NativeAppGlueAppCmd_UNUSED_APP_CMD_INPUT_CHANGED => AndroidAppMainEvent::InputChanged,
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_INIT_WINDOW => {
-                                        MainEvent::InitWindow {}
-                                    }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_TERM_WINDOW => {
-                                        MainEvent::TerminateWindow {}
-                                    }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_WINDOW_RESIZED => {
-                                        MainEvent::WindowResized {}
-                                    }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_WINDOW_REDRAW_NEEDED => {
-                                        MainEvent::RedrawNeeded {}
-                                    }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_CONTENT_RECT_CHANGED => {
-                                        MainEvent::ContentRectChanged {}
-                                    }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_GAINED_FOCUS => {
-                                        MainEvent::GainedFocus
-                                    }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_LOST_FOCUS => {
-                                        MainEvent::LostFocus
-                                    }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_CONFIG_CHANGED => {
-                                        MainEvent::ConfigChanged {}
-                                    }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_LOW_MEMORY => {
-                                        MainEvent::LowMemory
-                                    }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_START => MainEvent::Start,
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_RESUME => MainEvent::Resume {
-                                        loader: StateLoader { app: self },
-                                    },
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_SAVE_STATE => {
-                                        MainEvent::SaveState {
-                                            saver: StateSaver { app: self },
+                                // Handle all the commands that are pending for this wake up
+                                let mut record: ffi::android_app_cmd_record = std::mem::zeroed();
+                                while ffi::android_app_read_cmd_record(
+                                    native_app.as_ptr(),
+                                    &mut record,
+                                ) {
+                                    let cmd_i = record.cmd as i8;
+
+                                    let mut cmd = match cmd_i as u32 {
+                                        //NativeAppGlueAppCmd_UNUSED_APP_CMD_INPUT_CHANGED => AndroidAppMainEvent::InputChanged,
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_INIT_WINDOW => {
+                                            MainEvent::InitWindow {}
                                         }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_TERM_WINDOW => {
+                                            MainEvent::TerminateWindow {}
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_WINDOW_RESIZED => {
+                                            MainEvent::WindowResized {}
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_WINDOW_REDRAW_NEEDED => {
+                                            MainEvent::RedrawNeeded {}
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_CONTENT_RECT_CHANGED => {
+                                            MainEvent::ContentRectChanged {}
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_GAINED_FOCUS => {
+                                            MainEvent::GainedFocus
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_LOST_FOCUS => {
+                                            MainEvent::LostFocus
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_CONFIG_CHANGED => {
+                                            // Filled in once the config has been updated, below
+                                            MainEvent::ConfigChanged {
+                                                changes: ConfigChanges::empty(),
+                                            }
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_LOW_MEMORY => {
+                                            MainEvent::LowMemory
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_START => MainEvent::Start,
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_RESUME => {
+                                            MainEvent::Resume {
+                                                loader: StateLoader { app: self },
+                                            }
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_SAVE_STATE => {
+                                            MainEvent::SaveState {
+                                                saver: StateSaver { app: self },
+                                            }
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_PAUSE => MainEvent::Pause,
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_STOP => MainEvent::Stop,
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_DESTROY => {
+                                            MainEvent::Destroy
+                                        }
+                                        ffi::NativeAppGlueAppCmd_APP_CMD_WINDOW_INSETS_CHANGED => {
+                                            MainEvent::InsetsChanged {
+                                                changes: InsetsChanges::from_bits_truncate(
+                                                    record.insetsChangedMask,
+                                                ),
+                                            }
+                                        }
+                                        _ => unreachable!(),
+                                    };
+
+                                    trace!("Read ID_MAIN command {cmd_i} = {cmd:?}, {record:?}");
+
+                                    trace!("Calling android_app_pre_exec_cmd({cmd_i})");
+                                    ffi::android_app_pre_exec_cmd(native_app.as_ptr(), cmd_i);
+                                    match &mut cmd {
+                                        MainEvent::ConfigChanged { changes } => {
+                                            *changes =
+                                                self.config.replace(Configuration::clone_from_ptr(
+                                                    NonNull::new_unchecked(
+                                                        (*native_app.as_ptr()).config,
+                                                    ),
+                                                ));
+                                        }
+                                        MainEvent::InitWindow { .. } => {
+                                            let win_ptr = (*native_app.as_ptr()).window;
+                                            // It's important that we use ::clone_from_ptr() here
+                                            // because NativeWindow has a Drop implementation that
+                                            // will unconditionally _release() the native window
+                                            *self.native_window.write().unwrap() =
+                                                Some(NativeWindow::clone_from_ptr(
+                                                    NonNull::new(win_ptr).unwrap(),
+                                                ));
+                                        }
+                                        MainEvent::TerminateWindow { .. } => {
+                                            *self.native_window.write().unwrap() = None;
+                                        }
+                                        _ => {}
                                     }
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_PAUSE => MainEvent::Pause,
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_STOP => MainEvent::Stop,
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_DESTROY => MainEvent::Destroy,
-                                    ffi::NativeAppGlueAppCmd_APP_CMD_WINDOW_INSETS_CHANGED => {
-                                        MainEvent::InsetsChanged {}
-                                    }
-                                    _ => unreachable!(),
-                                };
-
-                                trace!("Read ID_MAIN command {cmd_i} = {cmd:?}");
-
-                                trace!("Calling android_app_pre_exec_cmd({cmd_i})");
-                                ffi::android_app_pre_exec_cmd(native_app.as_ptr(), cmd_i);
-                                match cmd {
-                                    MainEvent::ConfigChanged { .. } => {
-                                        self.config.replace(Configuration::clone_from_ptr(
-                                            NonNull::new_unchecked((*native_app.as_ptr()).config),
-                                        ));
-                                    }
-                                    MainEvent::InitWindow { .. } => {
-                                        let win_ptr = (*native_app.as_ptr()).window;
-                                        // It's important that we use ::clone_from_ptr() here
-                                        // because NativeWindow has a Drop implementation that
-                                        // will unconditionally _release() the native window
-                                        *self.native_window.write().unwrap() =
-                                            Some(NativeWindow::clone_from_ptr(
-                                                NonNull::new(win_ptr).unwrap(),
-                                            ));
-                                    }
-                                    MainEvent::TerminateWindow { .. } => {
-                                        *self.native_window.write().unwrap() = None;
-                                    }
-                                    _ => {}
-                                }
 
-                                trace!("Invoking callback for ID_MAIN command = {:?}", cmd);
-                                callback(PollEvent::Main(cmd));
+                                    trace!("Invoking callback for ID_MAIN command = {:?}", cmd);
+                                    callback(PollEvent::Main(cmd));
 
-                                trace!("Calling android_app_post_exec_cmd({cmd_i})");
-                                ffi::android_app_post_exec_cmd(native_app.as_ptr(), cmd_i);
+                                    trace!("Calling android_app_post_exec_cmd({cmd_i})");
+                                    ffi::android_app_post_exec_cmd(native_app.as_ptr(), cmd_i);
+                                }
                             } else {
                                 panic!("ALooper_pollAll returned ID_MAIN event with NULL android_poll_source!");
                             }
                         }
+                        ffi::NativeAppGlueLooperId_LOOPER_ID_FRAME => {
+                            trace!("ALooper_pollAll returned ID_FRAME");
+                            if let Some(frame) = self.frame_events.take_frame() {
+                                callback(PollEvent::Main(MainEvent::Frame {
+                                    frame_time_nanos: frame.frame_time_nanos,
+                                    vsync_id: frame.vsync_id,
+                                    deadline_nanos: frame.deadline_nanos,
+                                }));
+                            }
+                        }
+                        ffi::NativeAppGlueLooperId_LOOPER_ID_FD => {
+                            trace!(
+                                "ALooper_pollAll returned ID_FD, fd = {fd}, events = {events:?}"
+                            );
+                            // NB: the file descriptor may have been unregistered by another thread
+                            if let Some(token) = self.fd_sources.token(fd) {
+                                callback(PollEvent::Fd {
+                                    token,
+                                    events: FdEvents::from_bits_truncate(events as u32),
+                                });
+                            }
+                        }
                         _ => {
                             error!("Ignoring spurious ALooper event source: id = {id}, fd = {fd}, events = {events:?}, data = {source:?}");
                         }
@@ -437,6 +709,7 @@ impl AndroidAppInner {
                 }
             }
         }
+        true
     }
 
     pub fn set_window_flags(
@@ -476,39 +749,72 @@ impl AndroidAppInner {
         }
     }
 
-    unsafe extern "C" fn map_input_state_to_text_event_callback(
+    unsafe extern "C" fn apply_text_input_edit_callback(
         context: *mut c_void,
-        state: *const ffi::GameTextInputState,
+        edit: *const ffi::GameTextInputEdit,
     ) {
-        // Java uses a modified UTF-8 format, which is a modified cesu8 format
-        let out_ptr: *mut TextInputState = context.cast();
-        let text_modified_utf8: *const u8 = (*state).text_UTF8.cast();
-        let text_modified_utf8 =
-            std::slice::from_raw_parts(text_modified_utf8, (*state).text_length as usize);
-        match cesu8::from_java_cesu8(text_modified_utf8) {
-            Ok(str) => {
-                let len = str.len();
-                (*out_ptr).text = String::from(str);
-
-                let selection_start = (*state).selection.start.clamp(0, len as i32 + 1);
-                let selection_end = (*state).selection.end.clamp(0, len as i32 + 1);
-                (*out_ptr).selection = TextSpan {
-                    start: selection_start as usize,
-                    end: selection_end as usize,
-                };
-                if (*state).composingRegion.start < 0 || (*state).composingRegion.end < 0 {
-                    (*out_ptr).compose_region = None;
-                } else {
-                    (*out_ptr).compose_region = Some(TextSpan {
-                        start: (*state).composingRegion.start as usize,
-                        end: (*state).composingRegion.end as usize,
-                    });
-                }
-            }
+        let cache = &mut *context.cast::<TextInputCache>();
+        let edit = &*edit;
+
+        let text_utf8 = std::slice::from_raw_parts(
+            edit.text_UTF8.cast::<u8>(),
+            edit.text_length.max(0) as usize,
+        );
+        let text = match std::str::from_utf8(text_utf8) {
+            Ok(text) => text,
             Err(err) => {
                 log::error!("Invalid UTF8 text in TextEvent: {}", err);
+                cache.state = None;
+                return;
             }
-        }
+        };
+
+        let state = match &mut cache.state {
+            Some(state) => {
+                let start = edit.replaced.start.max(0) as usize;
+                let end = edit.replaced.end.max(0) as usize;
+                let applies = start <= end
+                    && end <= state.text.len()
+                    && state.text.is_char_boundary(start)
+                    && state.text.is_char_boundary(end);
+                if !applies {
+                    cache.state = None;
+                    return;
+                }
+                state.text.replace_range(start..end, text);
+                state
+            }
+            None => cache.state.insert(TextInputState {
+                text: text.to_owned(),
+                selection: TextSpan { start: 0, end: 0 },
+                compose_region: None,
+            }),
+        };
+
+        (state.selection, state.compose_region) =
+            Self::map_text_spans(edit.selection, edit.composingRegion, state.text.len());
+    }
+
+    fn map_text_spans(
+        selection: ffi::GameTextInputSpan,
+        compose_region: ffi::GameTextInputSpan,
+        len: usize,
+    ) -> (TextSpan, Option<TextSpan>) {
+        let selection_start = selection.start.clamp(0, len as i32 + 1);
+        let selection_end = selection.end.clamp(0, len as i32 + 1);
+        let selection = TextSpan {
+            start: selection_start as usize,
+            end: selection_end as usize,
+        };
+        let compose_region = if compose_region.start < 0 || compose_region.end < 0 {
+            None
+        } else {
+            Some(TextSpan {
+                start: compose_region.start as usize,
+                end: compose_region.end as usize,
+            })
+        };
+        (selection, compose_region)
     }
 
     // TODO: move into a trait
@@ -516,11 +822,171 @@ impl AndroidAppInner {
         self.native_app.text_input_state()
     }
 
+    // TODO: move into a trait
+    pub fn with_text_input_state<F, R>(&self, f: F) -> R
+    where
+        F: FnOnce(&TextInputStateRef<'_>) -> R,
+    {
+        struct Context<F, R> {
+            activity: *mut ffi::GameActivity,
+            f: Option<F>,
+            result: Option<std::thread::Result<R>>,
+        }
+
+        // Called by GameTextInput with the state locked
+        unsafe extern "C" fn callback<F, R>(
+            context: *mut c_void,
+            state: *const ffi::GameTextInputState,
+        ) where
+            F: FnOnce(&TextInputStateRef<'_>) -> R,
+        {
+            let context = &mut *context.cast::<Context<F, R>>();
+            let state = &*state;
+
+            // GameTextInput only stores valid UTF8, but we still check it, rather than
+            // make our safety depend on that
+            let text_utf8 = std::slice::from_raw_parts(
+                state.text_UTF8.cast::<u8>(),
+                state.text_length.max(0) as usize,
+            );
+            let text = std::str::from_utf8(text_utf8).unwrap_or_else(|err| {
+                log::error!("Invalid UTF8 text in text input state: {}", err);
+                ""
+            });
+            let (selection, compose_region) =
+                AndroidAppInner::map_text_spans(state.selection, state.composingRegion, text.len());
+            let state = TextInputStateRef {
+                text,
+                selection,
+                compose_region,
+                // The generation can't change while the state is locked
+                generation: ffi::GameActivity_getTextInputGeneration(context.activity),
+            };
+
+            // Unwinding into C isn't allowed, so we resume any panic after returning
+            if let Some(f) = context.f.take() {
+                context.result = Some(catch_unwind(std::panic::AssertUnwindSafe(|| f(&state))));
+            }
+        }
+
+        let mut context = Context {
+            activity: unsafe { (*self.native_app.as_ptr()).activity },
+            f: Some(f),
+            result: None,
+        };
+        unsafe {
+            ffi::GameActivity_getTextInputState(
+                context.activity,
+                Some(callback::<F, R>),
+                (&mut context as *mut Context<F, R>).cast(),
+            );
+        }
+        match context.result {
+            Some(Ok(result)) => result,
+            Some(Err(payload)) => std::panic::resume_unwind(payload),
+            None => unreachable!("GameTextInput didn't call the text input state callback"),
+        }
+    }
+
+    // TODO: move into a trait
+    pub fn text_input_generation(&self) -> u64 {
+        unsafe {
+            let activity = (*self.native_app.as_ptr()).activity;
+            ffi::GameActivity_getTextInputGeneration(activity)
+        }
+    }
+
     // TODO: move into a trait
     pub fn set_text_input_state(&self, state: TextInputState) {
         self.native_app.set_text_input_state(state);
     }
 
+    pub fn jni_stats(&self) -> Vec<JniEntryStats> {
+        (0..ffi::GameActivityJniEntryPoint_GAMEACTIVITY_JNI_ENTRY_COUNT)
+            .filter_map(|entry_point| unsafe {
+                let mut stats: ffi::GameActivityJniStats = std::mem::zeroed();
+                if !ffi::GameActivity_getJniStats(entry_point, &mut stats) {
+                    return None;
+                }
+                // The names are static, ASCII, strings
+                let name = CStr::from_ptr(stats.name).to_str().unwrap_or_default();
+                Some(JniEntryStats {
+                    name,
+                    calls: stats.calls,
+                    jni_calls: stats.jniCalls,
+                    local_refs: stats.localRefs,
+                    total_time: Duration::from_nanos(stats.totalNanos as u64),
+                    max_time: Duration::from_nanos(stats.maxNanos as u64),
+                })
+            })
+            .collect()
+    }
+
+    pub fn lifecycle_latency_stats(&self) -> Vec<LifecycleLatencyStats> {
+        let app_ptr = self.native_app.as_ptr();
+        let histogram = |cmd: u32, stage: u32| unsafe {
+            let mut hist: ffi::android_app_latency_histogram = std::mem::zeroed();
+            ffi::android_app_get_cmd_latency(app_ptr, cmd as i32, stage as i32, &mut hist);
+            LatencyHistogram {
+                count: hist.count,
+                total: Duration::from_nanos(hist.totalNanos),
+                max: Duration::from_nanos(hist.maxNanos),
+                buckets: hist.buckets,
+            }
+        };
+        LIFECYCLE_COMMANDS
+            .iter()
+            .map(|&(cmd, name)| LifecycleLatencyStats {
+                name,
+                queued: histogram(cmd, ffi::NativeAppGlueCmdStage_APP_CMD_STAGE_QUEUED),
+                pre_exec: histogram(cmd, ffi::NativeAppGlueCmdStage_APP_CMD_STAGE_PRE_EXEC),
+                callback: histogram(cmd, ffi::NativeAppGlueCmdStage_APP_CMD_STAGE_CALLBACK),
+                post_exec: histogram(cmd, ffi::NativeAppGlueCmdStage_APP_CMD_STAGE_POST_EXEC),
+                unblock: histogram(cmd, ffi::NativeAppGlueCmdStage_APP_CMD_STAGE_UNBLOCK),
+                wait: histogram(cmd, ffi::NativeAppGlueCmdStage_APP_CMD_STAGE_WAIT),
+            })
+            .filter(|stats| stats.queued.count > 0)
+            .collect()
+    }
+
+    pub fn set_handshake_watchdog(&self, watchdog: Option<HandshakeWatchdog>) {
+        self.watchdog.set_config(watchdog);
+    }
+
+    pub fn set_frame_events(&self, enabled: bool) {
+        let looper = unsafe { (*self.native_app.as_ptr()).looper };
+        self.frame_events.set_enabled(enabled, looper);
+    }
+
+    pub fn register_fd(&self, fd: RawFd, interest: FdEvents) -> std::io::Result<Token> {
+        let looper = unsafe { (*self.native_app.as_ptr()).looper };
+        self.fd_sources.register(looper, fd, interest)
+    }
+
+    pub fn unregister_fd(&self, token: Token) -> bool {
+        let looper = unsafe { (*self.native_app.as_ptr()).looper };
+        self.fd_sources.unregister(looper, token)
+    }
+
+    pub fn set_lifecycle_handoff(&self, handoff: LifecycleHandoff) {
+        let (enabled, timeout_nanos) = match handoff {
+            LifecycleHandoff::Blocking => (false, -1),
+            LifecycleHandoff::NonBlocking {
+                window_teardown_timeout,
+            } => (
+                true,
+                i64::try_from(window_teardown_timeout.as_nanos()).unwrap_or(-1),
+            ),
+        };
+        unsafe {
+            ffi::android_app_set_non_blocking_lifecycle(
+                self.native_app.as_ptr(),
+                enabled,
+                timeout_nanos,
+            )
+        }
+    }
+
     pub(crate) fn device_key_character_map(
         &self,
         device_id: i32,
@@ -553,6 +1019,46 @@ impl AndroidAppInner {
         unsafe { ffi::GameActivityPointerAxes_disableAxis(axis as i32) }
     }
 
+    pub fn set_motion_event_pointer_arrays(&mut self, enabled: bool) {
+        unsafe {
+            ffi::android_app_set_motion_event_pointer_arrays(self.native_app.as_ptr(), enabled)
+        }
+    }
+
+    pub fn set_motion_coalescing(&mut self, enabled: bool) {
+        unsafe { ffi::android_app_set_motion_coalescing(self.native_app.as_ptr(), enabled) }
+    }
+
+    pub fn set_deferred_motion_event_decoding(&mut self, enabled: bool) {
+        unsafe {
+            ffi::android_app_set_deferred_motion_event_decoding(self.native_app.as_ptr(), enabled)
+        }
+    }
+
+    pub fn set_input_filter(&self, filter: Option<&InputFilter>) {
+        let ffi_filter = filter.map(|filter| {
+            let mut device_ids = [0; ffi::GAMEACTIVITY_INPUT_FILTER_MAX_DEVICES as usize];
+            device_ids[..filter.device_ids.len()].copy_from_slice(&filter.device_ids);
+            ffi::GameActivityInputFilter {
+                motionSourceMask: filter.motion_source_mask,
+                motionActionMask: filter.motion_action_mask,
+                keySourceMask: filter.key_source_mask,
+                keyCodes: filter.keycodes,
+                deviceIdCount: filter.device_ids.len() as u32,
+                deviceIds: device_ids,
+            }
+        });
+        unsafe {
+            let activity = (*self.native_app.as_ptr()).activity;
+            ffi::GameActivity_setInputFilter(
+                activity,
+                ffi_filter
+                    .as_ref()
+                    .map_or(ptr::null(), |filter| filter as *const _),
+            );
+        }
+    }
+
     pub fn create_waker(&self) -> AndroidAppWaker {
         unsafe {
             // From the application's pov we assume the app_ptr and looper pointer
@@ -592,9 +1098,9 @@ impl AndroidAppInner {
         let mut guard = self.input_receiver.lock().unwrap();
 
         // Make sure we don't hand out more than one receiver at a time because
-        // turning the reciever into an interator will perform a swap_buffers
-        // for the buffered input events which shouldn't happen while we're in
-        // the middle of iterating events
+        // turning the reciever into an interator will acquire the buffered
+        // input events from the input ring, which shouldn't happen while we're
+        // in the middle of iterating events
         if let Some(receiver) = &*guard {
             if receiver.strong_count() > 0 {
                 return Err(crate::error::InternalAppError::InputUnavailable);
@@ -632,28 +1138,79 @@ impl AndroidAppInner {
     }
 }
 
+/// Returns the `count` events starting at index `head` of an input ring of `size` events, as two
+/// slices in case they wrap around the end of the ring
+///
+/// # Safety
+/// `ring` must point to `size` events, where `size` is a power of two, and the `count` events
+/// starting at `head` must be initialized and remain valid and unmodified for the lifetime `'buf`
+unsafe fn ring_slices<'buf, T>(
+    ring: *const T,
+    size: u64,
+    head: u64,
+    count: usize,
+) -> [&'buf [T]; 2] {
+    let start = (head & (size - 1)) as usize;
+    let first = count.min(size as usize - start);
+    [
+        std::slice::from_raw_parts(ring.add(start), first),
+        std::slice::from_raw_parts(ring, count - first),
+    ]
+}
+
 struct MotionEventsLendingIterator {
     pos: usize,
     count: usize,
+    head: u64,
+    mask: u64,
 }
 
 impl MotionEventsLendingIterator {
     fn new(buffer: &InputBuffer) -> Self {
+        let ring = unsafe { &*buffer.ptr.as_ptr() };
         Self {
             pos: 0,
             count: buffer.motion_events_count(),
+            head: ring.motionEventsHead,
+            mask: ring.motionEventsBufferSize - 1,
         }
     }
+
+    /// Returns the events that haven't been iterated yet
+    fn remaining<'buf>(
+        &self,
+        buffer: &'buf InputBuffer,
+    ) -> [&'buf [ffi::GameActivityMotionEvent]; 2] {
+        // Safety:
+        // - This iterator currently has exclusive access to the acquired events
+        // - The events from `head + pos` up to `head + count` have been acquired
+        unsafe {
+            let ring = &*buffer.ptr.as_ptr();
+            ring_slices(
+                ring.motionEvents,
+                ring.motionEventsBufferSize,
+                self.head + self.pos as u64,
+                self.count - self.pos,
+            )
+        }
+    }
+
+    fn peek_event_time(&self, buffer: &InputBuffer) -> Option<i64> {
+        let [first, _] = self.remaining(buffer);
+        first.first().map(|ga_event| ga_event.eventTime)
+    }
+
     fn next<'buf>(&mut self, buffer: &'buf InputBuffer) -> Option<MotionEvent<'buf>> {
         if self.pos < self.count {
             // Safety:
-            // - This iterator currently has exclusive access to the front buffer of events
+            // - This iterator currently has exclusive access to the acquired events
             // - We know the buffer is non-null
-            // - `pos` is less than the number of events stored in the buffer
+            // - `pos` is less than the number of events acquired from the ring
+            let index = (self.head + self.pos as u64) & self.mask;
             let ga_event = unsafe {
                 (*buffer.ptr.as_ptr())
                     .motionEvents
-                    .add(self.pos)
+                    .add(index as usize)
                     .as_ref()
                     .unwrap()
             };
@@ -669,25 +1226,53 @@ impl MotionEventsLendingIterator {
 struct KeyEventsLendingIterator {
     pos: usize,
     count: usize,
+    head: u64,
+    mask: u64,
 }
 
 impl KeyEventsLendingIterator {
     fn new(buffer: &InputBuffer) -> Self {
+        let ring = unsafe { &*buffer.ptr.as_ptr() };
         Self {
             pos: 0,
             count: buffer.key_events_count(),
+            head: ring.keyEventsHead,
+            mask: ring.keyEventsBufferSize - 1,
+        }
+    }
+
+    /// Returns the events that haven't been iterated yet
+    fn remaining<'buf>(&self, buffer: &'buf InputBuffer) -> [&'buf [ffi::GameActivityKeyEvent]; 2] {
+        // Safety:
+        // - This iterator currently has exclusive access to the acquired events
+        // - The events from `head + pos` up to `head + count` have been acquired
+        unsafe {
+            let ring = &*buffer.ptr.as_ptr();
+            ring_slices(
+                ring.keyEvents,
+                ring.keyEventsBufferSize,
+                self.head + self.pos as u64,
+                self.count - self.pos,
+            )
         }
     }
+
+    fn peek_event_time(&self, buffer: &InputBuffer) -> Option<i64> {
+        let [first, _] = self.remaining(buffer);
+        first.first().map(|ga_event| ga_event.eventTime)
+    }
+
     fn next<'buf>(&mut self, buffer: &'buf InputBuffer) -> Option<KeyEvent<'buf>> {
         if self.pos < self.count {
             // Safety:
-            // - This iterator currently has exclusive access to the front buffer of events
+            // - This iterator currently has exclusive access to the acquired events
             // - We know the buffer is non-null
-            // - `pos` is less than the number of events stored in the buffer
+            // - `pos` is less than the number of events acquired from the ring
+            let index = (self.head + self.pos as u64) & self.mask;
             let ga_event = unsafe {
                 (*buffer.ptr.as_ptr())
                     .keyEvents
-                    .add(self.pos)
+                    .add(index as usize)
                     .as_ref()
                     .unwrap()
             };
@@ -740,10 +1325,10 @@ impl<'a> Drop for InputBuffer<'a> {
 /// It serves two purposes:
 /// 1. It represents an exclusive access to input events (the application
 ///    can only have one receiver at a time) and it's intended to support
-///    the double-buffering design for input events in GameActivity where
-///    we issue a swap_buffers before iterating events and wouldn't want
-///    another swap to be possible before finishing - especially since
-///    we want to borrow directly from the buffer while dispatching.
+///    the input ring design for GameActivity where we acquire the buffered
+///    events before iterating them and wouldn't want another consumer to
+///    acquire or release events before finishing - especially since we
+///    want to borrow directly from the ring while dispatching.
 /// 2. It doesn't borrow from AndroidAppInner so we can pass it back to
 ///    AndroidApp which can drop its lock around AndroidAppInner and
 ///    it can then be turned into a lending iterator. (We wouldn't
@@ -753,9 +1338,9 @@ impl<'a> Drop for InputBuffer<'a> {
 ///    API in any way while iterating events)
 #[derive(Debug)]
 pub(crate) struct InputReceiver {
-    // Safety: the native_app effectively has a static lifetime and it
-    // has its own internal locking when calling
-    // `android_app_swap_input_buffers`
+    // Safety: the native_app effectively has a static lifetime and the
+    // input ring only supports a single consumer, which is guaranteed by
+    // only having one receiver at a time
     native_app: NativeAppGlue,
 }
 
@@ -807,38 +1392,115 @@ impl<'a> InputIteratorInner<'a> {
         F: FnOnce(&input::InputEvent) -> InputStatus,
     {
         if let Some(buffered) = &mut self.buffered {
-            if let Some(key_event) = buffered.keys_iter.next(&buffered.buffer) {
-                let _ = callback(&InputEvent::KeyEvent(key_event));
-                return true;
-            }
-            if let Some(motion_event) = buffered.motion_iter.next(&buffered.buffer) {
+            // Dispatch key and motion events in the order they happened
+            let key_time = buffered.keys_iter.peek_event_time(&buffered.buffer);
+            let motion_time = buffered.motion_iter.peek_event_time(&buffered.buffer);
+            let key_first = match (key_time, motion_time) {
+                (Some(key_time), Some(motion_time)) => key_time <= motion_time,
+                (Some(_), None) => true,
+                (None, _) => false,
+            };
+            if key_first {
+                if let Some(key_event) = buffered.keys_iter.next(&buffered.buffer) {
+                    let _ = callback(&InputEvent::KeyEvent(key_event));
+                    return true;
+                }
+            } else if let Some(motion_event) = buffered.motion_iter.next(&buffered.buffer) {
                 let _ = callback(&InputEvent::MotionEvent(motion_event));
                 return true;
             }
             self.buffered = None;
         }
 
-        if !self.text_event_checked {
-            self.text_event_checked = true;
-            unsafe {
-                let app_ptr = self.native_app.as_ptr();
-
-                // XXX: It looks like the GameActivity implementation should
-                // be using atomic ops to set this flag, and require us to
-                // use atomics to check and clear it too.
-                //
-                // We currently just hope that with the lack of atomic ops that
-                // the compiler isn't reordering code so this gets flagged
-                // before the java main thread really updates the state.
-                if (*app_ptr).textInputState != 0 {
-                    let state = self.native_app.text_input_state(); // Will clear .textInputState
-                    let _ = callback(&InputEvent::TextEvent(state));
-                    return true;
-                }
+        if let Some(state) = self.take_text_input_state() {
+            let event = InputEvent::TextEvent(state);
+            let _ = callback(&event);
+            if let InputEvent::TextEvent(state) = event {
+                self.native_app.restore_text_input_state(state);
             }
+            return true;
         }
         false
     }
+
+    pub(crate) fn next_batch<F>(&mut self, callback: F) -> bool
+    where
+        F: FnOnce(&crate::input::InputBatch) -> InputStatus,
+    {
+        let text_input_state = self.take_text_input_state();
+
+        // NB: the events are released back to the input ring when `buffered` is dropped
+        let buffered = self.buffered.take();
+        if buffered.is_none() && text_input_state.is_none() {
+            return false;
+        }
+
+        let (key_events, motion_events) = match &buffered {
+            Some(buffered) => (
+                buffered.keys_iter.remaining(&buffered.buffer),
+                buffered.motion_iter.remaining(&buffered.buffer),
+            ),
+            None => Default::default(),
+        };
+        let batch = crate::input::InputBatch {
+            inner: InputBatchImpl {
+                key_events: KeyEventsImpl::new(key_events),
+                motion_events: MotionEventsImpl::new(motion_events),
+                text_input_state,
+            },
+        };
+        let _ = callback(&batch);
+        if let Some(state) = batch.inner.text_input_state {
+            self.native_app.restore_text_input_state(state);
+        }
+        true
+    }
+
+    /// Returns the new text input state, the first time this is called, if it changed
+    fn take_text_input_state(&mut self) -> Option<TextInputState> {
+        if self.text_event_checked {
+            return None;
+        }
+        self.text_event_checked = true;
+
+        unsafe {
+            let app_ptr = self.native_app.as_ptr();
+
+            // XXX: It looks like the GameActivity implementation should
+            // be using atomic ops to set this flag, and require us to
+            // use atomics to check and clear it too.
+            //
+            // We currently just hope that with the lack of atomic ops that
+            // the compiler isn't reordering code so this gets flagged
+            // before the java main thread really updates the state.
+            if (*app_ptr).textInputState != 0 {
+                Some(self.native_app.take_text_input_state()) // Will clear .textInputState
+            } else {
+                None
+            }
+        }
+    }
+}
+
+#[derive(Debug)]
+pub(crate) struct InputBatchImpl<'a> {
+    key_events: KeyEventsImpl<'a>,
+    motion_events: MotionEventsImpl<'a>,
+    text_input_state: Option<TextInputState>,
+}
+
+impl<'a> InputBatchImpl<'a> {
+    pub fn key_events(&self) -> KeyEventsImpl<'a> {
+        self.key_events
+    }
+
+    pub fn motion_events(&self) -> MotionEventsImpl<'a> {
+        self.motion_events
+    }
+
+    pub fn text_input_state(&self) -> Option<&TextInputState> {
+        self.text_input_state.as_ref()
+    }
 }
 
 // Rust doesn't give us a clean way to directly export symbols from C/C++
@@ -929,6 +1591,7 @@ pub unsafe extern "C" fn _rust_glue_entry(native_app: *mut ffi::android_app) {
             libc::pthread_setname_np(libc::pthread_self(), thread_name.as_ptr());
 
             let app = AndroidApp::from_ptr(NonNull::new(native_app).unwrap(), jvm.clone());
+            let watchdog = app.inner.read().unwrap().watchdog.clone();
 
             // We want to specifically catch any panic from the application's android_main
             // so we can finish + destroy the Activity gracefully via the JVM
@@ -945,6 +1608,9 @@ pub unsafe extern "C" fn _rust_glue_entry(native_app: *mut ffi::android_app) {
             })
             .unwrap_or_else(|panic| log_panic(panic));
 
+            // The watchdog samples this thread, so it must be stopped before the thread exits
+            watchdog.stop();
+
             // Let JVM know that our Activity can be destroyed before detaching from the JVM
             //
             // "Note that this method can be called from any thread; it will send a message
@@ -907,6 +907,174 @@ pub struct TextInputState {
     pub compose_region: Option<TextSpan>,
 }
 
+/// A borrowed view of the current text input state
+///
+/// This is passed to the closure given to
+/// [`AndroidApp::with_text_input_state()`](crate::AndroidApp::with_text_input_state) and
+/// borrows the text directly from the native text input buffer, instead of copying it into a
+/// [`TextInputState`].
+#[derive(Debug, Clone, Copy)]
+pub struct TextInputStateRef<'a> {
+    pub text: &'a str,
+
+    /// A selection defined on the text.
+    pub selection: TextSpan,
+
+    /// A composing region defined on the text.
+    pub compose_region: Option<TextSpan>,
+
+    /// The generation of this state, as per
+    /// [`AndroidApp::text_input_generation()`](crate::AndroidApp::text_input_generation)
+    pub generation: u64,
+}
+
+impl<'a> From<TextInputStateRef<'a>> for TextInputState {
+    fn from(state: TextInputStateRef<'a>) -> Self {
+        TextInputState {
+            text: state.text.to_owned(),
+            selection: state.selection,
+            compose_region: state.compose_region,
+        }
+    }
+}
+
+/// The maximum number of devices that an [`InputFilter`] can accept events from
+pub const INPUT_FILTER_MAX_DEVICES: usize = 8;
+
+/// The number of keycodes that an [`InputFilter`] can reject (larger keycodes are always
+/// accepted)
+const INPUT_FILTER_KEYCODE_COUNT: usize = 512;
+
+/// A declarative filter for input events
+///
+/// Unlike skipping events while iterating them, an `InputFilter` is checked before events are
+/// converted and queued for the application, so a rejected event only costs the few JNI calls
+/// needed to check it. Rejected events are reported as unhandled, so the system may handle
+/// them instead.
+///
+/// A new filter accepts all events, and each method narrows down which events are accepted:
+///
+/// ```ignore
+/// # use android_activity::input::{InputFilter, Keycode, MotionAction, Source};
+/// # let app: AndroidApp = todo!();
+/// let filter = InputFilter::new()
+///     .motion_sources(&[Source::Touchscreen])
+///     .motion_actions(&[MotionAction::Down, MotionAction::Move, MotionAction::Up])
+///     .reject_keycodes(&[Keycode::VolumeUp, Keycode::VolumeDown]);
+/// app.set_input_filter(Some(&filter));
+/// ```
+///
+/// See [`crate::AndroidApp::set_input_filter`]
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct InputFilter {
+    pub(crate) motion_source_mask: u32,
+    pub(crate) motion_action_mask: u32,
+    pub(crate) key_source_mask: u32,
+    pub(crate) keycodes: [u64; INPUT_FILTER_KEYCODE_COUNT / 64],
+    pub(crate) device_ids: Vec<i32>,
+}
+
+impl Default for InputFilter {
+    fn default() -> Self {
+        Self {
+            motion_source_mask: u32::MAX,
+            motion_action_mask: u32::MAX,
+            key_source_mask: u32::MAX,
+            keycodes: [u64::MAX; INPUT_FILTER_KEYCODE_COUNT / 64],
+            device_ids: Vec::new(),
+        }
+    }
+}
+
+impl InputFilter {
+    /// Creates a filter that accepts all events
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Only accept motion events whose source is covered by the given sources
+    ///
+    /// A [`Source`] is a combination of bits for the class of the device and the kind of device,
+    /// and an event is rejected if its source has any bits that aren't set by one of `sources`.
+    pub fn motion_sources(mut self, sources: &[Source]) -> Self {
+        self.motion_source_mask = source_mask(sources);
+        self
+    }
+
+    /// Only accept motion events with one of the given actions
+    pub fn motion_actions(mut self, actions: &[MotionAction]) -> Self {
+        self.motion_action_mask = actions.iter().fold(0, |mask, action| {
+            let action: u32 = (*action).into();
+            mask | 1u32.checked_shl(action).unwrap_or(0)
+        });
+        self
+    }
+
+    /// Only accept key events whose source is covered by the given sources
+    ///
+    /// See [`Self::motion_sources`]
+    pub fn key_sources(mut self, sources: &[Source]) -> Self {
+        self.key_source_mask = source_mask(sources);
+        self
+    }
+
+    /// Only accept key events for the given keycodes
+    ///
+    /// Keycodes with a value of 512 or more (beyond any that Android currently defines) are
+    /// always accepted.
+    pub fn keycodes(mut self, keycodes: &[Keycode]) -> Self {
+        self.keycodes = [0; INPUT_FILTER_KEYCODE_COUNT / 64];
+        for keycode in keycodes {
+            self.set_keycode(*keycode, true);
+        }
+        self
+    }
+
+    /// Reject key events for the given keycodes
+    pub fn reject_keycodes(mut self, keycodes: &[Keycode]) -> Self {
+        for keycode in keycodes {
+            self.set_keycode(*keycode, false);
+        }
+        self
+    }
+
+    /// Only accept motion and key events from the devices with the given IDs
+    ///
+    /// An empty slice accepts events from all devices.
+    ///
+    /// # Panics
+    ///
+    /// This will panic if more than [`INPUT_FILTER_MAX_DEVICES`] IDs are given.
+    pub fn device_ids(mut self, device_ids: &[i32]) -> Self {
+        assert!(
+            device_ids.len() <= INPUT_FILTER_MAX_DEVICES,
+            "An InputFilter can't accept events from more than {INPUT_FILTER_MAX_DEVICES} devices"
+        );
+        self.device_ids = device_ids.to_vec();
+        self
+    }
+
+    fn set_keycode(&mut self, keycode: Keycode, accept: bool) {
+        let keycode: u32 = keycode.into();
+        let keycode = keycode as usize;
+        if keycode < INPUT_FILTER_KEYCODE_COUNT {
+            let bit = 1u64 << (keycode % 64);
+            if accept {
+                self.keycodes[keycode / 64] |= bit;
+            } else {
+                self.keycodes[keycode / 64] &= !bit;
+            }
+        }
+    }
+}
+
+fn source_mask(sources: &[Source]) -> u32 {
+    sources.iter().fold(0, |mask, source| {
+        let source: u32 = (*source).into();
+        mask | source
+    })
+}
+
 /// An exclusive, lending iterator for input events
 pub struct InputIterator<'a> {
     pub(crate) inner: crate::activity_impl::InputIteratorInner<'a>,
@@ -924,8 +1092,226 @@ impl<'a> InputIterator<'a> {
     {
         self.inner.next(callback)
     }
+
+    /// Reads all pending input events and handles them together by passing them to the given
+    /// `callback` as a single [`InputBatch`]
+    ///
+    /// This avoids the overhead of dispatching events one at a time, for applications that want
+    /// to process all of the input for a frame together.
+    ///
+    /// The [`InputStatus`] returned by `callback` applies to all of the key and motion events in
+    /// the batch. Use [`Self::next`] if events need to be individually reported as unhandled, to
+    /// allow for a fallback interpretation of the event.
+    ///
+    /// Returns `false` if there were no pending events.
+    pub fn next_batch<F>(&mut self, callback: F) -> bool
+    where
+        F: FnOnce(&InputBatch) -> InputStatus,
+    {
+        self.inner.next_batch(callback)
+    }
+}
+
+/// A batch of pending input events, see [`InputIterator::next_batch`]
+///
+/// The key and motion events are borrowed directly from the backend's buffer of pending events,
+/// without being copied.
+#[derive(Debug)]
+pub struct InputBatch<'a> {
+    pub(crate) inner: crate::activity_impl::InputBatchImpl<'a>,
+}
+
+impl<'a> InputBatch<'a> {
+    /// The key events in the batch, in the order they were received
+    #[inline]
+    pub fn key_events(&self) -> KeyEvents<'_> {
+        KeyEvents {
+            inner: self.inner.key_events(),
+        }
+    }
+
+    /// The motion events in the batch, in the order they were received
+    #[inline]
+    pub fn motion_events(&self) -> MotionEvents<'_> {
+        MotionEvents {
+            inner: self.inner.motion_events(),
+        }
+    }
+
+    /// The new state of the text input, if it changed
+    #[inline]
+    pub fn text_input_state(&self) -> Option<&TextInputState> {
+        self.inner.text_input_state()
+    }
+
+    /// The total number of key and motion events in the batch
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.key_events().len() + self.motion_events().len()
+    }
+
+    /// Returns `true` if there are no key or motion events in the batch
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Returns an iterator over all of the key and motion events in the batch, ordered by their
+    /// event time
+    ///
+    /// Events with the same event time are returned in the order they were received, with key
+    /// events first.
+    pub fn iter(&self) -> InputBatchIter<'_> {
+        InputBatchIter {
+            key_events: self.key_events().iter().peekable(),
+            motion_events: self.motion_events().iter().peekable(),
+        }
+    }
+}
+
+/// An iterator over the key and motion events in an [`InputBatch`], ordered by event time
+#[derive(Debug)]
+pub struct InputBatchIter<'a> {
+    key_events: std::iter::Peekable<KeyEventsIter<'a>>,
+    motion_events: std::iter::Peekable<MotionEventsIter<'a>>,
+}
+
+impl<'a> Iterator for InputBatchIter<'a> {
+    type Item = InputEvent<'a>;
+
+    fn next(&mut self) -> Option<InputEvent<'a>> {
+        let key_first = match (self.key_events.peek(), self.motion_events.peek()) {
+            (Some(key), Some(motion)) => key.event_time() <= motion.event_time(),
+            (Some(_), None) => true,
+            (None, _) => false,
+        };
+        if key_first {
+            self.key_events.next().map(InputEvent::KeyEvent)
+        } else {
+            self.motion_events.next().map(InputEvent::MotionEvent)
+        }
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        let len = self.key_events.len() + self.motion_events.len();
+        (len, Some(len))
+    }
+}
+
+impl<'a> ExactSizeIterator for InputBatchIter<'a> {}
+
+/// A borrowed view of the key events in an [`InputBatch`]
+#[derive(Debug, Clone, Copy)]
+pub struct KeyEvents<'a> {
+    pub(crate) inner: KeyEventsImpl<'a>,
+}
+
+impl<'a> KeyEvents<'a> {
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.inner.len()
+    }
+
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Returns the key event at the given `index`, or `None` if it's out of bounds
+    #[inline]
+    pub fn get(&self, index: usize) -> Option<KeyEvent<'a>> {
+        self.inner.get(index)
+    }
+
+    #[inline]
+    pub fn iter(&self) -> KeyEventsIter<'a> {
+        KeyEventsIter {
+            events: *self,
+            next: 0,
+        }
+    }
+}
+
+/// An iterator over the key events in an [`InputBatch`]
+#[derive(Debug)]
+pub struct KeyEventsIter<'a> {
+    events: KeyEvents<'a>,
+    next: usize,
+}
+
+impl<'a> Iterator for KeyEventsIter<'a> {
+    type Item = KeyEvent<'a>;
+
+    fn next(&mut self) -> Option<KeyEvent<'a>> {
+        let event = self.events.get(self.next)?;
+        self.next += 1;
+        Some(event)
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        let len = self.events.len() - self.next;
+        (len, Some(len))
+    }
+}
+
+impl<'a> ExactSizeIterator for KeyEventsIter<'a> {}
+
+/// A borrowed view of the motion events in an [`InputBatch`]
+#[derive(Debug, Clone, Copy)]
+pub struct MotionEvents<'a> {
+    pub(crate) inner: MotionEventsImpl<'a>,
+}
+
+impl<'a> MotionEvents<'a> {
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.inner.len()
+    }
+
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Returns the motion event at the given `index`, or `None` if it's out of bounds
+    #[inline]
+    pub fn get(&self, index: usize) -> Option<MotionEvent<'a>> {
+        self.inner.get(index)
+    }
+
+    #[inline]
+    pub fn iter(&self) -> MotionEventsIter<'a> {
+        MotionEventsIter {
+            events: *self,
+            next: 0,
+        }
+    }
 }
 
+/// An iterator over the motion events in an [`InputBatch`]
+#[derive(Debug)]
+pub struct MotionEventsIter<'a> {
+    events: MotionEvents<'a>,
+    next: usize,
+}
+
+impl<'a> Iterator for MotionEventsIter<'a> {
+    type Item = MotionEvent<'a>;
+
+    fn next(&mut self) -> Option<MotionEvent<'a>> {
+        let event = self.events.get(self.next)?;
+        self.next += 1;
+        Some(event)
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        let len = self.events.len() - self.next;
+        (len, Some(len))
+    }
+}
+
+impl<'a> ExactSizeIterator for MotionEventsIter<'a> {}
+
 /// A view into the data of a specific pointer in a motion event.
 #[derive(Debug)]
 pub struct Pointer<'a> {
@@ -1031,3 +1417,263 @@ impl<'a> ExactSizeIterator for PointersIter<'a> {
         self.inner.len()
     }
 }
+
+/// A view into a past moment of a [`MotionEvent`].
+///
+/// Android may batch multiple movement samples into a single [`MotionEvent`] and these
+/// can be accessed via [`MotionEvent::history()`].
+#[derive(Debug)]
+pub struct HistoricalMotionEvent<'a> {
+    pub(crate) inner: HistoricalMotionEventImpl<'a>,
+}
+
+impl<'a> HistoricalMotionEvent<'a> {
+    /// Returns the "history index" associated with this historical event. Older events have
+    /// smaller indices.
+    #[inline]
+    pub fn history_index(&self) -> usize {
+        self.inner.history_index()
+    }
+
+    /// Returns the time of the historical event, in the `java.lang.System.nanoTime()` time base
+    ///
+    /// See [the MotionEvent docs](https://developer.android.com/reference/android/view/MotionEvent#getHistoricalEventTimeNanos(int))
+    #[inline]
+    pub fn event_time(&self) -> i64 {
+        self.inner.event_time()
+    }
+
+    /// An iterator over the pointers of this historical motion event
+    #[inline]
+    pub fn pointers(&self) -> HistoricalPointersIter<'a> {
+        self.inner.pointers()
+    }
+}
+
+/// An iterator over all the historical moments in a [`MotionEvent`].
+///
+/// It iterates from oldest to newest.
+#[derive(Debug)]
+pub struct HistoricalMotionEventsIter<'a> {
+    pub(crate) inner: HistoricalMotionEventsIterImpl<'a>,
+}
+
+impl<'a> Iterator for HistoricalMotionEventsIter<'a> {
+    type Item = HistoricalMotionEvent<'a>;
+    fn next(&mut self) -> Option<HistoricalMotionEvent<'a>> {
+        self.inner.next()
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.inner.size_hint()
+    }
+}
+
+impl<'a> ExactSizeIterator for HistoricalMotionEventsIter<'a> {
+    fn len(&self) -> usize {
+        self.inner.len()
+    }
+}
+
+impl<'a> DoubleEndedIterator for HistoricalMotionEventsIter<'a> {
+    fn next_back(&mut self) -> Option<HistoricalMotionEvent<'a>> {
+        self.inner.next_back()
+    }
+}
+
+/// A view into the data of a specific pointer in a [`HistoricalMotionEvent`].
+#[derive(Debug)]
+pub struct HistoricalPointer<'a> {
+    pub(crate) inner: HistoricalPointerImpl<'a>,
+}
+
+impl<'a> HistoricalPointer<'a> {
+    #[inline]
+    pub fn pointer_index(&self) -> usize {
+        self.inner.pointer_index()
+    }
+
+    #[inline]
+    pub fn pointer_id(&self) -> i32 {
+        self.inner.pointer_id()
+    }
+
+    #[inline]
+    pub fn history_index(&self) -> usize {
+        self.inner.history_index()
+    }
+
+    #[inline]
+    pub fn axis_value(&self, axis: Axis) -> f32 {
+        self.inner.axis_value(axis)
+    }
+
+    #[inline]
+    pub fn orientation(&self) -> f32 {
+        self.axis_value(Axis::Orientation)
+    }
+
+    #[inline]
+    pub fn pressure(&self) -> f32 {
+        self.axis_value(Axis::Pressure)
+    }
+
+    #[inline]
+    pub fn x(&self) -> f32 {
+        self.axis_value(Axis::X)
+    }
+
+    #[inline]
+    pub fn y(&self) -> f32 {
+        self.axis_value(Axis::Y)
+    }
+
+    #[inline]
+    pub fn size(&self) -> f32 {
+        self.axis_value(Axis::Size)
+    }
+
+    #[inline]
+    pub fn tool_major(&self) -> f32 {
+        self.axis_value(Axis::ToolMajor)
+    }
+
+    #[inline]
+    pub fn tool_minor(&self) -> f32 {
+        self.axis_value(Axis::ToolMinor)
+    }
+
+    #[inline]
+    pub fn touch_major(&self) -> f32 {
+        self.axis_value(Axis::TouchMajor)
+    }
+
+    #[inline]
+    pub fn touch_minor(&self) -> f32 {
+        self.axis_value(Axis::TouchMinor)
+    }
+}
+
+/// An iterator over the pointers in a [`HistoricalMotionEvent`].
+#[derive(Debug)]
+pub struct HistoricalPointersIter<'a> {
+    pub(crate) inner: HistoricalPointersIterImpl<'a>,
+}
+
+impl<'a> Iterator for HistoricalPointersIter<'a> {
+    type Item = HistoricalPointer<'a>;
+    fn next(&mut self) -> Option<HistoricalPointer<'a>> {
+        self.inner.next()
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.inner.size_hint()
+    }
+}
+
+impl<'a> ExactSizeIterator for HistoricalPointersIter<'a> {
+    fn len(&self) -> usize {
+        self.inner.len()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn accepts_keycode(filter: &InputFilter, keycode: Keycode) -> bool {
+        let keycode: u32 = keycode.into();
+        let keycode = keycode as usize;
+        keycode >= INPUT_FILTER_KEYCODE_COUNT
+            || filter.keycodes[keycode / 64] & (1 << (keycode % 64)) != 0
+    }
+
+    #[test]
+    fn input_filter_accepts_all_by_default() {
+        let filter = InputFilter::new();
+        assert_eq!(filter.motion_source_mask, u32::MAX);
+        assert_eq!(filter.motion_action_mask, u32::MAX);
+        assert_eq!(filter.key_source_mask, u32::MAX);
+        assert!(filter.keycodes.iter().all(|&bits| bits == u64::MAX));
+        assert!(filter.device_ids.is_empty());
+    }
+
+    #[test]
+    fn input_filter_sources() {
+        let filter = InputFilter::new()
+            .motion_sources(&[Source::Touchscreen, Source::Mouse])
+            .key_sources(&[Source::Keyboard]);
+        assert_eq!(filter.motion_source_mask, 0x00001002 | 0x00002002);
+        assert_eq!(filter.key_source_mask, 0x00000101);
+        // A gamepad shares the button class bit with a keyboard, but not its device bits
+        assert_ne!(0x00000401 & !filter.key_source_mask, 0);
+
+        let filter = InputFilter::new().motion_sources(&[]);
+        assert_eq!(filter.motion_source_mask, 0);
+    }
+
+    #[test]
+    fn input_filter_motion_actions() {
+        let filter = InputFilter::new().motion_actions(&[MotionAction::Down, MotionAction::Up]);
+        let down: u32 = MotionAction::Down.into();
+        let up: u32 = MotionAction::Up.into();
+        assert_eq!(filter.motion_action_mask, (1 << down) | (1 << up));
+
+        // Actions that don't fit in the mask can't be accepted
+        let filter = InputFilter::new().motion_actions(&[MotionAction::__Unknown(40)]);
+        assert_eq!(filter.motion_action_mask, 0);
+    }
+
+    #[test]
+    fn input_filter_keycodes() {
+        let filter = InputFilter::new().reject_keycodes(&[Keycode::VolumeUp, Keycode::VolumeDown]);
+        assert!(!accepts_keycode(&filter, Keycode::VolumeUp));
+        assert!(!accepts_keycode(&filter, Keycode::VolumeDown));
+        assert!(accepts_keycode(&filter, Keycode::A));
+        assert_eq!(
+            filter
+                .keycodes
+                .iter()
+                .map(|bits| bits.count_zeros())
+                .sum::<u32>(),
+            2
+        );
+
+        let filter = InputFilter::new()
+            .keycodes(&[Keycode::A, Keycode::VolumeUp])
+            .reject_keycodes(&[Keycode::VolumeUp]);
+        assert!(accepts_keycode(&filter, Keycode::A));
+        assert!(!accepts_keycode(&filter, Keycode::VolumeUp));
+        assert!(!accepts_keycode(&filter, Keycode::VolumeDown));
+        assert_eq!(
+            filter
+                .keycodes
+                .iter()
+                .map(|bits| bits.count_ones())
+                .sum::<u32>(),
+            1
+        );
+
+        // Keycodes beyond the bitset are ignored, and so always accepted
+        let filter = InputFilter::new()
+            .keycodes(&[])
+            .reject_keycodes(&[Keycode::__Unknown(600)]);
+        assert!(filter.keycodes.iter().all(|&bits| bits == 0));
+        assert!(accepts_keycode(&filter, Keycode::__Unknown(600)));
+    }
+
+    #[test]
+    fn input_filter_device_ids() {
+        let ids: Vec<i32> = (0..INPUT_FILTER_MAX_DEVICES as i32).collect();
+        let filter = InputFilter::new().device_ids(&ids);
+        assert_eq!(filter.device_ids, ids);
+        assert!(InputFilter::new().device_ids(&[]).device_ids.is_empty());
+    }
+
+    #[test]
+    #[should_panic]
+    fn input_filter_too_many_device_ids() {
+        let ids: Vec<i32> = (0..=INPUT_FILTER_MAX_DEVICES as i32).collect();
+        let _ = InputFilter::new().device_ids(&ids);
+    }
+}
@@ -115,6 +115,7 @@
 #![deny(clippy::manual_let_else)]
 
 use std::hash::Hash;
+use std::os::fd::RawFd;
 use std::sync::Arc;
 use std::sync::RwLock;
 use std::time::Duration;
@@ -164,7 +165,17 @@ use error::Result;
 pub mod input;
 
 mod config;
-pub use config::ConfigurationRef;
+pub use config::{ConfigChanges, ConfigurationRef, ConfigurationSnapshot};
+
+mod saved_state;
+pub use saved_state::{SavedState, StateChunk};
+
+mod watchdog;
+pub use watchdog::HandshakeWatchdog;
+
+mod frame;
+
+mod fd_sources;
 
 mod util;
 
@@ -216,6 +227,177 @@ impl From<ndk_sys::ARect> for Rect {
 pub use activity_impl::StateLoader;
 pub use activity_impl::StateSaver;
 
+/// JNI usage statistics for one of the native methods that Java calls into
+///
+/// See [`AndroidApp::jni_stats`]
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub struct JniEntryStats {
+    /// The name of the native method
+    pub name: &'static str,
+
+    /// The number of times the method has been called
+    pub calls: u64,
+
+    /// The number of JNI functions that the method has called
+    pub jni_calls: u64,
+
+    /// The number of JNI local references that the method has created
+    pub local_refs: u64,
+
+    /// The total time spent in the method
+    ///
+    /// This includes the time spent in any application callbacks, such as for delivering
+    /// input events.
+    pub total_time: Duration,
+
+    /// The longest time spent in a single call of the method
+    pub max_time: Duration,
+}
+
+/// A histogram of latencies, with logarithmic buckets
+///
+/// See [`AndroidApp::lifecycle_latency_stats`]
+#[derive(Clone, Copy, Debug, Default, Eq, PartialEq)]
+pub struct LatencyHistogram {
+    /// The number of latencies that have been recorded
+    pub count: u64,
+
+    /// The sum of the latencies
+    pub total: Duration,
+
+    /// The longest latency
+    pub max: Duration,
+
+    /// The number of latencies in each bucket, see [`LatencyHistogram::bucket_range`]
+    pub buckets: [u64; LatencyHistogram::BUCKETS],
+}
+
+impl LatencyHistogram {
+    /// The number of buckets in a histogram
+    pub const BUCKETS: usize = 24;
+
+    /// The range of latencies that are counted by bucket `i`
+    ///
+    /// The first bucket counts latencies under 1 microsecond and bucket `i` counts latencies
+    /// from 2<sup>i-1</sup> up to 2<sup>i</sup> microseconds, except that the last bucket has no
+    /// upper bound.
+    pub fn bucket_range(i: usize) -> std::ops::Range<Duration> {
+        assert!(i < Self::BUCKETS, "Bucket index out of range");
+        let start = if i == 0 {
+            Duration::ZERO
+        } else {
+            Duration::from_micros(1 << (i - 1))
+        };
+        let end = if i == Self::BUCKETS - 1 {
+            Duration::MAX
+        } else {
+            Duration::from_micros(1 << i)
+        };
+        start..end
+    }
+
+    /// The bucket that a latency is counted in
+    pub(crate) fn bucket_index(latency: Duration) -> usize {
+        let micros = latency.as_micros() as u64;
+        let bucket = (u64::BITS - micros.leading_zeros()) as usize;
+        bucket.min(Self::BUCKETS - 1)
+    }
+
+    /// An upper bound for the given quantile (from `0.0` to `1.0`) of the latencies, such as
+    /// `0.99` for the 99th percentile, or `None` if no latencies have been recorded
+    ///
+    /// This is the end of the bucket that contains the quantile, or the longest latency if
+    /// that's shorter.
+    pub fn quantile(&self, quantile: f64) -> Option<Duration> {
+        if self.count == 0 {
+            return None;
+        }
+        let rank = ((quantile.clamp(0.0, 1.0) * self.count as f64).ceil() as u64).max(1);
+        let mut seen = 0;
+        for (i, count) in self.buckets.iter().enumerate() {
+            seen += count;
+            if seen >= rank {
+                return Some(Self::bucket_range(i).end.min(self.max));
+            }
+        }
+        Some(self.max)
+    }
+
+    /// The mean latency, or `None` if no latencies have been recorded
+    pub fn mean(&self) -> Option<Duration> {
+        if self.count == 0 {
+            return None;
+        }
+        Some(Duration::from_nanos(
+            (self.total.as_nanos() / self.count as u128) as u64,
+        ))
+    }
+}
+
+/// Latency statistics for handling one kind of lifecycle command, from the Java main thread
+/// sending the command to the Java main thread being unblocked
+///
+/// See [`AndroidApp::lifecycle_latency_stats`]
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub struct LifecycleLatencyStats {
+    /// The name of the command, which is the name of the corresponding [`MainEvent`] for
+    /// commands that are delivered to the application
+    pub name: &'static str,
+
+    /// From the command being sent by the Java main thread to it being read by the
+    /// application's main thread, in [`AndroidApp::poll_events`]
+    pub queued: LatencyHistogram,
+
+    /// The pre-processing of the command by `android-activity`, before the application's
+    /// callback is called, such as updating the native window or configuration
+    pub pre_exec: LatencyHistogram,
+
+    /// The application's handling of the command, by its [`AndroidApp::poll_events`] callback
+    pub callback: LatencyHistogram,
+
+    /// The post-processing of the command by `android-activity`, after the application's
+    /// callback has returned
+    pub post_exec: LatencyHistogram,
+
+    /// For commands that the Java main thread waits for, from the command being acknowledged
+    /// by the application's main thread to the Java main thread waking up
+    pub unblock: LatencyHistogram,
+
+    /// For commands that the Java main thread waits for, the whole time that it waited
+    ///
+    /// The Java main thread waits for `Start`, `Resume`, `Pause` and `Stop` to be
+    /// pre-processed, for `InitWindow` or `TerminateWindow` and `SaveState` to be
+    /// post-processed (so this includes the application's callback) and for `Destroy` until
+    /// the application's main thread exits. A long wait can cause an "Application Not
+    /// Responding" (ANR) error.
+    ///
+    /// With [`LifecycleHandoff::NonBlocking`], only `TerminateWindow`, `SaveState` and
+    /// `Destroy` are waited for.
+    pub wait: LatencyHistogram,
+}
+
+/// How lifecycle changes are handed over from the Java main thread to the application's main
+/// thread
+///
+/// See [`AndroidApp::set_lifecycle_handoff`]
+#[derive(Clone, Copy, Debug, Default, Eq, PartialEq)]
+pub enum LifecycleHandoff {
+    /// The Java main thread waits for the application's main thread to handle each change to
+    /// the activity state or window before returning to Android
+    #[default]
+    Blocking,
+
+    /// The Java main thread only waits for a window to be terminated or a state to be saved, for
+    /// up to `window_teardown_timeout`
+    ///
+    /// Changes to the activity state and new windows are handed over without waiting for them
+    /// to be handled. Each new window is handed over with its own reference, which is only
+    /// released after the corresponding [`MainEvent::TerminateWindow`] has been handled, so the
+    /// window stays valid for the application's main thread even if the Java main thread has
+    /// moved on.
+    NonBlocking { window_teardown_timeout: Duration },
+}
+
 /// An application event delivered during [`AndroidApp::poll_events`]
 #[non_exhaustive]
 #[derive(Debug)]
@@ -272,7 +454,12 @@ pub enum MainEvent<'a> {
     /// You can get a copy of the latest [`ndk::configuration::Configuration`] by calling
     /// [`AndroidApp::config()`]
     #[non_exhaustive]
-    ConfigChanged {},
+    ConfigChanged {
+        /// What changed since the previous configuration, so that applications
+        /// can skip work (such as recreating swapchains or reloading fonts)
+        /// that doesn't depend on anything that changed.
+        changes: ConfigChanges,
+    },
 
     /// Command from main thread: the system is running low on memory.
     /// Try to reduce your memory use.
@@ -305,7 +492,50 @@ pub enum MainEvent<'a> {
 
     /// Command from main thread: the app's insets have changed.
     #[non_exhaustive]
-    InsetsChanged {},
+    InsetsChanged {
+        /// Which insets changed (only GameActivity reports insets changes)
+        changes: InsetsChanges,
+    },
+
+    /// A new frame is starting, once per vsync, while frame events are enabled via
+    /// [`AndroidApp::set_frame_events()`]
+    ///
+    /// Timestamps are in the `CLOCK_MONOTONIC` time base, like [`std::time::Instant`].
+    #[non_exhaustive]
+    Frame {
+        /// When the frame started, as reported by `AChoreographer`
+        frame_time_nanos: i64,
+
+        /// The vsync ID of the frame timeline that the system prefers (API level 33+)
+        ///
+        /// This can be passed on to APIs that pace frames, such as
+        /// `ASurfaceTransaction_setFrameTimeline`.
+        vsync_id: Option<i64>,
+
+        /// When rendering for the preferred frame timeline needs to be finished by, in order to be
+        /// presented on time (API level 33+)
+        deadline_nanos: Option<i64>,
+    },
+}
+
+bitflags! {
+    /// The window insets that changed, as reported by [`MainEvent::InsetsChanged`]
+    ///
+    /// There is one flag for each [WindowInsetsCompat.Type](https://developer.android.com/reference/androidx/core/view/WindowInsetsCompat.Type),
+    /// plus the display's waterfall insets.
+    #[derive(Clone, Copy, Debug, Default, Eq, Hash, PartialEq)]
+    pub struct InsetsChanges: u32 {
+        const CAPTION_BAR = 1 << 0;
+        const DISPLAY_CUTOUT = 1 << 1;
+        const IME = 1 << 2;
+        const MANDATORY_SYSTEM_GESTURES = 1 << 3;
+        const NAVIGATION_BARS = 1 << 4;
+        const STATUS_BARS = 1 << 5;
+        const SYSTEM_BARS = 1 << 6;
+        const SYSTEM_GESTURES = 1 << 7;
+        const TAPPABLE_ELEMENT = 1 << 8;
+        const WATERFALL = 1 << 9;
+    }
 }
 
 /// An event delivered during [`AndroidApp::poll_events`]
@@ -315,6 +545,113 @@ pub enum PollEvent<'a> {
     Wake,
     Timeout,
     Main(MainEvent<'a>),
+
+    /// A file descriptor that was registered with [`AndroidApp::register_fd()`] is ready
+    #[non_exhaustive]
+    Fd {
+        /// The token that was returned when the file descriptor was registered
+        token: Token,
+
+        /// Which events the file descriptor is ready for
+        events: FdEvents,
+    },
+}
+
+/// Identifies a file descriptor that was registered with [`AndroidApp::register_fd()`]
+#[derive(Clone, Copy, Debug, Eq, Hash, Ord, PartialEq, PartialOrd)]
+pub struct Token(u64);
+
+bitflags! {
+    /// The events that a file descriptor can be ready for, as reported by [`PollEvent::Fd`]
+    ///
+    /// These are the looper's `ALOOPER_EVENT_*` flags.
+    #[derive(Clone, Copy, Debug, Default, Eq, Hash, PartialEq)]
+    pub struct FdEvents: u32 {
+        /// The file descriptor is available for reading
+        const INPUT = ndk_sys::ALOOPER_EVENT_INPUT as u32;
+
+        /// The file descriptor is available for writing
+        const OUTPUT = ndk_sys::ALOOPER_EVENT_OUTPUT as u32;
+
+        /// An error occurred on the file descriptor, which is always reported
+        const ERROR = ndk_sys::ALOOPER_EVENT_ERROR as u32;
+
+        /// The file descriptor was hung up, such as when the other end of a pipe or socket was
+        /// closed, which is always reported
+        const HANGUP = ndk_sys::ALOOPER_EVENT_HANGUP as u32;
+
+        /// The file descriptor is invalid, such as when it was closed without being
+        /// unregistered first, which is always reported
+        const INVALID = ndk_sys::ALOOPER_EVENT_INVALID as u32;
+    }
+}
+
+/// The events that were delivered by one call of [`AndroidApp::poll_events_batch`]
+#[derive(Clone, Copy, Debug, Default, Eq, PartialEq)]
+pub struct PollBatchStats {
+    /// How many times the looper was polled, including the last poll, which found nothing
+    /// ready (unless the batch was cut short)
+    pub polls: u32,
+
+    /// The number of lifecycle events ([`PollEvent::Main`]), other than
+    /// [`MainEvent::InputAvailable`]
+    pub main_events: u32,
+
+    /// The number of [`MainEvent::InputAvailable`] events
+    pub input_available: u32,
+
+    /// The number of [`PollEvent::Wake`] events
+    pub wakes: u32,
+
+    /// The number of [`PollEvent::Fd`] events
+    pub fds: u32,
+
+    /// Whether nothing was ready before the timeout, in which case [`PollEvent::Timeout`] was
+    /// the only event
+    pub timed_out: bool,
+}
+
+impl PollBatchStats {
+    /// The maximum number of times that the looper is polled by one call of
+    /// [`AndroidApp::poll_events_batch`], so that a steady stream of events can't keep the
+    /// application from returning to its own loop
+    const MAX_POLLS: u32 = 16;
+
+    /// Calls `poll_once` until it returns `false`, because nothing was ready, polling without
+    /// a timeout after the first call
+    pub(crate) fn drain(
+        timeout: Option<Duration>,
+        callback: &mut dyn FnMut(PollEvent<'_>),
+        mut poll_once: impl FnMut(Option<Duration>, &mut dyn FnMut(PollEvent<'_>)) -> bool,
+    ) -> Self {
+        let mut stats = Self::default();
+        let mut polls = 0;
+        let mut counted = |event: PollEvent<'_>| {
+            match &event {
+                PollEvent::Wake => stats.wakes += 1,
+                PollEvent::Timeout => stats.timed_out = true,
+                PollEvent::Main(MainEvent::InputAvailable) => stats.input_available += 1,
+                PollEvent::Main(_) => stats.main_events += 1,
+                PollEvent::Fd { .. } => stats.fds += 1,
+            }
+            callback(event);
+        };
+
+        let mut timeout = timeout;
+        while polls < Self::MAX_POLLS {
+            polls += 1;
+            if !poll_once(timeout, &mut counted) {
+                if polls == 1 {
+                    counted(PollEvent::Timeout);
+                }
+                break;
+            }
+            timeout = Some(Duration::ZERO);
+        }
+
+        stats.polls = polls;
+        stats
+    }
 }
 
 /// Indicates whether an application has handled or ignored an event
@@ -611,6 +948,70 @@ impl AndroidApp {
         self.inner.read().unwrap().poll_events(timeout, callback);
     }
 
+    /// Like [`AndroidApp::poll_events`] but keeps polling, without a timeout, until there are no
+    /// more events ready, and returns how many events of each kind were delivered
+    ///
+    /// [`AndroidApp::poll_events`] handles one looper event per call, so a burst of events, such
+    /// as when the device is rotated and the window is resized while the configuration, insets
+    /// and focus change, along with a wake up or input, can take several iterations of the
+    /// application's main loop. This delivers all of them in one call, in the same order.
+    ///
+    /// The `timeout` only applies to the first poll, and [`PollEvent::Timeout`] is only
+    /// delivered if nothing was ready before it. To bound the time that's spent in one call,
+    /// the looper is polled at most 16 times.
+    ///
+    /// # Panics
+    ///
+    /// This must only be called from your `android_main()` thread and it may panic if called
+    /// from another thread.
+    pub fn poll_events_batch<F>(&self, timeout: Option<Duration>, callback: F) -> PollBatchStats
+    where
+        F: FnMut(PollEvent<'_>),
+    {
+        self.inner
+            .read()
+            .unwrap()
+            .poll_events_batch(timeout, callback)
+    }
+
+    /// Registers a file descriptor with the `android_main` thread's looper, so
+    /// [`AndroidApp::poll_events()`] reports when it's ready via [`PollEvent::Fd`]
+    ///
+    /// This lets non-blocking sockets, pipes and other file descriptors be serviced from the
+    /// application's main loop, without a separate thread that has to wake it up with an
+    /// [`AndroidAppWaker`].
+    ///
+    /// `interest` is usually [`FdEvents::INPUT`] and/or [`FdEvents::OUTPUT`], while errors and
+    /// hang ups are always reported. Readiness is level-triggered, so a file descriptor is
+    /// reported again by each poll until it has been read from (or written to), or it's
+    /// unregistered. If several file descriptors are ready at once then they're reported by
+    /// consecutive polls, or all at once by [`AndroidApp::poll_events_batch()`].
+    ///
+    /// The returned [`Token`] identifies the file descriptor in [`PollEvent::Fd`] events.
+    ///
+    /// The file descriptor isn't owned by the `AndroidApp` and must be unregistered with
+    /// [`AndroidApp::unregister_fd()`] before it's closed. It must not already be registered
+    /// with the looper otherwise.
+    ///
+    /// This can be called from any thread.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file descriptor is invalid, or has already been registered.
+    pub fn register_fd(&self, fd: RawFd, interest: FdEvents) -> std::io::Result<Token> {
+        self.inner.read().unwrap().register_fd(fd, interest)
+    }
+
+    /// Unregisters a file descriptor that was registered with [`AndroidApp::register_fd()`]
+    ///
+    /// Returns `false` if the token isn't registered. [`PollEvent::Fd`] events are no longer
+    /// reported for the token once this returns.
+    ///
+    /// This can be called from any thread.
+    pub fn unregister_fd(&self, token: Token) -> bool {
+        self.inner.read().unwrap().unregister_fd(token)
+    }
+
     /// Creates a means to wake up the main loop while it is blocked waiting for
     /// events within [`AndroidApp::poll_events()`].
     pub fn create_waker(&self) -> AndroidAppWaker {
@@ -667,6 +1068,76 @@ impl AndroidApp {
         self.inner.write().unwrap().disable_motion_axis(axis);
     }
 
+    /// Store the pointers of motion events as separate arrays, one per field
+    ///
+    /// By default each pointer of a [`input::MotionEvent`] is stored with space for every
+    /// possible axis value. When enabled, pointer data is stored column-wise and only the
+    /// values for enabled axes (see [`Self::enable_motion_axis`]) are kept, which reduces how
+    /// much memory needs to be copied and touched for each event.
+    ///
+    /// This doesn't affect the [`input::Pointer`] API, and only takes effect for events
+    /// received after it's changed.
+    ///
+    /// This is currently only supported with the `GameActivity` backend and is otherwise
+    /// ignored.
+    pub fn set_motion_event_pointer_arrays(&self, enabled: bool) {
+        self.inner
+            .write()
+            .unwrap()
+            .set_motion_event_pointer_arrays(enabled);
+    }
+
+    /// Coalesce [`input::MotionAction::Move`] events while the application is falling behind
+    ///
+    /// When enabled, a move event that arrives before the previous event has been read is
+    /// merged into that event, if it has the same pointers and state, with the samples of the
+    /// previous event being added to its [`input::MotionEvent::history()`]. This bounds how
+    /// many events need to be dispatched each frame under load, without losing any samples.
+    ///
+    /// This is currently only supported with the `GameActivity` backend and is otherwise
+    /// ignored. (Android already batches move events that are delivered via `NativeActivity`'s
+    /// input queue)
+    pub fn set_motion_coalescing(&self, enabled: bool) {
+        self.inner.write().unwrap().set_motion_coalescing(enabled);
+    }
+
+    /// Defer decoding the axis values and history of motion events until they are read
+    ///
+    /// When enabled, the Java main thread only decodes the state of each motion event that's
+    /// needed to dispatch it (such as its action, source and pointer IDs) before queuing it, and
+    /// [`input::Pointer::axis_value`], [`input::Pointer::raw_x`] and
+    /// [`input::MotionEvent::history()`] read the rest of the event on demand, from the
+    /// application thread. This takes work off the UI thread for every event, and avoids it
+    /// entirely for events whose axis values or history are never read.
+    ///
+    /// Deferred events are never coalesced (see [`Self::set_motion_coalescing`]).
+    ///
+    /// This is currently only supported with the `GameActivity` backend, from Android 12
+    /// (API 31), and is otherwise ignored. (`NativeActivity` events are already read on demand)
+    pub fn set_deferred_motion_event_decoding(&self, enabled: bool) {
+        self.inner
+            .write()
+            .unwrap()
+            .set_deferred_motion_event_decoding(enabled);
+    }
+
+    /// Sets a declarative [`input::InputFilter`] for motion and key events, or clears it with
+    /// `None`
+    ///
+    /// The filter is checked on the Java main thread before each event is converted, so
+    /// events that the application doesn't want (such as from unused devices) are rejected
+    /// without the cost of converting and queuing them. Rejected events are reported as
+    /// unhandled and never seen by [`Self::input_events_iter`].
+    ///
+    /// The filter may be replaced at any time without blocking input delivery, and applies to
+    /// subsequent events.
+    ///
+    /// This is currently only supported with the `GameActivity` backend and is otherwise
+    /// ignored.
+    pub fn set_input_filter(&self, filter: Option<&input::InputFilter>) {
+        self.inner.read().unwrap().set_input_filter(filter);
+    }
+
     /// Explicitly request that the current input method's soft input area be
     /// shown to the user, if needed.
     ///
@@ -689,15 +1160,147 @@ impl AndroidApp {
     }
 
     /// Fetch the current input text state, as updated by any active IME.
+    ///
+    /// This returns a copy of the state. See [`Self::with_text_input_state()`] to look at the
+    /// state without copying it.
     pub fn text_input_state(&self) -> input::TextInputState {
         self.inner.read().unwrap().text_input_state()
     }
 
+    /// Call `f` with a borrowed view of the current input text state, as updated by any active
+    /// IME, and return its result.
+    ///
+    /// Unlike [`Self::text_input_state()`], this doesn't allocate or copy the text.
+    ///
+    /// The text input state is locked while `f` runs, which blocks the IME from updating it,
+    /// so `f` should return quickly.
+    ///
+    /// On NativeActivity, which doesn't support text input, `f` is called with an empty state.
+    pub fn with_text_input_state<F, R>(&self, f: F) -> R
+    where
+        F: FnOnce(&input::TextInputStateRef<'_>) -> R,
+    {
+        self.inner.read().unwrap().with_text_input_state(f)
+    }
+
+    /// Query a counter that's incremented each time the input text state changes
+    ///
+    /// This is cheap enough to check every frame, to find out whether the state has changed
+    /// since it was last read (see [`input::TextInputStateRef::generation`]), without
+    /// taking any locks or allocating.
+    ///
+    /// On NativeActivity, which doesn't support text input, this is always 0.
+    pub fn text_input_generation(&self) -> u64 {
+        self.inner.read().unwrap().text_input_generation()
+    }
+
     /// Forward the given input text `state` to any active IME.
     pub fn set_text_input_state(&self, state: input::TextInputState) {
         self.inner.read().unwrap().set_text_input_state(state);
     }
 
+    /// Query JNI usage statistics for each of the native methods that Java calls into
+    ///
+    /// This reports how many times each method has been called, how long it took and how
+    /// many JNI calls and local references it made, which can help to find expensive
+    /// callbacks. The statistics are accumulated for the lifetime of the process.
+    ///
+    /// This is currently only supported with the `GameActivity` backend and otherwise
+    /// returns an empty `Vec`. (`NativeActivity` calls into native code via C callbacks)
+    pub fn jni_stats(&self) -> Vec<JniEntryStats> {
+        self.inner.read().unwrap().jni_stats()
+    }
+
+    /// Query latency histograms for each stage of handling each lifecycle command
+    ///
+    /// Lifecycle commands, such as [`MainEvent::Pause`] or [`MainEvent::SaveState`], are sent
+    /// from the Java main thread to the application's main thread and some of them block the
+    /// Java main thread until they have been handled. This reports how long each command
+    /// waited to be read, how long it took the application to handle and how long the Java
+    /// main thread was blocked, which can help to attribute pauses and "Application Not
+    /// Responding" (ANR) errors to specific event handlers.
+    ///
+    /// Only commands that have been sent at least once are reported, and the statistics are
+    /// accumulated for the lifetime of the `Activity`.
+    pub fn lifecycle_latency_stats(&self) -> Vec<LifecycleLatencyStats> {
+        self.inner.read().unwrap().lifecycle_latency_stats()
+    }
+
+    /// Set how lifecycle changes are handed over from the Java main thread
+    ///
+    /// By default ([`LifecycleHandoff::Blocking`]), the Java main thread waits for the
+    /// application to handle each change to the activity state or window, such as
+    /// [`MainEvent::Pause`] or [`MainEvent::InitWindow`], so if the application is in the
+    /// middle of a long frame then the UI thread is stalled for the rest of that frame.
+    ///
+    /// With [`LifecycleHandoff::NonBlocking`], these changes are handed over without waiting
+    /// and the application sees them the next time it calls [`AndroidApp::poll_events`].
+    /// Android requires that a window isn't used after it has been destroyed, so the Java main
+    /// thread still waits for [`MainEvent::TerminateWindow`] to be handled, but only up to the
+    /// given timeout. After a timeout, rendering to the window will fail, but the
+    /// [`NativeWindow`] itself stays valid until the application has handled
+    /// [`MainEvent::TerminateWindow`].
+    ///
+    /// [`MainEvent::SaveState`] is also waited for with the same timeout, since the saved state
+    /// has to be returned to Android before its callback returns, and no state is saved after a
+    /// timeout. With `NativeActivity`, changes to the input queue are waited for with the same
+    /// timeout too, except that a destroyed queue is only taken away from the application once
+    /// it's not reading input, since the queue is destroyed as soon as its callback returns.
+    /// [`MainEvent::Destroy`] is always waited for.
+    ///
+    /// This applies to subsequent lifecycle changes, so it should be set at the start of
+    /// `android_main` to cover the initial window and activity state changes. If the Java main
+    /// thread is currently waiting for a lifecycle command, switching to
+    /// [`LifecycleHandoff::NonBlocking`] also ends that wait, or bounds it by the timeout
+    /// (counted from when the command was sent) for the commands above.
+    pub fn set_lifecycle_handoff(&self, handoff: LifecycleHandoff) {
+        self.inner.read().unwrap().set_lifecycle_handoff(handoff);
+    }
+
+    /// Enable a watchdog for lifecycle handshakes that stall, or disable it with `None`
+    ///
+    /// When the application stops calling [`AndroidApp::poll_events`], such as during a long
+    /// load or a deadlock, the Java main thread can be left waiting for a lifecycle command to
+    /// be handled until Android reports an "Application Not Responding" (ANR) error, without
+    /// any native context.
+    ///
+    /// Once the Java main thread has been waiting for a command for longer than the watchdog's
+    /// [`budget`](HandshakeWatchdog::budget), an error is logged with the pending command, how
+    /// long it's been since the application last called [`AndroidApp::poll_events`] and
+    /// (optionally) a backtrace that's sampled from the `android_main` thread. Frames are
+    /// reported as offsets into their modules, like in a tombstone, so they can be symbolized
+    /// with `ndk-stack` or `addr2line`.
+    ///
+    /// Each stalled handshake is only reported once. If
+    /// [`degrade_to_non_blocking`](HandshakeWatchdog::degrade_to_non_blocking) is set, the
+    /// watchdog then switches to [`LifecycleHandoff::NonBlocking`].
+    ///
+    /// Backtraces are sampled by interrupting the `android_main` thread with a real-time
+    /// signal (`SIGRTMAX - 1`), whose handler is installed the first time a backtrace is
+    /// sampled, and which is passed on to any previous handler if it wasn't sent by the
+    /// watchdog.
+    pub fn set_handshake_watchdog(&self, watchdog: Option<HandshakeWatchdog>) {
+        self.inner.read().unwrap().set_handshake_watchdog(watchdog);
+    }
+
+    /// Enable or disable [`MainEvent::Frame`] events, which are delivered once per vsync
+    ///
+    /// Instead of polling with a zero timeout, or blocking when presenting, an application can
+    /// block in [`AndroidApp::poll_events()`] and render a frame for each [`MainEvent::Frame`],
+    /// using its timestamps for animations. Frames come from the `AChoreographer` of the
+    /// `android_main` thread, and the next frame is requested as each one is delivered, so
+    /// frames are skipped while the application isn't polling for events.
+    ///
+    /// Frame events require API level 29. The vsync ID and deadline of each frame are only
+    /// known from API level 33. If frame events aren't supported, a warning is logged and no
+    /// frame events are delivered.
+    ///
+    /// This can be called from any thread and takes effect from the next time that events are
+    /// polled, which is woken up if this isn't called on the `android_main` thread.
+    pub fn set_frame_events(&self, enabled: bool) {
+        self.inner.read().unwrap().set_frame_events(enabled);
+    }
+
     /// Get an exclusive, lending iterator over buffered input events
     ///
     /// Applications are expected to call this in-sync with their rendering or
@@ -749,6 +1352,9 @@ impl AndroidApp {
     /// }
     /// ```
     ///
+    /// Alternatively, [`input::InputIterator::next_batch`] hands over all pending
+    /// events at once, as an [`input::InputBatch`].
+    ///
     /// # Panics
     ///
     /// This must only be called from your `android_main()` thread and it may panic if called
@@ -851,6 +1457,26 @@ impl AndroidApp {
         self.inner.read().unwrap().internal_data_path()
     }
 
+    /// Set the size, in bytes, above which a state stored during a [`MainEvent::SaveState`]
+    /// event is spilled to a file, or `None` to always keep saved state in memory
+    ///
+    /// By default, saved state is always kept in memory and copied into the `Bundle` that
+    /// Android saves for the `Activity`, which is intended for small amounts of state and is
+    /// limited in size. When a state is spilled, it's written to a file under
+    /// [`internal_data_path()`](Self::internal_data_path) and only a small handle for the file
+    /// is kept in memory. [`StateLoader::load_mapped()`] maps the file back into memory without
+    /// copying it.
+    ///
+    /// Spill files are only removed when a later state is spilled (or stored with
+    /// [`StateSaver::store_chunks()`]), so an application that stops spilling its state may want
+    /// to delete the `android-activity-saved-state` directory under its internal data path.
+    pub fn set_saved_state_spill_threshold(&self, threshold: Option<usize>) {
+        self.inner
+            .read()
+            .unwrap()
+            .set_saved_state_spill_threshold(threshold);
+    }
+
     /// Path to this application's external data directory
     pub fn external_data_path(&self) -> Option<std::path::PathBuf> {
         self.inner.read().unwrap().external_data_path()
@@ -867,3 +1493,107 @@ fn test_app_is_send_sync() {
     fn needs_send_sync<T: Send + Sync>() {}
     needs_send_sync::<AndroidApp>();
 }
+
+/// Runs [`PollBatchStats::drain`] with a poll closure that delivers `batches`, one per poll,
+/// and then finds nothing ready. Returns the stats, the timeout of each poll and the events
+/// that reached the callback.
+#[cfg(test)]
+fn drain_scripted(
+    timeout: Option<Duration>,
+    batches: &[&[fn() -> PollEvent<'static>]],
+    always_ready: bool,
+) -> (PollBatchStats, Vec<Option<Duration>>, Vec<String>) {
+    let mut timeouts = vec![];
+    let mut events = vec![];
+    let mut next = 0;
+    let stats = PollBatchStats::drain(
+        timeout,
+        &mut |event| events.push(format!("{event:?}")),
+        |timeout, callback| {
+            timeouts.push(timeout);
+            let batch = batches.get(next).copied().unwrap_or_default();
+            next += 1;
+            for event in batch {
+                callback(event());
+            }
+            always_ready || !batch.is_empty()
+        },
+    );
+    (stats, timeouts, events)
+}
+
+#[test]
+fn test_drain_times_out_when_nothing_is_ready() {
+    let timeout = Some(Duration::from_millis(100));
+    let (stats, timeouts, events) = drain_scripted(timeout, &[], false);
+    assert_eq!(timeouts, [timeout]);
+    assert_eq!(events, ["Timeout"]);
+    assert_eq!(
+        stats,
+        PollBatchStats {
+            polls: 1,
+            timed_out: true,
+            ..Default::default()
+        }
+    );
+}
+
+#[test]
+fn test_drain_polls_without_timeout_until_nothing_is_ready() {
+    let timeout = Some(Duration::from_millis(100));
+    let fd = || PollEvent::Fd {
+        token: Token(1),
+        events: FdEvents::INPUT,
+    };
+    let (stats, timeouts, events) = drain_scripted(
+        timeout,
+        &[
+            &[|| PollEvent::Main(MainEvent::Pause), || PollEvent::Wake],
+            &[|| PollEvent::Main(MainEvent::InputAvailable), fd],
+            &[|| PollEvent::Main(MainEvent::LowMemory)],
+        ],
+        false,
+    );
+    // Only the first poll waits, and the last poll, which found nothing, doesn't time out
+    assert_eq!(
+        timeouts,
+        [
+            timeout,
+            Some(Duration::ZERO),
+            Some(Duration::ZERO),
+            Some(Duration::ZERO)
+        ]
+    );
+    assert_eq!(events.len(), 5);
+    assert!(!events.iter().any(|event| event == "Timeout"));
+    assert_eq!(
+        stats,
+        PollBatchStats {
+            polls: 4,
+            main_events: 2,
+            input_available: 1,
+            wakes: 1,
+            fds: 1,
+            timed_out: false,
+        }
+    );
+}
+
+#[test]
+fn test_drain_stops_after_max_polls() {
+    let wake: &[fn() -> PollEvent<'static>] = &[|| PollEvent::Wake];
+    let (stats, timeouts, events) = drain_scripted(None, &[wake; 32], true);
+    let max_polls = PollBatchStats::MAX_POLLS as usize;
+    assert_eq!(timeouts.len(), max_polls);
+    assert_eq!(timeouts[0], None);
+    assert!(timeouts[1..].iter().all(|t| *t == Some(Duration::ZERO)));
+    assert_eq!(events.len(), max_polls);
+    assert_eq!(
+        stats,
+        PollBatchStats {
+            polls: PollBatchStats::MAX_POLLS,
+            wakes: PollBatchStats::MAX_POLLS,
+            ..Default::default()
+        }
+    );
+}
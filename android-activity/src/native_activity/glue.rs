@@ -3,10 +3,16 @@
 //! synchronization between the two threads.
 
 use std::{
+    cell::UnsafeCell,
+    collections::VecDeque,
     ops::Deref,
     panic::catch_unwind,
     ptr::{self, NonNull},
-    sync::{Arc, Condvar, Mutex, Weak},
+    sync::{
+        atomic::{AtomicBool, AtomicPtr, AtomicU32, AtomicU64, Ordering},
+        Arc, Condvar, Mutex, MutexGuard, Weak,
+    },
+    time::{Duration, Instant},
 };
 
 use ndk::{configuration::Configuration, input_queue::InputQueue, native_window::NativeWindow};
@@ -14,7 +20,8 @@ use ndk::{configuration::Configuration, input_queue::InputQueue, native_window::
 use crate::{
     jni_utils::CloneJavaVM,
     util::{abort_on_panic, forward_stdio_to_logcat, log_panic},
-    ConfigurationRef,
+    watchdog::{Handshakes, PendingHandshake},
+    ConfigChanges, ConfigurationRef, LatencyHistogram, LifecycleHandoff, LifecycleLatencyStats,
 };
 
 use super::{AndroidApp, Rect};
@@ -38,32 +45,393 @@ pub enum AppCmd {
     Stop = 14,
     Destroy = 15,
 }
-impl TryFrom<i8> for AppCmd {
-    type Error = ();
 
-    fn try_from(value: i8) -> Result<Self, Self::Error> {
-        match value {
-            0 => Ok(AppCmd::InputQueueChanged),
-            1 => Ok(AppCmd::InitWindow),
-            2 => Ok(AppCmd::TermWindow),
-            3 => Ok(AppCmd::WindowResized),
-            4 => Ok(AppCmd::WindowRedrawNeeded),
-            5 => Ok(AppCmd::ContentRectChanged),
-            6 => Ok(AppCmd::GainedFocus),
-            7 => Ok(AppCmd::LostFocus),
-            8 => Ok(AppCmd::ConfigChanged),
-            9 => Ok(AppCmd::LowMemory),
-            10 => Ok(AppCmd::Start),
-            11 => Ok(AppCmd::Resume),
-            12 => Ok(AppCmd::SaveState),
-            13 => Ok(AppCmd::Pause),
-            14 => Ok(AppCmd::Stop),
-            15 => Ok(AppCmd::Destroy),
-            _ => Err(()),
+impl AppCmd {
+    const COUNT: usize = 16;
+
+    const ALL: [AppCmd; AppCmd::COUNT] = [
+        AppCmd::InputQueueChanged,
+        AppCmd::InitWindow,
+        AppCmd::TermWindow,
+        AppCmd::WindowResized,
+        AppCmd::WindowRedrawNeeded,
+        AppCmd::ContentRectChanged,
+        AppCmd::GainedFocus,
+        AppCmd::LostFocus,
+        AppCmd::ConfigChanged,
+        AppCmd::LowMemory,
+        AppCmd::Start,
+        AppCmd::Resume,
+        AppCmd::SaveState,
+        AppCmd::Pause,
+        AppCmd::Stop,
+        AppCmd::Destroy,
+    ];
+
+    /// The name of the corresponding `MainEvent`, if there is one
+    fn name(self) -> &'static str {
+        match self {
+            AppCmd::InputQueueChanged => "InputQueueChanged",
+            AppCmd::InitWindow => "InitWindow",
+            AppCmd::TermWindow => "TerminateWindow",
+            AppCmd::WindowResized => "WindowResized",
+            AppCmd::WindowRedrawNeeded => "RedrawNeeded",
+            AppCmd::ContentRectChanged => "ContentRectChanged",
+            AppCmd::GainedFocus => "GainedFocus",
+            AppCmd::LostFocus => "LostFocus",
+            AppCmd::ConfigChanged => "ConfigChanged",
+            AppCmd::LowMemory => "LowMemory",
+            AppCmd::Start => "Start",
+            AppCmd::Resume => "Resume",
+            AppCmd::SaveState => "SaveState",
+            AppCmd::Pause => "Pause",
+            AppCmd::Stop => "Stop",
+            AppCmd::Destroy => "Destroy",
         }
     }
 }
 
+/// The number of nodes that a [`CmdQueue`] preallocates, so that pushing a command doesn't
+/// allocate unless more commands than this are queued at once
+const CMD_POOL_SIZE: usize = 32;
+
+#[derive(Debug)]
+struct CmdNode {
+    next: AtomicPtr<CmdNode>,
+    cmd: Option<AppCmd>,
+    written: Instant,
+
+    /// The index of the next node in the pool's free list, while this node is free
+    next_free: AtomicU32,
+}
+
+impl CmdNode {
+    fn new(cmd: Option<AppCmd>) -> *mut CmdNode {
+        Box::into_raw(Box::new(CmdNode {
+            next: AtomicPtr::new(ptr::null_mut()),
+            cmd,
+            written: Instant::now(),
+            next_free: AtomicU32::new(0),
+        }))
+    }
+}
+
+/// Returns the new top of a [`CmdQueue`]'s free list, with `index` as its top node
+fn next_free_top(top: u64, index: u32) -> u64 {
+    (top & !(u32::MAX as u64)).wrapping_add(1 << 32) | index as u64
+}
+
+/// A lock-free, multi-producer, single-consumer queue of commands for the Rust main thread
+///
+/// The Rust main thread's looper polls the `event_fd`, which is only signalled when a wake up
+/// isn't already pending, so that a burst of commands only costs a single wake up that drains
+/// all of them.
+#[derive(Debug)]
+pub struct CmdQueue {
+    event_fd: libc::c_int,
+
+    /// Where producers push new commands
+    head: AtomicPtr<CmdNode>,
+
+    /// A stub node, followed by the next command to pop (only accessed by the consumer)
+    tail: AtomicPtr<CmdNode>,
+
+    wake_pending: AtomicBool,
+
+    /// Preallocated nodes, which are only boxed when all of these are queued
+    pool: Box<[UnsafeCell<CmdNode>]>,
+
+    /// The free nodes of the `pool` form a lock-free stack, which producers pop from and the
+    /// consumer pushes to. This holds the index of the top node in its low 32 bits (or
+    /// `CMD_POOL_SIZE` if there are none) and a count of its updates in its high 32 bits, so
+    /// that a producer doesn't pop with a stale `next_free` if the top node was popped and
+    /// pushed again in the meantime.
+    free: AtomicU64,
+}
+
+// Safety: the nodes of the `pool` are only accessed by whichever thread owns them, which is
+// handed over through the atomic free list and queue links
+unsafe impl Send for CmdQueue {}
+unsafe impl Sync for CmdQueue {}
+
+impl CmdQueue {
+    fn new() -> Self {
+        let event_fd = unsafe { libc::eventfd(0, libc::EFD_CLOEXEC | libc::EFD_NONBLOCK) };
+        if event_fd < 0 {
+            panic!(
+                "could not create Rust <-> Java IPC eventfd: {}",
+                std::io::Error::last_os_error()
+            );
+        }
+        let pool = (1..=CMD_POOL_SIZE as u32)
+            .map(|next_free| {
+                UnsafeCell::new(CmdNode {
+                    next: AtomicPtr::new(ptr::null_mut()),
+                    cmd: None,
+                    written: Instant::now(),
+                    next_free: AtomicU32::new(next_free),
+                })
+            })
+            .collect();
+        let queue = Self {
+            event_fd,
+            head: AtomicPtr::new(ptr::null_mut()),
+            tail: AtomicPtr::new(ptr::null_mut()),
+            wake_pending: AtomicBool::new(false),
+            pool,
+            free: AtomicU64::new(0),
+        };
+        let stub = queue.alloc(None);
+        queue.head.store(stub, Ordering::Relaxed);
+        queue.tail.store(stub, Ordering::Relaxed);
+        queue
+    }
+
+    /// Returns a node for `cmd` from the pool, or boxes one if the pool is empty
+    fn alloc(&self, cmd: Option<AppCmd>) -> *mut CmdNode {
+        let mut top = self.free.load(Ordering::Acquire);
+        loop {
+            let index = top as u32;
+            let Some(node) = self.pool.get(index as usize).map(UnsafeCell::get) else {
+                return CmdNode::new(cmd);
+            };
+            // Safety: `next_free` may be read while another producer owns the node, which
+            // doesn't write it
+            let next = unsafe { (*node).next_free.load(Ordering::Relaxed) };
+            match self.free.compare_exchange_weak(
+                top,
+                next_free_top(top, next),
+                Ordering::Acquire,
+                Ordering::Acquire,
+            ) {
+                Ok(_) => {
+                    // Safety: we own the node until it's pushed, and only write the fields that
+                    // other producers don't read
+                    unsafe {
+                        (*node).next.store(ptr::null_mut(), Ordering::Relaxed);
+                        (*node).cmd = cmd;
+                        (*node).written = Instant::now();
+                    }
+                    return node;
+                }
+                Err(current) => top = current,
+            }
+        }
+    }
+
+    /// Returns a node to the pool, or drops it if it was boxed
+    ///
+    /// Safety: this must only be called by the consumer, for a node that has been popped
+    unsafe fn free(&self, node: *mut CmdNode) {
+        let offset = (node as usize).wrapping_sub(self.pool.as_ptr() as usize);
+        let index = offset / std::mem::size_of::<CmdNode>();
+        if index >= CMD_POOL_SIZE {
+            drop(Box::from_raw(node));
+            return;
+        }
+        let mut top = self.free.load(Ordering::Relaxed);
+        loop {
+            (*node).next_free.store(top as u32, Ordering::Relaxed);
+            match self.free.compare_exchange_weak(
+                top,
+                next_free_top(top, index as u32),
+                Ordering::Release,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => return,
+                Err(current) => top = current,
+            }
+        }
+    }
+
+    /// Push a command from any thread, and wake up the Rust main thread if needed
+    fn push(&self, cmd: AppCmd) {
+        let node = self.alloc(Some(cmd));
+        let prev = self.head.swap(node, Ordering::AcqRel);
+        // Safety: nodes are only freed by the consumer after they have been linked and
+        // popped, and `prev` can't have been popped before it's linked to `node`
+        unsafe { (*prev).next.store(node, Ordering::Release) };
+
+        // The Rust main thread drains all commands before clearing this flag
+        if self.wake_pending.swap(true, Ordering::SeqCst) {
+            return;
+        }
+        let one: u64 = 1;
+        loop {
+            match unsafe { libc::write(self.event_fd, &one as *const _ as *const _, 8) } {
+                8 => break,
+                -1 => {
+                    let err = std::io::Error::last_os_error();
+                    if err.kind() != std::io::ErrorKind::Interrupted {
+                        log::error!("Failure writing NativeActivityGlue cmd: {}", err);
+                        return;
+                    }
+                }
+                count => {
+                    log::error!(
+                        "Spurious write of {count} bytes while writing NativeActivityGlue cmd"
+                    );
+                    return;
+                }
+            }
+        }
+    }
+
+    /// Pop the next command, if there is one, along with when it was pushed
+    ///
+    /// Safety: this must only be called by the single consumer of the queue (the Rust main thread)
+    unsafe fn pop(&self) -> Option<(AppCmd, Instant)> {
+        if let Some(cmd) = self.try_pop() {
+            return Some(cmd);
+        }
+
+        // The queue looks empty, so clear the wake up flag and eventfd before checking again. A
+        // command that's pushed concurrently will either be seen by this second check or signal a
+        // new wake up.
+        //
+        // NB: this is sequentially consistent with producers setting the flag after pushing
+        // their command.
+        self.wake_pending.swap(false, Ordering::SeqCst);
+        let mut count: u64 = 0;
+        if libc::read(self.event_fd, &mut count as *mut _ as *mut _, 8) < 0 {
+            let err = std::io::Error::last_os_error();
+            if err.kind() != std::io::ErrorKind::WouldBlock {
+                log::error!("Failure reading NativeActivityGlue cmd eventfd: {}", err);
+            }
+        }
+        self.try_pop()
+    }
+
+    unsafe fn try_pop(&self) -> Option<(AppCmd, Instant)> {
+        let tail = self.tail.load(Ordering::Relaxed);
+        let next = (*tail).next.load(Ordering::Acquire);
+        if next.is_null() {
+            // Empty, or a producer hasn't finished linking its command yet, in which case it
+            // will signal the eventfd once it has.
+            return None;
+        }
+        // `next` becomes the new stub node, once its command has been taken
+        self.tail.store(next, Ordering::Relaxed);
+        self.free(tail);
+        (*next).cmd.take().map(|cmd| (cmd, (*next).written))
+    }
+}
+
+impl Drop for CmdQueue {
+    fn drop(&mut self) {
+        let mut node = *self.tail.get_mut();
+        while !node.is_null() {
+            // Safety: we have exclusive access to the queue and its nodes
+            unsafe {
+                let next = (*node).next.load(Ordering::Relaxed);
+                self.free(node);
+                node = next;
+            }
+        }
+        unsafe {
+            libc::close(self.event_fd);
+        }
+    }
+}
+
+/// A stage of handling a command, see [`LifecycleLatencyStats`]
+#[derive(Clone, Copy, Debug)]
+enum CmdStage {
+    Queued,
+    PreExec,
+    Callback,
+    PostExec,
+    Unblock,
+    Wait,
+}
+
+impl CmdStage {
+    const COUNT: usize = 6;
+}
+
+/// A [`LatencyHistogram`] that's updated by one thread and may be read by any thread
+#[derive(Debug, Default)]
+struct AtomicLatencyHistogram {
+    count: AtomicU64,
+    total_nanos: AtomicU64,
+    max_nanos: AtomicU64,
+    buckets: [AtomicU64; LatencyHistogram::BUCKETS],
+}
+
+impl AtomicLatencyHistogram {
+    fn record(&self, latency: Duration) {
+        let nanos = latency.as_nanos() as u64;
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.total_nanos.fetch_add(nanos, Ordering::Relaxed);
+        self.buckets[LatencyHistogram::bucket_index(latency)].fetch_add(1, Ordering::Relaxed);
+        // There's only one writer, so this doesn't need to compare and swap
+        if nanos > self.max_nanos.load(Ordering::Relaxed) {
+            self.max_nanos.store(nanos, Ordering::Relaxed);
+        }
+    }
+
+    fn load(&self) -> LatencyHistogram {
+        let mut buckets = [0; LatencyHistogram::BUCKETS];
+        for (bucket, count) in buckets.iter_mut().zip(&self.buckets) {
+            *bucket = count.load(Ordering::Relaxed);
+        }
+        LatencyHistogram {
+            count: self.count.load(Ordering::Relaxed),
+            total: Duration::from_nanos(self.total_nanos.load(Ordering::Relaxed)),
+            max: Duration::from_nanos(self.max_nanos.load(Ordering::Relaxed)),
+            buckets,
+        }
+    }
+}
+
+/// Latency histograms for each stage of handling each command
+///
+/// The `Unblock` and `Wait` stages are recorded by the Java main thread and the other stages
+/// are recorded by the Rust main thread.
+#[derive(Debug, Default)]
+pub struct CmdStats {
+    latency: [[AtomicLatencyHistogram; CmdStage::COUNT]; AppCmd::COUNT],
+
+    /// The command that the Rust main thread is handling, and when its pre-processing finished
+    /// (only accessed by the Rust main thread)
+    callback_start: Mutex<Option<(AppCmd, Instant)>>,
+}
+
+impl CmdStats {
+    fn record(&self, cmd: AppCmd, stage: CmdStage, latency: Duration) {
+        self.latency[cmd as usize][stage as usize].record(latency);
+    }
+
+    /// Record how long the Java main thread waited for `cmd`, which it sent at `start`, given
+    /// when the Rust main thread last acknowledged a command
+    fn record_wait(&self, cmd: AppCmd, start: Instant, ack: Option<Instant>) {
+        let now = Instant::now();
+        if let Some(ack) = ack.filter(|ack| *ack >= start) {
+            self.record(cmd, CmdStage::Unblock, now - ack);
+        }
+        self.record(cmd, CmdStage::Wait, now - start);
+    }
+
+    pub fn lifecycle_latency_stats(&self) -> Vec<LifecycleLatencyStats> {
+        AppCmd::ALL
+            .iter()
+            .map(|&cmd| {
+                let stages = &self.latency[cmd as usize];
+                LifecycleLatencyStats {
+                    name: cmd.name(),
+                    queued: stages[CmdStage::Queued as usize].load(),
+                    pre_exec: stages[CmdStage::PreExec as usize].load(),
+                    callback: stages[CmdStage::Callback as usize].load(),
+                    post_exec: stages[CmdStage::PostExec as usize].load(),
+                    unblock: stages[CmdStage::Unblock as usize].load(),
+                    wait: stages[CmdStage::Wait as usize].load(),
+                }
+            })
+            .filter(|stats| stats.queued.count > 0)
+            .collect()
+    }
+}
+
 #[derive(Clone, Copy, Eq, PartialEq, Debug)]
 pub enum State {
     Init,
@@ -77,6 +445,9 @@ pub enum State {
 pub struct WaitableNativeActivityState {
     pub activity: *mut ndk_sys::ANativeActivity,
 
+    pub cmd_queue: CmdQueue,
+    pub cmd_stats: CmdStats,
+
     pub mutex: Mutex<NativeActivityState>,
     pub cond: Condvar,
 }
@@ -88,6 +459,24 @@ pub struct NativeActivityGlue {
 unsafe impl Send for NativeActivityGlue {}
 unsafe impl Sync for NativeActivityGlue {}
 
+impl Handshakes for NativeActivityGlue {
+    fn pending_handshake(&self) -> Option<PendingHandshake> {
+        let guard = self.mutex.lock().unwrap();
+        guard
+            .pending_handshake
+            .map(|(cmd, start)| PendingHandshake {
+                name: cmd.name(),
+                waited: start.elapsed(),
+            })
+    }
+
+    fn degrade_to_non_blocking(&self, window_teardown_timeout: Duration) {
+        self.set_lifecycle_handoff(LifecycleHandoff::NonBlocking {
+            window_teardown_timeout,
+        });
+    }
+}
+
 impl Deref for NativeActivityGlue {
     type Target = WaitableNativeActivityState;
 
@@ -140,12 +529,18 @@ impl NativeActivityGlue {
     /// Returns the file descriptor that needs to be polled by the Rust main thread
     /// for events/commands from the JVM thread
     pub fn cmd_read_fd(&self) -> libc::c_int {
-        self.mutex.lock().unwrap().msg_read
+        self.cmd_queue.event_fd
     }
 
     /// For the Rust main thread to read a single pending command sent from the JVM main thread
+    ///
+    /// All pending commands should be read each time the `cmd_read_fd()` is ready.
     pub fn read_cmd(&self) -> Option<AppCmd> {
-        self.inner.mutex.lock().unwrap().read_cmd()
+        // Safety: this is only called by the Rust main thread
+        let (cmd, written) = unsafe { self.cmd_queue.pop() }?;
+        self.cmd_stats
+            .record(cmd, CmdStage::Queued, written.elapsed());
+        Some(cmd)
     }
 
     /// For the Rust main thread to get an [`InputQueue`] that wraps the AInputQueue pointer
@@ -164,6 +559,7 @@ impl NativeActivityGlue {
         if guard.input_queue.is_null() {
             return None;
         }
+        guard.input_queue_readers += 1;
 
         unsafe {
             // Reattach the input queue to the looper so future input will again deliver an
@@ -175,6 +571,15 @@ impl NativeActivityGlue {
         }
     }
 
+    /// For an `InputReceiver` that got the input queue from `looper_attached_input_queue` to
+    /// release it
+    pub fn release_input_queue(&self) {
+        let mut guard = self.mutex.lock().unwrap();
+        guard.input_queue_readers -= 1;
+        // The Java main thread may be waiting to take away a destroyed input queue
+        self.cond.notify_all();
+    }
+
     pub fn detach_input_queue_from_looper(&self) {
         unsafe {
             self.inner
@@ -189,6 +594,11 @@ impl NativeActivityGlue {
         self.mutex.lock().unwrap().config.clone()
     }
 
+    /// Returns what changed with the last `AppCmd::ConfigChanged` command
+    pub fn take_config_changes(&self) -> ConfigChanges {
+        std::mem::take(&mut self.mutex.lock().unwrap().config_changes)
+    }
+
     pub fn content_rect(&self) -> Rect {
         self.mutex.lock().unwrap().content_rect.into()
     }
@@ -208,9 +618,10 @@ pub enum NativeThreadState {
 
 #[derive(Debug)]
 pub struct NativeActivityState {
-    pub msg_read: libc::c_int,
-    pub msg_write: libc::c_int,
     pub config: ConfigurationRef,
+    /// What changed with the last `AppCmd::ConfigChanged` command, which is
+    /// reported via the corresponding `MainEvent::ConfigChanged`
+    pub config_changes: ConfigChanges,
     pub saved_state: Vec<u8>,
     pub input_queue: *mut ndk_sys::AInputQueue,
     pub window: Option<NativeWindow>,
@@ -218,7 +629,11 @@ pub struct NativeActivityState {
     pub activity_state: State,
     pub destroy_requested: bool,
     pub thread_state: NativeThreadState,
-    pub app_has_saved_state: bool,
+
+    /// The number of `SaveState` commands that have been sent and handled, so a state that's
+    /// only saved after the Java main thread stopped waiting for it isn't taken for a later one
+    pub save_states_sent: u64,
+    pub save_states_handled: u64,
 
     /// Set as soon as the Java main thread notifies us of an
     /// `onDestroyed` callback.
@@ -226,59 +641,45 @@ pub struct NativeActivityState {
     pub redraw_needed: bool,
     pub pending_input_queue: *mut ndk_sys::AInputQueue,
     pub pending_window: Option<NativeWindow>,
+
+    /// The number of `InputReceiver`s that are reading from `input_queue`, which can only be
+    /// taken away from the Rust main thread while there are none
+    pub input_queue_readers: usize,
+
+    pub lifecycle_handoff: LifecycleHandoff,
+
+    /// The window that Android has given us and not yet destroyed, from the Java main
+    /// thread's point of view, which may not have been handed over yet
+    pub java_window: Option<NativeWindow>,
+
+    /// The windows for `InitWindow` commands that were sent without waiting for them to be
+    /// handled, in order, which are taken over by the Rust main thread in `pre_exec_cmd`
+    pub handoff_windows: VecDeque<NativeWindow>,
+
+    /// The number of `TermWindow` commands that have been sent and handled, so the Java main
+    /// thread can wait for the last one to be handled
+    pub window_terms_sent: u64,
+    pub window_terms_handled: u64,
+
+    /// When the Rust main thread last acknowledged a command that the Java main thread may be
+    /// waiting for
+    pub cmd_ack_time: Option<Instant>,
+
+    /// The command that the Java main thread is currently waiting for, and when it started
+    /// waiting, which is checked by the handshake watchdog
+    pub pending_handshake: Option<(AppCmd, Instant)>,
 }
 
 impl NativeActivityState {
-    pub fn read_cmd(&mut self) -> Option<AppCmd> {
-        let mut cmd_i: i8 = 0;
-        loop {
-            match unsafe { libc::read(self.msg_read, &mut cmd_i as *mut _ as *mut _, 1) } {
-                1 => {
-                    let cmd = AppCmd::try_from(cmd_i);
-                    return match cmd {
-                        Ok(cmd) => Some(cmd),
-                        Err(_) => {
-                            log::error!("Spurious, unknown NativeActivityGlue cmd: {}", cmd_i);
-                            None
-                        }
-                    };
-                }
-                -1 => {
-                    let err = std::io::Error::last_os_error();
-                    if err.kind() != std::io::ErrorKind::Interrupted {
-                        log::error!("Failure reading NativeActivityGlue cmd: {}", err);
-                        return None;
-                    }
-                }
-                count => {
-                    log::error!(
-                        "Spurious read of {count} bytes while reading NativeActivityGlue cmd"
-                    );
-                    return None;
-                }
-            }
-        }
-    }
-
-    fn write_cmd(&mut self, cmd: AppCmd) {
-        let cmd = cmd as i8;
-        loop {
-            match unsafe { libc::write(self.msg_write, &cmd as *const _ as *const _, 1) } {
-                1 => break,
-                -1 => {
-                    let err = std::io::Error::last_os_error();
-                    if err.kind() != std::io::ErrorKind::Interrupted {
-                        log::error!("Failure writing NativeActivityGlue cmd: {}", err);
-                        return;
-                    }
-                }
-                count => {
-                    log::error!(
-                        "Spurious write of {count} bytes while writing NativeActivityGlue cmd"
-                    );
-                    return;
-                }
-            }
+    /// How long the Java main thread waits for a window to be terminated (or for another
+    /// command, once the handoff has been switched to non-blocking while it was waiting), if the
+    /// handoff is non-blocking
+    fn window_teardown_timeout(&self) -> Option<Duration> {
+        match self.lifecycle_handoff {
+            LifecycleHandoff::Blocking => None,
+            LifecycleHandoff::NonBlocking {
+                window_teardown_timeout,
+            } => Some(window_teardown_timeout),
         }
     }
 
@@ -327,16 +728,6 @@ impl WaitableNativeActivityState {
         saved_state_in: *const libc::c_void,
         saved_state_size: libc::size_t,
     ) -> Self {
-        let mut msgpipe: [libc::c_int; 2] = [-1, -1];
-        unsafe {
-            if libc::pipe(msgpipe.as_mut_ptr()) != 0 {
-                panic!(
-                    "could not create  Rust <-> Java IPC pipe: {}",
-                    std::io::Error::last_os_error()
-                );
-            }
-        }
-
         let saved_state = if saved_state_in.is_null() {
             Vec::new()
         } else {
@@ -357,10 +748,11 @@ impl WaitableNativeActivityState {
 
         Self {
             activity,
+            cmd_queue: CmdQueue::new(),
+            cmd_stats: CmdStats::default(),
             mutex: Mutex::new(NativeActivityState {
-                msg_read: msgpipe[0],
-                msg_write: msgpipe[1],
                 config,
+                config_changes: ConfigChanges::empty(),
                 saved_state,
                 input_queue: ptr::null_mut(),
                 window: None,
@@ -368,11 +760,20 @@ impl WaitableNativeActivityState {
                 activity_state: State::Init,
                 destroy_requested: false,
                 thread_state: NativeThreadState::Init,
-                app_has_saved_state: false,
+                save_states_sent: 0,
+                save_states_handled: 0,
                 destroyed: false,
                 redraw_needed: false,
                 pending_input_queue: ptr::null_mut(),
                 pending_window: None,
+                input_queue_readers: 0,
+                lifecycle_handoff: LifecycleHandoff::default(),
+                java_window: None,
+                handoff_windows: VecDeque::new(),
+                window_terms_sent: 0,
+                window_terms_handled: 0,
+                cmd_ack_time: None,
+                pending_handshake: None,
             }),
             cond: Condvar::new(),
         }
@@ -382,32 +783,34 @@ impl WaitableNativeActivityState {
         let mut guard = self.mutex.lock().unwrap();
         guard.destroyed = true;
 
-        unsafe {
-            guard.write_cmd(AppCmd::Destroy);
-            while guard.thread_state != NativeThreadState::Stopped {
-                guard = self.cond.wait(guard).unwrap();
-            }
-
-            libc::close(guard.msg_read);
-            guard.msg_read = -1;
-            libc::close(guard.msg_write);
-            guard.msg_write = -1;
+        // NB: the command queue and its eventfd are only freed once the last reference to
+        // this state is dropped, after the Rust main thread has stopped
+        let waited = guard.thread_state != NativeThreadState::Stopped;
+        let start = Instant::now();
+        if waited {
+            guard.pending_handshake = Some((AppCmd::Destroy, start));
+        }
+        self.cmd_queue.push(AppCmd::Destroy);
+        while guard.thread_state != NativeThreadState::Stopped {
+            guard = self.cond.wait(guard).unwrap();
+        }
+        if waited {
+            self.cmd_stats
+                .record_wait(AppCmd::Destroy, start, guard.cmd_ack_time);
+            guard.pending_handshake = None;
         }
     }
 
     pub fn notify_config_changed(&self) {
-        let mut guard = self.mutex.lock().unwrap();
-        guard.write_cmd(AppCmd::ConfigChanged);
+        self.cmd_queue.push(AppCmd::ConfigChanged);
     }
 
     pub fn notify_low_memory(&self) {
-        let mut guard = self.mutex.lock().unwrap();
-        guard.write_cmd(AppCmd::LowMemory);
+        self.cmd_queue.push(AppCmd::LowMemory);
     }
 
     pub fn notify_focus_changed(&self, focused: bool) {
-        let mut guard = self.mutex.lock().unwrap();
-        guard.write_cmd(if focused {
+        self.cmd_queue.push(if focused {
             AppCmd::GainedFocus
         } else {
             AppCmd::LostFocus
@@ -415,42 +818,124 @@ impl WaitableNativeActivityState {
     }
 
     pub fn notify_window_resized(&self, native_window: *mut ndk_sys::ANativeWindow) {
-        let mut guard = self.mutex.lock().unwrap();
-        // set_window always syncs .pending_window back to .window before returning. This callback
-        // from Android can never arrive at an interim state, and validates that Android:
+        let guard = self.mutex.lock().unwrap();
+        // set_window always updates .java_window before returning, even if the window is handed
+        // over asynchronously. This callback from Android can never arrive at an interim state, and
+        // validates that Android:
         // 1. Only provides resizes in between onNativeWindowCreated and onNativeWindowDestroyed;
         // 2. Doesn't call it on a bogus window pointer that we don't know about.
-        debug_assert_eq!(guard.window.as_ref().unwrap().ptr().as_ptr(), native_window);
-        guard.write_cmd(AppCmd::WindowResized);
+        debug_assert_eq!(
+            guard.java_window.as_ref().unwrap().ptr().as_ptr(),
+            native_window
+        );
+        self.cmd_queue.push(AppCmd::WindowResized);
     }
 
     pub fn notify_window_redraw_needed(&self, native_window: *mut ndk_sys::ANativeWindow) {
-        let mut guard = self.mutex.lock().unwrap();
-        // set_window always syncs .pending_window back to .window before returning. This callback
-        // from Android can never arrive at an interim state, and validates that Android:
+        let guard = self.mutex.lock().unwrap();
+        // set_window always updates .java_window before returning, even if the window is handed
+        // over asynchronously. This callback from Android can never arrive at an interim state, and
+        // validates that Android:
         // 1. Only provides resizes in between onNativeWindowCreated and onNativeWindowDestroyed;
         // 2. Doesn't call it on a bogus window pointer that we don't know about.
-        debug_assert_eq!(guard.window.as_ref().unwrap().ptr().as_ptr(), native_window);
-        guard.write_cmd(AppCmd::WindowRedrawNeeded);
+        debug_assert_eq!(
+            guard.java_window.as_ref().unwrap().ptr().as_ptr(),
+            native_window
+        );
+        self.cmd_queue.push(AppCmd::WindowRedrawNeeded);
+    }
+
+    /// Wait for the Rust main thread to handle a command that was sent at `start`, returning
+    /// `false` if the wait has timed out
+    ///
+    /// Once the handoff is non-blocking, such as after the handshake watchdog has switched it
+    /// while the Java main thread was waiting, the wait is bounded by the window teardown
+    /// timeout.
+    fn wait_for_cmd<'a>(
+        &self,
+        guard: MutexGuard<'a, NativeActivityState>,
+        start: Instant,
+    ) -> (MutexGuard<'a, NativeActivityState>, bool) {
+        match guard.window_teardown_timeout() {
+            None => (self.cond.wait(guard).unwrap(), true),
+            Some(timeout) => match timeout.checked_sub(start.elapsed()) {
+                Some(remaining) if !remaining.is_zero() => {
+                    // NB: a timeout is reported by the next call
+                    (self.cond.wait_timeout(guard, remaining).unwrap().0, true)
+                }
+                _ => (guard, false),
+            },
+        }
+    }
+
+    /// Wait for the `TermWindow` commands that have been sent to be handled, for up to the
+    /// window teardown timeout after `start`, in non-blocking mode
+    fn wait_for_window_term<'a>(
+        &self,
+        mut guard: MutexGuard<'a, NativeActivityState>,
+        start: Instant,
+    ) -> MutexGuard<'a, NativeActivityState> {
+        // NB: the Rust main thread may exit without handling the command
+        while guard.window_terms_handled < guard.window_terms_sent
+            && guard.thread_state != NativeThreadState::Stopped
+        {
+            let in_time;
+            (guard, in_time) = self.wait_for_cmd(guard, start);
+            if !in_time {
+                log::warn!(
+                    "TerminateWindow wasn't handled within {:?}, not waiting any longer",
+                    guard.window_teardown_timeout().unwrap_or_default()
+                );
+                break;
+            }
+        }
+        guard
     }
 
     unsafe fn set_input(&self, input_queue: *mut ndk_sys::AInputQueue) {
         let mut guard = self.mutex.lock().unwrap();
 
-        // The pending_input_queue state should only be set while in this method, and since
-        // it doesn't allow re-entrance and is cleared before returning then we expect
-        // this to be null
-        debug_assert!(
-            guard.pending_input_queue.is_null(),
-            "InputQueue update clash"
-        );
-
+        // NB: pending_input_queue may still be set if a new input queue was handed over without
+        // waiting, and the Rust main thread takes it when it handles that command
+        let start = Instant::now();
         guard.pending_input_queue = input_queue;
-        guard.write_cmd(AppCmd::InputQueueChanged);
+        guard.pending_handshake = Some((AppCmd::InputQueueChanged, start));
+        self.cmd_queue.push(AppCmd::InputQueueChanged);
+
+        // The wait is bounded once the handoff is non-blocking (such as after the handshake
+        // watchdog switched it), but a destroyed input queue has to be taken away from the Rust
+        // main thread before returning, which can't be done while it's reading from the queue
+        let mut handed_over = false;
         while guard.input_queue != guard.pending_input_queue {
-            guard = self.cond.wait(guard).unwrap();
+            let in_time;
+            (guard, in_time) = self.wait_for_cmd(guard, start);
+            if in_time {
+                continue;
+            }
+            let timeout = guard.window_teardown_timeout().unwrap_or_default();
+            if !input_queue.is_null() {
+                log::warn!(
+                    "InputQueueChanged wasn't handled within {timeout:?}, handing the input queue over without waiting"
+                );
+                handed_over = true;
+                break;
+            }
+            if guard.input_queue_readers == 0 {
+                log::warn!(
+                    "InputQueueChanged wasn't handled within {timeout:?}, detaching the destroyed input queue"
+                );
+                guard.detach_input_queue_from_looper();
+                guard.input_queue = ptr::null_mut();
+            } else {
+                guard = self.cond.wait(guard).unwrap();
+            }
+        }
+        self.cmd_stats
+            .record_wait(AppCmd::InputQueueChanged, start, guard.cmd_ack_time);
+        if !handed_over {
+            guard.pending_input_queue = ptr::null_mut();
         }
-        guard.pending_input_queue = ptr::null_mut();
+        guard.pending_handshake = None;
     }
 
     unsafe fn set_window(&self, window: Option<NativeWindow>) {
@@ -461,23 +946,65 @@ impl WaitableNativeActivityState {
         // this to be None
         debug_assert!(guard.pending_window.is_none(), "NativeWindow update clash");
 
-        if guard.window.is_some() {
-            guard.write_cmd(AppCmd::TermWindow);
+        let start = Instant::now();
+        let term = guard.java_window.is_some();
+        if term {
+            self.cmd_queue.push(AppCmd::TermWindow);
+            guard.window_terms_sent += 1;
         }
-        guard.pending_window = window;
-        if guard.pending_window.is_some() {
-            guard.write_cmd(AppCmd::InitWindow);
+        guard.java_window = window.clone();
+
+        if guard.lifecycle_handoff != LifecycleHandoff::Blocking {
+            if let Some(window) = window {
+                // The Rust main thread takes over this reference, so the window stays valid for
+                // it regardless of what the Java main thread does next
+                guard.handoff_windows.push_back(window);
+                self.cmd_queue.push(AppCmd::InitWindow);
+            }
+            if term {
+                guard.pending_handshake = Some((AppCmd::TermWindow, start));
+                let mut guard = self.wait_for_window_term(guard, start);
+                self.cmd_stats
+                    .record_wait(AppCmd::TermWindow, start, guard.cmd_ack_time);
+                guard.pending_handshake = None;
+            }
+            return;
         }
-        while guard.window != guard.pending_window {
+
+        guard.pending_window = window;
+        let cmd = if guard.pending_window.is_some() {
+            self.cmd_queue.push(AppCmd::InitWindow);
+            AppCmd::InitWindow
+        } else {
+            AppCmd::TermWindow
+        };
+        guard.pending_handshake = Some((cmd, start));
+        // The wait also ends if the handoff is switched to non-blocking in the meantime (such as
+        // by the handshake watchdog), apart from a bounded wait for the window to be terminated
+        while guard.window != guard.pending_window
+            && guard.lifecycle_handoff == LifecycleHandoff::Blocking
+        {
             guard = self.cond.wait(guard).unwrap();
         }
+        if guard.window != guard.pending_window {
+            // Hand over a new window that hasn't been taken yet, as in non-blocking mode
+            if let Some(window) = guard.pending_window.take() {
+                guard.handoff_windows.push_back(window);
+            }
+            if term {
+                guard = self.wait_for_window_term(guard, start);
+            }
+        }
+        // The wait is attributed to the last command, which it ends with
+        self.cmd_stats.record_wait(cmd, start, guard.cmd_ack_time);
         guard.pending_window = None;
+        guard.pending_handshake = None;
     }
 
     unsafe fn set_content_rect(&self, rect: *const ndk_sys::ARect) {
         let mut guard = self.mutex.lock().unwrap();
         guard.content_rect = *rect;
-        guard.write_cmd(AppCmd::ContentRectChanged);
+        self.cmd_queue.push(AppCmd::ContentRectChanged);
     }
 
     unsafe fn set_activity_state(&self, state: State) {
@@ -490,25 +1017,53 @@ impl WaitableNativeActivityState {
             State::Pause => AppCmd::Pause,
             State::Stop => AppCmd::Stop,
         };
-        guard.write_cmd(cmd);
+        let start = Instant::now();
+        self.cmd_queue.push(cmd);
+        if guard.lifecycle_handoff != LifecycleHandoff::Blocking {
+            // .activity_state is updated once the Rust main thread reads the command
+            return;
+        }
 
-        while guard.activity_state != state {
+        // The wait also ends if the handoff is switched to non-blocking in the meantime (such as
+        // by the handshake watchdog)
+        guard.pending_handshake = Some((cmd, start));
+        while guard.activity_state != state && guard.lifecycle_handoff == LifecycleHandoff::Blocking
+        {
             guard = self.cond.wait(guard).unwrap();
         }
+        self.cmd_stats.record_wait(cmd, start, guard.cmd_ack_time);
+        guard.pending_handshake = None;
     }
 
     fn request_save_state(&self) -> (*mut libc::c_void, libc::size_t) {
         let mut guard = self.mutex.lock().unwrap();
 
-        // The state_saved flag should only be set while in this method, and since
-        // it doesn't allow re-entrance and is cleared before returning then we expect
-        // this to be None
-        debug_assert!(!guard.app_has_saved_state, "SaveState request clash");
-        guard.write_cmd(AppCmd::SaveState);
-        while !guard.app_has_saved_state {
-            guard = self.cond.wait(guard).unwrap();
+        let start = Instant::now();
+        guard.save_states_sent += 1;
+        let save = guard.save_states_sent;
+        guard.pending_handshake = Some((AppCmd::SaveState, start));
+        self.cmd_queue.push(AppCmd::SaveState);
+        // The wait is bounded once the handoff is non-blocking (such as after the handshake
+        // watchdog switched it). NB: the Rust main thread may exit without handling the command
+        let mut saved = true;
+        while guard.save_states_handled < save && guard.thread_state != NativeThreadState::Stopped {
+            let in_time;
+            (guard, in_time) = self.wait_for_cmd(guard, start);
+            if !in_time {
+                log::warn!(
+                    "SaveState wasn't handled within {:?}, not saving any state",
+                    guard.window_teardown_timeout().unwrap_or_default()
+                );
+                saved = false;
+                break;
+            }
+        }
+        self.cmd_stats
+            .record_wait(AppCmd::SaveState, start, guard.cmd_ack_time);
+        guard.pending_handshake = None;
+        if !saved {
+            return (ptr::null_mut(), 0);
         }
-        guard.app_has_saved_state = false;
 
         // `ANativeActivity` explicitly documents that it expects save state to be
         // given via a `malloc()` allocated pointer since it will automatically
@@ -531,6 +1086,12 @@ impl WaitableNativeActivityState {
         }
     }
 
+    pub fn set_lifecycle_handoff(&self, handoff: LifecycleHandoff) {
+        self.mutex.lock().unwrap().lifecycle_handoff = handoff;
+        // Switching to a non-blocking handoff ends (or bounds) any wait for a command
+        self.cond.notify_all();
+    }
+
     pub fn saved_state(&self) -> Option<Vec<u8>> {
         let guard = self.mutex.lock().unwrap();
         if !guard.saved_state.is_empty() {
@@ -560,6 +1121,7 @@ impl WaitableNativeActivityState {
     pub fn notify_main_thread_stopped_running(&self) {
         let mut guard = self.mutex.lock().unwrap();
         guard.thread_state = NativeThreadState::Stopped;
+        guard.cmd_ack_time = Some(Instant::now());
         self.cond.notify_one();
     }
 
@@ -570,6 +1132,7 @@ impl WaitableNativeActivityState {
         input_queue_ident: libc::c_int,
     ) {
         log::trace!("Pre: AppCmd::{:#?}", cmd);
+        let start = Instant::now();
         match cmd {
             AppCmd::InputQueueChanged => {
                 let mut guard = self.mutex.lock().unwrap();
@@ -578,11 +1141,18 @@ impl WaitableNativeActivityState {
                 if !guard.input_queue.is_null() {
                     guard.attach_input_queue_to_looper(looper, input_queue_ident);
                 }
+                guard.cmd_ack_time = Some(Instant::now());
                 self.cond.notify_one();
             }
             AppCmd::InitWindow => {
                 let mut guard = self.mutex.lock().unwrap();
-                guard.window = guard.pending_window.clone();
+                // Windows that were handed over without waiting come with their own reference,
+                // and are queued in the same order as their commands
+                guard.window = match guard.handoff_windows.pop_front() {
+                    Some(window) => Some(window),
+                    None => guard.pending_window.clone(),
+                };
+                guard.cmd_ack_time = Some(Instant::now());
                 self.cond.notify_one();
             }
             AppCmd::Resume | AppCmd::Start | AppCmd::Pause | AppCmd::Stop => {
@@ -594,14 +1164,15 @@ impl WaitableNativeActivityState {
                     AppCmd::Stop => State::Stop,
                     _ => unreachable!(),
                 };
+                guard.cmd_ack_time = Some(Instant::now());
                 self.cond.notify_one();
             }
             AppCmd::ConfigChanged => {
-                let guard = self.mutex.lock().unwrap();
+                let mut guard = self.mutex.lock().unwrap();
                 let config = ndk_sys::AConfiguration_new();
                 ndk_sys::AConfiguration_fromAssetManager(config, (*self.activity).assetManager);
                 let config = Configuration::from_ptr(NonNull::new_unchecked(config));
-                guard.config.replace(config);
+                guard.config_changes = guard.config.replace(config);
                 log::debug!("Config: {:#?}", guard.config);
             }
             AppCmd::Destroy => {
@@ -610,23 +1181,40 @@ impl WaitableNativeActivityState {
             }
             _ => {}
         }
+        let end = Instant::now();
+        self.cmd_stats.record(cmd, CmdStage::PreExec, end - start);
+        *self.cmd_stats.callback_start.lock().unwrap() = Some((cmd, end));
     }
 
     pub unsafe fn post_exec_cmd(&self, cmd: AppCmd) {
         log::trace!("Post: AppCmd::{:#?}", cmd);
+        let start = Instant::now();
+        if let Some((callback_cmd, callback_start)) =
+            self.cmd_stats.callback_start.lock().unwrap().take()
+        {
+            if callback_cmd == cmd {
+                self.cmd_stats
+                    .record(cmd, CmdStage::Callback, start - callback_start);
+            }
+        }
         match cmd {
             AppCmd::TermWindow => {
                 let mut guard = self.mutex.lock().unwrap();
                 guard.window = None;
+                guard.window_terms_handled += 1;
+                guard.cmd_ack_time = Some(Instant::now());
                 self.cond.notify_one();
             }
             AppCmd::SaveState => {
                 let mut guard = self.mutex.lock().unwrap();
-                guard.app_has_saved_state = true;
+                guard.save_states_handled += 1;
+                guard.cmd_ack_time = Some(Instant::now());
                 self.cond.notify_one();
             }
             _ => {}
         }
+        self.cmd_stats
+            .record(cmd, CmdStage::PostExec, start.elapsed());
     }
 }
 
@@ -868,6 +1456,7 @@ extern "C" fn ANativeActivity_onCreate(
             });
 
             let app = AndroidApp::new(rust_glue.clone(), jvm.clone());
+            let watchdog = app.inner.read().unwrap().watchdog.clone();
 
             rust_glue.notify_main_thread_running();
 
@@ -892,6 +1481,9 @@ extern "C" fn ANativeActivity_onCreate(
                 })
                 .unwrap_or_else(log_panic);
 
+                // The watchdog samples this thread, so it must be stopped before the thread exits
+                watchdog.stop();
+
                 // Let JVM know that our Activity can be destroyed before detaching from the JVM
                 //
                 // "Note that this method can be called from any thread; it will send a message
@@ -1,7 +1,8 @@
 use std::marker::PhantomData;
 
 use crate::input::{
-    Axis, Button, ButtonState, EdgeFlags, KeyAction, Keycode, MetaState, MotionAction,
+    Axis, Button, ButtonState, EdgeFlags, HistoricalMotionEvent, HistoricalMotionEventsIter,
+    HistoricalPointer, HistoricalPointersIter, KeyAction, Keycode, MetaState, MotionAction,
     MotionEventFlags, Pointer, PointersIter, Source, ToolType,
 };
 
@@ -128,10 +129,6 @@ impl<'a> MotionEvent<'a> {
         }
     }
 
-    /*
-    XXX: Not currently supported with GameActivity so we don't currently expose for NativeActivity
-    either, for consistency.
-
     /// Returns the size of the history contained in this event.
     ///
     /// See [the NDK
@@ -144,9 +141,12 @@ impl<'a> MotionEvent<'a> {
     /// An iterator over the historical events contained in this event.
     #[inline]
     pub fn history(&self) -> HistoricalMotionEventsIter<'_> {
-        self.ndk_event.history()
+        HistoricalMotionEventsIter {
+            inner: HistoricalMotionEventsIterImpl {
+                ndk_history_iter: self.ndk_event.history(),
+            },
+        }
     }
-    */
 
     /// Returns the state of any modifier keys that were pressed during the event.
     ///
@@ -309,6 +309,127 @@ impl<'a> ExactSizeIterator for PointersIterImpl<'a> {
     }
 }
 
+/// A view into a past moment of a motion event
+#[derive(Debug)]
+pub(crate) struct HistoricalMotionEventImpl<'a> {
+    ndk_event: ndk::event::HistoricalMotionEvent<'a>,
+}
+
+impl<'a> HistoricalMotionEventImpl<'a> {
+    #[inline]
+    pub fn history_index(&self) -> usize {
+        self.ndk_event.history_index()
+    }
+
+    #[inline]
+    pub fn event_time(&self) -> i64 {
+        self.ndk_event.event_time()
+    }
+
+    #[inline]
+    pub fn pointers(&self) -> HistoricalPointersIter<'a> {
+        HistoricalPointersIter {
+            inner: HistoricalPointersIterImpl {
+                ndk_pointers_iter: self.ndk_event.pointers(),
+            },
+        }
+    }
+}
+
+/// An iterator over all the historical moments in a [`MotionEvent`].
+#[derive(Debug)]
+pub(crate) struct HistoricalMotionEventsIterImpl<'a> {
+    ndk_history_iter: ndk::event::HistoricalMotionEventsIter<'a>,
+}
+
+impl<'a> Iterator for HistoricalMotionEventsIterImpl<'a> {
+    type Item = HistoricalMotionEvent<'a>;
+    fn next(&mut self) -> Option<HistoricalMotionEvent<'a>> {
+        self.ndk_history_iter
+            .next()
+            .map(|ndk_event| HistoricalMotionEvent {
+                inner: HistoricalMotionEventImpl { ndk_event },
+            })
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.ndk_history_iter.size_hint()
+    }
+}
+
+impl<'a> ExactSizeIterator for HistoricalMotionEventsIterImpl<'a> {
+    fn len(&self) -> usize {
+        self.ndk_history_iter.len()
+    }
+}
+
+impl<'a> DoubleEndedIterator for HistoricalMotionEventsIterImpl<'a> {
+    fn next_back(&mut self) -> Option<HistoricalMotionEvent<'a>> {
+        self.ndk_history_iter
+            .next_back()
+            .map(|ndk_event| HistoricalMotionEvent {
+                inner: HistoricalMotionEventImpl { ndk_event },
+            })
+    }
+}
+
+/// A view into a pointer at a historical moment
+#[derive(Debug)]
+pub(crate) struct HistoricalPointerImpl<'a> {
+    ndk_pointer: ndk::event::HistoricalPointer<'a>,
+}
+
+impl<'a> HistoricalPointerImpl<'a> {
+    #[inline]
+    pub fn pointer_index(&self) -> usize {
+        self.ndk_pointer.pointer_index()
+    }
+
+    #[inline]
+    pub fn pointer_id(&self) -> i32 {
+        self.ndk_pointer.pointer_id()
+    }
+
+    #[inline]
+    pub fn history_index(&self) -> usize {
+        self.ndk_pointer.history_index()
+    }
+
+    #[inline]
+    pub fn axis_value(&self, axis: Axis) -> f32 {
+        let value: u32 = axis.into();
+        let value = value as i32;
+        self.ndk_pointer.axis_value(value.into())
+    }
+}
+
+/// An iterator over the pointers in a historical motion event
+#[derive(Debug)]
+pub(crate) struct HistoricalPointersIterImpl<'a> {
+    ndk_pointers_iter: ndk::event::HistoricalPointersIter<'a>,
+}
+
+impl<'a> Iterator for HistoricalPointersIterImpl<'a> {
+    type Item = HistoricalPointer<'a>;
+    fn next(&mut self) -> Option<HistoricalPointer<'a>> {
+        self.ndk_pointers_iter
+            .next()
+            .map(|ndk_pointer| HistoricalPointer {
+                inner: HistoricalPointerImpl { ndk_pointer },
+            })
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.ndk_pointers_iter.size_hint()
+    }
+}
+
+impl<'a> ExactSizeIterator for HistoricalPointersIterImpl<'a> {
+    fn len(&self) -> usize {
+        self.ndk_pointers_iter.len()
+    }
+}
+
 /// A key event
 ///
 /// For general discussion of key events in Android, see [the relevant
@@ -435,3 +556,55 @@ pub enum InputEvent<'a> {
     KeyEvent(self::KeyEvent<'a>),
     TextEvent(crate::input::TextInputState),
 }
+
+/// The key events of an input batch, drained from the `InputQueue`.
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct KeyEventsImpl<'a> {
+    events: &'a [ndk::event::KeyEvent],
+}
+
+impl<'a> KeyEventsImpl<'a> {
+    pub(crate) fn new(events: &'a [ndk::event::KeyEvent]) -> Self {
+        Self { events }
+    }
+
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.events.len()
+    }
+
+    #[inline]
+    pub fn get(&self, index: usize) -> Option<KeyEvent<'a>> {
+        self.events.get(index).map(|ndk_event| {
+            // Safety: the event remains valid until it's finished, after the whole batch
+            // has been handled
+            KeyEvent::new(unsafe { ndk::event::KeyEvent::from_ptr(ndk_event.ptr()) })
+        })
+    }
+}
+
+/// The motion events of an input batch, drained from the `InputQueue`.
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct MotionEventsImpl<'a> {
+    events: &'a [ndk::event::MotionEvent],
+}
+
+impl<'a> MotionEventsImpl<'a> {
+    pub(crate) fn new(events: &'a [ndk::event::MotionEvent]) -> Self {
+        Self { events }
+    }
+
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.events.len()
+    }
+
+    #[inline]
+    pub fn get(&self, index: usize) -> Option<MotionEvent<'a>> {
+        self.events.get(index).map(|ndk_event| {
+            // Safety: the event remains valid until it's finished, after the whole batch
+            // has been handled
+            MotionEvent::new(unsafe { ndk::event::MotionEvent::from_ptr(ndk_event.ptr()) })
+        })
+    }
+}
@@ -2,6 +2,7 @@
 
 use std::collections::HashMap;
 use std::marker::PhantomData;
+use std::os::fd::RawFd;
 use std::panic::AssertUnwindSafe;
 use std::ptr;
 use std::ptr::NonNull;
@@ -14,11 +15,17 @@ use ndk::input_queue::InputQueue;
 use ndk::{asset::AssetManager, native_window::NativeWindow};
 
 use crate::error::InternalResult;
-use crate::input::{Axis, KeyCharacterMap, KeyCharacterMapBinding};
-use crate::input::{TextInputState, TextSpan};
+use crate::fd_sources::FdSources;
+use crate::frame::{Choreographer, FrameEvents};
+use crate::input::{Axis, InputFilter, KeyCharacterMap, KeyCharacterMapBinding};
+use crate::input::{TextInputState, TextInputStateRef, TextSpan};
 use crate::jni_utils::{self, CloneJavaVM};
+use crate::saved_state::{SavedState, SavedStateStore, StateChunk};
+use crate::watchdog::{HandshakeWatchdog, Watchdog};
 use crate::{
-    util, AndroidApp, ConfigurationRef, InputStatus, MainEvent, PollEvent, Rect, WindowManagerFlags,
+    util, AndroidApp, ConfigChanges, ConfigurationRef, FdEvents, InputStatus, JniEntryStats,
+    LifecycleHandoff, LifecycleLatencyStats, MainEvent, PollBatchStats, PollEvent, Rect, Token,
+    WindowManagerFlags,
 };
 
 pub mod input;
@@ -28,7 +35,11 @@ use self::glue::NativeActivityGlue;
 
 pub const LOOPER_ID_MAIN: libc::c_int = 1;
 pub const LOOPER_ID_INPUT: libc::c_int = 2;
-//pub const LOOPER_ID_USER: ::std::os::raw::c_uint = 3;
+pub const LOOPER_ID_FRAME: libc::c_int = 3;
+pub const LOOPER_ID_FD: libc::c_int = 4;
+// NB: user-defined identifiers used to start at 3, before the frame and fd identifiers were
+// reserved
+//pub const LOOPER_ID_USER: ::std::os::raw::c_uint = 5;
 
 /// An interface for saving application state during [MainEvent::SaveState] events
 ///
@@ -41,8 +52,42 @@ pub struct StateSaver<'a> {
 impl<'a> StateSaver<'a> {
     /// Stores the given `state` such that it will be available to load the next
     /// time that the application resumes.
+    ///
+    /// If the state is larger than the threshold set with
+    /// [`AndroidApp::set_saved_state_spill_threshold()`](crate::AndroidApp::set_saved_state_spill_threshold)
+    /// then it's written to a file and only a small handle for the file is saved in memory.
     pub fn store(&self, state: &'a [u8]) {
-        self.app.native_activity.set_saved_state(state);
+        if let Some(handle) = self
+            .app
+            .saved_state
+            .store(self.app.internal_data_path(), state)
+        {
+            self.app.native_activity.set_saved_state(&handle);
+        } else {
+            self.app.native_activity.set_saved_state(state);
+        }
+    }
+
+    /// Stores the state as a sequence of chunks, such that the chunks will be available to
+    /// load (as one state) the next time that the application resumes, and only writes the
+    /// chunks that changed
+    ///
+    /// Chunks are written to a content-addressed store under the application's internal data
+    /// path and only a small manifest, with the hash and length of each chunk, is saved in
+    /// memory. A [`StateChunk::Changed`] chunk is only written if an identical chunk isn't
+    /// already stored, and a [`StateChunk::Unchanged`] chunk refers to the chunk at the same
+    /// index in the last state that was stored (or loaded) with chunks, so it doesn't need to
+    /// be serialized again. Chunks that aren't part of the new state are removed.
+    ///
+    /// If an error is returned then nothing is stored, and the application may want to
+    /// [`store()`](Self::store) its whole state instead.
+    pub fn store_chunks(&self, chunks: &[StateChunk<'_>]) -> std::io::Result<()> {
+        let manifest = self
+            .app
+            .saved_state
+            .store_chunks(self.app.internal_data_path(), chunks)?;
+        self.app.native_activity.set_saved_state(&manifest);
+        Ok(())
     }
 }
 
@@ -56,7 +101,19 @@ pub struct StateLoader<'a> {
 impl<'a> StateLoader<'a> {
     /// Returns whatever state was saved during the last [MainEvent::SaveState] event or `None`
     pub fn load(&self) -> Option<Vec<u8>> {
-        self.app.native_activity.saved_state()
+        self.load_mapped().map(SavedState::into_vec)
+    }
+
+    /// Returns whatever state was saved during the last [MainEvent::SaveState] event or `None`,
+    /// without copying it if it was spilled to a file
+    ///
+    /// A spilled state is mapped into memory, and is only read from the file as it's accessed.
+    /// A state that was stored with chunks is reassembled from its chunks.
+    pub fn load_mapped(&self) -> Option<SavedState> {
+        let saved = self.app.native_activity.saved_state()?;
+        self.app
+            .saved_state
+            .load(saved, self.app.internal_data_path())
     }
 }
 
@@ -96,6 +153,7 @@ impl AndroidApp {
             }
         };
 
+        let watchdog = Arc::new(Watchdog::new(Arc::new(native_activity.clone())));
         let app = Self {
             inner: Arc::new(RwLock::new(AndroidAppInner {
                 jvm,
@@ -106,6 +164,11 @@ impl AndroidApp {
                 key_map_binding: Arc::new(key_map_binding),
                 key_maps: Mutex::new(HashMap::new()),
                 input_receiver: Mutex::new(None),
+                input_batch_buffer: Arc::new(Mutex::new(InputBatchBuffer::default())),
+                saved_state: SavedStateStore::default(),
+                watchdog,
+                frame_events: FrameEvents::new(Choreographer::new_clock, LOOPER_ID_FRAME),
+                fd_sources: FdSources::new(LOOPER_ID_FD),
             })),
         };
 
@@ -159,9 +222,28 @@ pub(crate) struct AndroidAppInner {
     /// InputReceiver reference which we track to ensure
     /// we don't hand out more than one receiver at a time
     input_receiver: Mutex<Option<Weak<InputReceiver>>>,
+
+    /// Reusable storage for draining the InputQueue via
+    /// `InputIterator::next_batch`
+    input_batch_buffer: Arc<Mutex<InputBatchBuffer>>,
+
+    /// Options and bookkeeping for spilling saved states to files, or storing them as chunks
+    saved_state: SavedStateStore,
+
+    /// Watches for the Java main thread being blocked by a stalled `android_main` thread
+    pub(crate) watchdog: Arc<Watchdog>,
+
+    frame_events: FrameEvents,
+
+    /// File descriptors that the application has registered with the looper
+    fd_sources: FdSources,
 }
 
 impl AndroidAppInner {
+    pub fn set_saved_state_spill_threshold(&self, threshold: Option<usize>) {
+        self.saved_state.set_spill_threshold(threshold);
+    }
+
     pub(crate) fn vm_as_ptr(&self) -> *mut c_void {
         unsafe { (*self.native_activity.activity).vm as _ }
     }
@@ -188,8 +270,35 @@ impl AndroidAppInner {
         F: FnMut(PollEvent<'_>),
     {
         trace!("poll_events");
+        self.watchdog.note_poll();
+
+        if !self.poll_once(timeout, &mut callback) {
+            callback(PollEvent::Timeout);
+        }
+    }
 
+    pub fn poll_events_batch<F>(&self, timeout: Option<Duration>, mut callback: F) -> PollBatchStats
+    where
+        F: FnMut(PollEvent<'_>),
+    {
+        trace!("poll_events_batch");
+        self.watchdog.note_poll();
+
+        PollBatchStats::drain(timeout, &mut callback, |timeout, callback| {
+            self.poll_once(timeout, callback)
+        })
+    }
+
+    /// Polls the looper once and handles whatever it returns, or returns `false` if it timed
+    /// out, without notifying the callback
+    fn poll_once(
+        &self,
+        timeout: Option<Duration>,
+        callback: &mut dyn FnMut(PollEvent<'_>),
+    ) -> bool {
         unsafe {
+            self.frame_events.sync(self.looper());
+
             let mut fd: i32 = 0;
             let mut events: i32 = 0;
             let mut source: *mut c_void = ptr::null_mut();
@@ -224,10 +333,10 @@ impl AndroidAppInner {
                 }
                 ndk_sys::ALOOPER_POLL_TIMEOUT => {
                     trace!("ALooper_pollAll returned POLL_TIMEOUT");
-                    callback(PollEvent::Timeout);
+                    return false;
                 }
                 ndk_sys::ALOOPER_POLL_ERROR => {
-                    // If we have an IO error with our pipe to the main Java thread that's surely
+                    // If we have an IO error with our eventfd from the main Java thread that's surely
                     // not something we can recover from
                     panic!("ALooper_pollAll returned POLL_ERROR");
                 }
@@ -235,8 +344,9 @@ impl AndroidAppInner {
                     match id {
                         LOOPER_ID_MAIN => {
                             trace!("ALooper_pollAll returned ID_MAIN");
-                            if let Some(ipc_cmd) = self.native_activity.read_cmd() {
-                                let main_cmd = match ipc_cmd {
+                            // Handle all the commands that are pending for this wake up
+                            while let Some(ipc_cmd) = self.native_activity.read_cmd() {
+                                let mut main_cmd = match ipc_cmd {
                                     // We don't forward info about the AInputQueue to apps since it's
                                     // an implementation details that's also not compatible with
                                     // GameActivity
@@ -256,7 +366,10 @@ impl AndroidAppInner {
                                     glue::AppCmd::GainedFocus => Some(MainEvent::GainedFocus),
                                     glue::AppCmd::LostFocus => Some(MainEvent::LostFocus),
                                     glue::AppCmd::ConfigChanged => {
-                                        Some(MainEvent::ConfigChanged {})
+                                        // Filled in once the config has been updated, below
+                                        Some(MainEvent::ConfigChanged {
+                                            changes: ConfigChanges::empty(),
+                                        })
                                     }
                                     glue::AppCmd::LowMemory => Some(MainEvent::LowMemory),
                                     glue::AppCmd::Start => Some(MainEvent::Start),
@@ -278,6 +391,10 @@ impl AndroidAppInner {
                                     LOOPER_ID_INPUT,
                                 );
 
+                                if let Some(MainEvent::ConfigChanged { changes }) = &mut main_cmd {
+                                    *changes = self.native_activity.take_config_changes();
+                                }
+
                                 if let Some(main_cmd) = main_cmd {
                                     trace!("Invoking callback for ID_MAIN command = {main_cmd:?}");
                                     callback(PollEvent::Main(main_cmd));
@@ -297,6 +414,28 @@ impl AndroidAppInner {
                             self.native_activity.detach_input_queue_from_looper();
                             callback(PollEvent::Main(MainEvent::InputAvailable))
                         }
+                        LOOPER_ID_FRAME => {
+                            trace!("ALooper_pollAll returned ID_FRAME");
+                            if let Some(frame) = self.frame_events.take_frame() {
+                                callback(PollEvent::Main(MainEvent::Frame {
+                                    frame_time_nanos: frame.frame_time_nanos,
+                                    vsync_id: frame.vsync_id,
+                                    deadline_nanos: frame.deadline_nanos,
+                                }));
+                            }
+                        }
+                        LOOPER_ID_FD => {
+                            trace!(
+                                "ALooper_pollAll returned ID_FD, fd = {fd}, events = {events:?}"
+                            );
+                            // NB: the file descriptor may have been unregistered by another thread
+                            if let Some(token) = self.fd_sources.token(fd) {
+                                callback(PollEvent::Fd {
+                                    token,
+                                    events: FdEvents::from_bits_truncate(events as u32),
+                                });
+                            }
+                        }
                         _ => {
                             error!("Ignoring spurious ALooper event source: id = {id}, fd = {fd}, events = {events:?}, data = {source:?}");
                         }
@@ -307,6 +446,7 @@ impl AndroidAppInner {
                 }
             }
         }
+        true
     }
 
     pub fn create_waker(&self) -> AndroidAppWaker {
@@ -386,11 +526,59 @@ impl AndroidAppInner {
         }
     }
 
+    // TODO: move into a trait
+    pub fn with_text_input_state<F, R>(&self, f: F) -> R
+    where
+        F: FnOnce(&TextInputStateRef<'_>) -> R,
+    {
+        f(&TextInputStateRef {
+            text: "",
+            selection: TextSpan { start: 0, end: 0 },
+            compose_region: None,
+            generation: 0,
+        })
+    }
+
+    // TODO: move into a trait
+    pub fn text_input_generation(&self) -> u64 {
+        // NOP: Unsupported
+        0
+    }
+
     // TODO: move into a trait
     pub fn set_text_input_state(&self, _state: TextInputState) {
         // NOP: Unsupported
     }
 
+    pub fn jni_stats(&self) -> Vec<JniEntryStats> {
+        // NativeActivity's callbacks aren't JNI methods, so there's nothing to report
+        Vec::new()
+    }
+
+    pub fn lifecycle_latency_stats(&self) -> Vec<LifecycleLatencyStats> {
+        self.native_activity.cmd_stats.lifecycle_latency_stats()
+    }
+
+    pub fn set_lifecycle_handoff(&self, handoff: LifecycleHandoff) {
+        self.native_activity.set_lifecycle_handoff(handoff);
+    }
+
+    pub fn set_handshake_watchdog(&self, watchdog: Option<HandshakeWatchdog>) {
+        self.watchdog.set_config(watchdog);
+    }
+
+    pub fn set_frame_events(&self, enabled: bool) {
+        self.frame_events.set_enabled(enabled, self.looper());
+    }
+
+    pub fn register_fd(&self, fd: RawFd, interest: FdEvents) -> std::io::Result<Token> {
+        self.fd_sources.register(self.looper(), fd, interest)
+    }
+
+    pub fn unregister_fd(&self, token: Token) -> bool {
+        self.fd_sources.unregister(self.looper(), token)
+    }
+
     pub fn device_key_character_map(&self, device_id: i32) -> InternalResult<KeyCharacterMap> {
         let mut guard = self.key_maps.lock().unwrap();
 
@@ -418,6 +606,23 @@ impl AndroidAppInner {
         // NOP - The InputQueue API doesn't let us optimize which axis values are read
     }
 
+    pub fn set_motion_event_pointer_arrays(&self, _enabled: bool) {
+        // NOP - Pointer data is read directly from the `AInputEvent` on demand
+    }
+
+    pub fn set_motion_coalescing(&self, _enabled: bool) {
+        // NOP - The InputQueue already batches move events
+    }
+
+    pub fn set_deferred_motion_event_decoding(&self, _enabled: bool) {
+        // NOP - Events are already read directly from the `AInputEvent` on demand
+    }
+
+    pub fn set_input_filter(&self, _filter: Option<&InputFilter>) {
+        // NOP - Events aren't converted before they're read from the `InputQueue`, so there's
+        // no conversion to skip
+    }
+
     pub fn input_events_receiver(&self) -> InternalResult<Arc<InputReceiver>> {
         let mut guard = self.input_receiver.lock().unwrap();
 
@@ -438,7 +643,11 @@ impl AndroidAppInner {
         // Note: we don't treat it as an error if there is no queue, so if applications
         // iterate input before a queue has been created (e.g. before onStart) then
         // it will simply behave like there are no events available currently.
-        let receiver = Arc::new(InputReceiver { queue });
+        let receiver = Arc::new(InputReceiver {
+            queue,
+            batch_buffer: self.input_batch_buffer.clone(),
+            native_activity: self.native_activity.clone(),
+        });
 
         *guard = Some(Arc::downgrade(&receiver));
         Ok(receiver)
@@ -463,8 +672,30 @@ impl AndroidAppInner {
 #[derive(Debug)]
 pub(crate) struct InputReceiver {
     queue: Option<InputQueue>,
+    batch_buffer: Arc<Mutex<InputBatchBuffer>>,
+    native_activity: NativeActivityGlue,
+}
+
+impl Drop for InputReceiver {
+    fn drop(&mut self) {
+        if self.queue.is_some() {
+            self.native_activity.release_input_queue();
+        }
+    }
+}
+
+/// Storage for the events of an input batch, that's reused for each batch
+#[derive(Debug, Default)]
+struct InputBatchBuffer {
+    key_events: Vec<ndk::event::KeyEvent>,
+    motion_events: Vec<ndk::event::MotionEvent>,
 }
 
+// Safety: events are only stored in the buffer while a batch is being handled by the
+// thread that's reading input, and they are always finished and removed before the
+// buffer is unlocked, so only the capacity of the buffer is retained between batches.
+unsafe impl Send for InputBatchBuffer {}
+
 impl<'a> From<Arc<InputReceiver>> for InputIteratorInner<'a> {
     fn from(receiver: Arc<InputReceiver>) -> Self {
         Self {
@@ -543,4 +774,92 @@ impl<'a> InputIteratorInner<'a> {
             false
         }
     }
+
+    pub(crate) fn next_batch<F>(&self, callback: F) -> bool
+    where
+        F: FnOnce(&crate::input::InputBatch) -> InputStatus,
+    {
+        let Some(queue) = &self.receiver.queue else {
+            log::trace!("no queue available for events");
+            return false;
+        };
+
+        let mut buffer = self.receiver.batch_buffer.lock().unwrap();
+        let InputBatchBuffer {
+            key_events,
+            motion_events,
+        } = &mut *buffer;
+
+        // Note: as with `next()`, errors from event() are treated as meaning the queue is empty
+        let mut read_input = false;
+        while let Ok(Some(ndk_event)) = queue.event() {
+            read_input = true;
+            if let Some(ndk_event) = queue.pre_dispatch(ndk_event) {
+                match ndk_event {
+                    ndk::event::InputEvent::MotionEvent(e) => motion_events.push(e),
+                    ndk::event::InputEvent::KeyEvent(e) => key_events.push(e),
+                    _ => todo!("NDK added a new type"),
+                }
+            }
+        }
+        log::trace!(
+            "queue: got batch of {} key events and {} motion events",
+            key_events.len(),
+            motion_events.len()
+        );
+
+        let result = if key_events.is_empty() && motion_events.is_empty() {
+            Ok(InputStatus::Unhandled)
+        } else {
+            let batch = crate::input::InputBatch {
+                inner: InputBatchImpl {
+                    key_events: input::KeyEventsImpl::new(key_events),
+                    motion_events: input::MotionEventsImpl::new(motion_events),
+                },
+            };
+
+            // `finish_event` needs to be called for each event otherwise
+            // the app would likely get an ANR
+            std::panic::catch_unwind(AssertUnwindSafe(|| callback(&batch)))
+        };
+
+        let handled = matches!(result, Ok(InputStatus::Handled));
+        if result.is_err() {
+            log::error!("Calling `finish_event` after panic in input event handler, to try and avoid being killed via an ANR");
+        }
+        log::trace!("queue: finishing batch");
+        for e in key_events.drain(..) {
+            queue.finish_event(ndk::event::InputEvent::KeyEvent(e), handled);
+        }
+        for e in motion_events.drain(..) {
+            queue.finish_event(ndk::event::InputEvent::MotionEvent(e), handled);
+        }
+        drop(buffer);
+
+        if let Err(payload) = result {
+            std::panic::resume_unwind(payload);
+        }
+        read_input
+    }
+}
+
+#[derive(Debug)]
+pub(crate) struct InputBatchImpl<'a> {
+    key_events: input::KeyEventsImpl<'a>,
+    motion_events: input::MotionEventsImpl<'a>,
+}
+
+impl<'a> InputBatchImpl<'a> {
+    pub fn key_events(&self) -> input::KeyEventsImpl<'a> {
+        self.key_events
+    }
+
+    pub fn motion_events(&self) -> input::MotionEventsImpl<'a> {
+        self.motion_events
+    }
+
+    pub fn text_input_state(&self) -> Option<&TextInputState> {
+        // Text input isn't supported with NativeActivity
+        None
+    }
 }
@@ -0,0 +1,546 @@
+use std::collections::HashSet;
+use std::fmt;
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, Read as _, Write as _};
+use std::ops::Deref;
+use std::os::fd::AsRawFd as _;
+use std::path::{Path, PathBuf};
+use std::ptr::NonNull;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::time::{SystemTime, UNIX_EPOCH};
+
+/// The directory, under the application's internal data path, that large saved states and
+/// saved state chunks are written to
+const SPILL_DIR: &str = "android-activity-saved-state";
+
+/// Identifies a saved state that's a handle for a spill file, instead of the application's
+/// own state
+const HANDLE_MAGIC: &[u8; 16] = b"aa-spilled-state";
+
+/// The magic, followed by the file's ID and length, as little-endian `u64`s
+const HANDLE_LEN: usize = HANDLE_MAGIC.len() + 16;
+
+/// Identifies a saved state that's a manifest of chunks, which is followed by a
+/// [`ChunkRef`] for each chunk
+const MANIFEST_MAGIC: &[u8; 16] = b"aa-state-chunks\0";
+
+/// The length of a [`ChunkRef`] in a manifest: its hash, as a little-endian `u128`, and its
+/// length, as a little-endian `u64`
+const CHUNK_REF_LEN: usize = 24;
+
+/// A chunk of application state, for
+/// [`StateSaver::store_chunks()`](crate::StateSaver::store_chunks)
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum StateChunk<'a> {
+    /// The chunk's data, which is written to storage unless an identical chunk was already
+    /// stored
+    Changed(&'a [u8]),
+
+    /// The chunk is the same as the chunk at the same index in the previous state that was
+    /// stored or loaded with chunks
+    Unchanged,
+}
+
+/// Application state that was saved during a [`MainEvent::SaveState`](crate::MainEvent::SaveState)
+/// event, as returned by [`StateLoader::load_mapped()`](crate::StateLoader::load_mapped)
+///
+/// This dereferences to the saved bytes. A state that was spilled to a file is mapped into
+/// memory, rather than being read or copied, and the file's pages are only read as they're
+/// accessed.
+pub struct SavedState {
+    data: SavedStateData,
+}
+
+enum SavedStateData {
+    Bytes(Vec<u8>),
+    Mapped(Mapping),
+}
+
+/// A read-only mapping of a spill file, which is unmapped on drop
+struct Mapping {
+    ptr: NonNull<u8>,
+    len: usize,
+}
+
+// Safety: the mapping is private and read-only, and it's only unmapped on drop
+unsafe impl Send for Mapping {}
+unsafe impl Sync for Mapping {}
+
+impl Drop for Mapping {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.ptr.as_ptr().cast(), self.len);
+        }
+    }
+}
+
+impl SavedState {
+    /// Whether the state is mapped from a spill file
+    pub fn is_mapped(&self) -> bool {
+        matches!(self.data, SavedStateData::Mapped(_))
+    }
+
+    pub(crate) fn into_vec(self) -> Vec<u8> {
+        match self.data {
+            SavedStateData::Bytes(bytes) => bytes,
+            SavedStateData::Mapped(_) => self.to_vec(),
+        }
+    }
+}
+
+impl Deref for SavedState {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        match &self.data {
+            SavedStateData::Bytes(bytes) => bytes,
+            SavedStateData::Mapped(mapping) => unsafe {
+                std::slice::from_raw_parts(mapping.ptr.as_ptr(), mapping.len)
+            },
+        }
+    }
+}
+
+impl fmt::Debug for SavedState {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("SavedState")
+            .field("len", &self.len())
+            .field("mapped", &self.is_mapped())
+            .finish()
+    }
+}
+
+/// Identifies a stored chunk by the hash and length of its data
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash)]
+struct ChunkRef {
+    hash: u128,
+    len: u64,
+}
+
+impl ChunkRef {
+    fn new(data: &[u8]) -> Self {
+        Self {
+            hash: fnv1a_128(data),
+            len: data.len() as u64,
+        }
+    }
+
+    fn file_name(&self) -> String {
+        format!("{:032x}-{:x}.chunk", self.hash, self.len)
+    }
+}
+
+/// The 128-bit FNV-1a hash of `data`
+///
+/// Chunk hashes are persisted in manifests and chunk file names, so they must not change
+/// between builds or toolchains, unlike the hashers in `std`. The hash isn't cryptographic:
+/// chunks are only compared by hash with chunks that the application itself saved, and each
+/// chunk is checked against its hash when it's loaded.
+fn fnv1a_128(data: &[u8]) -> u128 {
+    const OFFSET_BASIS: u128 = 0x6c62272e07bb014262b821756295c58d;
+    const PRIME: u128 = 0x0000000001000000000000000000013b;
+    data.iter().fold(OFFSET_BASIS, |hash, &byte| {
+        (hash ^ byte as u128).wrapping_mul(PRIME)
+    })
+}
+
+/// The saved state options and bookkeeping for an `AndroidApp`, which saved states are
+/// passed through on their way to and from the Java `Activity`
+#[derive(Debug)]
+pub(crate) struct SavedStateStore {
+    /// Saved states larger than this are spilled to a file, or `usize::MAX` if disabled
+    spill_threshold: AtomicUsize,
+
+    /// The chunks of the last state that was stored or loaded with chunks, which
+    /// [`StateChunk::Unchanged`] refers to
+    chunks: Mutex<Vec<ChunkRef>>,
+}
+
+impl Default for SavedStateStore {
+    fn default() -> Self {
+        Self {
+            spill_threshold: AtomicUsize::new(usize::MAX),
+            chunks: Mutex::new(Vec::new()),
+        }
+    }
+}
+
+impl SavedStateStore {
+    pub fn set_spill_threshold(&self, threshold: Option<usize>) {
+        self.spill_threshold
+            .store(threshold.unwrap_or(usize::MAX), Ordering::Relaxed);
+    }
+
+    /// Returns the handle that should be saved in place of `state` if it's larger than the
+    /// spill threshold and could be spilled to a file under `data_dir`, or `None` if the state
+    /// should be saved as-is
+    pub fn store(&self, data_dir: Option<PathBuf>, state: &[u8]) -> Option<Vec<u8>> {
+        self.chunks.lock().unwrap().clear();
+
+        if state.len() <= self.spill_threshold.load(Ordering::Relaxed) {
+            return None;
+        }
+        let Some(data_dir) = data_dir else {
+            log::warn!("Can't spill saved state without an internal data path");
+            return None;
+        };
+        match spill(&data_dir, state) {
+            Ok(handle) => Some(handle),
+            Err(err) => {
+                log::warn!("Failed to spill saved state, saving it in memory instead: {err}");
+                None
+            }
+        }
+    }
+
+    /// Writes any chunks that aren't already stored under `data_dir` and returns the manifest
+    /// that should be saved in their place
+    pub fn store_chunks(
+        &self,
+        data_dir: Option<PathBuf>,
+        chunks: &[StateChunk<'_>],
+    ) -> io::Result<Vec<u8>> {
+        let data_dir = data_dir
+            .ok_or_else(|| io::Error::new(io::ErrorKind::NotFound, "no internal data path"))?;
+        let mut previous = self.chunks.lock().unwrap();
+
+        let mut refs = Vec::with_capacity(chunks.len());
+        for (i, chunk) in chunks.iter().enumerate() {
+            refs.push(match chunk {
+                StateChunk::Changed(data) => ChunkRef::new(data),
+                StateChunk::Unchanged => *previous.get(i).ok_or_else(|| {
+                    io::Error::new(
+                        io::ErrorKind::InvalidInput,
+                        format!("chunk {i} is unchanged but there's no previous chunk {i}"),
+                    )
+                })?,
+            });
+        }
+
+        let dir = data_dir.join(SPILL_DIR);
+        fs::create_dir_all(&dir)?;
+        let mut written = HashSet::new();
+        for (chunk, chunk_ref) in chunks.iter().zip(&refs) {
+            if let StateChunk::Changed(data) = chunk {
+                if written.insert(*chunk_ref) {
+                    write_chunk(&dir, chunk_ref, data)?;
+                }
+            }
+        }
+
+        let keep: HashSet<String> = refs.iter().map(ChunkRef::file_name).collect();
+        remove_stale_files(&dir, |name| keep.contains(name));
+
+        let mut manifest = Vec::with_capacity(MANIFEST_MAGIC.len() + refs.len() * CHUNK_REF_LEN);
+        manifest.extend_from_slice(MANIFEST_MAGIC);
+        for chunk_ref in &refs {
+            manifest.extend_from_slice(&chunk_ref.hash.to_le_bytes());
+            manifest.extend_from_slice(&chunk_ref.len.to_le_bytes());
+        }
+        *previous = refs;
+        Ok(manifest)
+    }
+
+    /// Load the state that was saved, given the bytes that were passed back from Java, which
+    /// may be a handle for a spill file, or a manifest of chunks, under `data_dir`
+    pub fn load<S>(&self, saved: S, data_dir: Option<PathBuf>) -> Option<SavedState>
+    where
+        S: AsRef<[u8]> + Into<Vec<u8>>,
+    {
+        let handle = parse_handle(saved.as_ref());
+        let manifest = parse_manifest(saved.as_ref());
+        if handle.is_none() && manifest.is_none() {
+            return Some(SavedState {
+                data: SavedStateData::Bytes(saved.into()),
+            });
+        }
+
+        let Some(data_dir) = data_dir else {
+            log::error!("Can't load saved state files without an internal data path");
+            return None;
+        };
+        let dir = data_dir.join(SPILL_DIR);
+        let result = match (handle, manifest) {
+            (Some((id, len)), _) => map_file(&dir.join(spill_file_name(id)), len),
+            (None, Some(manifest)) => read_chunks(&dir, &manifest).map(|state| {
+                *self.chunks.lock().unwrap() = manifest;
+                state
+            }),
+            (None, None) => unreachable!(),
+        };
+        match result {
+            Ok(state) => Some(state),
+            Err(err) => {
+                log::error!("Failed to load saved state from {dir:?}: {err}");
+                None
+            }
+        }
+    }
+}
+
+/// Write `state` to a new spill file under `data_dir` and return the handle that should be
+/// saved in its place
+///
+/// Any other spill files or chunks are removed, since only the latest saved state can be
+/// restored.
+fn spill(data_dir: &Path, state: &[u8]) -> io::Result<Vec<u8>> {
+    let dir = data_dir.join(SPILL_DIR);
+    fs::create_dir_all(&dir)?;
+
+    // The ID only needs to differ from the previous state's, which may still be referenced
+    // until the new state has been handed over
+    let mut id = SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map(|time| time.as_nanos() as u64)
+        .unwrap_or(0);
+    let (path, mut file) = loop {
+        let path = dir.join(spill_file_name(id));
+        match OpenOptions::new().write(true).create_new(true).open(&path) {
+            Ok(file) => break (path, file),
+            Err(err) if err.kind() == io::ErrorKind::AlreadyExists => id = id.wrapping_add(1),
+            Err(err) => return Err(err),
+        }
+    };
+
+    // NB: The file only needs to outlive the process, not the device, so there's no need to
+    // wait for it to be synced to storage
+    if let Err(err) = file.write_all(state) {
+        let _ = fs::remove_file(&path);
+        return Err(err);
+    }
+
+    let name = spill_file_name(id);
+    remove_stale_files(&dir, |other| other == name);
+
+    let mut handle = Vec::with_capacity(HANDLE_LEN);
+    handle.extend_from_slice(HANDLE_MAGIC);
+    handle.extend_from_slice(&id.to_le_bytes());
+    handle.extend_from_slice(&(state.len() as u64).to_le_bytes());
+    Ok(handle)
+}
+
+fn spill_file_name(id: u64) -> String {
+    format!("{id:016x}.state")
+}
+
+/// Write a chunk, unless it's already stored
+///
+/// Chunks are written to a temporary file that's then renamed, so a chunk's file is never
+/// incomplete. An existing file is only kept if it has exactly the chunk's data, so a file
+/// that was modified, or a different chunk with the same hash, is replaced.
+fn write_chunk(dir: &Path, chunk_ref: &ChunkRef, data: &[u8]) -> io::Result<()> {
+    let path = dir.join(chunk_ref.file_name());
+    if file_has_contents(&path, data) {
+        return Ok(());
+    }
+    let tmp_path = path.with_extension("tmp");
+    let result = File::create(&tmp_path)
+        .and_then(|mut file| file.write_all(data))
+        .and_then(|_| fs::rename(&tmp_path, &path));
+    if result.is_err() {
+        let _ = fs::remove_file(&tmp_path);
+    }
+    result
+}
+
+/// Whether the file at `path` exists and contains exactly `data`
+fn file_has_contents(path: &Path, data: &[u8]) -> bool {
+    let Ok(mut file) = File::open(path) else {
+        return false;
+    };
+    if !file
+        .metadata()
+        .map_or(false, |metadata| metadata.len() == data.len() as u64)
+    {
+        return false;
+    }
+    let mut buf = [0u8; 64 * 1024];
+    let mut offset = 0;
+    while offset < data.len() {
+        let len = buf.len().min(data.len() - offset);
+        if file.read_exact(&mut buf[..len]).is_err() || buf[..len] != data[offset..offset + len] {
+            return false;
+        }
+        offset += len;
+    }
+    true
+}
+
+fn read_chunks(dir: &Path, manifest: &[ChunkRef]) -> io::Result<SavedState> {
+    let total = manifest.iter().map(|chunk_ref| chunk_ref.len).sum::<u64>();
+    let total = usize::try_from(total).map_err(|_| io::Error::from(io::ErrorKind::OutOfMemory))?;
+    let mut state = vec![0u8; total];
+    let mut offset = 0;
+    for chunk_ref in manifest {
+        let mut file = File::open(dir.join(chunk_ref.file_name()))?;
+        if file.metadata()?.len() != chunk_ref.len {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "chunk file doesn't have the saved length",
+            ));
+        }
+        let len = chunk_ref.len as usize;
+        let chunk = &mut state[offset..offset + len];
+        file.read_exact(chunk)?;
+        if fnv1a_128(chunk) != chunk_ref.hash {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "chunk file doesn't match the saved hash",
+            ));
+        }
+        offset += len;
+    }
+    Ok(SavedState {
+        data: SavedStateData::Bytes(state),
+    })
+}
+
+/// Remove the files in `dir` that aren't needed for the latest saved state
+fn remove_stale_files(dir: &Path, keep: impl Fn(&str) -> bool) {
+    if let Ok(entries) = fs::read_dir(dir) {
+        for entry in entries.flatten() {
+            if !entry.file_name().to_str().map_or(false, &keep) {
+                let _ = fs::remove_file(entry.path());
+            }
+        }
+    }
+}
+
+fn parse_handle(saved: &[u8]) -> Option<(u64, u64)> {
+    if saved.len() != HANDLE_LEN || !saved.starts_with(HANDLE_MAGIC) {
+        return None;
+    }
+    let id = u64::from_le_bytes(saved[16..24].try_into().unwrap());
+    let len = u64::from_le_bytes(saved[24..32].try_into().unwrap());
+    Some((id, len))
+}
+
+fn parse_manifest(saved: &[u8]) -> Option<Vec<ChunkRef>> {
+    let refs = saved.strip_prefix(MANIFEST_MAGIC)?;
+    if refs.len() % CHUNK_REF_LEN != 0 {
+        return None;
+    }
+    Some(
+        refs.chunks_exact(CHUNK_REF_LEN)
+            .map(|chunk_ref| ChunkRef {
+                hash: u128::from_le_bytes(chunk_ref[0..16].try_into().unwrap()),
+                len: u64::from_le_bytes(chunk_ref[16..24].try_into().unwrap()),
+            })
+            .collect(),
+    )
+}
+
+fn map_file(path: &Path, len: u64) -> io::Result<SavedState> {
+    let file = File::open(path)?;
+    if file.metadata()?.len() != len {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "spill file doesn't have the saved length",
+        ));
+    }
+    let len = usize::try_from(len).map_err(|_| io::Error::from(io::ErrorKind::OutOfMemory))?;
+    if len == 0 {
+        return Ok(SavedState {
+            data: SavedStateData::Bytes(Vec::new()),
+        });
+    }
+
+    // The mapping stays valid after the file is closed
+    let ptr = unsafe {
+        libc::mmap(
+            std::ptr::null_mut(),
+            len,
+            libc::PROT_READ,
+            libc::MAP_PRIVATE,
+            file.as_raw_fd(),
+            0,
+        )
+    };
+    if ptr == libc::MAP_FAILED {
+        return Err(io::Error::last_os_error());
+    }
+    Ok(SavedState {
+        data: SavedStateData::Mapped(Mapping {
+            ptr: NonNull::new(ptr.cast()).unwrap(),
+            len,
+        }),
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn temp_dir(name: &str) -> PathBuf {
+        let dir = std::env::temp_dir().join(format!(
+            "android-activity-test-{name}-{}",
+            std::process::id()
+        ));
+        let _ = fs::remove_dir_all(&dir);
+        fs::create_dir_all(&dir).unwrap();
+        dir
+    }
+
+    #[test]
+    fn chunk_hash_is_fnv1a_128() {
+        // Test vectors for FNV-1a, which must never change since the hashes are persisted
+        assert_eq!(fnv1a_128(b""), 0x6c62272e07bb014262b821756295c58d);
+        assert_eq!(fnv1a_128(b"a"), 0xd228cb696f1a8caf78912b704e4a8964);
+        assert_eq!(fnv1a_128(b"foobar"), 0x343e1662793c64bf6f0d3597ba446f18);
+    }
+
+    #[test]
+    fn chunks_round_trip() {
+        let data_dir = temp_dir("chunks-round-trip");
+        let store = SavedStateStore::default();
+        let (a, b) = (vec![1u8; 100], vec![2u8; 50]);
+        store
+            .store_chunks(
+                Some(data_dir.clone()),
+                &[StateChunk::Changed(&a), StateChunk::Changed(&b)],
+            )
+            .unwrap();
+        let manifest = store
+            .store_chunks(
+                Some(data_dir.clone()),
+                &[StateChunk::Unchanged, StateChunk::Changed(&a)],
+            )
+            .unwrap();
+
+        let state = SavedStateStore::default()
+            .load(manifest, Some(data_dir.clone()))
+            .unwrap();
+        assert_eq!(&*state, [a.clone(), a].concat());
+        let _ = fs::remove_dir_all(&data_dir);
+    }
+
+    #[test]
+    fn modified_chunks_are_rejected_and_rewritten() {
+        let data_dir = temp_dir("modified-chunks");
+        let store = SavedStateStore::default();
+        let data = vec![7u8; 1000];
+        let manifest = store
+            .store_chunks(Some(data_dir.clone()), &[StateChunk::Changed(&data)])
+            .unwrap();
+
+        // The same length, but different contents
+        let path = data_dir
+            .join(SPILL_DIR)
+            .join(ChunkRef::new(&data).file_name());
+        fs::write(&path, vec![8u8; 1000]).unwrap();
+        assert!(SavedStateStore::default()
+            .load(&manifest[..], Some(data_dir.clone()))
+            .is_none());
+
+        // Storing the chunk again replaces the modified file
+        let manifest = store
+            .store_chunks(Some(data_dir.clone()), &[StateChunk::Changed(&data)])
+            .unwrap();
+        let state = SavedStateStore::default()
+            .load(manifest, Some(data_dir.clone()))
+            .unwrap();
+        assert_eq!(&*state, &data[..]);
+        let _ = fs::remove_dir_all(&data_dir);
+    }
+}
@@ -0,0 +1,734 @@
+//! A watchdog for the lifecycle handshakes between the Java main thread and the `android_main`
+//! thread
+//!
+//! While the Java main thread waits for a lifecycle command to be handled, nothing on the Java
+//! side can see why the `android_main` thread isn't handling it, so a stall ends in an
+//! "Application Not Responding" (ANR) error without any native context. Once a handshake has
+//! been pending for longer than a budget, the watchdog logs the pending command, how long it has
+//! been since the application last called `poll_events` and a backtrace that's sampled from the
+//! `android_main` thread.
+//!
+//! The watchdog only depends on POSIX threads, signals and the system unwinder, so its tests run
+//! on Linux, with a stalled thread standing in for `android_main`.
+
+use std::{
+    ffi::CStr,
+    mem,
+    sync::{
+        atomic::{AtomicU64, AtomicUsize, Ordering},
+        Arc, Condvar, Mutex, Once,
+    },
+    thread::{self, JoinHandle},
+    time::{Duration, Instant},
+};
+
+use libc::c_void;
+
+/// Configuration for the lifecycle handshake watchdog
+///
+/// See [`AndroidApp::set_handshake_watchdog`](crate::AndroidApp::set_handshake_watchdog)
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub struct HandshakeWatchdog {
+    /// How long the Java main thread may wait for a lifecycle command to be handled before a
+    /// diagnostic is logged
+    pub budget: Duration,
+
+    /// Whether the diagnostic includes a backtrace that's sampled from the `android_main`
+    /// thread
+    ///
+    /// The backtrace is sampled by unwinding `android_main` from a signal handler, and the
+    /// unwinder isn't async-signal-safe: if `android_main` was interrupted while it held a lock
+    /// that the unwinder needs (such as the dynamic linker's, while loading a library), the
+    /// handler deadlocks and `android_main` never resumes. Disable this if that risk isn't
+    /// acceptable, for example in release builds.
+    pub backtrace: bool,
+
+    /// Whether to switch to [`LifecycleHandoff::NonBlocking`](crate::LifecycleHandoff), with
+    /// `budget` as the window teardown timeout, once a handshake has stalled
+    ///
+    /// This also releases the Java main thread from the stalled handshake, since it has already
+    /// waited for `budget`: waits for a window to be terminated or a state to be saved time out
+    /// (without saving any state), and other waits end, except that a destroyed `NativeActivity`
+    /// input queue is only released once the application isn't reading input. Waits for the
+    /// `android_main` thread to exit are still required to complete.
+    pub degrade_to_non_blocking: bool,
+}
+
+impl HandshakeWatchdog {
+    /// A watchdog that logs a diagnostic, with a backtrace, once a handshake has been pending
+    /// for longer than `budget`
+    pub fn new(budget: Duration) -> Self {
+        Self {
+            budget,
+            backtrace: true,
+            degrade_to_non_blocking: false,
+        }
+    }
+}
+
+/// A lifecycle command that the Java main thread is waiting for
+#[derive(Debug)]
+pub(crate) struct PendingHandshake {
+    /// The name of the corresponding `MainEvent`
+    pub name: &'static str,
+
+    /// How long the Java main thread has been waiting
+    pub waited: Duration,
+}
+
+/// The handshakes of one of the backends, as seen by the watchdog
+pub(crate) trait Handshakes: Send + Sync {
+    /// The lifecycle command that the Java main thread is waiting for, if any
+    fn pending_handshake(&self) -> Option<PendingHandshake>;
+
+    /// Switch to a non-blocking lifecycle handoff, releasing the Java main thread if it's
+    /// waiting for a change to the activity state
+    fn degrade_to_non_blocking(&self, window_teardown_timeout: Duration);
+}
+
+struct WatchdogState {
+    config: Option<HandshakeWatchdog>,
+    thread: Option<JoinHandle<()>>,
+    stopped: bool,
+}
+
+/// Watches the lifecycle handshakes of an `AndroidApp`, on a thread that's spawned once the
+/// watchdog is first enabled
+pub(crate) struct Watchdog {
+    /// The `android_main` thread, which the watchdog is created on
+    main_thread: libc::pthread_t,
+
+    handshakes: Arc<dyn Handshakes>,
+
+    epoch: Instant,
+
+    /// When `poll_events` was last called, as nanoseconds since `epoch` plus one, or zero if it
+    /// hasn't been called yet
+    last_poll: AtomicU64,
+
+    state: Mutex<WatchdogState>,
+    cond: Condvar,
+}
+
+impl std::fmt::Debug for Watchdog {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("Watchdog")
+            .field("config", &self.state.lock().unwrap().config)
+            .finish_non_exhaustive()
+    }
+}
+
+impl Watchdog {
+    /// Create a (disabled) watchdog, which must be called on the `android_main` thread
+    pub fn new(handshakes: Arc<dyn Handshakes>) -> Self {
+        Self {
+            main_thread: unsafe { libc::pthread_self() },
+            handshakes,
+            epoch: Instant::now(),
+            last_poll: AtomicU64::new(0),
+            state: Mutex::new(WatchdogState {
+                config: None,
+                thread: None,
+                stopped: false,
+            }),
+            cond: Condvar::new(),
+        }
+    }
+
+    /// Note that the application has called `poll_events`
+    pub fn note_poll(&self) {
+        let nanos = self.epoch.elapsed().as_nanos() as u64;
+        self.last_poll.store(nanos + 1, Ordering::Relaxed);
+    }
+
+    /// How long it's been since the application last called `poll_events`, if ever
+    fn since_last_poll(&self) -> Option<Duration> {
+        match self.last_poll.load(Ordering::Relaxed) {
+            0 => None,
+            nanos => Some(
+                self.epoch
+                    .elapsed()
+                    .saturating_sub(Duration::from_nanos(nanos - 1)),
+            ),
+        }
+    }
+
+    pub fn set_config(self: &Arc<Self>, config: Option<HandshakeWatchdog>) {
+        let mut guard = self.state.lock().unwrap();
+        if guard.stopped {
+            return;
+        }
+        guard.config = config;
+        if config.is_some() && guard.thread.is_none() {
+            let watchdog = self.clone();
+            guard.thread = Some(
+                thread::Builder::new()
+                    .name("aa-watchdog".to_string())
+                    .spawn(move || watchdog.run())
+                    .expect("Failed to spawn handshake watchdog thread"),
+            );
+        }
+        self.cond.notify_one();
+    }
+
+    /// Stop the watchdog, which must be done before the `android_main` thread exits
+    pub fn stop(&self) {
+        let thread = {
+            let mut guard = self.state.lock().unwrap();
+            guard.stopped = true;
+            self.cond.notify_one();
+            guard.thread.take()
+        };
+        if let Some(thread) = thread {
+            let _ = thread.join();
+        }
+    }
+
+    fn run(&self) {
+        // How long the last pending handshake had been waiting when it was checked, which
+        // identifies a new handshake by having waited for less time, and whether it's been
+        // reported
+        let mut last_waited = Duration::ZERO;
+        let mut reported = false;
+
+        let mut guard = self.state.lock().unwrap();
+        while !guard.stopped {
+            let Some(config) = guard.config else {
+                guard = self.cond.wait(guard).unwrap();
+                continue;
+            };
+            drop(guard);
+
+            match self.handshakes.pending_handshake() {
+                Some(pending) => {
+                    if pending.waited < last_waited {
+                        reported = false;
+                    }
+                    last_waited = pending.waited;
+                    if !reported && pending.waited >= config.budget {
+                        reported = true;
+                        self.report_stall(&config, &pending);
+                        if config.degrade_to_non_blocking {
+                            log::warn!(
+                                "Switching to a non-blocking lifecycle handoff after a stalled {}",
+                                pending.name
+                            );
+                            self.handshakes.degrade_to_non_blocking(config.budget);
+                        }
+                    }
+                }
+                None => {
+                    last_waited = Duration::ZERO;
+                    reported = false;
+                }
+            }
+
+            let interval = (config.budget / 4).max(Duration::from_millis(10));
+            guard = self.state.lock().unwrap();
+            if !guard.stopped {
+                guard = self.cond.wait_timeout(guard, interval).unwrap().0;
+            }
+        }
+    }
+
+    fn report_stall(&self, config: &HandshakeWatchdog, pending: &PendingHandshake) {
+        let since_poll = match self.since_last_poll() {
+            Some(since_poll) => format!("last called poll_events {since_poll:?} ago"),
+            None => "hasn't called poll_events yet".to_string(),
+        };
+        log::error!(
+            "Lifecycle handshake stalled: the Java main thread has been waiting {:?} for {} to be handled, and android_main {since_poll}",
+            pending.waited,
+            pending.name
+        );
+        if !config.backtrace {
+            return;
+        }
+        match sample_backtrace(self.main_thread) {
+            Some(frames) => {
+                log::error!("Backtrace of android_main:");
+                for (i, &pc) in frames.iter().enumerate() {
+                    log::error!("  #{i:02} {}", describe_frame(pc));
+                }
+            }
+            None => log::error!("Failed to sample a backtrace of android_main"),
+        }
+    }
+}
+
+/// The most frames that are sampled for a backtrace
+const MAX_FRAMES: usize = 64;
+
+/// How long to wait for the sampled thread to handle the signal
+const SAMPLE_TIMEOUT: Duration = Duration::from_millis(100);
+
+/// The return addresses sampled by `on_sample_signal`, which can't allocate
+///
+/// Each sample is numbered, and `len` and `frames` belong to the signal handler from when it
+/// takes the `requested` sample until it has stored its number in `finished`.
+struct Sample {
+    /// The number of the sample that has been requested, until the signal handler takes it,
+    /// or zero
+    requested: AtomicU64,
+
+    /// The number of the last sample that the signal handler has finished writing
+    finished: AtomicU64,
+
+    len: AtomicUsize,
+    frames: [AtomicUsize; MAX_FRAMES],
+}
+
+#[allow(clippy::declare_interior_mutable_const)]
+const NO_FRAME: AtomicUsize = AtomicUsize::new(0);
+
+static SAMPLE: Sample = Sample {
+    requested: AtomicU64::new(0),
+    finished: AtomicU64::new(0),
+    len: AtomicUsize::new(0),
+    frames: [NO_FRAME; MAX_FRAMES],
+};
+
+struct Sampler {
+    /// The number of the last sample that was requested
+    last: u64,
+
+    /// The number of a sample that was given up on after the signal handler had taken it, so
+    /// the handler may still be writing to `SAMPLE`, or zero
+    abandoned: u64,
+}
+
+/// Serializes sampling, since there's only one `SAMPLE`
+static SAMPLER: Mutex<Sampler> = Mutex::new(Sampler {
+    last: 0,
+    abandoned: 0,
+});
+
+static INSTALL_HANDLER: Once = Once::new();
+
+/// The handler that was installed for the sampling signal before ours, which is only written
+/// once, before ours is installed
+static mut PREVIOUS_ACTION: mem::MaybeUninit<libc::sigaction> = mem::MaybeUninit::uninit();
+
+/// The signal that's sent to a thread to sample its backtrace, which is a real-time signal that's
+/// unlikely to be used by anything else
+fn sample_signal() -> libc::c_int {
+    libc::SIGRTMAX() - 1
+}
+
+#[allow(non_camel_case_types)]
+type _Unwind_Trace_Fn = extern "C" fn(context: *mut c_void, arg: *mut c_void) -> libc::c_int;
+
+extern "C" {
+    fn _Unwind_Backtrace(trace: _Unwind_Trace_Fn, arg: *mut c_void) -> libc::c_int;
+}
+
+const _URC_NO_REASON: libc::c_int = 0;
+const _URC_END_OF_STACK: libc::c_int = 5;
+
+#[cfg(not(target_arch = "arm"))]
+unsafe fn frame_pc(context: *mut c_void) -> usize {
+    extern "C" {
+        fn _Unwind_GetIP(context: *mut c_void) -> usize;
+    }
+    _Unwind_GetIP(context)
+}
+
+// With the ARM EHABI, _Unwind_GetIP() is an inline function around _Unwind_VRS_Get()
+#[cfg(target_arch = "arm")]
+unsafe fn frame_pc(context: *mut c_void) -> usize {
+    extern "C" {
+        fn _Unwind_VRS_Get(
+            context: *mut c_void,
+            regclass: libc::c_int,
+            regno: u32,
+            representation: libc::c_int,
+            valuep: *mut c_void,
+        ) -> libc::c_int;
+    }
+    const _UVRSC_CORE: libc::c_int = 0;
+    const _UVRSD_UINT32: libc::c_int = 0;
+    const PC: u32 = 15;
+    let mut pc: u32 = 0;
+    _Unwind_VRS_Get(
+        context,
+        _UVRSC_CORE,
+        PC,
+        _UVRSD_UINT32,
+        &mut pc as *mut u32 as *mut c_void,
+    );
+    // Clear the Thumb bit
+    (pc & !1) as usize
+}
+
+extern "C" fn trace_frame(context: *mut c_void, arg: *mut c_void) -> libc::c_int {
+    let len = unsafe { &mut *(arg as *mut usize) };
+    let pc = unsafe { frame_pc(context) };
+    if pc == 0 {
+        return _URC_END_OF_STACK;
+    }
+    SAMPLE.frames[*len].store(pc, Ordering::Relaxed);
+    *len += 1;
+    if *len == MAX_FRAMES {
+        _URC_END_OF_STACK
+    } else {
+        _URC_NO_REASON
+    }
+}
+
+extern "C" fn on_sample_signal(
+    signal: libc::c_int,
+    info: *mut libc::siginfo_t,
+    context: *mut c_void,
+) {
+    let number = SAMPLE.requested.swap(0, Ordering::AcqRel);
+    if number == 0 {
+        // Not sent by us, so pass it on to any previous handler (ignoring it if the previous
+        // disposition was to ignore it or, for a real-time signal, terminate)
+        unsafe {
+            let previous = (*std::ptr::addr_of!(PREVIOUS_ACTION)).assume_init_ref();
+            if previous.sa_sigaction == libc::SIG_DFL || previous.sa_sigaction == libc::SIG_IGN {
+                return;
+            }
+            if previous.sa_flags & libc::SA_SIGINFO != 0 {
+                let handler: extern "C" fn(libc::c_int, *mut libc::siginfo_t, *mut c_void) =
+                    mem::transmute(previous.sa_sigaction);
+                handler(signal, info, context);
+            } else {
+                let handler: extern "C" fn(libc::c_int) = mem::transmute(previous.sa_sigaction);
+                handler(signal);
+            }
+        }
+        return;
+    }
+
+    let mut len = 0usize;
+    unsafe {
+        _Unwind_Backtrace(trace_frame, &mut len as *mut usize as *mut c_void);
+    }
+    SAMPLE.len.store(len, Ordering::Relaxed);
+    SAMPLE.finished.store(number, Ordering::Release);
+}
+
+fn install_sample_handler() {
+    INSTALL_HANDLER.call_once(|| unsafe {
+        let mut action: libc::sigaction = mem::zeroed();
+        action.sa_sigaction = on_sample_signal as usize;
+        action.sa_flags = libc::SA_SIGINFO | libc::SA_RESTART | libc::SA_ONSTACK;
+        libc::sigemptyset(&mut action.sa_mask);
+        let previous = (*std::ptr::addr_of_mut!(PREVIOUS_ACTION)).as_mut_ptr();
+        if libc::sigaction(sample_signal(), &action, previous) != 0 {
+            log::error!(
+                "Failed to install backtrace sampling signal handler: {}",
+                std::io::Error::last_os_error()
+            );
+        }
+    });
+}
+
+/// Sample the return addresses of the given thread's stack, by interrupting it with a signal
+///
+/// This is best-effort: the unwinder may not be able to get past frames without unwind info, and
+/// the sample is given up on if the thread doesn't handle the signal promptly.
+///
+/// NB: `_Unwind_Backtrace` isn't async-signal-safe, so the thread may deadlock in the signal
+/// handler if it was interrupted while holding a lock that the unwinder needs. In that case,
+/// and whenever the handler is still running after a sample is given up on, no more samples
+/// are taken until the handler has finished.
+pub(crate) fn sample_backtrace(thread: libc::pthread_t) -> Option<Vec<usize>> {
+    let mut sampler = SAMPLER.lock().unwrap();
+    install_sample_handler();
+
+    // Don't reuse `SAMPLE` while a handler that was given up on might still write to it
+    if sampler.abandoned != 0 {
+        if SAMPLE.finished.load(Ordering::Acquire) < sampler.abandoned {
+            return None;
+        }
+        sampler.abandoned = 0;
+    }
+
+    sampler.last += 1;
+    let number = sampler.last;
+    SAMPLE.requested.store(number, Ordering::Release);
+    if unsafe { libc::pthread_kill(thread, sample_signal()) } != 0 {
+        SAMPLE.requested.store(0, Ordering::Relaxed);
+        return None;
+    }
+
+    let deadline = Instant::now() + SAMPLE_TIMEOUT;
+    while SAMPLE.finished.load(Ordering::Acquire) != number {
+        if Instant::now() >= deadline {
+            if SAMPLE.requested.swap(0, Ordering::AcqRel) != number {
+                // The handler has taken the sample, and is still writing it
+                sampler.abandoned = number;
+            }
+            // NB: otherwise, if the signal is handled later, it will be passed on as if it
+            // wasn't ours
+            return None;
+        }
+        thread::sleep(Duration::from_millis(1));
+    }
+
+    // The first frame is the signal handler itself
+    let len = SAMPLE.len.load(Ordering::Relaxed);
+    Some(
+        SAMPLE.frames[..len]
+            .iter()
+            .skip(1)
+            .map(|frame| frame.load(Ordering::Relaxed))
+            .collect(),
+    )
+}
+
+/// Describe a sampled return address like a tombstone does, with the offset into its module and
+/// the nearest symbol, if there is one
+pub(crate) fn describe_frame(pc: usize) -> String {
+    unsafe {
+        let mut info: libc::Dl_info = mem::zeroed();
+        // NB: look up the calling instruction, before the return address, in case the call was
+        // the last instruction of its function
+        if libc::dladdr(pc.saturating_sub(1) as *const c_void, &mut info) == 0 {
+            return format!("pc {pc:016x}  <unknown>");
+        }
+        let module = if info.dli_fname.is_null() {
+            "<unknown>".into()
+        } else {
+            CStr::from_ptr(info.dli_fname).to_string_lossy()
+        };
+        let offset = pc - info.dli_fbase as usize;
+        if info.dli_sname.is_null() {
+            format!("pc {offset:016x}  {module}")
+        } else {
+            let symbol = CStr::from_ptr(info.dli_sname).to_string_lossy();
+            let symbol_offset = pc - info.dli_saddr as usize;
+            format!("pc {offset:016x}  {module} ({symbol}+{symbol_offset})")
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::{atomic::AtomicBool, mpsc};
+
+    #[derive(Default)]
+    struct FakeState {
+        pending: Option<(&'static str, Instant)>,
+        /// The window teardown timeout, once the handoff is non-blocking
+        non_blocking: Option<Duration>,
+        /// The pending handshake, how long it had been pending and the window teardown timeout,
+        /// for each call to `degrade_to_non_blocking`
+        degraded: Vec<(&'static str, Duration, Duration)>,
+    }
+
+    /// Handshakes that are never handled by `android_main`, and are only completed by timing
+    /// out or, if `release_on_degrade` is set, by degrading to a non-blocking handoff
+    #[derive(Default)]
+    struct FakeHandshakes {
+        release_on_degrade: bool,
+        state: Mutex<FakeState>,
+        cond: Condvar,
+    }
+
+    impl FakeHandshakes {
+        /// Wait for a handshake, like the Java main thread, returning how long it waited
+        fn wait_for(&self, name: &'static str, timeout: Duration) -> Duration {
+            let start = Instant::now();
+            let mut guard = self.state.lock().unwrap();
+            guard.pending = Some((name, start));
+            while !(self.release_on_degrade && guard.non_blocking.is_some()) {
+                let Some(remaining) = timeout.checked_sub(start.elapsed()) else {
+                    break;
+                };
+                guard = self.cond.wait_timeout(guard, remaining).unwrap().0;
+            }
+            guard.pending = None;
+            start.elapsed()
+        }
+
+        /// Wait for a state to be saved, like the Java main thread, which the stalled
+        /// `android_main` never does, so in non-blocking mode the wait times out once it has
+        /// been pending for the window teardown timeout. Returns how long it waited before
+        /// giving up on the state, or `None` if `timeout` passed first.
+        fn save_state(&self, timeout: Duration) -> Option<Duration> {
+            let start = Instant::now();
+            let mut guard = self.state.lock().unwrap();
+            guard.pending = Some(("SaveState", start));
+            let waited = loop {
+                let remaining = match guard.non_blocking {
+                    Some(window_teardown_timeout) => {
+                        match window_teardown_timeout.checked_sub(start.elapsed()) {
+                            Some(remaining) if !remaining.is_zero() => remaining,
+                            _ => break Some(start.elapsed()),
+                        }
+                    }
+                    None => timeout,
+                };
+                if start.elapsed() >= timeout {
+                    break None;
+                }
+                let remaining = remaining.min(timeout - start.elapsed());
+                guard = self.cond.wait_timeout(guard, remaining).unwrap().0;
+            };
+            guard.pending = None;
+            waited
+        }
+
+        fn degraded(&self) -> Vec<(&'static str, Duration, Duration)> {
+            self.state.lock().unwrap().degraded.clone()
+        }
+    }
+
+    impl Handshakes for FakeHandshakes {
+        fn pending_handshake(&self) -> Option<PendingHandshake> {
+            let guard = self.state.lock().unwrap();
+            guard.pending.map(|(name, start)| PendingHandshake {
+                name,
+                waited: start.elapsed(),
+            })
+        }
+
+        fn degrade_to_non_blocking(&self, window_teardown_timeout: Duration) {
+            let mut guard = self.state.lock().unwrap();
+            let (name, waited) = guard.pending.map_or(("", Duration::ZERO), |(name, start)| {
+                (name, start.elapsed())
+            });
+            guard.degraded.push((name, waited, window_teardown_timeout));
+            guard.non_blocking = Some(window_teardown_timeout);
+            self.cond.notify_all();
+        }
+    }
+
+    #[inline(never)]
+    fn stall(stop: &AtomicBool) {
+        while !stop.load(Ordering::Relaxed) {
+            unsafe { libc::usleep(1000) };
+        }
+    }
+
+    /// Run `f` while a thread standing in for `android_main` is stalled, with a watchdog for
+    /// `handshakes` that's created on it
+    fn with_stalled_main(
+        handshakes: Arc<FakeHandshakes>,
+        config: HandshakeWatchdog,
+        f: impl FnOnce(),
+    ) {
+        let stop = Arc::new(AtomicBool::new(false));
+        let (ready_tx, ready_rx) = mpsc::channel();
+        let main = {
+            let stop = stop.clone();
+            thread::spawn(move || {
+                let watchdog = Arc::new(Watchdog::new(handshakes));
+                watchdog.set_config(Some(config));
+                watchdog.note_poll();
+                ready_tx.send(()).unwrap();
+                stall(&stop);
+                watchdog.stop();
+            })
+        };
+        ready_rx.recv().unwrap();
+        f();
+        stop.store(true, Ordering::Relaxed);
+        main.join().unwrap();
+    }
+
+    const BUDGET: Duration = Duration::from_millis(100);
+
+    #[test]
+    fn stalled_handshake_degrades_after_budget() {
+        let handshakes = Arc::new(FakeHandshakes {
+            release_on_degrade: true,
+            ..Default::default()
+        });
+        let config = HandshakeWatchdog {
+            degrade_to_non_blocking: true,
+            ..HandshakeWatchdog::new(BUDGET)
+        };
+        with_stalled_main(handshakes.clone(), config, || {
+            let waited = handshakes.wait_for("Pause", Duration::from_secs(5));
+            assert!(waited >= BUDGET, "released after {waited:?}");
+            assert!(waited < Duration::from_secs(2), "released after {waited:?}");
+        });
+        let degraded = handshakes.degraded();
+        assert_eq!(degraded.len(), 1);
+        let (name, waited, window_teardown_timeout) = degraded[0];
+        assert_eq!(name, "Pause");
+        assert!(waited >= BUDGET);
+        assert_eq!(window_teardown_timeout, BUDGET);
+    }
+
+    #[test]
+    fn stalled_save_state_gives_up_after_budget() {
+        let handshakes = Arc::new(FakeHandshakes::default());
+        let config = HandshakeWatchdog {
+            degrade_to_non_blocking: true,
+            ..HandshakeWatchdog::new(BUDGET)
+        };
+        with_stalled_main(handshakes.clone(), config, || {
+            let waited = handshakes
+                .save_state(Duration::from_secs(5))
+                .expect("Save state wasn't given up on");
+            assert!(waited >= BUDGET, "gave up after {waited:?}");
+            assert!(waited < Duration::from_secs(2), "gave up after {waited:?}");
+        });
+        let degraded = handshakes.degraded();
+        assert_eq!(degraded.len(), 1);
+        let (name, waited, window_teardown_timeout) = degraded[0];
+        assert_eq!(name, "SaveState");
+        assert!(waited >= BUDGET);
+        assert_eq!(window_teardown_timeout, BUDGET);
+    }
+
+    #[test]
+    fn each_stalled_handshake_is_reported_once() {
+        let handshakes = Arc::new(FakeHandshakes::default());
+        let config = HandshakeWatchdog {
+            backtrace: false,
+            degrade_to_non_blocking: true,
+            ..HandshakeWatchdog::new(BUDGET)
+        };
+        with_stalled_main(handshakes.clone(), config, || {
+            handshakes.wait_for("Pause", BUDGET * 5);
+            assert_eq!(handshakes.degraded().len(), 1);
+            // Give the watchdog a chance to see that there's no pending handshake
+            thread::sleep(BUDGET);
+            handshakes.wait_for("Stop", BUDGET * 5);
+            assert_eq!(handshakes.degraded().len(), 2);
+        });
+    }
+
+    #[test]
+    fn handshake_within_budget_is_not_reported() {
+        let handshakes = Arc::new(FakeHandshakes::default());
+        let config = HandshakeWatchdog {
+            degrade_to_non_blocking: true,
+            ..HandshakeWatchdog::new(BUDGET * 3)
+        };
+        with_stalled_main(handshakes.clone(), config, || {
+            handshakes.wait_for("Resume", BUDGET / 2);
+            thread::sleep(BUDGET * 4);
+        });
+        assert!(handshakes.degraded().is_empty());
+    }
+
+    #[test]
+    fn backtrace_of_stalled_thread() {
+        let stop = Arc::new(AtomicBool::new(false));
+        let (thread_tx, thread_rx) = mpsc::channel();
+        let stalled = {
+            let stop = stop.clone();
+            thread::spawn(move || {
+                thread_tx.send(unsafe { libc::pthread_self() }).unwrap();
+                stall(&stop);
+            })
+        };
+        let thread = thread_rx.recv().unwrap();
+        // Sampling again checks that a finished sample doesn't block the next one
+        for _ in 0..3 {
+            let frames = sample_backtrace(thread).expect("Failed to sample a backtrace");
+            assert!(!frames.is_empty());
+            assert!(frames.iter().all(|&pc| pc != 0));
+        }
+        stop.store(true, Ordering::Relaxed);
+        stalled.join().unwrap();
+    }
+}